@@ -12,6 +12,7 @@ from typing import Optional, List, Union, Dict, Deque
 from collections import deque
 
 from cereal import log
+from cereal.messaging import msgtrace
 from cereal.services import SERVICE_LIST
 
 NO_TRAVERSAL_LIMIT = 2**64-1
@@ -164,6 +165,11 @@ class SubMaster:
     # non-blocking receive for non-polled sockets
     for s in self.non_polled_services:
       msgs.append(recv_one_or_none(self.sock[s]))
+
+    if msgtrace.ENABLED:
+      for msg in msgs:
+        if msg is not None:
+          msgtrace.receive(msg.which(), msg)
     self.update_msgs(time.monotonic(), msgs)
 
   def update_msgs(self, cur_time: float, msgs: List[capnp.lib.capnp._DynamicStructReader]) -> None:
@@ -237,6 +243,8 @@ class PubMaster:
       self.sock[s] = pub_sock(s)
 
   def send(self, s: str, dat: Union[bytes, capnp.lib.capnp._DynamicStructBuilder]) -> None:
+    if msgtrace.ENABLED:
+      msgtrace.publish(s, log_from_bytes(dat) if isinstance(dat, bytes) else dat)
     if not isinstance(dat, bytes):
       dat = dat.to_bytes()
     self.sock[s].send(dat)
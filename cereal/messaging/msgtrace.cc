@@ -0,0 +1,113 @@
+#include "cereal/messaging/msgtrace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "common/timing.h"
+
+namespace msgtrace {
+
+const bool ENABLED = (getenv("MSGTRACE") != nullptr) && (std::string(getenv("MSGTRACE")) == "1");
+
+static std::mutex ring_lock;
+static std::atomic<RingHeader *> ring = nullptr;
+static std::atomic<uint32_t> generation = 0;  // of the ring, a forked child opens its own
+static bool ring_failed = false;
+
+std::string ring_path(int pid) {
+  const char *dir = getenv("MSGTRACE_DIR");
+  return std::string(dir ? dir : "/dev/shm") + "/msgtrace_" + std::to_string(pid);
+}
+
+static void reset_after_fork() {
+  ring = nullptr;
+  ring_failed = false;
+  ++generation;
+}
+
+static RingHeader *open_ring() {
+  std::lock_guard lk(ring_lock);
+  if (ring || ring_failed) return ring;
+
+  static bool registered = false;
+  if (!registered) {
+    pthread_atfork(nullptr, nullptr, reset_after_fork);
+    registered = true;
+  }
+
+  const size_t size = sizeof(RingHeader) + RING_SIZE * sizeof(Record);
+  const std::string path = ring_path(getpid());
+  void *mem = MAP_FAILED;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd >= 0) {
+    if (ftruncate(fd, size) == 0) {
+      mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+  }
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "msgtrace: failed to create %s\n", path.c_str());
+    ring_failed = true;
+    return nullptr;
+  }
+
+  // the file is zeroed, so the counters and the records start empty
+  RingHeader *r = (RingHeader *)mem;
+  r->version = VERSION;
+  r->size = RING_SIZE;
+  r->pid = getpid();
+  if (FILE *f = fopen("/proc/self/comm", "r")) {
+    if (fgets(r->comm, sizeof(r->comm), f)) r->comm[strcspn(r->comm, "\n")] = '\0';
+    fclose(f);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  r->magic = MAGIC;
+  ring = r;
+  return r;
+}
+
+static uint32_t register_thread(RingHeader *r) {
+  const uint32_t tid = syscall(SYS_gettid);
+  const uint32_t i = r->thread_count.fetch_add(1, std::memory_order_relaxed);
+  if (i < MAX_THREADS) {
+    prctl(PR_GET_NAME, r->threads[i].name);
+    r->threads[i].tid = tid;
+  }
+  return tid;
+}
+
+void record(Type type, const char *name, uint64_t log_mono_time, int64_t frame_id) {
+  RingHeader *r = ring.load(std::memory_order_acquire);
+  if (!r && !(r = open_ring())) return;
+
+  thread_local uint32_t tid = 0, tid_generation = 0;
+  if (tid == 0 || tid_generation != generation) {
+    tid = register_thread(r);
+    tid_generation = generation;
+  }
+
+  // seqlock per record: readers drop the ones whose seq changed while they copied them
+  const uint64_t i = r->head.fetch_add(1, std::memory_order_relaxed);
+  Record &rec = ((Record *)(r + 1))[i % r->size];
+  rec.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  rec.ts = nanos_since_boot();
+  rec.log_mono_time = log_mono_time;
+  rec.frame_id = frame_id;
+  rec.tid = tid;
+  rec.type = type;
+  strncpy(rec.name, name, sizeof(rec.name) - 1);
+  rec.name[sizeof(rec.name) - 1] = '\0';
+  rec.seq.store(i + 1, std::memory_order_release);
+}
+
+}  // namespace msgtrace
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Opt-in tracing of the messages a process publishes and receives, enabled with MSGTRACE=1.
+// Each process appends fixed size records to its own ring in shared memory, MSGTRACE_DIR/msgtrace_<pid>
+// (/dev/shm by default), and msgtrace_export turns the rings into a Chrome trace keyed by frame id.
+// The layout is shared with msgtrace.py, which writes msgtrace_<pid>_py for the python processes.
+
+namespace msgtrace {
+
+enum Type : uint8_t {
+  PUBLISH = 1,
+  RECEIVE = 2,
+  VIPC_RECEIVE = 3,  // log_mono_time is the timestamp_sof of the frame
+  HANDLED = 4,       // done with a received message, e.g. pandad sent it to the panda
+};
+
+const uint32_t MAGIC = 0x5452534d;
+const uint32_t VERSION = 1;
+const uint32_t RING_SIZE = 1 << 16;  // records, about a minute of a busy process
+const uint32_t MAX_THREADS = 32;
+
+struct Record {
+  std::atomic<uint64_t> seq;  // index in the ring + 1, 0 while it is written
+  uint64_t ts;                // nanos_since_boot
+  uint64_t log_mono_time;
+  int64_t frame_id;           // -1 if the message has none
+  uint32_t tid;
+  uint8_t type;
+  char name[27];
+};
+
+struct Thread {
+  uint32_t tid;
+  char name[28];
+};
+
+struct RingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t pid;
+  char comm[16];
+  std::atomic<uint64_t> head;  // records written so far
+  std::atomic<uint32_t> thread_count;
+  uint8_t reserved[20];
+  Thread threads[MAX_THREADS];
+  // followed by size records
+};
+
+static_assert(sizeof(Record) == 64 && sizeof(RingHeader) == 64 + 32 * MAX_THREADS, "msgtrace.py has the same layout");
+
+extern const bool ENABLED;
+
+std::string ring_path(int pid);
+void record(Type type, const char *name, uint64_t log_mono_time, int64_t frame_id = -1);
+
+inline void trace(Type type, const char *name, uint64_t log_mono_time, int64_t frame_id = -1) {
+  if (ENABLED) record(type, name, log_mono_time, frame_id);
+}
+
+}  // namespace msgtrace
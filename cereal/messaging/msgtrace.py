@@ -0,0 +1,121 @@
+# Opt-in message tracing for the python processes, the counterpart of msgtrace.h with the same ring layout.
+# Enabled with MSGTRACE=1, each process writes MSGTRACE_DIR/msgtrace_<pid>_py (/dev/shm by default).
+import mmap
+import os
+import struct
+import threading
+import time
+
+from typing import Dict, Optional
+
+PUBLISH = 1
+RECEIVE = 2
+VIPC_RECEIVE = 3
+HANDLED = 4
+
+MAGIC = 0x5452534d
+VERSION = 1
+RING_SIZE = 1 << 16
+MAX_THREADS = 32
+
+HEADER = struct.Struct('<IIII16sQI20x')
+THREAD = struct.Struct('<I28s')
+RECORD = struct.Struct('<QQQqIB27s')
+HEAD_OFFSET = 32
+THREAD_COUNT_OFFSET = 40
+RECORDS_OFFSET = HEADER.size + MAX_THREADS * THREAD.size
+
+ENABLED = os.getenv("MSGTRACE") == "1"
+
+
+def ring_path(pid: int) -> str:
+  return os.path.join(os.getenv("MSGTRACE_DIR", "/dev/shm"), f"msgtrace_{pid}_py")
+
+
+class Ring:
+  def __init__(self, path: str):
+    size = RECORDS_OFFSET + RING_SIZE * RECORD.size
+    with open(path, 'w+b') as f:
+      f.truncate(size)
+      self.buf = mmap.mmap(f.fileno(), size)
+    self.head = 0
+    self.tids: Dict[int, int] = {}
+
+    with open('/proc/self/comm', 'rb') as f:
+      comm = f.read().strip()
+    HEADER.pack_into(self.buf, 0, 0, VERSION, RING_SIZE, os.getpid(), comm, 0, 0)
+    struct.pack_into('<I', self.buf, 0, MAGIC)
+
+  def thread_id(self) -> int:
+    ident = threading.get_ident()
+    tid = self.tids.get(ident)
+    if tid is None:
+      tid = self.tids[ident] = threading.get_native_id()
+      if len(self.tids) <= MAX_THREADS:
+        with open(f'/proc/self/task/{tid}/comm', 'rb') as f:
+          name = f.read().strip()
+        THREAD.pack_into(self.buf, HEADER.size + (len(self.tids) - 1) * THREAD.size, tid, name)
+        struct.pack_into('<I', self.buf, THREAD_COUNT_OFFSET, len(self.tids))
+    return tid
+
+  def record(self, type: int, name: str, log_mono_time: int, frame_id: int) -> None:
+    i = self.head
+    self.head += 1
+    offset = RECORDS_OFFSET + (i % RING_SIZE) * RECORD.size
+    struct.pack_into('<Q', self.buf, offset, 0)
+    RECORD.pack_into(self.buf, offset, 0, time.clock_gettime_ns(time.CLOCK_BOOTTIME), log_mono_time, frame_id,
+                     self.thread_id(), type, name.encode()[:26])
+    struct.pack_into('<Q', self.buf, offset, i + 1)
+    struct.pack_into('<Q', self.buf, HEAD_OFFSET, self.head)
+
+
+_lock = threading.Lock()
+_ring: Optional[Ring] = None
+_ring_failed = False
+
+
+def _reset_after_fork() -> None:
+  global _lock, _ring, _ring_failed
+  _lock = threading.Lock()
+  _ring = None
+  _ring_failed = False
+
+os.register_at_fork(after_in_child=_reset_after_fork)
+
+
+def record(type: int, name: str, log_mono_time: int, frame_id: int = -1) -> None:
+  global _ring, _ring_failed
+  if not ENABLED:
+    return
+  with _lock:
+    if _ring is None:
+      if _ring_failed:
+        return
+      try:
+        _ring = Ring(ring_path(os.getpid()))
+      except OSError as e:
+        print(f"msgtrace: failed to create {ring_path(os.getpid())}: {e}")
+        _ring_failed = True
+        return
+    _ring.record(type, name, log_mono_time, frame_id)
+
+
+def frame_id(msg) -> int:
+  # the frameId of the message, for the services that have one
+  data = getattr(msg, msg.which())
+  schema = getattr(data, 'schema', None)
+  if 'frameId' in getattr(schema, 'fieldnames', ()):
+    return int(data.frameId)
+  return -1
+
+
+def publish(name: str, msg) -> None:
+  record(PUBLISH, name, msg.logMonoTime, frame_id(msg))
+
+
+def receive(name: str, msg) -> None:
+  record(RECEIVE, name, msg.logMonoTime, frame_id(msg))
+
+
+def vipc_receive(stream: str, frame_id: int, timestamp_sof: int) -> None:
+  record(VIPC_RECEIVE, stream, timestamp_sof, frame_id)
@@ -0,0 +1,242 @@
+// Converts the msgtrace rings of the processes that ran with MSGTRACE=1 into a Chrome trace, for
+// chrome://tracing or ui.perfetto.dev. Each message is linked by a flow from where it was published to where
+// it was received, and tagged with the camera frame it descends from: its own frameId, or the frame last
+// received by the thread that published it. The frames process has a slice per frame, from the camera to the
+// last message of the frame, and the end-to-end latency of the frames is printed.
+//
+// usage: msgtrace_export [-d DIR] [-o OUT] [-f FRAME] [-c]
+//   DIR:   where the rings are, by default MSGTRACE_DIR or /dev/shm
+//   OUT:   the trace, by default msgtrace.json
+//   FRAME: only the messages of this frame
+//   -c:    delete the rings after reading them
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cereal/messaging/msgtrace.h"
+
+struct Event {
+  uint64_t ts, log_mono_time;
+  int64_t frame_id;
+  uint32_t pid, tid;
+  uint8_t type;
+  std::string name;
+  int publish = -1;    // the event of the message a receive got
+  uint64_t dur = 0;    // from a receive to when it was handled
+  bool hidden = false;
+};
+
+struct Process {
+  std::string comm;
+  std::map<uint32_t, std::string> threads;
+};
+
+static bool read_ring(const std::string &path, std::map<uint32_t, Process> &processes, std::vector<Event> &events) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  void *mem = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(msgtrace::RingHeader)) {
+    mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED) return false;
+
+  const msgtrace::RingHeader *ring = (const msgtrace::RingHeader *)mem;
+  const bool valid = ring->magic == msgtrace::MAGIC && ring->version == msgtrace::VERSION && ring->size > 0 &&
+                     sizeof(msgtrace::RingHeader) + ring->size * sizeof(msgtrace::Record) == (size_t)st.st_size;
+  if (valid) {
+    Process &p = processes[ring->pid];
+    p.comm = std::string(ring->comm, strnlen(ring->comm, sizeof(ring->comm)));
+    const uint32_t thread_count = std::min(ring->thread_count.load(), msgtrace::MAX_THREADS);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      const msgtrace::Thread &t = ring->threads[i];
+      p.threads[t.tid] = std::string(t.name, strnlen(t.name, sizeof(t.name)));
+    }
+
+    // the oldest records are overwritten by the time the ring wraps around
+    const msgtrace::Record *records = (const msgtrace::Record *)(ring + 1);
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    for (uint64_t i = head > ring->size ? head - ring->size : 0; i < head; ++i) {
+      const msgtrace::Record &r = records[i % ring->size];
+      if (r.seq.load(std::memory_order_acquire) != i + 1) continue;
+      Event e = {.ts = r.ts, .log_mono_time = r.log_mono_time, .frame_id = r.frame_id, .pid = ring->pid,
+                 .tid = r.tid, .type = r.type, .name = std::string(r.name, strnlen(r.name, sizeof(r.name)))};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (r.seq.load(std::memory_order_relaxed) != i + 1) continue;
+      events.push_back(e);
+    }
+  }
+  munmap(mem, st.st_size);
+  return valid;
+}
+
+// gives each message the frame it descends from, and links the receives to their publishes
+static void link_events(std::vector<Event> &events) {
+  std::map<std::pair<std::string, uint64_t>, int> published;
+  std::map<std::tuple<uint32_t, uint32_t, std::string, uint64_t>, int> received;
+  std::map<std::pair<uint32_t, uint32_t>, int64_t> thread_frame;
+  for (int i = 0; i < (int)events.size(); ++i) {
+    Event &e = events[i];
+    const auto thread = std::make_pair(e.pid, e.tid);
+    if (e.type == msgtrace::PUBLISH) {
+      auto it = thread_frame.find(thread);
+      if (e.frame_id < 0 && it != thread_frame.end()) e.frame_id = it->second;
+      published[{e.name, e.log_mono_time}] = i;
+    } else if (e.type == msgtrace::RECEIVE) {
+      auto it = published.find({e.name, e.log_mono_time});
+      if (it != published.end()) {
+        e.publish = it->second;
+        if (e.frame_id < 0) e.frame_id = events[it->second].frame_id;
+      }
+      if (e.frame_id >= 0) thread_frame[thread] = e.frame_id;
+      received[{e.pid, e.tid, e.name, e.log_mono_time}] = i;
+    } else if (e.type == msgtrace::VIPC_RECEIVE) {
+      thread_frame[thread] = e.frame_id;
+    } else if (e.type == msgtrace::HANDLED) {
+      auto it = received.find({e.pid, e.tid, e.name, e.log_mono_time});
+      if (it != received.end()) {
+        Event &r = events[it->second];
+        r.dur = e.ts - r.ts;
+        e.frame_id = r.frame_id;
+        e.hidden = true;
+      }
+    }
+  }
+}
+
+static const char *category(uint8_t type) {
+  switch (type) {
+    case msgtrace::PUBLISH: return "publish";
+    case msgtrace::RECEIVE: return "receive";
+    case msgtrace::VIPC_RECEIVE: return "vipc";
+    case msgtrace::HANDLED: return "handled";
+    default: return "unknown";
+  }
+}
+
+// names are service and thread names, only quotes and control characters need care
+static std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += (unsigned char)c < 0x20 ? '?' : c;
+  }
+  return out + "\"";
+}
+
+int main(int argc, char *argv[]) {
+  const char *env_dir = getenv("MSGTRACE_DIR");
+  std::string dir = env_dir ? env_dir : "/dev/shm";
+  std::string out_path = "msgtrace.json";
+  int64_t frame = -1;
+  bool clear = false;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-d") == 0) dir = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-o") == 0) out_path = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-f") == 0) frame = std::atoll(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0) clear = true;
+    else {
+      printf("usage: %s [-d DIR] [-o OUT] [-f FRAME] [-c]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::map<uint32_t, Process> processes;
+  std::vector<Event> events;
+  std::vector<std::string> rings;
+  if (DIR *d = opendir(dir.c_str())) {
+    while (struct dirent *entry = readdir(d)) {
+      if (strncmp(entry->d_name, "msgtrace_", 9) == 0) rings.push_back(dir + "/" + entry->d_name);
+    }
+    closedir(d);
+  }
+  for (auto &path : rings) {
+    if (!read_ring(path, processes, events)) {
+      fprintf(stderr, "skipping %s, not a msgtrace ring\n", path.c_str());
+    } else if (clear) {
+      unlink(path.c_str());
+    }
+  }
+  if (events.empty()) {
+    fprintf(stderr, "no msgtrace records in %s, run the processes with MSGTRACE=1\n", dir.c_str());
+    return 1;
+  }
+
+  std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.ts < b.ts; });
+  link_events(events);
+
+  // a frame starts at the start of frame of the camera if a VisionIPC receive was traced
+  std::map<int64_t, std::pair<uint64_t, uint64_t>> frames;
+  for (auto &e : events) {
+    if (e.frame_id < 0) continue;
+    const uint64_t start = e.type == msgtrace::VIPC_RECEIVE ? std::min(e.ts, e.log_mono_time) : e.ts;
+    auto [it, inserted] = frames.try_emplace(e.frame_id, start, e.ts + e.dur);
+    it->second.first = std::min(it->second.first, start);
+    it->second.second = std::max(it->second.second, e.ts + e.dur);
+  }
+
+  FILE *f = fopen(out_path.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "failed to open %s\n", out_path.c_str());
+    return 1;
+  }
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"frames\"}}");
+  for (auto &[pid, p] : processes) {
+    fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":%s}}", pid, json_string(p.comm).c_str());
+    for (auto &[tid, name] : p.threads) {
+      fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":%s}}", pid, tid, json_string(name).c_str());
+    }
+  }
+
+  int flows = 0;
+  for (auto &e : events) {
+    if (e.hidden || (frame >= 0 && e.frame_id != frame)) continue;
+    fprintf(f, ",\n{\"name\":%s,\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,"
+               "\"args\":{\"frame_id\":%lld,\"logMonoTime\":%llu}}",
+            json_string(e.name).c_str(), category(e.type), e.ts / 1e3, e.dur / 1e3, e.pid, e.tid,
+            (long long)e.frame_id, (unsigned long long)e.log_mono_time);
+    if (e.publish >= 0) {
+      const Event &p = events[e.publish];
+      fprintf(f, ",\n{\"name\":%s,\"cat\":\"flow\",\"ph\":\"s\",\"id\":%d,\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+              json_string(e.name).c_str(), flows, p.ts / 1e3, p.pid, p.tid);
+      fprintf(f, ",\n{\"name\":%s,\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%d,\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+              json_string(e.name).c_str(), flows, e.ts / 1e3, e.pid, e.tid);
+      ++flows;
+    }
+  }
+
+  // frames overlap when the latency is longer than the frame time, async slices get a row each
+  std::vector<double> latencies;
+  for (auto &[id, span] : frames) {
+    if (span.second <= span.first || (frame >= 0 && id != frame)) continue;
+    latencies.push_back((span.second - span.first) / 1e6);
+    for (auto [ph, ts] : {std::pair{"b", span.first}, std::pair{"e", span.second}}) {
+      fprintf(f, ",\n{\"name\":\"frame %lld\",\"cat\":\"frame\",\"ph\":\"%s\",\"id\":%lld,\"ts\":%.3f,\"pid\":0,\"tid\":0}",
+              (long long)id, ph, (long long)id, ts / 1e3);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+
+  printf("%zu records from %zu processes written to %s\n", events.size(), processes.size(), out_path.c_str());
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    printf("%zu frames, end-to-end latency %.2f ms p50, %.2f ms p90, %.2f ms max\n", latencies.size(),
+           latencies[latencies.size() / 2], latencies[latencies.size() * 9 / 10], latencies.back());
+  }
+  return 0;
+}
@@ -3,8 +3,11 @@
 #include <string>
 #include <mutex>
 
+#include <capnp/dynamic.h>
+
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
+#include "cereal/messaging/msgtrace.h"
 
 const bool SIMULATION = (getenv("SIMULATION") != nullptr) && (std::string(getenv("SIMULATION")) == "1");
 
@@ -30,6 +33,21 @@ private:
 
 MessageContext message_context;
 
+// the frameId of the message, for the services that have one
+static int64_t trace_frame_id(cereal::Event::Reader event) {
+  capnp::DynamicStruct::Reader dynamic = capnp::toDynamic(event);
+  KJ_IF_MAYBE(field, dynamic.which()) {
+    capnp::DynamicValue::Reader value = dynamic.get(*field);
+    if (value.getType() == capnp::DynamicValue::STRUCT) {
+      capnp::DynamicStruct::Reader data = value.as<capnp::DynamicStruct>();
+      KJ_IF_MAYBE(frame_id, data.getSchema().findFieldByName("frameId")) {
+        return data.get(*frame_id).as<int64_t>();
+      }
+    }
+  }
+  return -1;
+}
+
 struct SubMaster::SubMessage {
   std::string name;
   SubSocket *socket = nullptr;
@@ -95,6 +113,10 @@ void SubMaster::update(int timeout) {
     m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(m->aligned_buf.align(msg), options);
     delete msg;
     messages.push_back({m->name, m->msg_reader->getRoot<cereal::Event>()});
+    if (msgtrace::ENABLED) {
+      auto event = messages.back().second;
+      msgtrace::record(msgtrace::RECEIVE, m->name.c_str(), event.getLogMonoTime(), trace_frame_id(event));
+    }
   }
 
   update_msgs(current_time, messages);
@@ -194,6 +216,10 @@ PubMaster::PubMaster(const std::vector<const char *> &service_list) {
 }
 
 int PubMaster::send(const char *name, MessageBuilder &msg) {
+  if (msgtrace::ENABLED) {
+    auto event = msg.getRoot<cereal::Event>().asReader();
+    msgtrace::record(msgtrace::PUBLISH, name, event.getLogMonoTime(), trace_frame_id(event));
+  }
   auto bytes = msg.toBytes();
   return send(name, bytes.begin(), bytes.size());
 }
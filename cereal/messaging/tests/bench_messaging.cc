@@ -0,0 +1,302 @@
+// Measures the messaging layer the way the daemons use it, by message size: building, serializing, aligning
+// and reading events, PubMaster::send and SubMaster::update, the latency from PubMaster to SubMaster with the
+// message fanned out to 1..N subscribers, and the throughput of a subscriber that keeps every message.
+//
+// usage: bench_messaging [-n ITERATIONS] [-s SUBSCRIBERS] [--json]
+//   ITERATIONS:  of the build and read benchmarks, the ones that publish do a tenth
+//   SUBSCRIBERS: the most subscribers of the fan-out, which runs 1, 2, 4, .. up to it
+//   --json:      a JSON object per result instead of the table, to keep and compare between builds
+//   default: 10000 iterations, 8 subscribers
+//   the messages are customReservedRawData0 events, run with ZMQ=1 to measure zmq instead of msgq
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "common/alloc_counter.h"
+#include "common/timing.h"
+
+const char *SERVICE = "customReservedRawData0";
+const size_t SIZES[] = {64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+const int CAN_FRAMES = 256;  // a usb read of pandad at full load
+const int BATCH = 10;  // the clock read costs as much as the smallest operations
+
+static volatile uint64_t sink;
+
+struct Result {
+  std::string bench;
+  size_t size = 0;
+  int subscribers = 0;
+  uint64_t count = 0;      // operations
+  std::vector<double> us;  // per operation, or per batch of them
+  double allocs = -1;      // per operation, counted in the thread that measures
+  double mb_per_s = 0;
+  uint64_t lost = 0;
+};
+
+template <class F>
+static Result measure(const char *bench, size_t size, int iterations, F op) {
+  Result r = {.bench = bench, .size = size};
+  r.us.reserve(iterations / BATCH + 1);
+  const uint64_t allocs = thread_allocations();
+  for (int i = 0; i < iterations; i += BATCH) {
+    const uint64_t t = nanos_since_boot();
+    for (int j = 0; j < BATCH; ++j) op();
+    r.us.push_back((nanos_since_boot() - t) / 1e3 / BATCH);
+    r.count += BATCH;
+  }
+  r.allocs = double(thread_allocations() - allocs) / r.count;
+  return r;
+}
+
+static void build_event(MessageBuilder &msg, const std::vector<capnp::byte> &payload, size_t size) {
+  msg.initEvent().setCustomReservedRawData0(kj::arrayPtr(payload.data(), size));
+}
+
+// a MessageBuilder with the time it is sent in the first 8 bytes of the payload
+static void send_timestamped(PubMaster &pm, const std::vector<capnp::byte> &payload, size_t size) {
+  MessageBuilder msg;
+  build_event(msg, payload, size);
+  auto data = msg.getRoot<cereal::Event>().getCustomReservedRawData0();
+  const uint64_t ts = nanos_since_boot();
+  memcpy(data.begin(), &ts, sizeof(ts));
+  pm.send(SERVICE, msg);
+}
+
+static uint64_t sent_at(cereal::Event::Reader event) {
+  uint64_t ts;
+  memcpy(&ts, event.getCustomReservedRawData0().begin(), sizeof(ts));
+  return ts;
+}
+
+static std::vector<Result> bench_build_and_read(size_t size, int iterations, const std::vector<capnp::byte> &payload) {
+  std::vector<Result> results;
+  results.push_back(measure("MessageBuilder", size, iterations, [&]() {
+    MessageBuilder msg;
+    build_event(msg, payload, size);
+    sink = msg.getSegmentsForOutput().size();
+  }));
+
+  MessageBuilder msg;
+  build_event(msg, payload, size);
+  results.push_back(measure("messageToFlatArray", size, iterations, [&]() {
+    sink = capnp::messageToFlatArray(msg).size();
+  }));
+
+  std::vector<unsigned char> buffer(msg.getSerializedSize());
+  results.push_back(measure("serializeToBuffer", size, iterations, [&]() {
+    sink = msg.serializeToBuffer(buffer.data(), buffer.size());
+  }));
+
+  AlignedBuffer aligned_buf;
+  results.push_back(measure("AlignedBuffer::align", size, iterations, [&]() {
+    sink = aligned_buf.align((const char *)buffer.data(), buffer.size()).size();
+  }));
+
+  auto words = aligned_buf.align((const char *)buffer.data(), buffer.size());
+  results.push_back(measure("FlatArrayMessageReader", size, iterations, [&]() {
+    capnp::FlatArrayMessageReader reader(words);
+    auto event = reader.getRoot<cereal::Event>();
+    sink = event.which() + event.getCustomReservedRawData0().size();
+  }));
+  return results;
+}
+
+static void build_can(MessageBuilder &msg) {
+  auto can_data = msg.initEvent().initCan(CAN_FRAMES);
+  for (int i = 0; i < CAN_FRAMES; ++i) {
+    const uint64_t dat = i;
+    can_data[i].setAddress(0x100 + i);
+    can_data[i].setSrc(i % 3);
+    can_data[i].setDat(kj::arrayPtr((const capnp::byte *)&dat, sizeof(dat)));
+  }
+}
+
+static Result bench_build_can(int iterations) {
+  MessageBuilder can;
+  build_can(can);
+  return measure("MessageBuilder can", can.getSerializedSize(), iterations, [&]() {
+    MessageBuilder msg;
+    build_can(msg);
+    sink = msg.getSegmentsForOutput().size();
+  });
+}
+
+// both ends in one thread, SubMaster::update finds the message waiting
+static std::vector<Result> bench_send_and_update(size_t size, int iterations, const std::vector<capnp::byte> &payload) {
+  SubMaster sm({SERVICE});
+  PubMaster pm({SERVICE});
+  Result send = {.bench = "PubMaster::send", .size = size, .count = (uint64_t)iterations, .allocs = 0};
+  Result update = {.bench = "SubMaster::update", .size = size, .count = (uint64_t)iterations, .allocs = 0};
+  for (int i = 0; i < iterations; ++i) {
+    MessageBuilder msg;
+    build_event(msg, payload, size);
+    uint64_t allocs = thread_allocations(), t = nanos_since_boot();
+    pm.send(SERVICE, msg);
+    send.allocs += thread_allocations() - allocs;
+    send.us.push_back((nanos_since_boot() - t) / 1e3);
+
+    allocs = thread_allocations();
+    t = nanos_since_boot();
+    sm.update(1000);
+    update.allocs += thread_allocations() - allocs;
+    update.us.push_back((nanos_since_boot() - t) / 1e3);
+    if (!sm.updated(SERVICE)) {
+      ++update.lost;
+    }
+  }
+  send.allocs /= iterations;
+  update.allocs /= iterations;
+  return {send, update};
+}
+
+// one message at a time, the next is sent once every subscriber got it or gave up on it
+static Result bench_latency(size_t size, int subscribers, int iterations, const std::vector<capnp::byte> &payload) {
+  std::vector<std::unique_ptr<SubMaster>> sms;
+  for (int i = 0; i < subscribers; ++i) sms.emplace_back(new SubMaster({SERVICE}));
+  PubMaster pm({SERVICE});
+
+  std::atomic<bool> done = false;
+  std::atomic<int> received = 0;
+  std::vector<std::vector<double>> latencies(subscribers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < subscribers; ++i) {
+    threads.emplace_back([&, i]() {
+      SubMaster &sm = *sms[i];
+      while (!done) {
+        sm.update(100);
+        if (sm.updated(SERVICE)) {
+          latencies[i].push_back((nanos_since_boot() - sent_at(sm[SERVICE])) / 1e3);
+          ++received;
+        }
+      }
+    });
+  }
+
+  Result r = {.bench = "latency", .size = size, .subscribers = subscribers, .count = (uint64_t)iterations * subscribers};
+  for (int i = 0; i < iterations; ++i) {
+    received = 0;
+    send_timestamped(pm, payload, size);
+    const uint64_t deadline = nanos_since_boot() + 1e9;
+    while (received < subscribers && nanos_since_boot() < deadline) {
+      std::this_thread::yield();
+    }
+    r.lost += subscribers - received;
+  }
+  done = true;
+  for (auto &t : threads) t.join();
+  for (auto &l : latencies) r.us.insert(r.us.end(), l.begin(), l.end());
+  return r;
+}
+
+// the publisher sends as fast as it can to a subscriber that keeps every message, like loggerd
+static Result bench_throughput(size_t size, int iterations, const std::vector<capnp::byte> &payload) {
+  std::unique_ptr<Context> context(Context::create());
+  std::unique_ptr<SubSocket> sock(SubSocket::create(context.get(), SERVICE));
+  assert(sock);
+  sock->setTimeout(100);
+  PubMaster pm({SERVICE});
+
+  std::atomic<bool> done = false;
+  uint64_t received = 0, received_bytes = 0, last_received = 0;
+  std::thread subscriber([&]() {
+    AlignedBuffer aligned_buf;
+    while (true) {
+      std::unique_ptr<Message> msg(sock->receive());
+      if (!msg) {
+        if (done) break;
+        continue;
+      }
+      capnp::FlatArrayMessageReader reader(aligned_buf.align(msg.get()));
+      received_bytes += reader.getRoot<cereal::Event>().getCustomReservedRawData0().size();
+      last_received = nanos_since_boot();
+      ++received;
+    }
+  });
+
+  Result r = {.bench = "throughput", .size = size, .subscribers = 1, .count = (uint64_t)iterations};
+  MessageBuilder msg;
+  build_event(msg, payload, size);
+  auto bytes = msg.toBytes();
+  const uint64_t start = nanos_since_boot();
+  for (int i = 0; i < iterations; ++i) {
+    const uint64_t t = nanos_since_boot();
+    pm.send(SERVICE, bytes.begin(), bytes.size());
+    r.us.push_back((nanos_since_boot() - t) / 1e3);
+  }
+  done = true;
+  subscriber.join();
+  r.lost = iterations - received;
+  r.mb_per_s = last_received > start ? received_bytes / ((last_received - start) / 1e3) : 0;
+  return r;
+}
+
+static void print(const Result &r, bool json) {
+  std::vector<double> us = r.us;
+  std::sort(us.begin(), us.end());
+  const double mean = us.empty() ? 0 : std::accumulate(us.begin(), us.end(), 0.0) / us.size();
+  const double p50 = us.empty() ? 0 : us[us.size() / 2];
+  const double p99 = us.empty() ? 0 : us[std::min(us.size() - 1, us.size() * 99 / 100)];
+  char allocs[16] = "-";
+  if (r.allocs >= 0) snprintf(allocs, sizeof(allocs), "%.2f", r.allocs);
+  if (json) {
+    printf("{\"bench\":\"%s\",\"size\":%zu,\"subscribers\":%d,\"count\":%llu,\"mean_us\":%.3f,\"p50_us\":%.3f,"
+           "\"p99_us\":%.3f,\"allocs_per_op\":%s,\"mb_per_s\":%.1f,\"lost\":%llu}\n",
+           r.bench.c_str(), r.size, r.subscribers, (unsigned long long)r.count, mean, p50, p99,
+           r.allocs >= 0 ? allocs : "null", r.mb_per_s, (unsigned long long)r.lost);
+  } else {
+    printf("  %-24s %8zu %5d %8llu %10.3f %10.3f %10.3f %8s %9.1f %6llu\n", r.bench.c_str(), r.size, r.subscribers,
+           (unsigned long long)r.count, mean, p50, p99, allocs, r.mb_per_s, (unsigned long long)r.lost);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 10000;
+  int max_subscribers = 8;
+  bool json = false;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) iterations = std::atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-s") == 0) max_subscribers = std::atoi(argv[++i]);
+    else if (strcmp(argv[i], "--json") == 0) json = true;
+    else iterations = 0;
+  }
+  if (iterations < BATCH * 10 || max_subscribers < 1) {
+    printf("usage: %s [-n ITERATIONS] [-s SUBSCRIBERS] [--json]\n", argv[0]);
+    return 1;
+  }
+  const int pub_iterations = iterations / 10;
+
+  std::vector<capnp::byte> payload(SIZES[std::size(SIZES) - 1]);
+  for (size_t i = 0; i < payload.size(); ++i) payload[i] = i * 7;
+
+  if (!json) {
+    printf("%d iterations, %d publishing, %s\n", iterations, pub_iterations, getenv("ZMQ") ? "zmq" : "msgq");
+    printf("  %-24s %8s %5s %8s %10s %10s %10s %8s %9s %6s\n", "bench", "size", "subs", "count", "mean us",
+           "p50 us", "p99 us", "allocs", "MB/s", "lost");
+  }
+  print(bench_build_can(iterations), json);
+  for (size_t size : SIZES) {
+    for (auto &r : bench_build_and_read(size, iterations, payload)) print(r, json);
+    for (auto &r : bench_send_and_update(size, pub_iterations, payload)) print(r, json);
+  }
+  for (size_t size : SIZES) {
+    for (int subscribers = 1; subscribers <= max_subscribers; subscribers *= 2) {
+      print(bench_latency(size, subscribers, pub_iterations, payload), json);
+    }
+  }
+  for (size_t size : SIZES) {
+    print(bench_throughput(size, pub_iterations, payload), json);
+  }
+  return 0;
+}
@@ -0,0 +1,21 @@
+// Writes msgtrace records from a C++ process, for test_msgtrace.py to check them against the python ones.
+//
+// usage: msgtrace_writer [TYPE NAME LOG_MONO_TIME FRAME_ID]...
+//   TYPE: the msgtrace::Type, 1 publish, 2 receive, 3 vipc receive, 4 handled
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "cereal/messaging/msgtrace.h"
+
+int main(int argc, char *argv[]) {
+  if (argc % 4 != 1 || !msgtrace::ENABLED) {
+    printf("usage: MSGTRACE=1 %s [TYPE NAME LOG_MONO_TIME FRAME_ID]...\n", argv[0]);
+    return 1;
+  }
+  for (int i = 1; i < argc; i += 4) {
+    msgtrace::record((msgtrace::Type)std::atoi(argv[i]), argv[i + 1], std::strtoull(argv[i + 2], nullptr, 10),
+                     std::atoll(argv[i + 3]));
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+import json
+import os
+import struct
+import subprocess
+import tempfile
+import threading
+
+import cereal.messaging as messaging
+from cereal.messaging import msgtrace
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+MESSAGING_DIR = os.path.dirname(TESTS_DIR)
+
+class TestMsgtrace:
+
+  def setup_method(self):
+    self.dir = tempfile.TemporaryDirectory()
+    os.environ["MSGTRACE_DIR"] = self.dir.name
+    msgtrace.ENABLED = True
+    msgtrace._reset_after_fork()
+
+  def teardown_method(self):
+    msgtrace.ENABLED = False
+    msgtrace._reset_after_fork()
+    del os.environ["MSGTRACE_DIR"]
+    self.dir.cleanup()
+
+  def read_ring(self):
+    with open(msgtrace.ring_path(os.getpid()), 'rb') as f:
+      buf = f.read()
+    magic, version, size, pid, comm, head, thread_count = msgtrace.HEADER.unpack_from(buf, 0)
+    assert (magic, version, size, pid) == (msgtrace.MAGIC, msgtrace.VERSION, msgtrace.RING_SIZE, os.getpid())
+    assert len(buf) == msgtrace.RECORDS_OFFSET + size * msgtrace.RECORD.size
+    threads = [msgtrace.THREAD.unpack_from(buf, msgtrace.HEADER.size + i * msgtrace.THREAD.size)[0] for i in range(thread_count)]
+    records = [msgtrace.RECORD.unpack_from(buf, msgtrace.RECORDS_OFFSET + (i % size) * msgtrace.RECORD.size)
+               for i in range(max(0, head - size), head)]
+    return threads, records
+
+  def test_records(self):
+    msg = messaging.new_message('roadCameraState')
+    msg.roadCameraState.frameId = 1234
+    msgtrace.publish('roadCameraState', msg)
+    msgtrace.receive('carState', messaging.new_message('carState'))
+    msgtrace.vipc_receive('roadCamera', 1235, 5678)
+
+    threads, records = self.read_ring()
+    assert threads == [threading.get_native_id()]
+    assert [r[0] for r in records] == [1, 2, 3]
+    assert [(r[3], r[5], r[6].rstrip(b'\0')) for r in records] == [
+      (1234, msgtrace.PUBLISH, b'roadCameraState'),
+      (-1, msgtrace.RECEIVE, b'carState'),
+      (1235, msgtrace.VIPC_RECEIVE, b'roadCamera'),
+    ]
+    assert records[0][2] == msg.logMonoTime
+    assert records[2][2] == 5678
+    assert records[0][1] <= records[1][1] <= records[2][1]
+
+  def test_wraps_around(self):
+    n = msgtrace.RING_SIZE + 100
+    t = threading.Thread(target=lambda: [msgtrace.record(msgtrace.PUBLISH, 'can', i) for i in range(n)])
+    t.start()
+    t.join()
+
+    threads, records = self.read_ring()
+    assert len(threads) == 1
+    assert len(records) == msgtrace.RING_SIZE
+    assert [r[0] for r in records] == list(range(101, n + 1))
+    assert [r[2] for r in records] == list(range(100, n))
+
+  def test_disabled(self):
+    msgtrace.ENABLED = False
+    msgtrace.record(msgtrace.PUBLISH, 'can', 0)
+    assert not os.path.exists(msgtrace.ring_path(os.getpid()))
+
+  def test_pub_master(self):
+    pm = messaging.PubMaster(['driverCameraState'])
+    msg = messaging.new_message('driverCameraState')
+    msg.driverCameraState.frameId = 42
+    pm.send('driverCameraState', msg.to_bytes())
+
+    _, records = self.read_ring()
+    assert len(records) == 1
+    assert (records[0][2], records[0][3], records[0][5]) == (msg.logMonoTime, 42, msgtrace.PUBLISH)
+
+  def test_export(self):
+    # a frame goes from python to a C++ process and back, the exporter follows it through both
+    msgtrace.record(msgtrace.PUBLISH, 'roadCameraState', 1000, 42)
+    writer = subprocess.Popen([os.path.join(TESTS_DIR, 'msgtrace_writer'),
+                               str(msgtrace.RECEIVE), 'roadCameraState', '1000', '-1',
+                               str(msgtrace.PUBLISH), 'modelV2', '2000', '-1',
+                               str(msgtrace.VIPC_RECEIVE), 'driverCamera', '2500', '43',
+                               str(msgtrace.PUBLISH), 'driverStateV2', '3000', '-1'],
+                              env={**os.environ, 'MSGTRACE': '1'})
+    assert writer.wait() == 0
+    msgtrace.record(msgtrace.RECEIVE, 'modelV2', 2000)
+    msgtrace.record(msgtrace.RECEIVE, 'driverStateV2', 3000)
+
+    out = os.path.join(self.dir.name, 'trace.json')
+    subprocess.check_call([os.path.join(MESSAGING_DIR, 'msgtrace_export'), '-d', self.dir.name, '-o', out])
+    with open(out) as f:
+      events = json.load(f)['traceEvents']
+
+    py, cpp = os.getpid(), writer.pid
+    names = {e['pid']: e['args']['name'] for e in events if e['name'] == 'process_name'}
+    assert names[cpp] == 'msgtrace_writer'
+
+    # the messages without a frameId get the frame of what their thread received last
+    slices = [(e['name'], e['cat'], e['pid'], e['args']['frame_id']) for e in events if e['ph'] == 'X']
+    assert slices == [
+      ('roadCameraState', 'publish', py, 42),
+      ('roadCameraState', 'receive', cpp, 42),
+      ('modelV2', 'publish', cpp, 42),
+      ('driverCamera', 'vipc', cpp, 43),
+      ('driverStateV2', 'publish', cpp, 43),
+      ('modelV2', 'receive', py, 42),
+      ('driverStateV2', 'receive', py, 43),
+    ]
+
+    # each receive is linked to its publish, across the processes
+    flows = {}
+    for e in events:
+      if e.get('cat') == 'flow':
+        flows.setdefault(e['id'], {})[e['ph']] = (e['name'], e['pid'])
+    assert sorted(flows.values(), key=lambda f: f['s']) == [
+      {'s': ('driverStateV2', cpp), 'f': ('driverStateV2', py)},
+      {'s': ('modelV2', cpp), 'f': ('modelV2', py)},
+      {'s': ('roadCameraState', py), 'f': ('roadCameraState', cpp)},
+    ]
+    assert sorted(e['name'] for e in events if e.get('cat') == 'frame' and e['ph'] == 'b') == ['frame 42', 'frame 43']
@@ -0,0 +1,37 @@
+#pragma once
+
+// Counts the heap allocations of each thread, for the benchmarks. malloc, calloc and realloc are replaced
+// with versions that count and call glibc's, operator new and Eigen allocate with malloc, so those are
+// counted too. It defines the replacements, so include it in the main file of the benchmark only.
+
+#include <cstdint>
+#include <cstdlib>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static thread_local uint64_t thread_allocation_count = 0;
+
+// allocations of the calling thread so far
+static inline uint64_t thread_allocations() {
+  return thread_allocation_count;
+}
+
+extern "C" void *malloc(size_t size) {
+  ++thread_allocation_count;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+  ++thread_allocation_count;
+  return __libc_calloc(n, size);
+}
+
+// growing a block may move it, each call counts
+extern "C" void *realloc(void *ptr, size_t size) {
+  ++thread_allocation_count;
+  return __libc_realloc(ptr, size);
+}
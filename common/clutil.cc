@@ -75,6 +75,18 @@ cl_device_id cl_get_device_id(cl_device_type device_type) {
   return nullptr;
 }
 
+bool cl_device_is_gpu(cl_device_id device_id) {
+  cl_device_type device_type;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL));
+  return device_type & CL_DEVICE_TYPE_GPU;
+}
+
+void *map_cl_buffer(cl_command_queue q, cl_mem mem, cl_map_flags flags) {
+  size_t size;
+  CL_CHECK(clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(size), &size, NULL));
+  return CL_CHECK_ERR(clEnqueueMapBuffer(q, mem, CL_TRUE, flags, 0, size, 0, NULL, NULL, &err));
+}
+
 cl_context cl_create_context(cl_device_id device_id) {
   return CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
 }
@@ -22,6 +22,9 @@
   })
 
 cl_device_id cl_get_device_id(cl_device_type device_type);
+bool cl_device_is_gpu(cl_device_id device_id);
+// blocks until the queue is done with the buffer and maps all of it
+void *map_cl_buffer(cl_command_queue q, cl_mem mem, cl_map_flags flags);
 cl_context cl_create_context(cl_device_id device_id);
 cl_program cl_program_from_source(cl_context ctx, cl_device_id device_id, const std::string& src, const char* args = nullptr);
 cl_program cl_program_from_binary(cl_context ctx, cl_device_id device_id, const uint8_t* binary, size_t length, const char* args = nullptr);
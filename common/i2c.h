@@ -10,10 +10,16 @@ class I2CBus {
     int i2c_fd;
     std::mutex m;
 
+  protected:
+    // for mock buses in tests
+    I2CBus() : i2c_fd(-1) {}
+
   public:
     I2CBus(uint8_t bus_id);
-    ~I2CBus();
+    virtual ~I2CBus();
 
-    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
-    int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    virtual int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
+    virtual int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    // reads len bytes from consecutive registers in one transaction, without the 32 byte limit of read_register
+    virtual int read_block(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len);
 };
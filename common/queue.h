@@ -1,8 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 template <class T>
 class SafeQueue {
@@ -50,3 +52,64 @@ private:
   std::condition_variable cv;
   std::queue<T> q;
 };
+
+// Bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+template <class T>
+class SPSCQueue {
+public:
+  explicit SPSCQueue(size_t capacity) : buffer_(round_up_pow2(capacity)), mask_(buffer_.size() - 1) {}
+
+  // called from the producer thread. returns false if the queue is full.
+  bool try_push(const T& v) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ == buffer_.size()) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ == buffer_.size()) return false;
+    }
+    buffer_[head & mask_] = v;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // called from the consumer thread. returns false if the queue is empty.
+  bool try_pop(T& v) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_cache_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail == head_cache_) return false;
+    }
+    v = buffer_[tail & mask_];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // called from the consumer thread. pops all available items, returns the number of items.
+  template <class F>
+  size_t consume_all(F f) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    head_cache_ = head_.load(std::memory_order_acquire);
+    for (size_t i = tail; i != head_cache_; ++i) {
+      f(buffer_[i & mask_]);
+    }
+    tail_.store(head_cache_, std::memory_order_release);
+    return head_cache_ - tail;
+  }
+
+  size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+  size_t capacity() const { return buffer_.size(); }
+
+private:
+  static size_t round_up_pow2(size_t n) {
+    size_t v = 1;
+    while (v < n) v <<= 1;
+    return v;
+  }
+
+  std::vector<T> buffer_;
+  const size_t mask_;
+  // head and tail live on separate cache lines, each next to the cached copy its owner reads.
+  alignas(64) std::atomic<size_t> head_ = 0;
+  size_t tail_cache_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+  size_t head_cache_ = 0;
+};
@@ -4,17 +4,67 @@
 
 #include "common/swaglog.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <signal.h>
 #include <zmq.h>
 #include <stdarg.h>
 #include "third_party/json11/json11.hpp"
+#include "common/queue.h"
+#include "common/util.h"
 #include "common/version.h"
 #include "system/hardware/hw.h"
 
+bool LOG_TIMESTAMPS = getenv("LOG_TIMESTAMPS");
+uint32_t NO_FRAME_ID = std::numeric_limits<uint32_t>::max();
+
+namespace {
+
+const int MAX_INLINE_MSG = 256;
+const int THREAD_BUFFER_SIZE = 512;
+
+// A log call as recorded by the calling thread. filename and func point to string literals,
+// everything else that needs formatting is deferred to the flush thread.
+struct LogRecord {
+  int levelnum;
+  int lineno;
+  const char* filename;
+  const char* func;
+  double created;
+  bool timestamp;
+  uint32_t frame_id;
+  uint64_t nanos;
+  char* long_msg;  // allocated if the message doesn't fit in msg
+  char msg[MAX_INLINE_MSG];
+
+  const char* text() const { return long_msg ? long_msg : msg; }
+};
+
+// per-thread lock-free buffer, written by the owning thread and drained by the flush thread.
+struct LogBuffer {
+  LogBuffer() : queue(THREAD_BUFFER_SIZE) {}
+  SPSCQueue<LogRecord> queue;
+  std::atomic<uint32_t> dropped = 0;
+  std::atomic<bool> closed = false;  // the owning thread has exited
+};
+
+// the signals that end the process without running the exit handlers. std::terminate gets here too, through abort().
+const int FATAL_SIGNALS[] = {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+
+}  // namespace
+
 class SwaglogState {
 public:
   SwaglogState() {
@@ -56,97 +106,261 @@ public:
     ctx_j["version"] = COMMA_VERSION;
     ctx_j["dirty"] = !getenv("CLEAN");
     ctx_j["device"] = Hardware::get_name();
+    ctx_s = ((json11::Json)ctx_j).dump();
+
+    flush_thread = std::thread(&SwaglogState::flushThread, this);
+
+    instance = this;
+    for (size_t i = 0; i < std::size(FATAL_SIGNALS); ++i) {
+      struct sigaction sa = {};
+      sa.sa_handler = fatalSignalHandler;
+      sigemptyset(&sa.sa_mask);
+      sigaction(FATAL_SIGNALS[i], &sa, &prev_actions[i]);
+    }
   }
 
+  // runs at exit, after the flush thread sent what is still queued.
   ~SwaglogState() {
+    instance = nullptr;
+    {
+      std::lock_guard lk(lock);
+      exit = true;
+    }
+    cv.notify_one();
+    if (crashed) {
+      // the crash flush keeps send_lock, the flush thread can't finish
+      flush_thread.detach();
+      return;
+    }
+    flush_thread.join();
     zmq_close(sock);
     zmq_ctx_destroy(zctx);
   }
 
-  void log(int levelnum, const char* filename, int lineno, const char* func, const char* msg, const std::string& log_s) {
-    std::lock_guard lk(lock);
-    if (levelnum >= print_level) {
-      printf("%s: %s\n", filename, msg);
+  // called from the logging threads, the records of every level are sent by the flush thread.
+  void push(LogRecord& r) {
+    LogBuffer* buf = threadBuffer();
+    if (!buf->queue.try_push(r)) {
+      free(r.long_msg);
+      buf->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    // only the first record since the last flush wakes the flush thread, the others don't lock.
+    if (!pending.exchange(true, std::memory_order_acq_rel)) {
+      std::lock_guard lk(lock);
+      cv.notify_one();
+    }
+  }
+
+  // for the tests, the flush thread sends nothing while held. returns once a flush in progress is done.
+  void holdFlush(bool h) {
+    {
+      std::lock_guard lk(lock);
+      hold = h;
+    }
+    if (h) {
+      std::lock_guard lk(send_lock);
+    } else {
+      cv.notify_one();
+    }
+  }
+
+private:
+  LogBuffer* threadBuffer() {
+    struct Owner {
+      std::shared_ptr<LogBuffer> buf;
+      ~Owner() {
+        if (buf) buf->closed = true;
+      }
+    };
+    thread_local Owner owner;
+    if (!owner.buf) {
+      owner.buf = std::make_shared<LogBuffer>();
+      std::lock_guard lk(lock);
+      buffers.push_back(owner.buf);
+    }
+    return owner.buf.get();
+  }
+
+  // sends what is queued when the process is killed by a fatal signal, then hands the signal to the
+  // handler that was there before. it's best effort: nothing is sent if the crash is in the flush thread,
+  // or while the crashing thread holds the buffers lock.
+  static void fatalSignalHandler(int sig) {
+    SwaglogState* s = instance;
+    if (s && std::this_thread::get_id() != s->flush_thread.get_id() &&
+        s->send_lock.try_lock_for(std::chrono::milliseconds(100))) {
+      if (s->lock.try_lock()) {
+        auto bufs = s->buffers;
+        s->lock.unlock();
+        s->crashed = true;
+        s->flush(bufs);
+        // closing blocks until the messages are out or the linger timeout. send_lock stays held, the
+        // flush thread must not use the closed socket.
+        zmq_close(s->sock);
+        zmq_ctx_term(s->zctx);
+      } else {
+        s->send_lock.unlock();
+      }
+    }
+    for (size_t i = 0; i < std::size(FATAL_SIGNALS); ++i) {
+      if (FATAL_SIGNALS[i] == sig) sigaction(sig, &prev_actions[i], nullptr);
+    }
+    raise(sig);
+  }
+
+  void flushThread() {
+    util::set_thread_name("swaglog");
+    bool done = false;
+    while (!done) {
+      std::vector<std::shared_ptr<LogBuffer>> bufs;
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [this]() { return exit || (pending && !hold); });
+        pending = false;
+        done = exit;
+        bufs = buffers;
+      }
+      std::lock_guard lk(send_lock);
+      flush(bufs);
     }
+  }
+
+  // the caller holds send_lock, which makes it the only consumer of the buffers.
+  void flush(const std::vector<std::shared_ptr<LogBuffer>>& bufs) {
+    for (auto& buf : bufs) {
+      // read closed before draining, nothing is pushed after it is set.
+      const bool closed = buf->closed;
+      buf->queue.consume_all([this](const LogRecord& r) {
+        send(r);
+        free(r.long_msg);
+      });
+      if (uint32_t dropped = buf->dropped.exchange(0, std::memory_order_relaxed)) {
+        LogRecord r = {};
+        r.levelnum = CLOUDLOG_WARNING;
+        r.lineno = __LINE__;
+        r.filename = __FILE__;
+        r.func = __func__;
+        r.created = seconds_since_epoch();
+        snprintf(r.msg, sizeof(r.msg), "swaglog: %u messages dropped", dropped);
+        send(r);
+      }
+      if (closed) {
+        std::lock_guard lk(lock);
+        auto it = std::find(buffers.begin(), buffers.end(), buf);
+        if (it != buffers.end()) buffers.erase(it);
+      }
+    }
+  }
+
+  void send(const LogRecord& r) {
+    const char* msg = r.text();
+    if (r.levelnum >= print_level) {
+      printf("%s: %s\n", r.filename, msg);
+    }
+
+    json11::Json msg_j = msg;
+    if (r.timestamp) {
+      json11::Json::object tspt_j = json11::Json::object{
+        {"event", msg},
+        {"time", std::to_string(r.nanos)}
+      };
+      if (r.frame_id < NO_FRAME_ID) {
+        tspt_j["frame_id"] = std::to_string(r.frame_id);
+      }
+      msg_j = json11::Json::object{{"timestamp", tspt_j}};
+    }
+
+    // the context is the same for every message, splice in its pre-serialized form.
+    log_s.clear();
+    log_s += (char)r.levelnum;
+    log_s += "{\"created\": ";
+    json11::Json(r.created).dump(log_s);
+    log_s += ", \"ctx\": " + ctx_s + ", \"filename\": ";
+    json11::Json(r.filename).dump(log_s);
+    log_s += ", \"funcname\": ";
+    json11::Json(r.func).dump(log_s);
+    log_s += ", \"levelnum\": " + std::to_string(r.levelnum) + ", \"lineno\": " + std::to_string(r.lineno) + ", \"msg\": ";
+    msg_j.dump(log_s);
+    log_s += "}";
     zmq_send(sock, log_s.data(), log_s.length(), ZMQ_NOBLOCK);
   }
 
-  std::mutex lock;
+  std::mutex lock;  // buffers and the flush thread wakeup
+  std::timed_mutex send_lock;  // draining the buffers and the socket
+  std::condition_variable cv;
+  std::atomic<bool> exit = false;
+  std::atomic<bool> pending = false;
+  bool hold = false;
+  std::atomic<bool> crashed = false;
+  static inline std::atomic<SwaglogState*> instance = nullptr;
+  static inline struct sigaction prev_actions[std::size(FATAL_SIGNALS)] = {};
+  std::vector<std::shared_ptr<LogBuffer>> buffers;
+  std::thread flush_thread;
+  std::string log_s;
+
   void* zctx = nullptr;
   void* sock = nullptr;
   int print_level;
   json11::Json::object ctx_j;
+  std::string ctx_s;
 };
 
-bool LOG_TIMESTAMPS = getenv("LOG_TIMESTAMPS");
-uint32_t NO_FRAME_ID = std::numeric_limits<uint32_t>::max();
+static SwaglogState& swaglog_state() {
+  static SwaglogState s;
+  return s;
+}
 
 static void cloudlog_common(int levelnum, const char* filename, int lineno, const char* func,
-                            char* msg_buf, const json11::Json::object &msg_j={}) {
-  static SwaglogState s;
+                            bool timestamp, uint32_t frame_id, const char* fmt, va_list args) {
+  SwaglogState& s = swaglog_state();
 
-  json11::Json::object log_j = json11::Json::object {
-    {"ctx", s.ctx_j},
-    {"levelnum", levelnum},
-    {"filename", filename},
-    {"lineno", lineno},
-    {"funcname", func},
-    {"created", seconds_since_epoch()}
-  };
-  if (msg_j.empty()) {
-    log_j["msg"] = msg_buf;
-  } else {
-    log_j["msg"] = msg_j;
-  }
+  LogRecord r;
+  r.levelnum = levelnum;
+  r.lineno = lineno;
+  r.filename = filename;
+  r.func = func;
+  r.created = seconds_since_epoch();
+  r.timestamp = timestamp;
+  r.frame_id = frame_id;
+  r.nanos = timestamp ? nanos_since_boot() : 0;
+  r.long_msg = nullptr;
 
-  std::string log_s;
-  log_s += (char)levelnum;
-  ((json11::Json)log_j).dump(log_s);
-  s.log(levelnum, filename, lineno, func, msg_buf, log_s);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int ret = vsnprintf(r.msg, sizeof(r.msg), fmt, args);
+  if (ret >= (int)sizeof(r.msg) && vasprintf(&r.long_msg, fmt, args_copy) < 0) {
+    r.long_msg = nullptr;
+  }
+  va_end(args_copy);
+  if (ret <= 0) return;
 
-  free(msg_buf);
+  s.push(r);
 }
 
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  char* msg_buf = nullptr;
-  int ret = vasprintf(&msg_buf, fmt, args);
+  cloudlog_common(levelnum, filename, lineno, func, false, NO_FRAME_ID, fmt, args);
   va_end(args);
-  if (ret <= 0 || !msg_buf) return;
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf);
-}
-
-void cloudlog_t_common(int levelnum, const char* filename, int lineno, const char* func,
-                       uint32_t frame_id, const char* fmt, va_list args) {
-  if (!LOG_TIMESTAMPS) return;
-  char* msg_buf = nullptr;
-  int ret = vasprintf(&msg_buf, fmt, args);
-  if (ret <= 0 || !msg_buf) return;
-  json11::Json::object tspt_j = json11::Json::object{
-    {"event", msg_buf},
-    {"time", std::to_string(nanos_since_boot())}
-  };
-  if (frame_id < NO_FRAME_ID) {
-    tspt_j["frame_id"] = std::to_string(frame_id);
-  }
-  tspt_j = json11::Json::object{{"timestamp", tspt_j}};
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf, tspt_j);
 }
 
-
 void cloudlog_te(int levelnum, const char* filename, int lineno, const char* func,
                  const char* fmt, ...) {
+  if (!LOG_TIMESTAMPS) return;
   va_list args;
   va_start(args, fmt);
-  cloudlog_t_common(levelnum, filename, lineno, func, NO_FRAME_ID, fmt, args);
+  cloudlog_common(levelnum, filename, lineno, func, true, NO_FRAME_ID, fmt, args);
   va_end(args);
 }
 void cloudlog_te(int levelnum, const char* filename, int lineno, const char* func,
                  uint32_t frame_id, const char* fmt, ...) {
+  if (!LOG_TIMESTAMPS) return;
   va_list args;
   va_start(args, fmt);
-  cloudlog_t_common(levelnum, filename, lineno, func, frame_id, fmt, args);
+  cloudlog_common(levelnum, filename, lineno, func, true, frame_id, fmt, args);
   va_end(args);
 }
+
+void swaglog_hold_flush(bool hold) {
+  swaglog_state().holdFlush(hold);
+}
@@ -24,6 +24,9 @@ void cloudlog_te(int levelnum, const char* filename, int lineno, const char* fun
 void cloudlog_te(int levelnum, const char* filename, int lineno, const char* func,
                  uint32_t frame_id, const char* fmt, ...) SWAG_LOG_CHECK_FMT(6, 7);
 
+// for the tests: the queued records are not sent until it is called with false
+void swaglog_hold_flush(bool hold);
+
 
 #define cloudlog(lvl, fmt, ...) cloudlog_e(lvl, __FILE__, __LINE__, \
                                            __func__, \
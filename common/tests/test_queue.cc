@@ -0,0 +1,52 @@
+#include <thread>
+
+#include "catch2/catch.hpp"
+#include "common/queue.h"
+
+TEST_CASE("SPSCQueue") {
+  SPSCQueue<int> q(5);
+  REQUIRE(q.capacity() == 8);
+
+  SECTION("push and pop") {
+    int v = 0;
+    REQUIRE(!q.try_pop(v));
+    for (int i = 0; i < 8; ++i) {
+      REQUIRE(q.try_push(i));
+    }
+    REQUIRE(!q.try_push(8));
+    REQUIRE(q.size() == 8);
+    for (int i = 0; i < 8; ++i) {
+      REQUIRE(q.try_pop(v));
+      REQUIRE(v == i);
+    }
+    REQUIRE(!q.try_pop(v));
+  }
+
+  SECTION("consume_all") {
+    for (int i = 0; i < 5; ++i) q.try_push(i);
+    std::vector<int> items;
+    REQUIRE(q.consume_all([&](int v) { items.push_back(v); }) == 5);
+    REQUIRE(items == std::vector<int>{0, 1, 2, 3, 4});
+    REQUIRE(q.size() == 0);
+  }
+
+  SECTION("concurrent producer and consumer") {
+    const int count = 100000;
+    std::thread producer([&]() {
+      for (int i = 0; i < count; ++i) {
+        while (!q.try_push(i)) std::this_thread::yield();
+      }
+    });
+
+    int expected = 0;
+    bool in_order = true;
+    while (expected < count) {
+      if (q.consume_all([&](int v) { in_order = in_order && v == expected++; }) == 0) {
+        std::this_thread::yield();
+      }
+    }
+    producer.join();
+    REQUIRE(in_order);
+    REQUIRE(q.size() == 0);
+  }
+}
@@ -1,6 +1,10 @@
+#include <sys/wait.h>
 #include <zmq.h>
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "catch2/catch.hpp"
 #include "common/swaglog.h"
@@ -86,3 +90,111 @@ TEST_CASE("swaglog") {
 
   recv_log(thread_cnt, thread_msg_cnt);
 }
+
+// receives the messages logged by the funcs until there are none for a while.
+std::vector<json11::Json> recv_func_log(void *sock, const std::vector<std::string> &funcs, int timeout_ms = 500) {
+  std::vector<json11::Json> msgs;
+  for (auto last = std::chrono::steady_clock::now();
+       std::chrono::steady_clock::now() < last + std::chrono::milliseconds(timeout_ms);) {
+    char buf[4096] = {};
+    if (zmq_recv(sock, buf, sizeof(buf), ZMQ_DONTWAIT) <= 0) continue;
+    last = std::chrono::steady_clock::now();
+    std::string err;
+    auto msg = json11::Json::parse(buf + 1, err);
+    REQUIRE(!msg.is_null());
+    if (std::find(funcs.begin(), funcs.end(), msg["funcname"].string_value()) != funcs.end()) {
+      msgs.push_back(msg);
+    }
+  }
+  return msgs;
+}
+
+void log_count(int msg_cnt) {
+  for (int i = 0; i < msg_cnt; ++i) {
+    LOGD("%d", i);
+  }
+}
+
+TEST_CASE("swaglog dropped messages") {
+  void *zctx = zmq_ctx_new();
+  void *sock = zmq_socket(zctx, ZMQ_PULL);
+  zmq_bind(sock, Path::swaglog_ipc().c_str());
+
+  // with the flush thread held, what doesn't fit in the buffer of the new thread (512 records) is dropped
+  const int buffer_size = 512, msg_cnt = buffer_size + 100;
+  swaglog_hold_flush(true);
+  std::thread t(log_count, msg_cnt);
+  t.join();
+  swaglog_hold_flush(false);
+  // the dropped message warnings come from the flush
+  auto msgs = recv_func_log(sock, {"log_count", "flush"});
+
+  int received = 0, dropped = 0;
+  for (auto &msg : msgs) {
+    if (msg["funcname"].string_value() == "log_count") {
+      REQUIRE(atoi(msg["msg"].string_value().c_str()) == received);
+      ++received;
+    } else {
+      REQUIRE(msg["levelnum"].int_value() == CLOUDLOG_WARNING);
+      int n = 0;
+      REQUIRE(sscanf(msg["msg"].string_value().c_str(), "swaglog: %d messages dropped", &n) == 1);
+      dropped += n;
+    }
+  }
+  REQUIRE(received == buffer_size);
+  REQUIRE(dropped == msg_cnt - buffer_size);
+
+  zmq_close(sock);
+  zmq_ctx_destroy(zctx);
+}
+
+// run in a child process by "swaglog flushes on exit"
+TEST_CASE("swaglog exit child", "[.]") {
+  log_count(400);
+}
+
+void log_crash() {
+  log_count(400);
+  // queued like the other records
+  LOGE("crashing");
+  abort();
+}
+
+// run in a child process by "swaglog flushes on exit"
+TEST_CASE("swaglog crash child", "[.]") {
+  log_crash();
+}
+
+TEST_CASE("swaglog flushes on exit") {
+  void *zctx = zmq_ctx_new();
+  void *sock = zmq_socket(zctx, ZMQ_PULL);
+  zmq_bind(sock, Path::swaglog_ipc().c_str());
+
+  // the child goes down right after logging, with most of the records still queued
+  const bool crash = GENERATE(false, true);
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl("/proc/self/exe", "test_common", crash ? "swaglog crash child" : "swaglog exit child", nullptr);
+    _exit(1);
+  }
+  int status = 0;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  if (crash) {
+    REQUIRE((WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT));
+  } else {
+    REQUIRE((WIFEXITED(status) && WEXITSTATUS(status) == 0));
+  }
+
+  auto msgs = recv_func_log(sock, {"log_count", "log_crash"});
+  REQUIRE(msgs.size() == (crash ? 401 : 400));
+  for (int i = 0; i < 400; ++i) {
+    REQUIRE(atoi(msgs[i]["msg"].string_value().c_str()) == i);
+  }
+  if (crash) {
+    REQUIRE(msgs.back()["levelnum"].int_value() == CLOUDLOG_ERROR);
+    REQUIRE(msgs.back()["msg"].string_value() == "crashing");
+  }
+
+  zmq_close(sock);
+  zmq_ctx_destroy(zctx);
+}
@@ -38,6 +38,8 @@ const float  GPS_POS_STD_RESET_THRESHOLD = 2.0;
 const float  GPS_VEL_STD_RESET_THRESHOLD = 0.5;
 const float  GPS_ORIENTATION_ERROR_RESET_THRESHOLD = 1.0;
 const int    GPS_ORIENTATION_ERROR_RESET_CNT = 3;
+const size_t MAX_PENDING_IMU_SAMPLES = 64;
+const double MAX_PENDING_IMU_SPAN = 0.05; // s, one camera odometry interval
 
 const bool   DEBUG = getenv("DEBUG") != nullptr && std::string(getenv("DEBUG")) != "0";
 
@@ -74,7 +76,16 @@ static VectorXd rotate_std(const MatrixXdr& rot_matrix, const VectorXd& std_in)
   return rotate_cov(rot_matrix, std_in.array().square().matrix().asDiagonal()).diagonal().array().sqrt();
 }
 
-Localizer::Localizer(LocalizerGnssSource gnss_source) {
+LocalizerImuMode parse_imu_mode(const std::string &mode) {
+  if (mode == "batch") return IMU_BATCH;
+  if (mode == "preintegrate") return IMU_PREINTEGRATE;
+  return IMU_EACH_SAMPLE;
+}
+
+Localizer::Localizer(LocalizerGnssSource gnss_source, LocalizerImuMode imu_mode) : imu_mode(imu_mode) {
+  for (auto &pending : this->pending_imu) {
+    pending.meas.reserve(MAX_PENDING_IMU_SAMPLES);
+  }
   this->kf = std::make_unique<LiveKalman>();
   this->reset_kalman();
 
@@ -259,16 +270,16 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
     auto v = log.getGyroUncalibrated().getV();
     auto meas = Vector3d(-v[2], -v[1], -v[0]);
 
-    VectorXd gyro_bias = this->kf->get_x().segment<STATE_GYRO_BIAS_LEN>(STATE_GYRO_BIAS_START);
+    const Vector3d gyro_bias = this->kf->get_x().segment<STATE_GYRO_BIAS_LEN>(STATE_GYRO_BIAS_START);
     float gyro_camodo_yawrate_err = std::abs((meas[2] - gyro_bias[2]) - this->camodo_yawrate_distribution[0]);
     float gyro_camodo_yawrate_err_threshold = YAWRATE_CROSS_ERR_CHECK_FACTOR * this->camodo_yawrate_distribution[1];
     bool gyro_valid = gyro_camodo_yawrate_err < gyro_camodo_yawrate_err_threshold;
 
     if ((meas.norm() < ROTATION_SANITY_CHECK) && gyro_valid) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, { meas });
-      this->observation_values_invalid["gyroscope"] *= DECAY;
+      this->observe_imu(sensor_time, OBSERVATION_PHONE_GYRO, meas);
+      this->observation_values_invalid[INPUT_GYROSCOPE] *= DECAY;
     } else {
-      this->observation_values_invalid["gyroscope"] += 1.0;
+      this->observation_values_invalid[INPUT_GYROSCOPE] += 1.0;
     }
   }
 
@@ -283,11 +294,62 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
 
     auto meas = Vector3d(-v[2], -v[1], -v[0]);
     if (meas.norm() < ACCEL_SANITY_CHECK) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, { meas });
-      this->observation_values_invalid["accelerometer"] *= DECAY;
+      this->observe_imu(sensor_time, OBSERVATION_PHONE_ACCEL, meas);
+      this->observation_values_invalid[INPUT_ACCELEROMETER] *= DECAY;
+    } else {
+      this->observation_values_invalid[INPUT_ACCELEROMETER] += 1.0;
+    }
+  }
+}
+
+void Localizer::observe_imu(double sensor_time, int kind, const Vector3d &meas) {
+  if (this->imu_mode == IMU_EACH_SAMPLE) {
+    this->kf->predict_and_observe_single(sensor_time, kind, meas);
+    return;
+  }
+
+  // the samples are applied together at their mean time, none of them further than half the span from it
+  PendingImu &pending = this->pending_imu[kind == OBSERVATION_PHONE_GYRO ? 0 : 1];
+  if (!pending.meas.empty() && std::abs(sensor_time - pending.first_time) > MAX_PENDING_IMU_SPAN) {
+    this->flush_imu();
+  }
+  if (pending.meas.empty()) {
+    pending.first_time = sensor_time;
+    pending.time_sum = 0.0;
+  }
+  pending.time_sum += sensor_time;
+  pending.meas.push_back(meas);
+  if (pending.meas.size() >= MAX_PENDING_IMU_SAMPLES) {
+    this->flush_imu();
+  }
+}
+
+void Localizer::flush_imu() {
+  // the samples of a kind are applied at their mean time, the kind with the older samples first, so the
+  // filter does not rewind. the rates and accelerations are close to linear over the short span, so their
+  // mean time is where observing them together is closest to observing them one by one
+  double mean_time[2];
+  for (int i : {0, 1}) {
+    const PendingImu &pending = this->pending_imu[i];
+    mean_time[i] = pending.meas.empty() ? NAN : pending.time_sum / pending.meas.size();
+  }
+  const bool gyro_first = this->pending_imu[1].meas.empty() || mean_time[0] <= mean_time[1];
+  for (int i : {gyro_first ? 0 : 1, gyro_first ? 1 : 0}) {
+    PendingImu &pending = this->pending_imu[i];
+    if (pending.meas.empty()) continue;
+
+    if (this->imu_mode == IMU_BATCH) {
+      this->kf->predict_and_observe_batch(mean_time[i], pending.kind, pending.meas);
     } else {
-      this->observation_values_invalid["accelerometer"] += 1.0;
+      // the average of n samples carries the information of all of them, with 1/n of the noise
+      Vector3d mean = Vector3d::Zero();
+      for (const Vector3d &m : pending.meas) {
+        mean += m;
+      }
+      mean /= pending.meas.size();
+      this->kf->predict_and_observe_single(mean_time[i], pending.kind, mean, 1.0 / pending.meas.size());
     }
+    pending.meas.clear();
   }
 }
 
@@ -444,8 +506,9 @@ void Localizer::handle_car_state(double current_time, const cereal::CarState::Re
   this->car_speed = std::abs(log.getVEgo());
   this->standstill = log.getStandstill();
   if (this->standstill) {
-    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, { Vector3d(0.0, 0.0, 0.0) });
-    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ACCEL, { Vector3d(0.0, 0.0, 0.0) });
+    this->flush_imu();
+    this->kf->predict_and_observe_single(current_time, OBSERVATION_NO_ROT, Vector3d::Zero());
+    this->kf->predict_and_observe_single(current_time, OBSERVATION_NO_ACCEL, Vector3d::Zero());
   }
 }
 
@@ -459,7 +522,7 @@ void Localizer::handle_cam_odo(double current_time, const cereal::CameraOdometry
   }
 
   if ((rot_device.norm() > ROTATION_SANITY_CHECK) || (trans_device.norm() > TRANS_SANITY_CHECK)) {
-    this->observation_values_invalid["cameraOdometry"] += 1.0;
+    this->observation_values_invalid[INPUT_CAMERA_ODOMETRY] += 1.0;
     return;
   }
 
@@ -467,12 +530,12 @@ void Localizer::handle_cam_odo(double current_time, const cereal::CameraOdometry
   VectorXd trans_calib_std = floatlist2vector(log.getTransStd());
 
   if ((rot_calib_std.minCoeff() <= MIN_STD_SANITY_CHECK) || (trans_calib_std.minCoeff() <= MIN_STD_SANITY_CHECK)) {
-    this->observation_values_invalid["cameraOdometry"] += 1.0;
+    this->observation_values_invalid[INPUT_CAMERA_ODOMETRY] += 1.0;
     return;
   }
 
   if ((rot_calib_std.norm() > 10 * ROTATION_SANITY_CHECK) || (trans_calib_std.norm() > 10 * TRANS_SANITY_CHECK)) {
-    this->observation_values_invalid["cameraOdometry"] += 1.0;
+    this->observation_values_invalid[INPUT_CAMERA_ODOMETRY] += 1.0;
     return;
   }
 
@@ -488,7 +551,7 @@ void Localizer::handle_cam_odo(double current_time, const cereal::CameraOdometry
     { rot_device }, { rot_device_cov });
   this->kf->predict_and_observe(current_time, OBSERVATION_CAMERA_ODO_TRANSLATION,
     { trans_device }, { trans_device_cov });
-  this->observation_values_invalid["cameraOdometry"] *= DECAY;
+  this->observation_values_invalid[INPUT_CAMERA_ODOMETRY] *= DECAY;
   this->camodo_yawrate_distribution = Vector2d(rot_device[2], rotate_std(this->device_from_calib, rot_calib_std)[2]);
 }
 
@@ -501,7 +564,7 @@ void Localizer::handle_live_calib(double current_time, const cereal::LiveCalibra
   if (log.getRpyCalib().size() > 0) {
     auto live_calib = floatlist2vector(log.getRpyCalib());
     if ((live_calib.minCoeff() < -CALIB_RPY_SANITY_CHECK) || (live_calib.maxCoeff() > CALIB_RPY_SANITY_CHECK)) {
-      this->observation_values_invalid["liveCalibration"] += 1.0;
+      this->observation_values_invalid[INPUT_LIVE_CALIBRATION] += 1.0;
       return;
     }
 
@@ -509,7 +572,7 @@ void Localizer::handle_live_calib(double current_time, const cereal::LiveCalibra
     this->device_from_calib = euler2rot(this->calib);
     this->calib_from_device = this->device_from_calib.transpose();
     this->calibrated = log.getCalStatus() == cereal::LiveCalibrationData::Status::CALIBRATED;
-    this->observation_values_invalid["liveCalibration"] *= DECAY;
+    this->observation_values_invalid[INPUT_LIVE_CALIBRATION] *= DECAY;
   }
 }
 
@@ -573,6 +636,9 @@ void Localizer::reset_kalman(double current_time, const VectorXd &init_orient, c
 }
 
 void Localizer::reset_kalman(double current_time, const VectorXd &init_x, const MatrixXdr &init_P) {
+  for (auto &pending : this->pending_imu) {
+    pending.meas.clear();
+  }
   this->kf->init_state(init_x, init_P, current_time);
   this->last_reset_time = current_time;
   this->reset_tracker += 1.0;
@@ -590,6 +656,11 @@ void Localizer::handle_msg_bytes(const char *data, const size_t size) {
 void Localizer::handle_msg(const cereal::Event::Reader& log) {
   double t = log.getLogMonoTime() * 1e-9;
   this->time_check(t);
+  // the observations that predict to their time see all IMU samples before them. carState only
+  // observes at standstill, handle_car_state flushes then
+  if (log.isCameraOdometry() || log.isGpsLocation() || log.isGpsLocationExternal()) {
+    this->flush_imu();
+  }
   if (log.isAccelerometer()) {
     this->handle_sensor(t, log.getAccelerometer());
   } else if (log.isGyroscope()) {
@@ -612,9 +683,12 @@ void Localizer::handle_msg(const cereal::Event::Reader& log) {
 }
 
 kj::ArrayPtr<capnp::byte> Localizer::get_message_bytes(MessageBuilder& msg_builder, bool inputsOK,
-                                                       bool sensorsOK, bool gpsOK, bool msgValid) {
+                                                       bool sensorsOK, bool gpsOK, bool msgValid, uint64_t log_mono_time) {
   cereal::Event::Builder evt = msg_builder.initEvent();
   evt.setValid(msgValid);
+  if (log_mono_time != 0) {
+    evt.setLogMonoTime(log_mono_time);
+  }
   cereal::LiveLocationKalman::Builder liveLoc = evt.initLiveLocationKalman();
   this->build_live_location(liveLoc);
   liveLoc.setSensorsOK(sensorsOK);
@@ -623,13 +697,26 @@ kj::ArrayPtr<capnp::byte> Localizer::get_message_bytes(MessageBuilder& msg_build
   return msg_builder.toBytes();
 }
 
+kj::ArrayPtr<capnp::byte> Localizer::get_output_bytes(MessageBuilder& msg_builder, uint64_t trigger_time,
+                                                      bool services_valid, bool sensors_ok, bool filter_initialized, uint64_t log_mono_time) {
+  bool inputsOK = services_valid && this->are_inputs_ok();
+  bool gpsOK = this->is_gps_ok();
+
+  // Log time to first fix
+  if (gpsOK && std::isnan(this->ttff) && !std::isnan(this->first_valid_log_time)) {
+    this->ttff = std::max(1e-3, (trigger_time * 1e-9) - this->first_valid_log_time);
+  }
+
+  return this->get_message_bytes(msg_builder, inputsOK, sensors_ok, gpsOK, filter_initialized, log_mono_time);
+}
+
 bool Localizer::is_gps_ok() {
   return (this->kf->get_filter_time() - this->last_gps_msg) < 2.0;
 }
 
-bool Localizer::critical_services_valid(const std::map<std::string, double> &critical_services) {
-  for (auto &kv : critical_services){
-    if (kv.second >= INPUT_INVALID_THRESHOLD){
+bool Localizer::critical_services_valid(const std::array<double, NUM_LOCALIZER_INPUTS> &critical_services) {
+  for (double invalid : critical_services) {
+    if (invalid >= INPUT_INVALID_THRESHOLD) {
       return false;
     }
   }
@@ -696,11 +783,6 @@ int Localizer::locationd_thread() {
 
   uint64_t cnt = 0;
   bool filterInitialized = false;
-  const std::vector<std::string> critical_input_services = {"cameraOdometry", "liveCalibration", "accelerometer", "gyroscope"};
-  for (std::string service : critical_input_services) {
-    this->observation_values_invalid.insert({service, 0.0});
-  }
-
   while (!do_exit) {
     sm.update();
     if (filterInitialized){
@@ -717,20 +799,14 @@ int Localizer::locationd_thread() {
 
     const char* trigger_msg = "cameraOdometry";
     if (sm.updated(trigger_msg)) {
-      bool inputsOK = sm.allValid() && this->are_inputs_ok();
-      bool gpsOK = this->is_gps_ok();
       bool sensorsOK = sm.allAliveAndValid({"accelerometer", "gyroscope"});
 
-      // Log time to first fix
-      if (gpsOK && std::isnan(this->ttff) && !std::isnan(this->first_valid_log_time)) {
-        this->ttff = std::max(1e-3, (sm[trigger_msg].getLogMonoTime() * 1e-9) - this->first_valid_log_time);
-      }
-
       MessageBuilder msg_builder;
-      kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, inputsOK, sensorsOK, gpsOK, filterInitialized);
+      kj::ArrayPtr<capnp::byte> bytes = this->get_output_bytes(msg_builder, sm[trigger_msg].getLogMonoTime(), sm.allValid(),
+                                                               sensorsOK, filterInitialized);
       pm.send("liveLocationKalman", bytes.begin(), bytes.size());
 
-      if (cnt % 1200 == 0 && gpsOK) {  // once a minute
+      if (cnt % 1200 == 0 && this->is_gps_ok()) {  // once a minute
         VectorXd posGeo = this->get_position_geodetic();
         std::string lastGPSPosJSON = util::string_format(
           "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
@@ -741,10 +817,3 @@ int Localizer::locationd_thread() {
   }
   return 0;
 }
-
-int main() {
-  util::set_realtime_priority(5);
-
-  Localizer localizer;
-  return localizer.locationd_thread();
-}
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <eigen3/Eigen/Dense>
+#include <array>
 #include <deque>
 #include <fstream>
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "common/transformations/coordinates.hpp"
@@ -26,9 +28,23 @@ enum LocalizerGnssSource {
   UBLOX, QCOM
 };
 
+// how the IMU samples update the filter: one update each, one update per kind with the samples of up to
+// 50ms before the next other observation, or one update per kind with their average
+enum LocalizerImuMode {
+  IMU_EACH_SAMPLE, IMU_BATCH, IMU_PREINTEGRATE
+};
+
+// "batch" or "preintegrate", anything else is IMU_EACH_SAMPLE
+LocalizerImuMode parse_imu_mode(const std::string &mode);
+
+// the inputs whose invalid values are tracked, all of them are critical
+enum LocalizerInput {
+  INPUT_CAMERA_ODOMETRY, INPUT_LIVE_CALIBRATION, INPUT_ACCELEROMETER, INPUT_GYROSCOPE, NUM_LOCALIZER_INPUTS
+};
+
 class Localizer {
 public:
-  Localizer(LocalizerGnssSource gnss_source = LocalizerGnssSource::UBLOX);
+  Localizer(LocalizerGnssSource gnss_source = LocalizerGnssSource::UBLOX, LocalizerImuMode imu_mode = IMU_EACH_SAMPLE);
 
   int locationd_thread();
 
@@ -39,14 +55,18 @@ public:
   void time_check(double current_time = NAN);
   void update_reset_tracker();
   bool is_gps_ok();
-  bool critical_services_valid(const std::map<std::string, double> &critical_services);
+  bool critical_services_valid(const std::array<double, NUM_LOCALIZER_INPUTS> &critical_services);
   bool is_timestamp_valid(double current_time);
   void determine_gps_mode(double current_time);
   bool are_inputs_ok();
   void observation_timings_invalid_reset();
 
   kj::ArrayPtr<capnp::byte> get_message_bytes(MessageBuilder& msg_builder,
-    bool inputsOK, bool sensorsOK, bool gpsOK, bool msgValid);
+    bool inputsOK, bool sensorsOK, bool gpsOK, bool msgValid, uint64_t log_mono_time = 0);
+  // liveLocationKalman for the cameraOdometry logged at trigger_time. services_valid is whether the subscribed services
+  // are valid, sensors_ok whether the IMU ones are also alive. log_mono_time 0 stamps it with the current time
+  kj::ArrayPtr<capnp::byte> get_output_bytes(MessageBuilder& msg_builder, uint64_t trigger_time,
+    bool services_valid, bool sensors_ok, bool filter_initialized, uint64_t log_mono_time = 0);
   void build_live_location(cereal::LiveLocationKalman::Builder& fix);
 
   Eigen::VectorXd get_position_geodetic();
@@ -63,6 +83,8 @@ public:
   void handle_live_calib(double current_time, const cereal::LiveCalibrationData::Reader& log);
 
   void input_fake_gps_observations(double current_time);
+  void observe_imu(double sensor_time, int kind, const Eigen::Vector3d &meas);
+  void flush_imu();
 
 private:
   std::unique_ptr<LiveKalman> kf;
@@ -87,14 +109,24 @@ private:
   double last_gps_msg = 0;
   LocalizerGnssSource gnss_source;
   bool observation_timings_invalid = false;
-  std::map<std::string, double> observation_values_invalid;
+  std::array<double, NUM_LOCALIZER_INPUTS> observation_values_invalid = {};
   bool standstill = true;
   int32_t orientation_reset_count = 0;
   float gps_std_factor;
   float gps_variance_factor;
   float gps_vertical_variance_factor;
   double gps_time_offset;
-  Eigen::VectorXd camodo_yawrate_distribution = Eigen::Vector2d(0.0, 10.0); // mean, std
+  Eigen::Vector2d camodo_yawrate_distribution = Eigen::Vector2d(0.0, 10.0); // mean, std
+
+  // the IMU samples waiting for the next update in IMU_BATCH and IMU_PREINTEGRATE
+  struct PendingImu {
+    int kind;
+    double first_time;
+    double time_sum;
+    std::vector<Eigen::Vector3d> meas;
+  };
+  LocalizerImuMode imu_mode;
+  PendingImu pending_imu[2] = {{OBSERVATION_PHONE_GYRO, NAN, 0.0, {}}, {OBSERVATION_PHONE_ACCEL, NAN, 0.0, {}}};
 
   void configure_gnss_source(const LocalizerGnssSource &source);
 };
@@ -0,0 +1,8 @@
+#include "selfdrive/locationd/locationd.h"
+
+int main() {
+  util::set_realtime_priority(5);
+
+  Localizer localizer(LocalizerGnssSource::UBLOX, parse_imu_mode(util::getenv("LOCATIOND_IMU_MODE")));
+  return localizer.locationd_thread();
+}
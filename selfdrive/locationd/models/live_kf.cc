@@ -40,6 +40,9 @@ LiveKalman::LiveKalman() {
   for (auto& pair : live_obs_noise_diag) {
     this->obs_noise[pair.first] = pair.second.asDiagonal();
   }
+  for (auto& pair : this->obs_noise) {
+    this->obs_noise_R[pair.first] = {get_mapmat(pair.second)};
+  }
 
   // init filter
   this->filter = std::make_shared<EKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
@@ -48,25 +51,36 @@ LiveKalman::LiveKalman() {
 }
 
 void LiveKalman::init_state(const VectorXd &state, const VectorXd &covs_diag, double filter_time) {
+  this->x_stale = this->P_stale = true;
   MatrixXdr covs = covs_diag.asDiagonal();
   this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
 }
 
 void LiveKalman::init_state(const VectorXd &state, const MatrixXdr &covs, double filter_time) {
+  this->x_stale = this->P_stale = true;
   this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
 }
 
 void LiveKalman::init_state(const VectorXd &state, double filter_time) {
+  this->x_stale = this->P_stale = true;
   MatrixXdr covs = this->filter->covs();
   this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
 }
 
-VectorXd LiveKalman::get_x() {
-  return this->filter->state();
+const LiveState &LiveKalman::get_x() {
+  if (this->x_stale) {
+    this->x = this->filter->state();
+    this->x_stale = false;
+  }
+  return this->x;
 }
 
-MatrixXdr LiveKalman::get_P() {
-  return this->filter->covs();
+const LiveCovs &LiveKalman::get_P() {
+  if (this->P_stale) {
+    this->P = this->filter->covs();
+    this->P_stale = false;
+  }
+  return this->P;
 }
 
 double LiveKalman::get_filter_time() {
@@ -82,6 +96,7 @@ std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
 }
 
 std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, const std::vector<VectorXd> &meas, std::vector<MatrixXdr> R) {
+  this->x_stale = this->P_stale = true;
   std::optional<Estimate> r;
   if (R.size() == 0) {
     R = this->get_R(kind, meas.size());
@@ -90,7 +105,30 @@ std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, cons
   return r;
 }
 
+std::optional<Estimate> LiveKalman::predict_and_observe_single(double t, int kind, const Vector3d &meas, double noise_scale) {
+  this->x_stale = this->P_stale = true;
+  // the measurement and the noise are mapped in place, not copied into vectors of dynamic matrices
+  std::vector<Eigen::Map<VectorXd>> z = {Eigen::Map<VectorXd>((double*)meas.data(), meas.size())};
+  if (noise_scale != 1.0) {
+    MatrixXdr R = this->obs_noise.at(kind) * noise_scale;
+    return this->filter->predict_and_update_batch(t, kind, std::move(z), {get_mapmat(R)});
+  }
+  return this->filter->predict_and_update_batch(t, kind, std::move(z), this->obs_noise_R.at(kind));
+}
+
+std::optional<Estimate> LiveKalman::predict_and_observe_batch(double t, int kind, const std::vector<Vector3d> &meas) {
+  this->x_stale = this->P_stale = true;
+  std::vector<Eigen::Map<VectorXd>> z;
+  z.reserve(meas.size());
+  for (const Vector3d &m : meas) {
+    z.emplace_back((double*)m.data(), m.size());
+  }
+  std::vector<Eigen::Map<MatrixXdr>> R(meas.size(), this->obs_noise_R.at(kind)[0]);
+  return this->filter->predict_and_update_batch(t, kind, std::move(z), std::move(R));
+}
+
 void LiveKalman::predict(double t) {
+  this->x_stale = this->P_stale = true;
   this->filter->predict(t);
 }
 
@@ -16,6 +16,9 @@
 
 using namespace EKFS;
 
+typedef Eigen::Matrix<double, LIVE_DIM_STATE, 1> LiveState;
+typedef Eigen::Matrix<double, LIVE_DIM_STATE_ERR, LIVE_DIM_STATE_ERR, Eigen::RowMajor> LiveCovs;
+
 Eigen::Map<Eigen::VectorXd> get_mapvec(const Eigen::VectorXd &vec);
 Eigen::Map<MatrixXdr> get_mapmat(const MatrixXdr &mat);
 std::vector<Eigen::Map<Eigen::VectorXd>> get_vec_mapvec(const std::vector<Eigen::VectorXd> &vec_vec);
@@ -29,12 +32,17 @@ public:
   void init_state(const Eigen::VectorXd &state, const MatrixXdr &covs, double filter_time);
   void init_state(const Eigen::VectorXd &state, double filter_time);
 
-  Eigen::VectorXd get_x();
-  MatrixXdr get_P();
+  // copies of the filter state, refreshed on the first use after the filter changed
+  const LiveState &get_x();
+  const LiveCovs &get_P();
   double get_filter_time();
   std::vector<MatrixXdr> get_R(int kind, int n);
 
   std::optional<Estimate> predict_and_observe(double t, int kind, const std::vector<Eigen::VectorXd> &meas, std::vector<MatrixXdr> R = {});
+  // a single measurement with the noise of its kind times noise_scale, for the sensor hot path
+  std::optional<Estimate> predict_and_observe_single(double t, int kind, const Eigen::Vector3d &meas, double noise_scale = 1.0);
+  // several measurements of one kind in one update at time t, each with the noise of its kind
+  std::optional<Estimate> predict_and_observe_batch(double t, int kind, const std::vector<Eigen::Vector3d> &meas);
   std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
@@ -63,4 +71,10 @@ private:
   MatrixXdr reset_orientation_P;
   MatrixXdr Q;  // process noise
   std::unordered_map<int, MatrixXdr> obs_noise;
+  std::unordered_map<int, std::vector<Eigen::Map<MatrixXdr>>> obs_noise_R;  // obs_noise mapped for a single measurement
+
+  LiveState x;
+  LiveCovs P;
+  bool x_stale = true;
+  bool P_stale = true;
 };
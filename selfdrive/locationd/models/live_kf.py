@@ -217,6 +217,8 @@ class LiveKalman:
       live_kf_header += f'#define STATE_{state}_START {slc.start}\n'
       live_kf_header += f'#define STATE_{state}_END {slc.stop}\n'
       live_kf_header += f'#define STATE_{state}_LEN {slc.stop - slc.start}\n'
+    live_kf_header += f'#define LIVE_DIM_STATE {dim_state}\n'
+    live_kf_header += f'#define LIVE_DIM_STATE_ERR {dim_state_err}\n'
     live_kf_header += "\n"
 
     for kind, val in inspect.getmembers(ObservationKind, lambda x: isinstance(x, int)):
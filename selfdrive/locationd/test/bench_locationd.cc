@@ -0,0 +1,152 @@
+// Replays the messages locationd subscribes to from a log through the Localizer, and measures the
+// time and heap allocations of each message type.
+//
+// usage: bench_locationd RLOG [-n PASSES] [-m MODE]
+//   RLOG:    a decompressed rlog (bunzip2 -k rlog.bz2)
+//   MODE:    how IMU samples are observed, each, batch or preintegrate. other than each, the output
+//            is compared with observing each sample
+//   default: 3 passes over the log, each with a new Localizer, observing each sample
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "common/alloc_counter.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/locationd/locationd.h"
+
+struct Stats {
+  std::vector<double> us;
+  uint64_t allocations = 0;
+};
+
+// the state after each cameraOdometry, when locationd publishes
+typedef std::vector<Eigen::VectorXd> Outputs;
+
+void run(const std::vector<kj::ArrayPtr<const capnp::word>> &events, const std::map<cereal::Event::Which, const char *> &services,
+         LocalizerImuMode mode, std::map<std::string, Stats> *stats, Outputs *outputs) {
+  Localizer localizer(LocalizerGnssSource::UBLOX, mode);
+  for (auto &data : events) {
+    capnp::FlatArrayMessageReader reader(data);
+    const cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+
+    Stats &s = (*stats)[services.at(event.which())];
+    const uint64_t allocs = thread_allocations();
+    const uint64_t t = nanos_since_boot();
+    localizer.handle_msg(event);
+    s.us.push_back((nanos_since_boot() - t) / 1e3);
+    s.allocations += thread_allocations() - allocs;
+
+    if (event.which() == cereal::Event::CAMERA_ODOMETRY) {
+      Stats &out = (*stats)["liveLocationKalman"];
+      const uint64_t out_allocs = thread_allocations();
+      const uint64_t out_t = nanos_since_boot();
+      MessageBuilder msg_builder;
+      localizer.get_message_bytes(msg_builder, localizer.are_inputs_ok(), true, localizer.is_gps_ok(), true);
+      out.us.push_back((nanos_since_boot() - out_t) / 1e3);
+      out.allocations += thread_allocations() - out_allocs;
+      if (outputs) outputs->push_back(localizer.get_state());
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int passes = 3;
+  std::string mode = "each";
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) passes = std::atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-m") == 0) mode = argv[++i];
+    else args.push_back(argv[i]);
+  }
+  if (args.size() != 1 || passes < 1) {
+    printf("usage: %s RLOG [-n PASSES] [-m each|batch|preintegrate]\n", argv[0]);
+    return 1;
+  }
+
+  const std::string log = util::read_file(args[0]);
+  const std::map<cereal::Event::Which, const char *> services = {
+    {cereal::Event::ACCELEROMETER, "accelerometer"},
+    {cereal::Event::GYROSCOPE, "gyroscope"},
+    {cereal::Event::GPS_LOCATION, "gpsLocation"},
+    {cereal::Event::GPS_LOCATION_EXTERNAL, "gpsLocationExternal"},
+    {cereal::Event::CAR_STATE, "carState"},
+    {cereal::Event::CAMERA_ODOMETRY, "cameraOdometry"},
+    {cereal::Event::LIVE_CALIBRATION, "liveCalibration"},
+  };
+
+  // the messages locationd handles, in log order
+  std::vector<kj::ArrayPtr<const capnp::word>> events;
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)log.data(), log.size() / sizeof(capnp::word));
+  try {
+    while (words.size() > 0) {
+      capnp::FlatArrayMessageReader reader(words);
+      if (services.count(reader.getRoot<cereal::Event>().which())) {
+        events.push_back(kj::arrayPtr(words.begin(), reader.getEnd()));
+      }
+      words = kj::arrayPtr(reader.getEnd(), words.end());
+    }
+  } catch (const kj::Exception &e) {
+    printf("stopped reading %s at a corrupt event\n", args[0].c_str());
+  }
+  if (events.empty()) {
+    printf("no locationd inputs in %s\n", args[0].c_str());
+    return 1;
+  }
+
+  const LocalizerImuMode imu_mode = parse_imu_mode(mode);
+  std::map<std::string, Stats> stats;
+  Outputs outputs;
+  for (int pass = 0; pass < passes; ++pass) {
+    run(events, services, imu_mode, &stats, pass == 0 ? &outputs : nullptr);
+  }
+  printf("%zu messages, %d passes, IMU mode %s\n", events.size(), passes, imu_mode == IMU_BATCH ? "batch" :
+         imu_mode == IMU_PREINTEGRATE ? "preintegrate" : "each");
+  printf("  %-20s %8s %10s %10s %10s %12s\n", "", "count", "mean us", "p50 us", "p99 us", "allocs/msg");
+  double total_us = 0;
+  uint64_t total_allocations = 0;
+  for (auto &[name, s] : stats) {
+    std::sort(s.us.begin(), s.us.end());
+    const double sum = std::accumulate(s.us.begin(), s.us.end(), 0.0);
+    printf("  %-20s %8zu %10.2f %10.2f %10.2f %12.1f\n", name.c_str(), s.us.size() / passes, sum / s.us.size(),
+           s.us[s.us.size() / 2], s.us[std::min(s.us.size() - 1, s.us.size() * 99 / 100)], (double)s.allocations / s.us.size());
+    total_us += sum;
+    total_allocations += s.allocations;
+  }
+  printf("  total: %.2f ms and %.0f allocations per pass\n", total_us / 1e3 / passes, (double)total_allocations / passes);
+
+  if (imu_mode != IMU_EACH_SAMPLE) {
+    std::map<std::string, Stats> each_stats;
+    Outputs each_outputs;
+    run(events, services, IMU_EACH_SAMPLE, &each_stats, &each_outputs);
+
+    // the largest difference to observing each sample, over all published states
+    const std::tuple<const char *, int, int> groups[] = {
+      {"position m", STATE_ECEF_POS_START, STATE_ECEF_POS_LEN},
+      {"orientation quat", STATE_ECEF_ORIENTATION_START, STATE_ECEF_ORIENTATION_LEN},
+      {"velocity m/s", STATE_ECEF_VELOCITY_START, STATE_ECEF_VELOCITY_LEN},
+      {"angular velocity rad/s", STATE_ANGULAR_VELOCITY_START, STATE_ANGULAR_VELOCITY_LEN},
+      {"acceleration m/s^2", STATE_ACCELERATION_START, STATE_ACCELERATION_LEN},
+    };
+    printf("  max difference to each:\n");
+    for (auto &[name, start, len] : groups) {
+      double diff = 0;
+      for (size_t i = 0; i < std::min(outputs.size(), each_outputs.size()); ++i) {
+        diff = std::max(diff, (outputs[i].segment(start, len) - each_outputs[i].segment(start, len)).cwiseAbs().maxCoeff());
+      }
+      printf("    %-24s %12.6f\n", name, diff);
+    }
+    const double each_us = std::accumulate(each_stats.begin(), each_stats.end(), 0.0, [](double sum, auto &kv) {
+      return sum + std::accumulate(kv.second.us.begin(), kv.second.us.end(), 0.0);
+    });
+    printf("  each: %.2f ms per pass\n", each_us / 1e3);
+  }
+  return 0;
+}
@@ -221,3 +221,23 @@ class TestLocationdScenarios:
     orig_data, replayed_data = run_scenarios(Scenario.ACCEL_SPIKE_MIDWAY, self.logs)
     assert np.allclose(orig_data['yaw_rate'], replayed_data['yaw_rate'], atol=np.radians(0.2))
     assert np.allclose(orig_data['roll'], replayed_data['roll'], atol=np.radians(0.5))
+
+  @pytest.mark.parametrize("imu_mode", ["batch", "preintegrate"])
+  def test_imu_modes(self, imu_mode, monkeypatch):
+    """
+    Test: the first 20s of the segment, with the IMU samples observed together (LOCATIOND_IMU_MODE)
+    Expected Result:
+      - yaw_rate, roll: within a small tolerance of observing each sample
+      - gpsOK, inputsOK, sensorsOK: the same
+    """
+    start = min(x.logMonoTime for x in self.logs)
+    logs = [x for x in self.logs if x.logMonoTime < start + 20e9]
+    each_data = get_select_fields_data(replay_process_with_name(name='locationd', lr=logs))
+    monkeypatch.setenv("LOCATIOND_IMU_MODE", imu_mode)
+    mode_data = get_select_fields_data(replay_process_with_name(name='locationd', lr=logs))
+
+    assert len(mode_data['yaw_rate']) == len(each_data['yaw_rate']) > 0
+    assert np.allclose(each_data['yaw_rate'], mode_data['yaw_rate'], atol=np.radians(0.05))
+    assert np.allclose(each_data['roll'], mode_data['roll'], atol=np.radians(0.1))
+    for flag in ('gps_flag', 'inputs_flag', 'sensors_flag'):
+      assert np.array_equal(each_data[flag], mode_data[flag])
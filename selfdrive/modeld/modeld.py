@@ -5,6 +5,7 @@ import pickle
 import numpy as np
 import cereal.messaging as messaging
 from cereal import car, log
+from cereal.messaging import msgtrace
 from pathlib import Path
 from openpilot.common.threadname import setthreadname
 from cereal.messaging import PubMaster, SubMaster
@@ -52,7 +53,7 @@ class ModelState:
 
   def __init__(self, context: CLContext):
     self.frame = ModelFrame(context)
-    self.wide_frame = ModelFrame(context)
+    self.wide_frame = ModelFrame(context, self.frame)
     self.prev_desire = np.zeros(ModelConstants.DESIRE_LEN, dtype=np.float32)
     self.inputs = {
       'desire': np.zeros(ModelConstants.DESIRE_LEN * (ModelConstants.HISTORY_BUFFER_LEN+1), dtype=np.float32),
@@ -93,10 +94,13 @@ class ModelState:
     self.inputs['traffic_convention'][:] = inputs['traffic_convention']
     self.inputs['lateral_control_params'][:] = inputs['lateral_control_params']
 
-    # if getCLBuffer is not None, frame will be None
-    self.model.setInputBuffer("input_imgs", self.frame.prepare(buf, transform.flatten(), self.model.getCLBuffer("input_imgs")))
+    # both frames are queued in one batch and waited for once. if getCLBuffer is not None, frame will be None
+    self.frame.queue(buf, transform.flatten(), self.model.getCLBuffer("input_imgs"))
     if wbuf is not None:
-      self.model.setInputBuffer("big_input_imgs", self.wide_frame.prepare(wbuf, transform_wide.flatten(), self.model.getCLBuffer("big_input_imgs")))
+      self.wide_frame.queue(wbuf, transform_wide.flatten(), self.model.getCLBuffer("big_input_imgs"))
+    self.model.setInputBuffer("input_imgs", self.frame.finish())
+    if wbuf is not None:
+      self.model.setInputBuffer("big_input_imgs", self.wide_frame.finish())
 
     if prepare_only:
       return None
@@ -188,6 +192,7 @@ def main(demo=False):
       meta_main = FrameMeta(vipc_client_main)
       if buf_main is None:
         break
+      msgtrace.vipc_receive("wideRoadCamera" if main_wide_camera else "roadCamera", meta_main.frame_id, meta_main.timestamp_sof)
 
     if buf_main is None:
       cloudlog.debug("vipc_client_main no frame")
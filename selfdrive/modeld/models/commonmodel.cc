@@ -2,14 +2,18 @@
 
 #include <cassert>
 #include <cmath>
-#include <cstring>
 
 #include "common/clutil.h"
 
-ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
-  input_frames = std::make_unique<float[]>(buf_size);
+ModelFrame::ModelFrame(cl_device_id device_id, cl_context context, ModelFrame *batch) {
+  input_frames = std::make_unique<float[]>(MODEL_FRAME_SIZE * 3);
 
-  q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  if (batch) {
+    q = batch->q;
+    CL_CHECK(clRetainCommandQueue(q));
+  } else {
+    q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  }
   y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
   u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
   v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
@@ -20,6 +24,11 @@ ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
 }
 
 float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3 &projection, cl_mem *output) {
+  queue(yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset, projection, output);
+  return finish();
+}
+
+void ModelFrame::queue(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3 &projection, cl_mem *output) {
   transform_queue(&this->transform, q,
                   yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
                   y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
@@ -27,16 +36,28 @@ float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int
   if (output == NULL) {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, net_input_cl);
 
-    std::memmove(&input_frames[0], &input_frames[MODEL_FRAME_SIZE], sizeof(float) * MODEL_FRAME_SIZE);
-    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr));
-    clFinish(q);
-    return &input_frames[0];
+    const size_t frame_bytes = MODEL_FRAME_SIZE * sizeof(float);
+    if (frame_count % 2 == 0) {
+      CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_FALSE, 0, frame_bytes, &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr));
+      input = &input_frames[0];
+    } else {
+      CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_FALSE, 0, frame_bytes, &input_frames[MODEL_FRAME_SIZE * 2], 0, nullptr, nullptr));
+      CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_FALSE, 0, frame_bytes, &input_frames[0], 0, nullptr, nullptr));
+      input = &input_frames[MODEL_FRAME_SIZE];
+    }
+    frame_count++;
   } else {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, *output, true);
-    // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
-    clFinish(q);
-    return NULL;
+    input = NULL;
   }
+  // start the batch on the device while the next camera is queued
+  CL_CHECK(clFlush(q));
+}
+
+float* ModelFrame::finish() {
+  // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
+  CL_CHECK(clFinish(q));
+  return input;
 }
 
 ModelFrame::~ModelFrame() {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cfloat>
+#include <cstdint>
 #include <cstdlib>
 
 #include <memory>
@@ -18,11 +19,19 @@
 
 float sigmoid(float input);
 
+// Prepares the model input of one camera: the last two frames, transformed and in the layout of the model.
+// ModelFrames created with the same batch share a command queue, so the inputs of several cameras
+// can be queued back to back and waited for once with finish().
 class ModelFrame {
 public:
-  ModelFrame(cl_device_id device_id, cl_context context);
+  ModelFrame(cl_device_id device_id, cl_context context, ModelFrame *batch = nullptr);
   ~ModelFrame();
   float* prepare(cl_mem yuv_cl, int width, int height, int frame_stride, int frame_uv_offset, const mat3& transform, cl_mem *output);
+  // queues the transform of a new frame without waiting for it. with an output buffer (on the device), the history
+  // is kept there, otherwise the frame is read back to the host ring
+  void queue(cl_mem yuv_cl, int width, int height, int frame_stride, int frame_uv_offset, const mat3& transform, cl_mem *output);
+  // waits for everything queued in the batch, returns the host input of the last queue() or NULL if it had an output buffer
+  float* finish();
 
   const int MODEL_WIDTH = 512;
   const int MODEL_HEIGHT = 256;
@@ -34,5 +43,9 @@ private:
   LoadYUVState loadyuv;
   cl_command_queue q;
   cl_mem y_cl, u_cl, v_cl, net_input_cl;
+  // three frames, the input is the window [0, 2) after even frames and [1, 3) after odd ones.
+  // odd frames are read to both 2 and 0, so the history never has to be moved
   std::unique_ptr<float[]> input_frames;
+  float *input = nullptr;
+  uint64_t frame_count = 0;
 };
@@ -16,5 +16,7 @@ cdef extern from "selfdrive/modeld/models/commonmodel.h":
 
   cppclass ModelFrame:
     int buf_size
-    ModelFrame(cl_device_id, cl_context)
+    ModelFrame(cl_device_id, cl_context, ModelFrame*)
     float * prepare(cl_mem, int, int, int, int, mat3, cl_mem*)
+    void queue(cl_mem, int, int, int, int, mat3, cl_mem*)
+    float * finish()
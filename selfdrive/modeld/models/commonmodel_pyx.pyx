@@ -28,20 +28,26 @@ cdef class CLMem:
 cdef class ModelFrame:
   cdef cppModelFrame * frame
 
-  def __cinit__(self, CLContext context):
-    self.frame = new cppModelFrame(context.device_id, context.context)
+  def __cinit__(self, CLContext context, ModelFrame batch=None):
+    self.frame = new cppModelFrame(context.device_id, context.context, batch.frame if batch is not None else NULL)
 
   def __dealloc__(self):
     del self.frame
 
   def prepare(self, VisionBuf buf, float[:] projection, CLMem output):
+    self.queue(buf, projection, output)
+    return self.finish()
+
+  def queue(self, VisionBuf buf, float[:] projection, CLMem output):
     cdef mat3 cprojection
     memcpy(cprojection.v, &projection[0], 9*sizeof(float))
-    cdef float * data
     if output is None:
-      data = self.frame.prepare(buf.buf.buf_cl, buf.width, buf.height, buf.stride, buf.uv_offset, cprojection, NULL)
+      self.frame.queue(buf.buf.buf_cl, buf.width, buf.height, buf.stride, buf.uv_offset, cprojection, NULL)
     else:
-      data = self.frame.prepare(buf.buf.buf_cl, buf.width, buf.height, buf.stride, buf.uv_offset, cprojection, output.mem)
+      self.frame.queue(buf.buf.buf_cl, buf.width, buf.height, buf.stride, buf.uv_offset, cprojection, output.mem)
+
+  def finish(self):
+    cdef float * data = self.frame.finish()
     if not data:
       return None
     return np.asarray(<cnp.float32_t[:self.frame.buf_size]> data)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <cassert>
@@ -32,6 +33,8 @@ public:
   virtual ~RunModel() {}
   virtual void execute() {}
   virtual void* getCLBuffer(const std::string name) { return nullptr; }
+  // the time in ms of each layer of a run, when the backend can run them one at a time
+  virtual std::vector<std::pair<std::string, double>> layerTimes() { return {}; }
 
   virtual void addInput(const std::string name, float *buffer, int size) {
     inputs.push_back(std::unique_ptr<ModelInput>(new ModelInput(name, buffer, size)));
@@ -10,6 +10,7 @@ public:
   ThneedModel(const std::string path, float *_output, size_t _output_size, int runtime, bool use_tf8 = false, cl_context context = NULL);
   void *getCLBuffer(const std::string name);
   void execute();
+  std::vector<std::pair<std::string, double>> layerTimes() { return thneed->time_kernels(); }
 private:
   Thneed *thneed = NULL;
   bool recorded;
@@ -0,0 +1,160 @@
+// Benchmarks a model with any RunModel backend: load and warm up cost, execute latency and memory,
+// and the time of each kernel when the backend can tell (thneed).
+//
+// usage: bench_runmodel MODEL OUTPUT_SIZE INPUT... [-n RUNS] [-w WARMUP] [-k KERNELS]
+//   MODEL:   .thneed or .dlc
+//   INPUT:   name:size for random inputs, name=file.raw for a recorded float32 input, or name:size=file.raw
+//            for a file with several frames of it, they are fed in turn. add the inputs in the order modeld does
+//   default: 200 runs after 10 warm up runs, show the 20 slowest kernels
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/modeld/runners/snpemodel.h"
+#include "selfdrive/modeld/runners/thneedmodel.h"
+
+struct Input {
+  std::string name;
+  int size;
+  std::vector<float> frames;  // one or more frames of size floats
+};
+
+// max resident set size in MB
+double max_rss() {
+  struct rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+// name:size, name=file.raw or name:size=file.raw
+std::optional<Input> parse_input(const std::string &arg, std::mt19937 &gen) {
+  Input input;
+  const size_t eq = arg.find('=');
+  const std::string spec = arg.substr(0, eq);
+  const size_t colon = spec.find(':');
+  input.name = spec.substr(0, colon);
+  input.size = colon != std::string::npos ? std::atoi(spec.substr(colon + 1).c_str()) : 0;
+
+  if (eq != std::string::npos) {
+    std::string data = util::read_file(arg.substr(eq + 1));
+    input.frames.resize(data.size() / sizeof(float));
+    memcpy(input.frames.data(), data.data(), input.frames.size() * sizeof(float));
+    if (input.size == 0) input.size = input.frames.size();
+  } else {
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    input.frames.resize(std::max(input.size, 0));
+    for (float &v : input.frames) v = dist(gen);
+  }
+  if (input.name.empty() || input.size <= 0 || input.frames.empty() || input.frames.size() % input.size != 0) return std::nullopt;
+  return input;
+}
+
+double percentile(std::vector<double> sorted, double p) {
+  return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 200, warmup = 10, show_kernels = 20;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) runs = std::atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-w") == 0) warmup = std::atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-k") == 0) show_kernels = std::atoi(argv[++i]);
+    else args.push_back(argv[i]);
+  }
+  if (args.size() < 3 || runs < 1) {
+    printf("usage: %s MODEL OUTPUT_SIZE INPUT... [-n RUNS] [-w WARMUP] [-k KERNELS]\n", argv[0]);
+    return 1;
+  }
+  const std::string path = args[0];
+  std::vector<float> output(std::atoi(args[1].c_str()));
+
+  std::mt19937 gen(0);
+  std::vector<Input> inputs;
+  for (int i = 2; i < args.size(); ++i) {
+    auto input = parse_input(args[i], gen);
+    if (!input) {
+      printf("bad input %s\n", args[i].c_str());
+      return 1;
+    }
+    inputs.push_back(std::move(*input));
+  }
+
+  const double rss_start = max_rss();
+  double t = millis_since_boot();
+  std::unique_ptr<RunModel> model;
+  if (util::ends_with(path, ".thneed")) {
+    model = std::make_unique<ThneedModel>(path, output.data(), output.size(), USE_GPU_RUNTIME);
+  } else if (util::ends_with(path, ".dlc")) {
+    model = std::make_unique<SNPEModel>(path, output.data(), output.size(), USE_GPU_RUNTIME);
+  } else {
+    printf("unknown model type %s\n", path.c_str());
+    return 1;
+  }
+  for (auto &input : inputs) {
+    model->addInput(input.name, input.frames.data(), input.size);
+  }
+  const double load_ms = millis_since_boot() - t;
+  const double rss_loaded = max_rss();
+
+  auto feed = [&](int run) {
+    for (auto &input : inputs) {
+      const int frames = input.frames.size() / input.size;
+      model->setInputBuffer(input.name, &input.frames[(run % frames) * input.size], input.size);
+    }
+  };
+
+  // the first run records (thneed) or sets up the runtime
+  std::vector<double> warmup_ms;
+  for (int i = 0; i < std::max(warmup, 1); ++i) {
+    feed(i);
+    t = millis_since_boot();
+    model->execute();
+    warmup_ms.push_back(millis_since_boot() - t);
+  }
+
+  std::vector<double> latency;
+  for (int i = 0; i < runs; ++i) {
+    feed(i);
+    t = millis_since_boot();
+    model->execute();
+    latency.push_back(millis_since_boot() - t);
+  }
+  std::sort(latency.begin(), latency.end());
+
+  printf("%s\n", path.c_str());
+  printf("  load:     %8.2f ms\n", load_ms);
+  printf("  warm up:  %8.2f ms first run, %.2f ms for %zu runs\n", warmup_ms[0],
+         std::accumulate(warmup_ms.begin(), warmup_ms.end(), 0.0), warmup_ms.size());
+  printf("  execute:  %8.2f ms p50, %.2f ms p99, %.2f ms max, %.2f ms mean over %d runs\n",
+         percentile(latency, 0.5), percentile(latency, 0.99), latency.back(),
+         std::accumulate(latency.begin(), latency.end(), 0.0) / latency.size(), runs);
+  printf("  memory:   %8.1f MB max RSS, %.1f MB for the model, %.1f MB more after running\n",
+         max_rss(), rss_loaded - rss_start, max_rss() - rss_loaded);
+
+  auto kernels = model->layerTimes();
+  if (!kernels.empty()) {
+    const double total = std::accumulate(kernels.begin(), kernels.end(), 0.0, [](double s, auto &k) { return s + k.second; });
+    printf("  kernels:  %zu, %.2f ms one at a time\n", kernels.size(), total);
+    std::vector<int> order(kernels.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return kernels[a].second > kernels[b].second; });
+    for (int i = 0; i < std::min<int>(show_kernels, order.size()); ++i) {
+      auto &[name, ms] = kernels[order[i]];
+      printf("    %4d %-64s %8.3f ms %5.1f%%\n", order[i], name.c_str(), ms, 100.0 * ms / total);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cassert>
+#include <random>
+#include <vector>
+
+#include "common/clutil.h"
+#include "selfdrive/modeld/transforms/loadyuv.h"
+#include "selfdrive/modeld/transforms/transform.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+// compares transform_cpu and loadyuv_cpu with transform.cl and loadyuv.cl on a random frame
+
+const int IN_WIDTH = 1928, IN_HEIGHT = 1208, IN_STRIDE = 2048, IN_UV_OFFSET = IN_STRIDE * 1216;
+const int MODEL_WIDTH = 512, MODEL_HEIGHT = 256;
+const int Y_SIZE = MODEL_WIDTH * MODEL_HEIGHT, UV_SIZE = Y_SIZE / 4, FRAME_SIZE = Y_SIZE * 3 / 2;
+
+template <class T>
+std::vector<T> read_buffer(cl_command_queue q, cl_mem mem, size_t size) {
+  std::vector<T> out(size);
+  CL_CHECK(clEnqueueReadBuffer(q, mem, CL_TRUE, 0, size * sizeof(T), out.data(), 0, NULL, NULL));
+  return out;
+}
+
+TEST_CASE("transform_cpu and loadyuv_cpu match the kernels") {
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = cl_create_context(device_id);
+  const cl_queue_properties props[] = {0};
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
+
+  // noise and gradients
+  std::vector<uint8_t> yuv(IN_UV_OFFSET + IN_STRIDE * IN_HEIGHT / 2);
+  std::mt19937 gen(0);
+  for (size_t i = 0; i < yuv.size(); ++i) {
+    yuv[i] = (i / 5000) % 2 ? gen() : (i * 3 / 7) & 0xff;
+  }
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, yuv.size(), yuv.data(), &err));
+  cl_mem y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, Y_SIZE, NULL, &err));
+  cl_mem u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, UV_SIZE, NULL, &err));
+  cl_mem v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, UV_SIZE, NULL, &err));
+  cl_mem out_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, FRAME_SIZE * sizeof(float), NULL, &err));
+
+  // force the kernels, even on a CPU device
+  Transform transform;
+  transform_init(&transform, context, device_id);
+  transform.on_cpu = false;
+  LoadYUVState loadyuv;
+  loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
+  loadyuv.on_cpu = false;
+
+  const mat3 projections[] = {
+    {{1.5f, 0.01f, 300.0f, 0.02f, 1.4f, 200.0f, 0.00001f, 0.00002f, 1.0f}},  // like the road camera
+    {{2.0f, 0.0f, -500.0f, 0.0f, 2.0f, -300.0f, 0.0f, 0.0f, 1.0f}},          // partly outside of the frame
+    {{0.3f, 0.1f, 10.0f, -0.05f, 0.9f, 50.0f, 0.0003f, 0.0001f, 0.7f}},
+    {{1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}},                // W is 0
+  };
+  for (const mat3 &projection : projections) {
+    transform_queue(&transform, q, yuv_cl, IN_WIDTH, IN_HEIGHT, IN_STRIDE, IN_UV_OFFSET,
+                    y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
+    const auto y = read_buffer<uint8_t>(q, y_cl, Y_SIZE);
+    const auto u = read_buffer<uint8_t>(q, u_cl, UV_SIZE);
+    const auto v = read_buffer<uint8_t>(q, v_cl, UV_SIZE);
+
+    std::vector<uint8_t> cpu_y(Y_SIZE), cpu_u(UV_SIZE), cpu_v(UV_SIZE);
+    transform_cpu(yuv.data(), IN_WIDTH, IN_HEIGHT, IN_STRIDE, IN_UV_OFFSET,
+                  cpu_y.data(), cpu_u.data(), cpu_v.data(), MODEL_WIDTH, MODEL_HEIGHT, projection);
+
+    // the device may fuse the multiply-adds of the coordinates, allow those to round differently
+    size_t diffs = 0;
+    for (int i = 0; i < Y_SIZE; ++i) diffs += cpu_y[i] != y[i];
+    for (int i = 0; i < UV_SIZE; ++i) diffs += (cpu_u[i] != u[i]) + (cpu_v[i] != v[i]);
+    INFO(diffs << " pixels differ");
+    REQUIRE(diffs <= FRAME_SIZE / 1000);
+
+    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, out_cl);
+    std::vector<float> cpu_out(FRAME_SIZE);
+    loadyuv_cpu(MODEL_WIDTH, MODEL_HEIGHT, y.data(), u.data(), v.data(), cpu_out.data());
+    REQUIRE(cpu_out == read_buffer<float>(q, out_cl, FRAME_SIZE));
+  }
+
+  transform_destroy(&transform);
+  loadyuv_destroy(&loadyuv);
+  for (cl_mem mem : {yuv_cl, y_cl, u_cl, v_cl, out_cl}) {
+    CL_CHECK(clReleaseMemObject(mem));
+  }
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseContext(context));
+}
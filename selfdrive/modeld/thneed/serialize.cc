@@ -1,32 +1,323 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <fstream>
 #include <set>
 
 #include "third_party/json11/json11.hpp"
 #include "common/util.h"
 #include "common/clutil.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "selfdrive/modeld/thneed/thneed.h"
 using namespace json11;
 
 extern map<cl_program, string> g_program_source;
 
+// binary thneed, written by serialize.py from the JSON one. all offsets are from the start of the file,
+// the tables are 8 byte aligned so they can be used in place from the mapped file.
+namespace {
+
+const char THNEED_BINARY_MAGIC[4] = {'T', 'H', 'N', 'B'};
+const uint32_t THNEED_BINARY_VERSION = 1;
+
+enum ObjectType : uint32_t {
+  OBJECT_BUFFER = 0,
+  OBJECT_IMAGE2D = 1,
+  OBJECT_IMAGE1D = 2,
+};
+
+struct BinaryString {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct BinaryHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_objects, num_programs, num_inputs, num_outputs, num_kernels, num_args;
+  uint64_t objects, programs, inputs, outputs, kernels, args;
+};
+
+struct BinaryObject {
+  uint64_t id;
+  uint64_t buffer_id;     // the buffer of an image, 0 if it has none
+  uint64_t data_offset;   // 0 if the object starts zeroed
+  uint32_t size;
+  uint32_t type;          // ObjectType
+  uint32_t width, height, row_pitch;
+  uint32_t float32;
+};
+
+struct BinaryProgram {
+  BinaryString name;
+  BinaryString data;
+  uint32_t is_binary;     // data is a program binary, not source
+  uint32_t pad;
+};
+
+struct BinaryIO {
+  BinaryString name;
+  uint64_t buffer_id;
+  uint32_t size;
+  uint32_t pad;
+};
+
+struct BinaryKernel {
+  BinaryString name;
+  uint64_t global_work_size[3];
+  uint64_t local_work_size[3];
+  uint32_t work_dim;
+  uint32_t num_args;
+  uint32_t first_arg;     // index into the args table
+  uint32_t pad;
+};
+
+struct BinaryArg {
+  BinaryString value;     // empty for local memory
+  uint32_t size;
+  uint32_t pad;
+};
+
+static_assert(sizeof(BinaryHeader) == 80 && sizeof(BinaryObject) == 48 && sizeof(BinaryProgram) == 40 &&
+              sizeof(BinaryIO) == 32 && sizeof(BinaryKernel) == 80 && sizeof(BinaryArg) == 24,
+              "keep in sync with serialize.py");
+
+// time spent in each step of Thneed::load
+struct LoadTimes {
+  double start = millis_since_boot(), last = start;
+  string summary;
+
+  void step(const char *name) {
+    const double now = millis_since_boot();
+    summary += util::string_format(", %s %.1f ms", name, now - last);
+    last = now;
+  }
+};
+
+}  // namespace
+
+// zeroed buffers are filled on the device instead of copying zeros from the host
+cl_mem Thneed::create_buffer(int size, const void *data) {
+  cl_mem clbuf;
+  if (data != NULL) {
+    clbuf = clCreateBuffer(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, size, (void *)data, NULL);
+  } else {
+    clbuf = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, NULL);
+    const uint8_t zero = 0;
+    CL_CHECK(clEnqueueFillBuffer(command_queue, clbuf, &zero, sizeof(zero), 0, size, 0, NULL, NULL));
+  }
+  assert(clbuf != NULL);
+  return clbuf;
+}
+
+cl_mem Thneed::create_image(cl_mem clbuf, bool image2d, int size, int width, int height, int row_pitch, bool float32, const void *data) {
+  cl_image_desc desc = {0};
+  desc.image_type = image2d ? CL_MEM_OBJECT_IMAGE2D : CL_MEM_OBJECT_IMAGE1D_BUFFER;
+  desc.image_width = width;
+  desc.image_height = height;
+  desc.image_row_pitch = row_pitch;
+  assert(size == desc.image_height*desc.image_row_pitch);
+#ifdef QCOM2
+  desc.buffer = clbuf;
+#else
+  // TODO: we are creating unused buffers on PC
+  clReleaseMemObject(clbuf);
+#endif
+  cl_image_format format = {0};
+  format.image_channel_order = CL_RGBA;
+  format.image_channel_data_type = float32 ? CL_FLOAT : CL_HALF_FLOAT;
+
+  cl_int errcode;
+
+#ifndef QCOM2
+  if (data != NULL) {
+    clbuf = clCreateImage(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, &format, &desc, (void *)data, &errcode);
+  } else {
+    clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &errcode);
+  }
+#else
+  clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &errcode);
+#endif
+  if (clbuf == NULL) {
+    LOGE("clError: %s create image %zux%zu rp %zu with buffer %p\n", cl_get_error_string(errcode),
+         desc.image_width, desc.image_height, desc.image_row_pitch, desc.buffer);
+  }
+  assert(clbuf != NULL);
+  return clbuf;
+}
+
+void Thneed::add_input(cl_mem clbuf, int sz, const char *name) {
+  input_clmem.push_back(clbuf);
+  input_sizes.push_back(sz);
+  LOGD("Thneed::load: adding input %s with size %d\n", name, sz);
+
+  cl_int cl_err;
+  void *ret = clEnqueueMapBuffer(command_queue, clbuf, CL_TRUE, CL_MAP_WRITE, 0, sz, 0, NULL, NULL, &cl_err);
+  if (cl_err != CL_SUCCESS) LOGE("clError: %s map %p %d\n", cl_get_error_string(cl_err), clbuf, sz);
+  assert(cl_err == CL_SUCCESS);
+  inputs.push_back(ret);
+}
+
 void Thneed::load(const char *filename) {
   LOGD("Thneed::load: loading from %s\n", filename);
 
+  char magic[sizeof(THNEED_BINARY_MAGIC)] = {};
+  {
+    std::ifstream f(filename, std::ios::binary);
+    f.read(magic, sizeof(magic));
+  }
+  if (memcmp(magic, THNEED_BINARY_MAGIC, sizeof(magic)) == 0) {
+    load_binary(filename);
+  } else {
+    load_json(filename);
+  }
+}
+
+void Thneed::load_binary(const char *filename) {
+  LoadTimes times;
+
+  int fd = open(filename, O_RDONLY);
+  assert(fd >= 0);
+  struct stat st = {};
+  int ret = fstat(fd, &st);
+  assert(ret == 0);
+  const size_t file_size = st.st_size;
+  const char *buf = (const char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(buf != MAP_FAILED);
+  close(fd);
+
+  const BinaryHeader *header = (const BinaryHeader *)buf;
+  assert(file_size >= sizeof(BinaryHeader) && header->version == THNEED_BINARY_VERSION);
+  auto table = [&](uint64_t offset, uint32_t count, size_t size) {
+    assert(offset % 8 == 0 && offset + (uint64_t)count * size <= file_size);
+    return buf + offset;
+  };
+  auto str = [&](const BinaryString &s) {
+    assert(s.offset + s.size <= file_size);
+    return string(buf + s.offset, s.size);
+  };
+  const BinaryObject *objects = (const BinaryObject *)table(header->objects, header->num_objects, sizeof(BinaryObject));
+  const BinaryProgram *programs = (const BinaryProgram *)table(header->programs, header->num_programs, sizeof(BinaryProgram));
+  const BinaryIO *input_table = (const BinaryIO *)table(header->inputs, header->num_inputs, sizeof(BinaryIO));
+  const BinaryIO *output_table = (const BinaryIO *)table(header->outputs, header->num_outputs, sizeof(BinaryIO));
+  const BinaryKernel *kernels = (const BinaryKernel *)table(header->kernels, header->num_kernels, sizeof(BinaryKernel));
+  const BinaryArg *args = (const BinaryArg *)table(header->args, header->num_args, sizeof(BinaryArg));
+  times.step("map");
+
+  map<uint64_t, cl_mem> real_mem;
+  real_mem[0] = NULL;
+  size_t loaded_bytes = 0, zeroed_bytes = 0;
+  for (uint32_t i = 0; i < header->num_objects; i++) {
+    const BinaryObject &obj = objects[i];
+    assert(obj.data_offset + obj.size <= file_size);
+    const void *data = obj.data_offset ? buf + obj.data_offset : NULL;
+    cl_mem clbuf;
+    if (obj.buffer_id != 0) {
+      // image buffer must already be allocated
+      clbuf = real_mem[obj.buffer_id];
+      assert(data == NULL);
+    } else {
+      clbuf = create_buffer(obj.size, data);
+      (data ? loaded_bytes : zeroed_bytes) += obj.size;
+      if (debug >= 1) printf("loading %p %d @ 0x%zX\n", clbuf, obj.size, (size_t)obj.data_offset);
+    }
+    assert(clbuf != NULL);
+
+    if (obj.type != OBJECT_BUFFER) {
+      clbuf = create_image(clbuf, obj.type == OBJECT_IMAGE2D, obj.size, obj.width, obj.height, obj.row_pitch, obj.float32, data);
+    }
+    real_mem[obj.id] = clbuf;
+  }
+  times.step("objects");
+
+  map<string, cl_program> g_programs;
+  for (uint32_t i = 0; i < header->num_programs; i++) {
+    const BinaryProgram &prg = programs[i];
+    const string name = str(prg.name);
+    if (debug >= 1) printf("%s %s with size %zu\n", prg.is_binary ? "binary" : "building", name.c_str(), (size_t)prg.data.size);
+    if (prg.is_binary) {
+      assert(prg.data.offset + prg.data.size <= file_size);
+      g_programs[name] = cl_program_from_binary(context, device_id, (const uint8_t *)buf + prg.data.offset, prg.data.size);
+    } else {
+      g_programs[name] = cl_program_from_source(context, device_id, str(prg.data));
+    }
+  }
+  times.step("programs");
+
+  for (uint32_t i = 0; i < header->num_inputs; i++) {
+    add_input(real_mem[input_table[i].buffer_id], input_table[i].size, str(input_table[i].name).c_str());
+  }
+  for (uint32_t i = 0; i < header->num_outputs; i++) {
+    LOGD("Thneed::load: adding output with size %d\n", output_table[i].size);
+    // TODO: support multiple outputs
+    output = real_mem[output_table[i].buffer_id];
+    assert(output != NULL);
+  }
+
+  for (uint32_t i = 0; i < header->num_kernels; i++) {
+    const BinaryKernel &k = kernels[i];
+    auto kk = shared_ptr<CLQueuedKernel>(new CLQueuedKernel(this));
+    kk->name = str(k.name);
+    kk->program = g_programs[kk->name];
+    kk->work_dim = k.work_dim;
+    for (int j = 0; j < kk->work_dim; j++) {
+      kk->global_work_size[j] = k.global_work_size[j];
+      kk->local_work_size[j] = k.local_work_size[j];
+    }
+    kk->num_args = k.num_args;
+    assert((uint64_t)k.first_arg + k.num_args <= header->num_args);
+    for (int j = 0; j < kk->num_args; j++) {
+      const BinaryArg &arg = args[k.first_arg + j];
+      kk->args_size.push_back(arg.size);
+      if (arg.size == 8) {
+        const string value = str(arg.value);
+        uint64_t id = 0;
+        memcpy(&id, value.data(), std::min(value.size(), sizeof(id)));
+        auto it = real_mem.find(id);
+        cl_mem val = it != real_mem.end() ? it->second : NULL;
+        kk->args.push_back(string((char*)&val, sizeof(val)));
+      } else {
+        kk->args.push_back(str(arg.value));
+      }
+    }
+    kq.push_back(kk);
+  }
+  times.step("kernels");
+
+  const int num_objects = header->num_objects;
+  clFinish(command_queue);
+  munmap((void *)buf, file_size);
+  times.step("finish");
+  LOGW("Thneed::load: %.1f ms, %d objects (%.1f MB loaded, %.1f MB zeroed)%s", times.last - times.start, num_objects,
+       loaded_bytes / 1e6, zeroed_bytes / 1e6, times.summary.c_str());
+}
+
+void Thneed::load_json(const char *filename) {
+  LoadTimes times;
+
   string buf = util::read_file(filename);
   int jsz = *(int *)buf.data();
   string jsonerr;
   string jj(buf.data() + sizeof(int), jsz);
   Json jdat = Json::parse(jj, jsonerr);
+  times.step("parse");
 
   map<cl_mem, cl_mem> real_mem;
   real_mem[NULL] = NULL;
 
+  size_t loaded_bytes = 0, zeroed_bytes = 0;
   int ptr = sizeof(int)+jsz;
   for (auto &obj : jdat["objects"].array_items()) {
     auto mobj = obj.object_items();
     int sz = mobj["size"].int_value();
     cl_mem clbuf = NULL;
+    const void *data = NULL;
 
     if (mobj["buffer_id"].string_value().size() > 0) {
       // image buffer must already be allocated
@@ -34,55 +325,26 @@ void Thneed::load(const char *filename) {
       assert(mobj["needs_load"].bool_value() == false);
     } else {
       if (mobj["needs_load"].bool_value()) {
-        clbuf = clCreateBuffer(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, sz, &buf[ptr], NULL);
+        data = &buf[ptr];
+        clbuf = create_buffer(sz, data);
         if (debug >= 1) printf("loading %p %d @ 0x%X\n", clbuf, sz, ptr);
         ptr += sz;
+        loaded_bytes += sz;
       } else {
-        // TODO: is there a faster way to init zeroed out buffers?
-        void *host_zeros = calloc(sz, 1);
-        clbuf = clCreateBuffer(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, sz, host_zeros, NULL);
-        free(host_zeros);
+        clbuf = create_buffer(sz, NULL);
+        zeroed_bytes += sz;
       }
     }
     assert(clbuf != NULL);
 
     if (mobj["arg_type"] == "image2d_t" || mobj["arg_type"] == "image1d_t") {
-      cl_image_desc desc = {0};
-      desc.image_type = (mobj["arg_type"] == "image2d_t") ? CL_MEM_OBJECT_IMAGE2D : CL_MEM_OBJECT_IMAGE1D_BUFFER;
-      desc.image_width = mobj["width"].int_value();
-      desc.image_height = mobj["height"].int_value();
-      desc.image_row_pitch = mobj["row_pitch"].int_value();
-      assert(sz == desc.image_height*desc.image_row_pitch);
-#ifdef QCOM2
-      desc.buffer = clbuf;
-#else
-      // TODO: we are creating unused buffers on PC
-      clReleaseMemObject(clbuf);
-#endif
-      cl_image_format format = {0};
-      format.image_channel_order = CL_RGBA;
-      format.image_channel_data_type = mobj["float32"].bool_value() ? CL_FLOAT : CL_HALF_FLOAT;
-
-      cl_int errcode;
-
-#ifndef QCOM2
-      if (mobj["needs_load"].bool_value()) {
-        clbuf = clCreateImage(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, &format, &desc, &buf[ptr-sz], &errcode);
-      } else {
-        clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &errcode);
-      }
-#else
-      clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &errcode);
-#endif
-      if (clbuf == NULL) {
-        LOGE("clError: %s create image %zux%zu rp %zu with buffer %p\n", cl_get_error_string(errcode),
-             desc.image_width, desc.image_height, desc.image_row_pitch, desc.buffer);
-      }
-      assert(clbuf != NULL);
+      clbuf = create_image(clbuf, mobj["arg_type"] == "image2d_t", sz, mobj["width"].int_value(), mobj["height"].int_value(),
+                           mobj["row_pitch"].int_value(), mobj["float32"].bool_value(), data);
     }
 
     real_mem[*(cl_mem*)(mobj["id"].string_value().data())] = clbuf;
   }
+  times.step("objects");
 
   map<string, cl_program> g_programs;
   for (const auto &[name, source] : jdat["programs"].object_items()) {
@@ -92,17 +354,7 @@ void Thneed::load(const char *filename) {
 
   for (auto &obj : jdat["inputs"].array_items()) {
     auto mobj = obj.object_items();
-    int sz = mobj["size"].int_value();
-    cl_mem aa = real_mem[*(cl_mem*)(mobj["buffer_id"].string_value().data())];
-    input_clmem.push_back(aa);
-    input_sizes.push_back(sz);
-    LOGD("Thneed::load: adding input %s with size %d\n", mobj["name"].string_value().data(), sz);
-
-    cl_int cl_err;
-    void *ret = clEnqueueMapBuffer(command_queue, aa, CL_TRUE, CL_MAP_WRITE, 0, sz, 0, NULL, NULL, &cl_err);
-    if (cl_err != CL_SUCCESS) LOGE("clError: %s map %p %d\n", cl_get_error_string(cl_err), aa, sz);
-    assert(cl_err == CL_SUCCESS);
-    inputs.push_back(ret);
+    add_input(real_mem[*(cl_mem*)(mobj["buffer_id"].string_value().data())], mobj["size"].int_value(), mobj["name"].string_value().data());
   }
 
   for (auto &obj : jdat["outputs"].array_items()) {
@@ -121,6 +373,7 @@ void Thneed::load(const char *filename) {
     g_programs[name] = cl_program_from_binary(context, device_id, (const uint8_t*)&buf[ptr], length);
     ptr += length;
   }
+  times.step("programs");
 
   for (auto &obj : jdat["kernels"].array_items()) {
     auto gws = obj["global_work_size"];
@@ -149,6 +402,10 @@ void Thneed::load(const char *filename) {
     }
     kq.push_back(kk);
   }
+  times.step("kernels");
 
   clFinish(command_queue);
+  times.step("finish");
+  LOGW("Thneed::load: %.1f ms, %zu objects (%.1f MB loaded, %.1f MB zeroed)%s", times.last - times.start, jdat["objects"].array_items().size(),
+       loaded_bytes / 1e6, zeroed_bytes / 1e6, times.summary.c_str());
 }
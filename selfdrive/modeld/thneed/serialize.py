@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Converts a JSON thneed (from tinygrad's compile2.py) to the binary thneed that Thneed::load maps in place.
+# The layout is described in serialize.cc, keep them in sync.
+import json
+import struct
+import sys
+
+MAGIC = b'THNB'
+VERSION = 1
+
+OBJECT_BUFFER, OBJECT_IMAGE2D, OBJECT_IMAGE1D = 0, 1, 2
+
+HEADER = struct.Struct('<4sI6I6Q')
+OBJECT = struct.Struct('<QQQIIIIII')
+PROGRAM = struct.Struct('<QQQQII')
+IO = struct.Struct('<QQQII')
+KERNEL = struct.Struct('<QQ3Q3QIIII')
+ARG = struct.Struct('<QQII')
+
+DATA_ALIGNMENT = 64
+
+
+def raw(s: str) -> bytes:
+  # the bytes the C++ JSON loader sees
+  return s.encode('utf-8', 'surrogateescape')
+
+
+def object_id(s: str) -> int:
+  return struct.unpack('<Q', raw(s)[:8].ljust(8, b'\0'))[0] if s else 0
+
+
+def read_json_thneed(fn: str) -> tuple[dict, bytes]:
+  with open(fn, 'rb') as f:
+    buf = f.read()
+  jsz = struct.unpack('<i', buf[:4])[0]
+  return json.loads(buf[4:4 + jsz].decode('utf-8', 'surrogateescape')), buf[4 + jsz:]
+
+
+class Writer:
+  def __init__(self):
+    self.buf = bytearray(HEADER.size)
+
+  def align(self, alignment: int):
+    self.buf += b'\0' * (-len(self.buf) % alignment)
+
+  def add(self, data: bytes, alignment: int = 8) -> int:
+    self.align(alignment)
+    offset = len(self.buf)
+    self.buf += data
+    return offset
+
+  def add_string(self, data: bytes) -> tuple[int, int]:
+    return self.add(data, 1), len(data)
+
+
+def to_binary(jdat: dict, data: bytes) -> bytes:
+  w = Writer()
+  ptr = 0
+
+  objects = []
+  for obj in jdat['objects']:
+    data_offset = 0
+    if obj.get('needs_load', False):
+      data_offset = w.add(data[ptr:ptr + obj['size']], DATA_ALIGNMENT)
+      ptr += obj['size']
+    obj_type = {'image2d_t': OBJECT_IMAGE2D, 'image1d_t': OBJECT_IMAGE1D}.get(obj.get('arg_type'), OBJECT_BUFFER)
+    objects.append(OBJECT.pack(object_id(obj['id']), object_id(obj.get('buffer_id', '')), data_offset, obj['size'], obj_type,
+                               obj.get('width', 0), obj.get('height', 0), obj.get('row_pitch', 0), int(obj.get('float32', False))))
+
+  programs = []
+  for name, source in jdat.get('programs', {}).items():
+    programs.append(PROGRAM.pack(*w.add_string(raw(name)), *w.add_string(raw(source)), 0, 0))
+  for obj in jdat.get('binaries', []):
+    binary_offset = w.add(data[ptr:ptr + obj['length']])
+    ptr += obj['length']
+    programs.append(PROGRAM.pack(*w.add_string(raw(obj['name'])), binary_offset, obj['length'], 1, 0))
+
+  def io(obj: dict) -> bytes:
+    return IO.pack(*w.add_string(raw(obj.get('name', ''))), object_id(obj['buffer_id']), obj['size'], 0)
+
+  inputs = [io(obj) for obj in jdat['inputs']]
+  outputs = [io(obj) for obj in jdat['outputs']]
+
+  kernels, args = [], []
+  for obj in jdat['kernels']:
+    gws = (obj['global_work_size'] + [0, 0, 0])[:3]
+    lws = (obj['local_work_size'] + [0, 0, 0])[:3]
+    kernels.append(KERNEL.pack(*w.add_string(raw(obj['name'])), *gws, *lws, obj['work_dim'], obj['num_args'], len(args), 0))
+    for arg, arg_size in zip(obj['args'][:obj['num_args']], obj['args_size'][:obj['num_args']], strict=True):
+      args.append(ARG.pack(*w.add_string(raw(arg)), arg_size, 0))
+
+  tables = [w.add(b''.join(t)) for t in (objects, programs, inputs, outputs, kernels, args)]
+  counts = [len(t) for t in (objects, programs, inputs, outputs, kernels, args)]
+  w.buf[:HEADER.size] = HEADER.pack(MAGIC, VERSION, *counts, *tables)
+  return bytes(w.buf)
+
+
+if __name__ == "__main__":
+  if len(sys.argv) not in (2, 3):
+    print(f"usage: {sys.argv[0]} <json thneed> [binary thneed, default: in place]")
+    sys.exit(1)
+
+  with open(sys.argv[1], 'rb') as f:
+    if f.read(4) == MAGIC:
+      print(f'{sys.argv[1]} is already binary')
+      sys.exit(0)
+
+  out = to_binary(*read_json_thneed(sys.argv[1]))
+  with open(sys.argv[-1], 'wb') as f:
+    f.write(out)
+  print(f'saved binary thneed to {sys.argv[-1]} ({len(out) / 1e6:.1f} MB)')
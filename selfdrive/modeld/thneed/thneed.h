@@ -120,6 +120,8 @@ class Thneed {
     void copy_inputs(float **finputs, bool internal=false);
     void copy_output(float *foutput);
     cl_int clexec();
+    // runs the kernels one at a time, returns how long each one took in ms
+    vector<pair<string, double>> time_kernels();
     vector<shared_ptr<CLQueuedKernel> > kq;
 
     // pending CL kernels
@@ -129,5 +131,10 @@ class Thneed {
     void load(const char *filename);
   private:
     void clinit();
+    void load_json(const char *filename);
+    void load_binary(const char *filename);
+    cl_mem create_buffer(int size, const void *data);
+    cl_mem create_image(cl_mem clbuf, bool image2d, int size, int width, int height, int row_pitch, bool float32, const void *data);
+    void add_input(cl_mem clbuf, int sz, const char *name);
 };
 
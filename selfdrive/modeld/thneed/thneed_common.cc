@@ -35,6 +35,18 @@ cl_int Thneed::clexec() {
   return clFinish(command_queue);
 }
 
+vector<pair<string, double>> Thneed::time_kernels() {
+  vector<pair<string, double>> times;
+  clFinish(command_queue);
+  for (auto &k : kq) {
+    double start = millis_since_boot();
+    k->exec();
+    clFinish(command_queue);
+    times.push_back({k->name, millis_since_boot() - start});
+  }
+  return times;
+}
+
 void Thneed::copy_inputs(float **finputs, bool internal) {
   for (int idx = 0; idx < inputs.size(); ++idx) {
     if (debug >= 1) printf("copying %lu -- %p -> %p (cl %p)\n", input_sizes[idx], finputs[idx], inputs[idx], input_clmem[idx]);
@@ -4,11 +4,14 @@
 #include <cstdio>
 #include <cstring>
 
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
 void loadyuv_init(LoadYUVState* s, cl_context ctx, cl_device_id device_id, int width, int height) {
   memset(s, 0, sizeof(*s));
 
   s->width = width;
   s->height = height;
+  s->on_cpu = !cl_device_is_gpu(device_id);
 
   char args[1024];
   snprintf(args, sizeof(args),
@@ -34,6 +37,25 @@ void loadyuv_destroy(LoadYUVState* s) {
 void loadyuv_queue(LoadYUVState* s, cl_command_queue q,
                    cl_mem y_cl, cl_mem u_cl, cl_mem v_cl,
                    cl_mem out_cl, bool do_shift) {
+  if (s->on_cpu) {
+    const uint8_t *y = (const uint8_t *)map_cl_buffer(q, y_cl, CL_MAP_READ);
+    const uint8_t *u = (const uint8_t *)map_cl_buffer(q, u_cl, CL_MAP_READ);
+    const uint8_t *v = (const uint8_t *)map_cl_buffer(q, v_cl, CL_MAP_READ);
+    float *out = (float *)map_cl_buffer(q, out_cl, CL_MAP_READ | CL_MAP_WRITE);
+    float *frame = out;
+    if (do_shift) {
+      const int frame_size = (s->width*s->height) + (s->width/2)*(s->height/2)*2;
+      memmove(out, out + frame_size, frame_size * sizeof(float));
+      frame += frame_size;
+    }
+    loadyuv_cpu(s->width, s->height, y, u, v, frame);
+    CL_CHECK(clEnqueueUnmapMemObject(q, y_cl, (void *)y, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, u_cl, (void *)u, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, v_cl, (void *)v, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, out_cl, out, 0, NULL, NULL));
+    return;
+  }
+
   cl_int global_out_off = 0;
   if (do_shift) {
     // shift the image in slot 1 to slot 0, then place the new image in slot 1
@@ -5,6 +5,7 @@
 typedef struct {
   int width, height;
   cl_kernel loadys_krnl, loaduv_krnl, copy_krnl;
+  bool on_cpu;  // no GPU, the buffers are mapped and packed by loadyuv_cpu
 } LoadYUVState;
 
 void loadyuv_init(LoadYUVState* s, cl_context ctx, cl_device_id device_id, int width, int height);
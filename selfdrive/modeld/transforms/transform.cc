@@ -4,9 +4,11 @@
 #include <cstring>
 
 #include "common/clutil.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
 
 void transform_init(Transform* s, cl_context ctx, cl_device_id device_id) {
   memset(s, 0, sizeof(*s));
+  s->on_cpu = !cl_device_is_gpu(device_id);
 
   cl_program prg = cl_program_from_file(ctx, device_id, TRANSFORM_PATH, "");
   s->krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpPerspective", &err));
@@ -29,6 +31,19 @@ void transform_queue(Transform* s,
                      cl_mem out_y, cl_mem out_u, cl_mem out_v,
                      int out_width, int out_height,
                      const mat3& projection) {
+  if (s->on_cpu) {
+    const uint8_t *yuv = (const uint8_t *)map_cl_buffer(q, in_yuv, CL_MAP_READ);
+    uint8_t *y = (uint8_t *)map_cl_buffer(q, out_y, CL_MAP_WRITE);
+    uint8_t *u = (uint8_t *)map_cl_buffer(q, out_u, CL_MAP_WRITE);
+    uint8_t *v = (uint8_t *)map_cl_buffer(q, out_v, CL_MAP_WRITE);
+    transform_cpu(yuv, in_width, in_height, in_stride, in_uv_offset, y, u, v, out_width, out_height, projection);
+    CL_CHECK(clEnqueueUnmapMemObject(q, in_yuv, (void *)yuv, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, out_y, y, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, out_u, u, 0, NULL, NULL));
+    CL_CHECK(clEnqueueUnmapMemObject(q, out_v, v, 0, NULL, NULL));
+    return;
+  }
+
   const int zero = 0;
 
   // sampled using pixel center origin
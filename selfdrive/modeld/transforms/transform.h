@@ -12,6 +12,7 @@
 typedef struct {
   cl_kernel krnl;
   cl_mem m_y_cl, m_uv_cl;
+  bool on_cpu;  // no GPU, the buffers are mapped and transformed by transform_cpu
 } Transform;
 
 void transform_init(Transform* s, cl_context ctx, cl_device_id device_id);
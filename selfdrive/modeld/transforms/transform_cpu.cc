@@ -0,0 +1,138 @@
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// follows transform.cl and loadyuv.cl step by step, keep them in sync.
+
+namespace {
+
+typedef float float4_t __attribute__((vector_size(16)));
+typedef int32_t int4_t __attribute__((vector_size(16)));
+
+constexpr int INTER_BITS = 5;
+constexpr int INTER_TAB_SIZE = 1 << INTER_BITS;
+constexpr int INTER_REMAP_COEF_BITS = 15;
+constexpr int INTER_REMAP_COEF_SCALE = 1 << INTER_REMAP_COEF_BITS;
+
+inline int4_t select(int4_t mask, int4_t a, int4_t b) {
+  return (a & mask) | (b & ~mask);
+}
+
+inline float4_t select(int4_t mask, float4_t a, float4_t b) {
+  return (float4_t)select(mask, (int4_t)a, (int4_t)b);
+}
+
+inline int4_t clamp(int4_t v, int lo, int hi) {
+  v = select(v > lo, v, int4_t{} + lo);
+  return select(v < hi, v, int4_t{} + hi);
+}
+
+// rint for coordinates. beyond +-2^22 both taps are clamped to the same edge pixel anyway
+inline int4_t rint(float4_t v) {
+  const float limit = 1 << 22, magic = 1.5f * (1 << 23);
+  v = select(v > -limit, v, float4_t{} - limit);
+  v = select(v < limit, v, float4_t{} + limit);
+  return __builtin_convertvector((v + magic) - magic, int4_t);
+}
+
+// convert_short_sat_rte, the weight of a whole pixel is 32767
+inline int16_t short_sat_rte(float v) {
+  return std::clamp(std::nearbyint(v), -32768.0f, 32767.0f);
+}
+
+// the weights of the four taps for each fractional position, computed like the kernel does
+struct BilinearTab {
+  int16_t w[INTER_TAB_SIZE * INTER_TAB_SIZE][4];
+
+  BilinearTab() {
+    for (int ay = 0; ay < INTER_TAB_SIZE; ++ay) {
+      for (int ax = 0; ax < INTER_TAB_SIZE; ++ax) {
+        const float taby = 1.f / INTER_TAB_SIZE * ay;
+        const float tabx = 1.f / INTER_TAB_SIZE * ax;
+        int16_t *t = w[ay * INTER_TAB_SIZE + ax];
+        t[0] = short_sat_rte((1.0f - taby) * (1.0f - tabx) * INTER_REMAP_COEF_SCALE);
+        t[1] = short_sat_rte((1.0f - taby) * tabx * INTER_REMAP_COEF_SCALE);
+        t[2] = short_sat_rte(taby * (1.0f - tabx) * INTER_REMAP_COEF_SCALE);
+        t[3] = short_sat_rte(taby * tabx * INTER_REMAP_COEF_SCALE);
+      }
+    }
+  }
+};
+
+}  // namespace
+
+void warp_perspective_cpu(const uint8_t *src, int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                          uint8_t *dst, int dst_row_stride, int dst_rows, int dst_cols, const float M[9]) {
+  static const BilinearTab tab;
+
+  for (int dy = 0; dy < dst_rows; ++dy) {
+    uint8_t *out = dst + dy * dst_row_stride;
+    const float x_dy = M[1] * (float)dy, y_dy = M[4] * (float)dy, w_dy = M[7] * (float)dy;
+    for (int dx = 0; dx < dst_cols; dx += 4) {
+      const float4_t dxf = float4_t{0, 1, 2, 3} + (float)dx;
+      const float4_t X0 = (M[0] * dxf + x_dy) + M[2];
+      const float4_t Y0 = (M[3] * dxf + y_dy) + M[5];
+      float4_t W = (M[6] * dxf + w_dy) + M[8];
+      W = select(W != 0.0f, INTER_TAB_SIZE / W, float4_t{});
+      const int4_t X = rint(X0 * W), Y = rint(Y0 * W);
+
+      const int4_t sx = X >> INTER_BITS, sy = Y >> INTER_BITS;
+      const int4_t col0 = clamp(sx, 0, src_cols - 1) * src_px_stride + src_offset;
+      const int4_t col1 = clamp(sx + 1, 0, src_cols - 1) * src_px_stride + src_offset;
+      const int4_t row0 = clamp(sy, 0, src_rows - 1) * src_row_stride;
+      const int4_t row1 = clamp(sy + 1, 0, src_rows - 1) * src_row_stride;
+      const int4_t t = (Y & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (X & (INTER_TAB_SIZE - 1));
+
+      int4_t v0, v1, v2, v3, w0, w1, w2, w3;
+      for (int i = 0; i < 4; ++i) {
+        v0[i] = src[row0[i] + col0[i]];
+        v1[i] = src[row0[i] + col1[i]];
+        v2[i] = src[row1[i] + col0[i]];
+        v3[i] = src[row1[i] + col1[i]];
+        const int16_t *w = tab.w[t[i]];
+        w0[i] = w[0];
+        w1[i] = w[1];
+        w2[i] = w[2];
+        w3[i] = w[3];
+      }
+      const int4_t val = v0 * w0 + v1 * w1 + v2 * w2 + v3 * w3;
+      const int4_t pix = clamp((val + (1 << (INTER_REMAP_COEF_BITS - 1))) >> INTER_REMAP_COEF_BITS, 0, 255);
+      for (int i = 0; i < std::min(4, dst_cols - dx); ++i) {
+        out[dx + i] = pix[i];
+      }
+    }
+  }
+}
+
+void transform_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v, int out_width, int out_height,
+                   const mat3 &projection) {
+  // the same arguments as transform_queue passes to the kernel
+  const mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+  warp_perspective_cpu(yuv, in_stride, 1, 0, in_height, in_width,
+                       out_y, out_width, out_height, out_width, projection.v);
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset, in_height / 2, in_width / 2,
+                       out_u, out_width / 2, out_height / 2, out_width / 2, projection_uv.v);
+  warp_perspective_cpu(yuv, in_stride, 2, in_uv_offset + 1, in_height / 2, in_width / 2,
+                       out_v, out_width / 2, out_height / 2, out_width / 2, projection_uv.v);
+}
+
+void loadyuv_cpu(int width, int height, const uint8_t *y, const uint8_t *u, const uint8_t *v, float *out) {
+  const int uv_size = (width / 2) * (height / 2);
+
+  // 02
+  // 13
+  for (int oy = 0; oy < height; ++oy) {
+    const uint8_t *row = y + oy * width;
+    float *out0 = out + (oy & 1) * uv_size + (oy / 2) * (width / 2);
+    float *out1 = out0 + uv_size * 2;
+    for (int ox = 0; ox < width / 2; ++ox) {
+      out0[ox] = row[ox * 2];
+      out1[ox] = row[ox * 2 + 1];
+    }
+  }
+  std::copy(u, u + uv_size, out + uv_size * 4);
+  std::copy(v, v + uv_size, out + uv_size * 5);
+}
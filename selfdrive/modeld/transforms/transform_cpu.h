@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/mat.h"
+
+// CPU implementations of transform.cl and loadyuv.cl, used by transform_queue and loadyuv_queue when
+// the device isn't a GPU (e.g. offline re-simulation on servers). They produce the same output as the kernels.
+
+// warpPerspective with fixed point bilinear interpolation, four pixels at a time in SIMD registers
+void warp_perspective_cpu(const uint8_t *src, int src_row_stride, int src_px_stride, int src_offset, int src_rows, int src_cols,
+                          uint8_t *dst, int dst_row_stride, int dst_rows, int dst_cols, const float M[9]);
+
+// transforms the Y, U and V planes of a NV12 frame, like transform_queue
+void transform_cpu(const uint8_t *yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v, int out_width, int out_height,
+                   const mat3 &projection);
+
+// packs one transformed frame into the model input layout, like loadyuv_queue without the shift
+void loadyuv_cpu(int width, int height, const uint8_t *y, const uint8_t *u, const uint8_t *v, float *out);
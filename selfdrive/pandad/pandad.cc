@@ -13,6 +13,7 @@
 
 #include "cereal/gen/cpp/car.capnp.h"
 #include "cereal/messaging/messaging.h"
+#include "cereal/messaging/msgtrace.h"
 #include "common/params.h"
 #include "common/ratekeeper.h"
 #include "common/swaglog.h"
@@ -183,6 +184,7 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
 
     capnp::FlatArrayMessageReader cmsg(aligned_buf.align(msg.get()));
     cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
+    msgtrace::trace(msgtrace::RECEIVE, "sendcan", event.getLogMonoTime());
 
     // Don't send if older than 1 second
     if ((nanos_since_boot() - event.getLogMonoTime() < 1e9) && !fake_send) {
@@ -191,6 +193,7 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
         panda->can_send(event.getSendcan());
         LOGT("sendcan sent to panda: %s", (panda->hw_serial()).c_str());
       }
+      msgtrace::trace(msgtrace::HANDLED, "sendcan", event.getLogMonoTime());
     } else {
       LOGE("sendcan too old to send: %" PRIu64 ", %" PRIu64, nanos_since_boot(), event.getLogMonoTime());
     }
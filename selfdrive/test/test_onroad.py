@@ -321,6 +321,8 @@ class TestOnroad:
     result += f"execution time: min  {min(ts):.5f}s\n"
     result += f"execution time: max  {max(ts):.5f}s\n"
     result += f"execution time: mean {np.mean(ts):.5f}s\n"
+    qt = [getattr(m, m.which()).queueTime for m in self.lr if 'CameraState' in m.which()]
+    result += f"queue time:     mean {np.mean(qt):.5f}s\n"
     result += "------------------------------------------------\n"
     print(result)
 
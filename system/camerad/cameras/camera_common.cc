@@ -1,5 +1,6 @@
 #include "system/camerad/cameras/camera_common.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -11,6 +12,7 @@
 #include "third_party/linux/include/msm_media_info.h"
 
 #include "system/camerad/cameras/camera_qcom2.h"
+#include "system/camerad/cameras/process_raw.h"
 #ifdef QCOM2
 #include "CL/cl_ext_qcom.h"
 #endif
@@ -20,8 +22,14 @@ ExitHandler do_exit;
 class ImgProc {
 public:
   ImgProc(cl_device_id device_id, cl_context context, const CameraBuf *b, const CameraState *s, int buf_width, int uv_offset) {
-    char args[4096];
     const SensorInfo *ci = s->ci.get();
+    if (!cl_device_is_gpu(device_id)) {
+      LOGW("no GPU, processing frames on the CPU");
+      cpu_ = std::make_unique<RawProcessor>(ci, b->rgb_width, b->rgb_height, buf_width, uv_offset, s->camera_num == 1);
+      return;
+    }
+
+    char args[4096];
     snprintf(args, sizeof(args),
              "-cl-fast-relaxed-math -cl-denorms-are-zero -Isensors "
              "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
@@ -48,12 +56,19 @@ public:
     CL_CHECK(clEnqueueNDRangeKernel(q, krnl_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, imgproc_event));
   }
 
+  // without a GPU, the frame is processed when the processing thread gets it instead of being queued
+  inline bool onCpu() const { return cpu_ != nullptr; }
+  void process(const VisionBuf *cam_buf, VisionBuf *yuv_buf, int expo_time) {
+    cpu_->process((const uint8_t *)cam_buf->addr, (uint8_t *)yuv_buf->addr, expo_time);
+  }
+
   ~ImgProc() {
-    CL_CHECK(clReleaseKernel(krnl_));
+    if (!cpu_) CL_CHECK(clReleaseKernel(krnl_));
   }
 
 private:
   cl_kernel krnl_;
+  std::unique_ptr<RawProcessor> cpu_;
 };
 
 void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType type) {
@@ -91,11 +106,16 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 
   imgproc = new ImgProc(device_id, context, this, s, nv12_width, nv12_uv_offset);
 
-  const cl_queue_properties props[] = {0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
+  // profiling gives the ISP time from the event, independent of when the processing thread waits for it.
+  const cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
   q = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
 }
 
 CameraBuf::~CameraBuf() {
+  ProcessingFrame f;
+  while (safe_queue.try_pop(f)) {
+    if (f.event) CL_CHECK(clReleaseEvent(f.event));
+  }
   for (int i = 0; i < frame_buf_count; i++) {
     camera_bufs[i].free();
   }
@@ -104,23 +124,35 @@ CameraBuf::~CameraBuf() {
 }
 
 bool CameraBuf::acquire() {
-  if (!safe_queue.try_pop(cur_buf_idx, 50)) return false;
-
-  if (camera_bufs_metadata[cur_buf_idx].frame_id == -1) {
-    LOGE("no frame data? wtf");
-    return false;
+  if (publish_start_time > 0) {
+    // the processing thread is done with the previous frame
+    publish_time = (millis_since_boot() - publish_start_time) / 1000.0;
+    publish_start_time = 0;
   }
 
-  cur_frame_data = camera_bufs_metadata[cur_buf_idx];
-  cur_yuv_buf = vipc_server->get_buffer(stream_type);
+  ProcessingFrame f;
+  if (!safe_queue.try_pop(f, 50)) return false;
+
+  cur_buf_idx = f.buf_idx;
+  cur_frame_data = f.frame_data;
+  cur_yuv_buf = f.yuv_buf;
   cur_camera_buf = &camera_bufs[cur_buf_idx];
 
-  double start_time = millis_since_boot();
-  cl_event event;
-  imgproc->queue(q, camera_bufs[cur_buf_idx].buf_cl, cur_yuv_buf->buf_cl, rgb_width, rgb_height, &event, cur_frame_data.integ_lines);
-  clWaitForEvents(1, &event);
-  CL_CHECK(clReleaseEvent(event));
-  cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
+  if (f.event) {
+    CL_CHECK(clWaitForEvents(1, &f.event));
+    cl_ulong queued_ns = 0, end_ns = 0;
+    CL_CHECK(clGetEventProfilingInfo(f.event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued_ns), &queued_ns, NULL));
+    CL_CHECK(clGetEventProfilingInfo(f.event, CL_PROFILING_COMMAND_END, sizeof(end_ns), &end_ns, NULL));
+    CL_CHECK(clReleaseEvent(f.event));
+    cur_frame_data.processing_time = (end_ns - queued_ns) / 1e9;
+  } else {
+    const double start_time = millis_since_boot();
+    imgproc->process(cur_camera_buf, cur_yuv_buf, cur_frame_data.integ_lines);
+    cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
+  }
+  cur_frame_data.queue_time = std::max(0.0, (millis_since_boot() - f.queued_time) / 1000.0 - cur_frame_data.processing_time);
+  cur_frame_data.publish_time = publish_time;
+  cur_frame_data.queue_depth = safe_queue.size();
 
   VisionIpcBufExtra extra = {
     cur_frame_data.frame_id,
@@ -130,11 +162,43 @@ bool CameraBuf::acquire() {
   cur_yuv_buf->set_frame_id(cur_frame_data.frame_id);
   vipc_server->send(cur_yuv_buf, &extra);
 
+  publish_start_time = millis_since_boot();
   return true;
 }
 
+// called from the camera thread as soon as a frame is received.
+// the ISP kernel is queued right away, so it runs while the processing thread is still publishing
+// the previous frame and computing its AE.
 void CameraBuf::queue(size_t buf_idx) {
-  safe_queue.push(buf_idx);
+  if (camera_bufs_metadata[buf_idx].frame_id == -1) {
+    LOGE("no frame data? wtf");
+    return;
+  }
+
+  // get_buffer hands out the YUV buffers round robin and isn't thread safe, only the camera thread calls it
+  if (queue_thread == std::thread::id()) queue_thread = std::this_thread::get_id();
+  assert(queue_thread == std::this_thread::get_id());
+
+  // a YUV buffer is in flight from here until the processing thread is done publishing it. the queued frames
+  // and the one being published may hold all YUV_BUFFER_COUNT of them, get_buffer would hand one out again.
+  if (const size_t queued = safe_queue.size(); queued + 2 > YUV_BUFFER_COUNT) {
+    LOGW("dropping frame %u, %zu frames waiting for the processing thread", camera_bufs_metadata[buf_idx].frame_id, queued);
+    return;
+  }
+
+  ProcessingFrame f = {
+    .buf_idx = (int)buf_idx,
+    .yuv_buf = vipc_server->get_buffer(stream_type),
+    .frame_data = camera_bufs_metadata[buf_idx],
+    .queued_time = millis_since_boot(),
+  };
+  if (imgproc->onCpu()) {
+    f.event = nullptr;
+  } else {
+    imgproc->queue(q, camera_bufs[buf_idx].buf_cl, f.yuv_buf->buf_cl, rgb_width, rgb_height, &f.event, f.frame_data.integ_lines);
+    CL_CHECK(clFlush(q));
+  }
+  safe_queue.push(f);
 }
 
 // common functions
@@ -150,6 +214,9 @@ void fill_frame_data(cereal::FrameData::Builder &framed, const FrameMetadata &fr
   framed.setMeasuredGreyFraction(frame_data.measured_grey_fraction);
   framed.setTargetGreyFraction(frame_data.target_grey_fraction);
   framed.setProcessingTime(frame_data.processing_time);
+  framed.setQueueTime(frame_data.queue_time);
+  framed.setPublishTime(frame_data.publish_time);
+  framed.setQueueDepth(frame_data.queue_depth);
 
   const float ev = c->cur_ev[frame_data.frame_id % 3];
   const float perc = util::map_val(ev, c->ci->min_ev, c->ci->max_ev, 0.0f, 100.0f);
@@ -257,31 +324,81 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
   pm->send("thumbnail", msg);
 }
 
-float set_exposure_target(const CameraBuf *b, Rect ae_xywh, int x_skip, int y_skip) {
-  int lum_med;
-  uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
+AEStats calc_ae_stats(const uint8_t *pix_ptr, int stride, Rect ae_xywh, int x_skip, int y_skip) {
+  // one histogram for the median and the clipped pixels, in four lanes so that the increments of neighbouring
+  // pixels with the same value don't wait for each other. the cells only need their sum and count.
+  uint32_t lum_binning[4][256] = {};
+  uint64_t cell_sum[AE_GRID_SIZE * AE_GRID_SIZE] = {};
+  uint32_t cell_cnt[AE_GRID_SIZE * AE_GRID_SIZE] = {};
+
+  // the first sampled column of each grid column
+  int col_start[AE_GRID_SIZE + 1];
+  for (int j = 0; j <= AE_GRID_SIZE; ++j) {
+    const int cx = (ae_xywh.w * j + AE_GRID_SIZE - 1) / AE_GRID_SIZE;
+    col_start[j] = ae_xywh.x + (cx + x_skip - 1) / x_skip * x_skip;
+  }
 
-  unsigned int lum_total = 0;
   for (int y = ae_xywh.y; y < ae_xywh.y + ae_xywh.h; y += y_skip) {
-    for (int x = ae_xywh.x; x < ae_xywh.x + ae_xywh.w; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
+    const uint8_t *row = pix_ptr + y * stride;
+    const int cell_row = (y - ae_xywh.y) * AE_GRID_SIZE / ae_xywh.h * AE_GRID_SIZE;
+    for (int j = 0; j < AE_GRID_SIZE; ++j) {
+      const int end = col_start[j + 1];
+      uint32_t sum = 0;
+      int x = col_start[j];
+      for (; x + 3 * x_skip < end; x += 4 * x_skip) {
+        const uint8_t p0 = row[x], p1 = row[x + x_skip], p2 = row[x + 2 * x_skip], p3 = row[x + 3 * x_skip];
+        lum_binning[0][p0]++;
+        lum_binning[1][p1]++;
+        lum_binning[2][p2]++;
+        lum_binning[3][p3]++;
+        sum += p0 + p1 + p2 + p3;
+      }
+      for (; x < end; x += x_skip) {
+        lum_binning[0][row[x]]++;
+        sum += row[x];
+      }
+      cell_sum[cell_row + j] += sum;
+      cell_cnt[cell_row + j] += end > col_start[j] ? (end - col_start[j] + x_skip - 1) / x_skip : 0;
     }
   }
 
+  AEStats stats = {};
+  uint32_t lum_hist[256];
+  unsigned int lum_total = 0;
+  uint64_t lum_sum = 0, lum_clipped = 0;
+  for (int i = 0; i < 256; ++i) {
+    lum_hist[i] = lum_binning[0][i] + lum_binning[1][i] + lum_binning[2][i] + lum_binning[3][i];
+  }
+  for (int c = 0; c < AE_GRID_SIZE * AE_GRID_SIZE; ++c) {
+    stats.grid[c] = cell_cnt[c] > 0 ? cell_sum[c] / 256.0 / cell_cnt[c] : 0;
+    lum_total += cell_cnt[c];
+    lum_sum += cell_sum[c];
+  }
+  for (int i = AE_CLIPPED_LUM; i < 256; ++i) {
+    lum_clipped += lum_hist[i];
+  }
+
   // Find mean lumimance value
+  int lum_med;
   unsigned int lum_cur = 0;
   for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
+    lum_cur += lum_hist[lum_med];
 
     if (lum_cur >= lum_total / 2) {
       break;
     }
   }
 
-  return lum_med / 256.0;
+  stats.median = lum_med / 256.0;
+  if (lum_total > 0) {
+    stats.mean = lum_sum / 256.0 / lum_total;
+    stats.clipped = (float)lum_clipped / lum_total;
+  }
+  return stats;
+}
+
+float set_exposure_target(const CameraBuf *b, Rect ae_xywh, int x_skip, int y_skip) {
+  return calc_ae_stats(b->cur_yuv_buf->y, b->rgb_width, ae_xywh, x_skip, y_skip).median;
 }
 
 void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback) {
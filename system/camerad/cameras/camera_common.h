@@ -10,6 +10,8 @@
 #include "common/util.h"
 
 const int YUV_BUFFER_COUNT = 20;
+const int AE_GRID_SIZE = 4;
+const int AE_CLIPPED_LUM = 235;  // yuv max
 
 enum CameraType {
   RoadCam = 0,
@@ -40,7 +42,11 @@ typedef struct FrameMetadata {
   float measured_grey_fraction;
   float target_grey_fraction;
 
-  float processing_time;
+  // pipeline stages
+  float processing_time;  // ISP kernel, from queueing it to completion
+  float queue_time;  // waiting for the processing thread after the ISP finished
+  float publish_time;  // processing thread, publishing the previous frame and running AE
+  uint8_t queue_depth;  // frames waiting behind this one
 } FrameMetadata;
 
 struct MultiCameraState;
@@ -49,12 +55,24 @@ class ImgProc;
 
 class CameraBuf {
 private:
+  // a frame whose ISP kernel is queued or done
+  struct ProcessingFrame {
+    int buf_idx;
+    VisionBuf *yuv_buf;
+    cl_event event;
+    FrameMetadata frame_data;
+    double queued_time;
+  };
+
   VisionIpcServer *vipc_server;
   ImgProc *imgproc = nullptr;
   VisionStreamType stream_type;
   int cur_buf_idx;
-  SafeQueue<int> safe_queue;
+  SafeQueue<ProcessingFrame> safe_queue;
+  std::thread::id queue_thread;  // the only thread taking YUV buffers from vipc_server, see queue()
   int frame_buf_count;
+  double publish_start_time = 0;  // when the processing thread got the last frame
+  float publish_time = 0;
 
 public:
   cl_command_queue q;
@@ -76,6 +94,14 @@ typedef void (*process_thread_cb)(MultiCameraState *s, CameraState *c, int cnt);
 
 void fill_frame_data(cereal::FrameData::Builder &framed, const FrameMetadata &frame_data, CameraState *c);
 kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b);
+// luminance statistics of the AE region, collected in one pass over the sampled pixels. all in 0-1.
+struct AEStats {
+  float median;  // the grey fraction AE controls
+  float mean;
+  float clipped;  // fraction of pixels at AE_CLIPPED_LUM or above
+  float grid[AE_GRID_SIZE * AE_GRID_SIZE];  // mean of each cell of the region, row major
+};
+AEStats calc_ae_stats(const uint8_t *pix_ptr, int stride, Rect ae_xywh, int x_skip, int y_skip);
 float set_exposure_target(const CameraBuf *b, Rect ae_xywh, int x_skip, int y_skip);
 std::thread start_process_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback);
 
@@ -0,0 +1,363 @@
+#include "system/camerad/cameras/process_raw.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "system/camerad/sensors/sensor.h"
+
+// everything here follows process_raw.cl and the sensor headers in sensors/*_cl.h step by step,
+// keep them in sync.
+
+namespace {
+
+typedef float float4_t __attribute__((vector_size(16)));
+typedef int32_t int4_t __attribute__((vector_size(16)));
+
+const float ox03c10_lut[] = {
+#include "system/camerad/sensors/ox03c10_lut.h"
+};
+static_assert(sizeof(ox03c10_lut) / sizeof(ox03c10_lut[0]) == 4096);
+
+inline float4_t select(int4_t mask, float4_t a, float4_t b) {
+  return (float4_t)(((int4_t)a & mask) | ((int4_t)b & ~mask));
+}
+
+// NaN becomes lo, like fmin(fmax(v, lo), hi)
+inline float4_t clamp(float4_t v, float lo, float hi) {
+  v = select(v > lo, v, float4_t{} + lo);
+  return select(v < hi, v, float4_t{} + hi);
+}
+
+inline float4_t fabs(float4_t v) {
+  return (float4_t)((int4_t)v & 0x7fffffff);
+}
+
+template <class F>
+inline float4_t lanes(F f) {
+  return float4_t{f(0), f(1), f(2), f(3)};
+}
+
+inline float4_t get_k(float4_t a, float4_t b, float4_t c, float4_t d) {
+  return 2.0f - (fabs(a - b) + fabs(c - d));
+}
+
+float get_vignetting_s(float r) {
+  if (r < 62500) {
+    return (1.0f + 0.0000008f*r);
+  } else if (r < 490000) {
+    return (0.9625f + 0.0000014f*r);
+  } else if (r < 1102500) {
+    return (1.26434f + 0.0000000000016f*r*r);
+  } else {
+    return (0.53503625f + 0.0000000000022f*r*r);
+  }
+}
+
+void parse_12bit(const uint8_t *pvs, int out[4]) {
+  out[0] = ((int)pvs[0] << 4) + (pvs[1] >> 4);
+  out[1] = ((int)pvs[2] << 4) + (pvs[4] & 0xF);
+  out[2] = ((int)pvs[3] << 4) + (pvs[4] >> 4);
+  out[3] = ((int)pvs[5] << 4) + (pvs[7] & 0xF);
+}
+
+void parse_10bit(const uint8_t *pvs, bool aligned, int out[4]) {
+  if (aligned) {
+    out[0] = ((int)pvs[0] << 2) + (pvs[1] & 0b00000011);
+    out[1] = ((int)pvs[2] << 2) + ((pvs[6] & 0b11000000) / 64);
+    out[2] = ((int)pvs[3] << 2) + ((pvs[6] & 0b00110000) / 16);
+    out[3] = ((int)pvs[4] << 2) + ((pvs[6] & 0b00001100) / 4);
+  } else {
+    out[0] = ((int)pvs[0] << 2) + ((pvs[3] & 0b00110000) / 16);
+    out[1] = ((int)pvs[1] << 2) + ((pvs[3] & 0b00001100) / 4);
+    out[2] = ((int)pvs[2] << 2) + ((pvs[3] & 0b00000011));
+    out[3] = ((int)pvs[4] << 2) + ((pvs[8] & 0b11000000) / 64);
+  }
+}
+
+struct RGB {
+  float4_t r, g, b;
+};
+
+RGB color_correct(cereal::FrameData::ImageSensor sensor, const RGB &rgb) {
+  static const float ar0231[3][3] = {{1.82717181, -0.31231438, 0.07307673},
+                                     {-0.5743977, 1.36858544, -0.53183455},
+                                     {-0.25277411, -0.05627105, 1.45875782}};
+  static const float ox03c10[3][3] = {{1.5664815, -0.29808738, -0.03973474},
+                                      {-0.48672447, 1.41914433, -0.40295248},
+                                      {-0.07975703, -0.12105695, 1.44268722}};
+  static const float os04c10[3][3] = {{1.55361989, -0.268894615, -0.000593219},
+                                      {-0.421217301, 1.51883144, -0.69760146},
+                                      {-0.132402589, -0.249936825, 1.69819468}};
+  const auto &m = sensor == cereal::FrameData::ImageSensor::AR0231 ? ar0231
+                : sensor == cereal::FrameData::ImageSensor::OX03C10 ? ox03c10 : os04c10;
+  return {rgb.r * m[0][0] + rgb.g * m[1][0] + rgb.b * m[2][0],
+          rgb.r * m[0][1] + rgb.g * m[1][1] + rgb.b * m[2][1],
+          rgb.r * m[0][2] + rgb.g * m[1][2] + rgb.b * m[2][2]};
+}
+
+// the per frame constants of os04c10 apply_gamma
+struct LogGamma {
+  LogGamma(int expo_time) {
+    float s = std::log2((float)expo_time);
+    if (s < 6) {s = std::fmin(12.0f - s, 9.0f);}
+    scale = 0.48f*s*s - 12.92f*s + 115.0f;
+    offset = 1.08f*s*s - 29.2f*s + 260.0f;
+  }
+  float scale, offset;
+};
+
+float4_t apply_gamma(cereal::FrameData::ImageSensor sensor, float4_t rgb, const LogGamma &log_gamma) {
+  if (sensor == cereal::FrameData::ImageSensor::AR0231) {
+    // tone mapping params
+    const float gamma_k = 0.75f;
+    const float gamma_b = 0.125f;
+    const float mp = 0.01f; // ideally midpoint should be adaptive
+    const float rk = 9 - 100*mp;
+
+    // poly approximation for s curve
+    const float4_t hi = (rk * (rgb-mp) * (1-(gamma_k*mp+gamma_b)) * (1+1/(rk*(1-mp))) / (1.0f+rk*(rgb-mp))) + gamma_k*mp + gamma_b;
+    const float4_t lo = (rk * (rgb-mp) * (gamma_k*mp+gamma_b) * (1+1/(rk*mp)) / (1.0f-rk*(rgb-mp))) + gamma_k*mp + gamma_b;
+    return select(rgb > mp, hi, lo);
+  } else if (sensor == cereal::FrameData::ImageSensor::OX03C10) {
+    return lanes([&](int i) { return -0.507089f*std::exp(-12.54124638f*rgb[i]) + 0.9655f*std::sqrt(rgb[i]) - 0.472597f*rgb[i] + 0.507089f; });
+  } else {
+    // log function adaptive to number of bits
+    const float4_t l = lanes([&](int i) { return std::log(1 + rgb[i]*(65536 - 64)); });
+    return clamp(l * log_gamma.scale - log_gamma.offset, 0.0f, 255.0f) / 255.0f;
+  }
+}
+
+}  // namespace
+
+RawProcessor::RawProcessor(const SensorInfo *ci, int rgb_width, int rgb_height, int yuv_stride, int uv_offset, bool vignetting, int threads)
+    : sensor_(ci->image_sensor), frame_stride_(ci->hdr_offset > 0 ? ci->frame_stride * 2 : ci->frame_stride),
+      frame_offset_(ci->frame_offset), hdr_offset_(ci->hdr_offset), rgb_width_(rgb_width), rgb_height_(rgb_height),
+      yuv_stride_(yuv_stride), uv_offset_(uv_offset), vignetting_(vignetting),
+      threads_(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {
+  // the 10 bit sensor is always HDR
+  assert((sensor_ == cereal::FrameData::ImageSensor::OS04C10) == (hdr_offset_ > 0));
+  for (int i = 1; i < threads_; ++i) {
+    workers_.emplace_back(&RawProcessor::workerThread, this, i);
+  }
+}
+
+RawProcessor::~RawProcessor() {
+  {
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &t : workers_) t.join();
+}
+
+std::pair<int, int> RawProcessor::rowRange(int index) const {
+  const int block_rows = rgb_height_ / 2;
+  return {block_rows * index / threads_, block_rows * (index + 1) / threads_};
+}
+
+void RawProcessor::workerThread(int index) {
+  const auto [begin, end] = rowRange(index);
+  uint64_t frame = 0;
+  std::unique_lock lk(lock_);
+  while (true) {
+    start_cv_.wait(lk, [&]() { return exit_ || frame_ != frame; });
+    if (exit_) break;
+
+    frame = frame_;
+    const uint8_t *in = in_;
+    uint8_t *out = out_;
+    const int expo_time = expo_time_;
+    lk.unlock();
+    processRows(in, out, expo_time, begin, end);
+    lk.lock();
+    if (--pending_ == 0) done_cv_.notify_one();
+  }
+}
+
+void RawProcessor::process(const uint8_t *in, uint8_t *out, int expo_time) {
+  {
+    std::lock_guard lk(lock_);
+    in_ = in;
+    out_ = out;
+    expo_time_ = expo_time;
+    pending_ = workers_.size();
+    ++frame_;
+  }
+  start_cv_.notify_all();
+
+  const auto [begin, end] = rowRange(0);
+  processRows(in, out, expo_time, begin, end);
+
+  std::unique_lock lk(lock_);
+  done_cv_.wait(lk, [this]() { return pending_ == 0; });
+}
+
+void RawProcessor::processRows(const uint8_t *in, uint8_t *out, int expo_time, int begin, int end) const {
+  const bool hdr = hdr_offset_ > 0;
+  const bool bggr = sensor_ == cereal::FrameData::ImageSensor::OS04C10;
+  const int row_read_order[] = {bggr ? 3 : 0, bggr ? 2 : 1, bggr ? 1 : 2, bggr ? 0 : 3};
+  const int rgb_write_order[] = {bggr ? 2 : 0, bggr ? 3 : 1, bggr ? 0 : 2, bggr ? 1 : 3};
+  const float vignette_rsz = sensor_ == cereal::FrameData::ImageSensor::OS04C10 ? 2.2545f : 1.0f;
+  const int blocks = rgb_width_ / 2;
+  const LogGamma log_gamma(expo_time);
+
+  for (int gid_y = begin; gid_y < end; ++gid_y) {
+    const int row_offsets[] = {(gid_y == 0) ? 2 : 0, 1, 2, (gid_y == (rgb_height_/2 - 1)) ? 1 : 3};
+
+    for (int gid_x0 = 0; gid_x0 < blocks; gid_x0 += 4) {
+      // v_rows of the kernel, a vector holds the same pixel of four blocks
+      float4_t v_rows[4][4];
+      float4_t vignette_factor = {1.0f, 1.0f, 1.0f, 1.0f};
+      int parsed[4][4][4], short_parsed[4][4][4];  // [row][pixel][block]
+
+      for (int l = 0; l < 4; ++l) {
+        // the blocks after the end of the row repeat the last one, and are not written
+        const int gid_x = std::min(gid_x0 + l, blocks - 1);
+        if (vignetting_) {
+          int gx = (gid_x*2 - rgb_width_/2);
+          int gy = (gid_y*2 - rgb_height_/2);
+          vignette_factor[l] = get_vignetting_s((gx*gx + gy*gy) / vignette_rsz);
+        }
+
+        const bool aligned10 = gid_x % 2 == 0;
+        int start_idx;
+        if (hdr) {
+          start_idx = (2 * gid_y - 1) * frame_stride_ + (aligned10 ? (5 * gid_x / 2 - 2) : (5 * (gid_x - 1) / 2 + 1)) + (frame_stride_ * frame_offset_);
+        } else {
+          start_idx = (2 * gid_y - 1) * frame_stride_ + (3 * gid_x - 2) + (frame_stride_ * frame_offset_);
+        }
+
+        for (int r = 0; r < 4; ++r) {
+          int p[4];
+          const uint8_t *row = in + start_idx + frame_stride_ * row_offsets[r];
+          const uint8_t *dat = row;
+          uint8_t first[9];
+          if (r == 1 && gid_x == 0 && gid_y == 0) {
+            // the two bytes before the first row are not read
+            first[0] = first[1] = 0;
+            std::copy(row + 2, row + 9, first + 2);
+            dat = first;
+          }
+          if (hdr) {
+            parse_10bit(dat, aligned10, p);
+            int sp[4];
+            parse_10bit(row + frame_stride_ * (hdr_offset_ / 2) + frame_stride_ / 2, aligned10, sp);
+            for (int c = 0; c < 4; ++c) short_parsed[row_read_order[r]][c][l] = sp[c];
+          } else {
+            parse_12bit(dat, p);
+          }
+          for (int c = 0; c < 4; ++c) parsed[row_read_order[r]][c][l] = p[c];
+        }
+
+        // mirror padding, it's the same after normalizing
+        for (int r = 0; r < 4; ++r) {
+          if (gid_x == 0) {
+            parsed[r][0][l] = parsed[r][2][l];
+            short_parsed[r][0][l] = short_parsed[r][2][l];
+          } else if (gid_x == blocks - 1) {
+            parsed[r][3][l] = parsed[r][1][l];
+            short_parsed[r][3][l] = short_parsed[r][1][l];
+          }
+        }
+      }
+
+      // parse into floats 0.0-1.0
+      for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+          const int *pv = parsed[r][c];
+          if (sensor_ == cereal::FrameData::ImageSensor::AR0231) {
+            const float4_t v = (float4_t{(float)pv[0], (float)pv[1], (float)pv[2], (float)pv[3]} - 168.0f) / (4096.0f - 168.0f);
+            v_rows[r][c] = clamp(v * vignette_factor, 0.0f, 1.0f);
+          } else if (sensor_ == cereal::FrameData::ImageSensor::OX03C10) {
+            // PWL
+            const float4_t v = {ox03c10_lut[pv[0]], ox03c10_lut[pv[1]], ox03c10_lut[pv[2]], ox03c10_lut[pv[3]]};
+            v_rows[r][c] = clamp(v * vignette_factor * 256.0f, 0.0f, 1.0f);
+          } else {
+            // combine_dual_pvs
+            const int *sv = short_parsed[r][c];
+            const float4_t pl = {(float)(pv[0] - 64), (float)(pv[1] - 64), (float)(pv[2] - 64), (float)(pv[3] - 64)};
+            const float4_t ps = {(float)(sv[0] - 64), (float)(sv[1] - 64), (float)(sv[2] - 64), (float)(sv[3] - 64)};
+            float4_t v;
+            if (expo_time > 64) {
+              const float4_t svc = lanes([&](int i) { return std::fmax(ps[i] * expo_time, (float)(64 * (1023 - 64))); });
+              v = select(pl < 1023.0f - 64, pl / (65536.0f - 64), (svc / 64.0f) / (65536.0f - 64));
+            } else {
+              const float4_t svd = ps * std::fmin((float)expo_time, 8.0f) / 8.0f;
+              v = select(pl > 32.0f, (pl * 64.0f / std::fmax((float)expo_time, 8.0f)) / (65536.0f - 64), svd / (65536.0f - 64));
+            }
+            v_rows[r][c] = clamp(v * vignette_factor, 0.0f, 1.0f);
+          }
+        }
+      }
+
+      // debayering
+      // a simplified version of https://opensignalprocessingjournal.com/contents/volumes/V6/TOSIGPJ-6-1/TOSIGPJ-6-1.pdf
+      const auto &v = v_rows;
+      RGB rgb[4];
+      const float4_t k01 = get_k(v[0][0], v[1][1], v[0][2], v[1][1]);
+      const float4_t k02 = get_k(v[0][2], v[1][1], v[2][2], v[1][1]);
+      const float4_t k03 = get_k(v[2][0], v[1][1], v[2][2], v[1][1]);
+      const float4_t k04 = get_k(v[0][0], v[1][1], v[2][0], v[1][1]);
+      rgb[0].r = (k02*v[1][2]+k04*v[1][0])/(k02+k04); // R_G1
+      rgb[0].g = v[1][1]; // G1(R)
+      rgb[0].b = (k01*v[0][1]+k03*v[2][1])/(k01+k03); // B_G1
+
+      const float4_t k11 = get_k(v[0][1], v[2][1], v[0][3], v[2][3]);
+      const float4_t k12 = get_k(v[0][2], v[1][1], v[1][3], v[2][2]);
+      const float4_t k13 = get_k(v[0][1], v[0][3], v[2][1], v[2][3]);
+      const float4_t k14 = get_k(v[0][2], v[1][3], v[2][2], v[1][1]);
+      rgb[1].r = v[1][2]; // R
+      rgb[1].g = (k11*(v[0][2]+v[2][2])*0.5f+k13*(v[1][3]+v[1][1])*0.5f)/(k11+k13); // G_R
+      rgb[1].b = (k12*(v[0][3]+v[2][1])*0.5f+k14*(v[0][1]+v[2][3])*0.5f)/(k12+k14); // B_R
+
+      const float4_t k21 = get_k(v[1][0], v[3][0], v[1][2], v[3][2]);
+      const float4_t k22 = get_k(v[1][1], v[2][0], v[2][2], v[3][1]);
+      const float4_t k23 = get_k(v[1][0], v[1][2], v[3][0], v[3][2]);
+      const float4_t k24 = get_k(v[1][1], v[2][2], v[3][1], v[2][0]);
+      rgb[2].r = (k22*(v[1][2]+v[3][0])*0.5f+k24*(v[1][0]+v[3][2])*0.5f)/(k22+k24); // R_B
+      rgb[2].g = (k21*(v[1][1]+v[3][1])*0.5f+k23*(v[2][2]+v[2][0])*0.5f)/(k21+k23); // G_B
+      rgb[2].b = v[2][1]; // B
+
+      const float4_t k31 = get_k(v[1][1], v[2][2], v[1][3], v[2][2]);
+      const float4_t k32 = get_k(v[1][3], v[2][2], v[3][3], v[2][2]);
+      const float4_t k33 = get_k(v[3][1], v[2][2], v[3][3], v[2][2]);
+      const float4_t k34 = get_k(v[1][1], v[2][2], v[3][1], v[2][2]);
+      rgb[3].r = (k31*v[1][2]+k33*v[3][2])/(k31+k33); // R_G2
+      rgb[3].g = v[2][2]; // G2(B)
+      rgb[3].b = (k32*v[2][3]+k34*v[2][1])/(k32+k34); // B_G2
+
+      // convert_uchar3_sat(apply_gamma(color_correct(clamp(rgb_tmp, 0.0, 1.0)), expo_time) * 255.0)
+      int4_t rgb_out[4][3];
+      for (int i = 0; i < 4; ++i) {
+        const RGB cc = color_correct(sensor_, {clamp(rgb[i].r, 0.0f, 1.0f), clamp(rgb[i].g, 0.0f, 1.0f), clamp(rgb[i].b, 0.0f, 1.0f)});
+        int4_t *o = rgb_out[rgb_write_order[i]];
+        o[0] = __builtin_convertvector(clamp(apply_gamma(sensor_, cc.r, log_gamma) * 255.0f, 0.0f, 255.0f), int4_t);
+        o[1] = __builtin_convertvector(clamp(apply_gamma(sensor_, cc.g, log_gamma) * 255.0f, 0.0f, 255.0f), int4_t);
+        o[2] = __builtin_convertvector(clamp(apply_gamma(sensor_, cc.b, log_gamma) * 255.0f, 0.0f, 255.0f), int4_t);
+      }
+
+      // rgb2yuv(nv12)
+      auto rgb_to_y = [](const int4_t *p) { return (((p[2] * 13 + p[1] * 65 + p[0] * 33) + 64) >> 7) + 16; };
+      const int4_t y[4] = {rgb_to_y(rgb_out[0]), rgb_to_y(rgb_out[1]), rgb_to_y(rgb_out[2]), rgb_to_y(rgb_out[3])};
+      const int4_t ar = (rgb_out[0][0] + rgb_out[1][0] + rgb_out[2][0] + rgb_out[3][0] + 1) >> 1;
+      const int4_t ag = (rgb_out[0][1] + rgb_out[1][1] + rgb_out[2][1] + rgb_out[3][1] + 1) >> 1;
+      const int4_t ab = (rgb_out[0][2] + rgb_out[1][2] + rgb_out[2][2] + rgb_out[3][2] + 1) >> 1;
+      const int4_t u = (ab * 56 - ag * 37 - ar * 19 + 0x8080) >> 8;
+      const int4_t vv = (ar * 56 - ag * 47 - ab * 9 + 0x8080) >> 8;
+
+      const int n = std::min(4, blocks - gid_x0);
+      uint8_t *y0 = out + (gid_y * 2) * yuv_stride_ + gid_x0 * 2;
+      uint8_t *y1 = y0 + yuv_stride_;
+      uint8_t *uv = out + uv_offset_ + gid_y * yuv_stride_ + gid_x0 * 2;
+      for (int l = 0; l < n; ++l) {
+        y0[l * 2] = y[0][l];
+        y0[l * 2 + 1] = y[1][l];
+        y1[l * 2] = y[2][l];
+        y1[l * 2 + 1] = y[3][l];
+        uv[l * 2] = u[l];
+        uv[l * 2 + 1] = vv[l];
+      }
+    }
+  }
+}
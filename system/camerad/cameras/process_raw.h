@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cereal/gen/cpp/log.capnp.h"
+
+class SensorInfo;
+
+// CPU implementation of process_raw.cl for machines without a GPU: debayering, black level, vignetting,
+// color correction, gamma and RGB to NV12, producing the same image as the OpenCL kernel.
+// Four 2x2 blocks (work items of the kernel) are processed at once in SIMD registers, and the block
+// rows are split across the calling thread and a pool of workers started with the processor.
+class RawProcessor {
+public:
+  RawProcessor(const SensorInfo *ci, int rgb_width, int rgb_height, int yuv_stride, int uv_offset, bool vignetting, int threads = 0);
+  ~RawProcessor();
+  // one frame at a time, returns when the whole frame is processed.
+  void process(const uint8_t *in, uint8_t *out, int expo_time);
+  // processes the block rows [begin, end), each one is two rows of the output image.
+  void processRows(const uint8_t *in, uint8_t *out, int expo_time, int begin, int end) const;
+
+private:
+  void workerThread(int index);
+  // the block rows [begin, end) of the thread, the calling thread is 0
+  std::pair<int, int> rowRange(int index) const;
+
+  cereal::FrameData::ImageSensor sensor_;
+  int frame_stride_, frame_offset_, hdr_offset_;
+  int rgb_width_, rgb_height_, yuv_stride_, uv_offset_;
+  bool vignetting_;
+  int threads_;
+
+  // a frame is handed to the workers by bumping frame_, each one takes its row range and decrements pending_
+  std::vector<std::thread> workers_;
+  std::mutex lock_;
+  std::condition_variable start_cv_, done_cv_;
+  const uint8_t *in_ = nullptr;
+  uint8_t *out_ = nullptr;
+  int expo_time_ = 0;
+  uint64_t frame_ = 0;
+  int pending_ = 0;
+  bool exit_ = false;
+};
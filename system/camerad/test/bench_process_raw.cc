@@ -0,0 +1,50 @@
+// Measures the throughput of the CPU ISP (RawProcessor) for each sensor.
+//
+// usage: bench_process_raw [FRAMES] [THREADS]
+//   default: 20 frames per sensor, one thread per core
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/timing.h"
+#include "system/camerad/cameras/process_raw.h"
+#include "system/camerad/sensors/sensor.h"
+#include "third_party/linux/include/msm_media_info.h"
+
+int main(int argc, char *argv[]) {
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 20;
+  const int threads = argc > 2 ? std::atoi(argv[2]) : 0;
+
+  std::pair<const char *, std::unique_ptr<SensorInfo>> sensors[] = {
+    {"ar0231", std::make_unique<AR0231>()},
+    {"ox03c10", std::make_unique<OX03C10>()},
+    {"os04c10", std::make_unique<OS04C10>()},
+  };
+  std::mt19937 gen(0);
+  for (auto &[name, ci] : sensors) {
+    const int rgb_width = ci->frame_width;
+    const int rgb_height = ci->hdr_offset > 0 ? (ci->frame_height - ci->hdr_offset) / 2 : ci->frame_height;
+    const int yuv_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, rgb_width);
+    const int uv_offset = yuv_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, rgb_height);
+
+    std::vector<uint8_t> in((ci->frame_height + ci->extra_height) * ci->frame_stride);
+    for (auto &b : in) b = gen();
+    std::vector<uint8_t> out(uv_offset + yuv_stride * VENUS_UV_SCANLINES(COLOR_FMT_NV12, rgb_height));
+
+    RawProcessor processor(ci.get(), rgb_width, rgb_height, yuv_stride, uv_offset, true, threads);
+    processor.process(in.data(), out.data(), 64);  // warm up
+
+    const double start = millis_since_boot();
+    for (int i = 0; i < frames; ++i) {
+      processor.process(in.data(), out.data(), 64);
+    }
+    const double ms = (millis_since_boot() - start) / frames;
+    printf("%-8s %dx%d: %.2f ms/frame, %.1f fps, %.1f MP/s\n", name, rgb_width, rgb_height, ms, 1000.0 / ms,
+           rgb_width * rgb_height / ms / 1000.0);
+  }
+  return 0;
+}
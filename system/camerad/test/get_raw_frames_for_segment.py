@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+import argparse
+import os
+from tqdm import tqdm
+
+from openpilot.tools.lib.logreader import LogReader
+
+# dumps the raw road camera frames of a route recorded with LOG_RAW_FRAMES=1,
+# named <sensor>_<frameId>_<integLines>.raw for RAW_FRAMES_DIR of test_process_raw
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser()
+  parser.add_argument("route", help="The route name")
+  args = parser.parse_args()
+
+  out_path = os.path.join("raw", f"{args.route.replace('|', '_').replace('/', '_')}")
+  os.makedirs(out_path, exist_ok=True)
+
+  lr = LogReader(args.route)
+
+  for msg in tqdm(lr):
+    if msg.which() == 'roadCameraState' and len(msg.roadCameraState.image):
+      cs = msg.roadCameraState
+      with open(os.path.join(out_path, f"{str(cs.sensor).lower()}_{cs.frameId}_{cs.integLines}.raw"), 'wb') as f:
+        f.write(cs.image)
@@ -1,10 +1,14 @@
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include "catch2/catch.hpp"
 
 #include <cassert>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <random>
+#include <vector>
 
 #include "common/util.h"
 #include "system/camerad/cameras/camera_common.h"
@@ -82,3 +86,70 @@ TEST_CASE("camera.test_set_exposure_target") {
 
   delete[] fb_y;
 }
+
+// the median as set_exposure_target computed it before calc_ae_stats
+static float scalar_median(const uint8_t *pix_ptr, int stride, Rect ae_xywh, int x_skip, int y_skip) {
+  int lum_med;
+  uint32_t lum_binning[256] = {0};
+  unsigned int lum_total = 0;
+  for (int y = ae_xywh.y; y < ae_xywh.y + ae_xywh.h; y += y_skip) {
+    for (int x = ae_xywh.x; x < ae_xywh.x + ae_xywh.w; x += x_skip) {
+      uint8_t lum = pix_ptr[(y * stride) + x];
+      lum_binning[lum]++;
+      lum_total += 1;
+    }
+  }
+  unsigned int lum_cur = 0;
+  for (lum_med = 255; lum_med >= 0; lum_med--) {
+    lum_cur += lum_binning[lum_med];
+    if (lum_cur >= lum_total / 2) {
+      break;
+    }
+  }
+  return lum_med / 256.0;
+}
+
+TEST_CASE("camera.calc_ae_stats") {
+  // a road camera frame with the AE region and subsampling of process_road_camera
+  const int w = 1928, h = 1208;
+  const Rect rect = {96, 160, 1734, 986};
+  std::vector<uint8_t> frame(w * h);
+  std::mt19937 gen(0);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      // bright sky on top, noise everywhere
+      frame[y * w + x] = std::min(255, int(y < h / 3 ? 240 : x * 200 / w) + int(gen() % 16));
+    }
+  }
+
+  for (auto [x_skip, y_skip] : {std::pair{1, 1}, {2, 2}, {2, 4}, {3, 5}}) {
+    AEStats stats = calc_ae_stats(frame.data(), w, rect, x_skip, y_skip);
+    REQUIRE(stats.median == scalar_median(frame.data(), w, rect, x_skip, y_skip));
+
+    uint64_t sum = 0, cnt = 0, clipped = 0;
+    uint64_t cell_sum[AE_GRID_SIZE * AE_GRID_SIZE] = {}, cell_cnt[AE_GRID_SIZE * AE_GRID_SIZE] = {};
+    for (int y = rect.y; y < rect.y + rect.h; y += y_skip) {
+      for (int x = rect.x; x < rect.x + rect.w; x += x_skip) {
+        const uint8_t lum = frame[y * w + x];
+        const int cell = (y - rect.y) * AE_GRID_SIZE / rect.h * AE_GRID_SIZE + (x - rect.x) * AE_GRID_SIZE / rect.w;
+        sum += lum;
+        cnt++;
+        clipped += lum >= AE_CLIPPED_LUM;
+        cell_sum[cell] += lum;
+        cell_cnt[cell]++;
+      }
+    }
+    REQUIRE(stats.mean == Approx(sum / 256.0 / cnt));
+    REQUIRE(stats.clipped == Approx((float)clipped / cnt));
+    for (int i = 0; i < AE_GRID_SIZE * AE_GRID_SIZE; ++i) {
+      REQUIRE(stats.grid[i] == Approx(cell_sum[i] / 256.0 / cell_cnt[i]));
+    }
+  }
+
+  BENCHMARK("scalar histogram") {
+    return scalar_median(frame.data(), w, rect, 2, 2);
+  };
+  BENCHMARK("calc_ae_stats") {
+    return calc_ae_stats(frame.data(), w, rect, 2, 2);
+  };
+}
@@ -0,0 +1,137 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <dirent.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/clutil.h"
+#include "common/util.h"
+#include "system/camerad/cameras/process_raw.h"
+#include "system/camerad/sensors/sensor.h"
+#include "third_party/linux/include/msm_media_info.h"
+
+// compares RawProcessor with process_raw.cl on random frames, and on the raw frames in RAW_FRAMES_DIR
+// (from get_raw_frames_for_segment.py) if it's set. run from system/camerad, like camerad.
+
+struct Frame {
+  std::string data;
+  int expo_time;
+};
+
+struct Sensor {
+  std::string name;
+  std::unique_ptr<SensorInfo> ci;
+  int rgb_width, rgb_height, yuv_stride, uv_offset, yuv_size;
+
+  Sensor(const std::string &sensor_name, SensorInfo *sensor_info) : name(sensor_name), ci(sensor_info) {
+    rgb_width = ci->frame_width;
+    rgb_height = ci->hdr_offset > 0 ? (ci->frame_height - ci->hdr_offset) / 2 : ci->frame_height;
+    yuv_stride = VENUS_Y_STRIDE(COLOR_FMT_NV12, rgb_width);
+    uv_offset = yuv_stride * VENUS_Y_SCANLINES(COLOR_FMT_NV12, rgb_height);
+    yuv_size = uv_offset + yuv_stride * VENUS_UV_SCANLINES(COLOR_FMT_NV12, rgb_height);
+  }
+  size_t frameSize() const { return (ci->frame_height + ci->extra_height) * ci->frame_stride; }
+};
+
+std::vector<uint8_t> process_cl(cl_device_id device_id, cl_context context, const Sensor &s, bool vignetting, const Frame &frame) {
+  const SensorInfo *ci = s.ci.get();
+  // the same as ImgProc in camera_common.cc
+  char args[4096];
+  snprintf(args, sizeof(args),
+           "-cl-fast-relaxed-math -cl-denorms-are-zero -Isensors "
+           "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
+           "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DYUV_STRIDE=%d -DUV_OFFSET=%d "
+           "-DSENSOR_ID=%hu -DHDR_OFFSET=%d -DVIGNETTING=%d ",
+           ci->frame_width, ci->frame_height, ci->hdr_offset > 0 ? ci->frame_stride * 2 : ci->frame_stride, ci->frame_offset,
+           s.rgb_width, s.rgb_height, s.yuv_stride, s.uv_offset,
+           static_cast<unsigned short>(ci->image_sensor), ci->hdr_offset, vignetting);
+  cl_program prg = cl_program_from_file(context, device_id, "cameras/process_raw.cl", args);
+  cl_kernel krnl = CL_CHECK_ERR(clCreateKernel(prg, "process_raw", &err));
+  CL_CHECK(clReleaseProgram(prg));
+
+  std::vector<uint8_t> out(s.yuv_size);
+  cl_mem in_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, frame.data.size(), (void *)frame.data.data(), &err));
+  cl_mem out_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_COPY_HOST_PTR, out.size(), out.data(), &err));
+  CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &in_cl));
+  CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_mem), &out_cl));
+  CL_CHECK(clSetKernelArg(krnl, 2, sizeof(cl_int), &frame.expo_time));
+
+  const cl_queue_properties props[] = {0};
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
+  const size_t globalWorkSize[] = {size_t(s.rgb_width / 2), size_t(s.rgb_height / 2)};
+  const size_t localWorkSize[] = {16, 16};
+  CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, globalWorkSize, localWorkSize, 0, 0, NULL));
+  CL_CHECK(clEnqueueReadBuffer(q, out_cl, CL_TRUE, 0, out.size(), out.data(), 0, NULL, NULL));
+
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseMemObject(in_cl));
+  CL_CHECK(clReleaseMemObject(out_cl));
+  CL_CHECK(clReleaseKernel(krnl));
+  return out;
+}
+
+std::vector<Frame> load_frames(const Sensor &s) {
+  std::vector<Frame> frames;
+  // noise and gradients
+  std::mt19937 gen(0);
+  for (int expo_time : {4, 64, 500}) {
+    std::string data(s.frameSize(), '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = (i / 10000) % 3 == 0 ? gen() : (i * 7 / 1000 + (gen() & 3));
+    }
+    frames.push_back({data, expo_time});
+  }
+
+  if (const char *dir = std::getenv("RAW_FRAMES_DIR")) {
+    DIR *d = opendir(dir);
+    REQUIRE(d);
+    while (struct dirent *de = readdir(d)) {
+      // <sensor>_<frameId>_<integLines>.raw
+      std::string name = de->d_name;
+      if (!util::starts_with(name, s.name + "_") || !util::ends_with(name, ".raw")) continue;
+
+      Frame f = {util::read_file(std::string(dir) + "/" + name), std::atoi(name.substr(name.rfind('_') + 1).c_str())};
+      REQUIRE(f.data.size() == s.frameSize());
+      frames.push_back(f);
+    }
+    closedir(d);
+  }
+  return frames;
+}
+
+TEST_CASE("RawProcessor matches process_raw.cl") {
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = cl_create_context(device_id);
+
+  Sensor sensors[] = {{"ar0231", new AR0231()}, {"ox03c10", new OX03C10()}, {"os04c10", new OS04C10()}};
+  for (auto &s : sensors) {
+    for (bool vignetting : {false, true}) {
+      RawProcessor processor(s.ci.get(), s.rgb_width, s.rgb_height, s.yuv_stride, s.uv_offset, vignetting);
+      for (const auto &frame : load_frames(s)) {
+        std::vector<uint8_t> expected = process_cl(device_id, context, s, vignetting, frame);
+        std::vector<uint8_t> out(s.yuv_size);
+        processor.process((const uint8_t *)frame.data.data(), out.data(), frame.expo_time);
+
+        // -cl-fast-relaxed-math lets the device use less precise exp and log, allow those to round differently
+        size_t diffs = 0;
+        int max_diff = 0;
+        for (size_t i = 0; i < out.size(); ++i) {
+          if (out[i] != expected[i]) {
+            ++diffs;
+            max_diff = std::max(max_diff, std::abs(out[i] - expected[i]));
+          }
+        }
+        INFO(s.name << " vignetting " << vignetting << " expo_time " << frame.expo_time << ": " << diffs << " bytes differ");
+        REQUIRE(max_diff <= 1);
+        REQUIRE(diffs <= out.size() / 1000);
+      }
+    }
+  }
+  CL_CHECK(clReleaseContext(context));
+}
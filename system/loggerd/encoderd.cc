@@ -1,5 +1,6 @@
 #include <cassert>
 
+#include "cereal/messaging/msgtrace.h"
 #include "system/loggerd/loggerd.h"
 
 #ifdef QCOM2
@@ -84,6 +85,7 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
         continue;
       }
       lagging = false;
+      msgtrace::trace(msgtrace::VIPC_RECEIVE, cam_info.thread_name, extra.timestamp_sof, extra.frame_id);
 
       if (!sync_encoders(s, cam_info.type, extra.frame_id)) {
         continue;
@@ -9,13 +9,16 @@ ExitHandler do_exit;
 
 int main(int argc, char **argv) {
   setpriority(PRIO_PROCESS, 0, -15);
+  // one fd is kept open per process
+  util::set_file_descriptor_limit(4096);
 
   RateKeeper rk("proclogd", 0.5);
   PubMaster publisher({"procLog"});
+  ProcLogCollector collector(getenv("PROCLOG_DELTA") != nullptr, getenv("PROCLOG_SCHED") != nullptr);
 
   while (!do_exit) {
     MessageBuilder msg;
-    buildProcLogMessage(msg);
+    collector.build(msg);
     publisher.send("procLog", msg);
 
     rk.keepTime();
@@ -1,14 +1,21 @@
 #include "system/proclogd/proclog.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <sstream>
 
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/util.h"
+#include "system/proclogd/schedlog.h"
 
 namespace Parser {
 
@@ -59,66 +66,94 @@ enum StatPos {
   vsize = 23,
   rss = 24,
   processor = 39,
+  rt_priority = 40,
+  policy = 41,
   MAX_FIELD = 52,
 };
 
 // parse /proc/pid/stat
-std::optional<ProcStat> procStat(std::string stat) {
+bool procStat(const char *buf, size_t len, ProcStat &p) {
   // To avoid being fooled by names containing a closing paren, scan backwards.
-  auto open_paren = stat.find('(');
-  auto close_paren = stat.rfind(')');
-  if (open_paren == std::string::npos || close_paren == std::string::npos || open_paren > close_paren) {
-    return std::nullopt;
+  const char *end = buf + len;
+  const char *open_paren = (const char *)memchr(buf, '(', len);
+  const char *close_paren = (const char *)memrchr(buf, ')', len);
+  if (open_paren == nullptr || close_paren == nullptr || open_paren > close_paren) {
+    return false;
   }
 
-  std::string name = stat.substr(open_paren + 1, close_paren - open_paren - 1);
-  // replace space in name with _
-  std::replace(&stat[open_paren], &stat[close_paren], ' ', '_');
-  std::istringstream iss(stat);
-  std::vector<std::string> v{std::istream_iterator<std::string>(iss),
-                             std::istream_iterator<std::string>()};
-  try {
-    if (v.size() != StatPos::MAX_FIELD) {
-      throw std::invalid_argument("stat");
+  auto parse_number = [end](const char *&s, uint64_t &v) {
+    const bool negative = s < end && *s == '-';
+    if (negative) ++s;
+    const char *first = s;
+    for (v = 0; s < end && *s >= '0' && *s <= '9'; ++s) {
+      v = v * 10 + (*s - '0');
     }
-    ProcStat p = {
-      .name = name,
-      .pid = stoi(v[StatPos::pid - 1]),
-      .state = v[StatPos::state - 1][0],
-      .ppid = stoi(v[StatPos::ppid - 1]),
-      .utime = stoul(v[StatPos::utime - 1]),
-      .stime = stoul(v[StatPos::stime - 1]),
-      .cutime = stol(v[StatPos::cutime - 1]),
-      .cstime = stol(v[StatPos::cstime - 1]),
-      .priority = stol(v[StatPos::priority - 1]),
-      .nice = stol(v[StatPos::nice - 1]),
-      .num_threads = stol(v[StatPos::num_threads - 1]),
-      .starttime = stoull(v[StatPos::starttime - 1]),
-      .vms = stoul(v[StatPos::vsize - 1]),
-      .rss = stol(v[StatPos::rss - 1]),
-      .processor = stoi(v[StatPos::processor - 1]),
-    };
-    return p;
-  } catch (const std::invalid_argument &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  } catch (const std::out_of_range &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  }
-  return std::nullopt;
+    if (negative) v = -v;
+    return s != first && (s == end || *s == ' ' || *s == '\n');
+  };
+
+  uint64_t fields[StatPos::MAX_FIELD + 1] = {};
+  const char *s = buf;
+  if (!parse_number(s, fields[StatPos::pid]) || s + 1 != open_paren) {
+    return false;
+  }
+  p.name.assign(open_paren + 1, close_paren);
+
+  int field = 2;
+  for (s = close_paren + 1; ; ) {
+    while (s < end && (*s == ' ' || *s == '\n')) ++s;
+    if (s == end) break;
+    if (++field > StatPos::MAX_FIELD) return false;
+
+    if (field == StatPos::state) {
+      p.state = *s++;
+    } else if (!parse_number(s, fields[field])) {
+      return false;
+    }
+  }
+  if (field != StatPos::MAX_FIELD) {
+    return false;
+  }
+
+  p.pid = fields[StatPos::pid];
+  p.ppid = fields[StatPos::ppid];
+  p.utime = fields[StatPos::utime];
+  p.stime = fields[StatPos::stime];
+  p.cutime = fields[StatPos::cutime];
+  p.cstime = fields[StatPos::cstime];
+  p.priority = fields[StatPos::priority];
+  p.nice = fields[StatPos::nice];
+  p.num_threads = fields[StatPos::num_threads];
+  p.starttime = fields[StatPos::starttime];
+  p.vms = fields[StatPos::vsize];
+  p.rss = fields[StatPos::rss];
+  p.processor = fields[StatPos::processor];
+  p.rt_priority = fields[StatPos::rt_priority];
+  p.policy = fields[StatPos::policy];
+  return true;
 }
 
-// return list of PIDs from /proc
-std::vector<int> pids() {
+std::optional<ProcStat> procStat(std::string stat) {
+  ProcStat p = {};
+  if (!procStat(stat.data(), stat.size(), p)) {
+    LOGE("failed to parse procStat :%s", stat.c_str());
+    return std::nullopt;
+  }
+  return p;
+}
+
+// return the numeric entries of a /proc directory
+static std::vector<int> listIds(const char *path) {
   std::vector<int> ids;
-  DIR *d = opendir("/proc");
-  assert(d);
+  DIR *d = opendir(path);
+  if (!d) return ids;
   char *p_end;
   struct dirent *de = NULL;
   while ((de = readdir(d))) {
     if (de->d_type == DT_DIR) {
-      int pid = strtol(de->d_name, &p_end, 10);
+      int id = strtol(de->d_name, &p_end, 10);
       if (p_end == (de->d_name + strlen(de->d_name))) {
-        ids.push_back(pid);
+        ids.push_back(id);
       }
     }
   }
@@ -126,6 +161,41 @@ std::vector<int> pids() {
   return ids;
 }
 
+// return list of PIDs from /proc
+std::vector<int> pids() {
+  std::vector<int> ids = listIds("/proc");
+  assert(!ids.empty());
+  return ids;
+}
+
+// return list of thread ids of a process from /proc/pid/task
+std::vector<int> tids(int pid) {
+  return listIds(("/proc/" + std::to_string(pid) + "/task").c_str());
+}
+
+// parse /proc/pid/task/tid/schedstat
+std::optional<SchedStat> schedStat(const char *str) {
+  SchedStat s = {};
+  if (sscanf(str, "%" SCNu64 " %" SCNu64 " %" SCNu64, &s.run_time, &s.run_delay, &s.timeslices) != 3) {
+    return std::nullopt;
+  }
+  return s;
+}
+
+// parse the "key : value" lines of /proc/pid/task/tid/sched
+std::unordered_map<std::string, uint64_t> schedInfo(std::istream &stream) {
+  std::unordered_map<std::string, uint64_t> info;
+  std::string line, key, colon;
+  while (std::getline(stream, line)) {
+    uint64_t val = 0;
+    std::istringstream iss(line);
+    if (iss >> key >> colon >> val && colon == ":") {
+      info[key] = val;
+    }
+  }
+  return info;
+}
+
 // null-delimited cmdline arguments to vector
 std::vector<std::string> cmdline(std::istream &stream) {
   std::vector<std::string> ret;
@@ -138,17 +208,12 @@ std::vector<std::string> cmdline(std::istream &stream) {
   return ret;
 }
 
-const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
-  static std::unordered_map<pid_t, ProcCache> proc_cache;
-  ProcCache &cache = proc_cache[pid];
-  if (cache.pid != pid || cache.name != name) {
-    cache.pid = pid;
-    cache.name = name;
-    std::string proc_path = "/proc/" + std::to_string(pid);
-    cache.exe = util::readlink(proc_path + "/exe");
-    std::ifstream stream(proc_path + "/cmdline");
-    cache.cmdline = cmdline(stream);
-  }
+ProcCache procExtraInfo(int pid, const std::string &name) {
+  ProcCache cache = {.pid = pid, .name = name};
+  std::string proc_path = "/proc/" + std::to_string(pid);
+  cache.exe = util::readlink(proc_path + "/exe");
+  std::ifstream stream(proc_path + "/cmdline");
+  cache.cmdline = cmdline(stream);
   return cache;
 }
 
@@ -157,8 +222,85 @@ const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
 const double jiffy = sysconf(_SC_CLK_TCK);
 const size_t page_size = sysconf(_SC_PAGE_SIZE);
 
-void buildCPUTimes(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/stat");
+bool preadFile(int fd, std::string &buf) {
+  buf.resize(std::max<size_t>(buf.capacity(), 4096));
+  size_t size = 0;
+  while (true) {
+    ssize_t n = pread(fd, buf.data() + size, buf.size() - size, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    size += n;
+    if (size == buf.size()) buf.resize(buf.size() * 2);
+  }
+  buf.resize(size);
+  return size > 0;
+}
+
+ProcLogCollector::ProcLogCollector(bool delta, bool sched) : delta_(delta) {
+  if (sched) {
+    sched_ = std::make_unique<SchedSampler>();
+  }
+  stat_fd_ = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+  meminfo_fd_ = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+  assert(stat_fd_ != -1 && meminfo_fd_ != -1);
+}
+
+ProcLogCollector::~ProcLogCollector() {
+  for (auto &[_, proc] : procs_) {
+    if (proc.fd != -1) close(proc.fd);
+  }
+  close(stat_fd_);
+  close(meminfo_fd_);
+}
+
+bool ProcLogCollector::updateProc(int pid, Proc &proc) {
+  char buf[2048];
+  ssize_t n = proc.fd != -1 ? pread(proc.fd, buf, sizeof(buf), 0) : -1;
+  if (n <= 0) {
+    // a new pid, or the fd belongs to an exited process and the pid was reused.
+    if (proc.fd != -1) close(proc.fd);
+    proc.fd = open(("/proc/" + std::to_string(pid) + "/stat").c_str(), O_RDONLY | O_CLOEXEC);
+    if (proc.fd == -1) {
+      if (errno == EMFILE) LOGE_100("too many open files, skipping pid %d", pid);
+      return false;
+    }
+    n = pread(proc.fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+  }
+
+  proc.changed = proc.raw.size() != n || memcmp(proc.raw.data(), buf, n) != 0;
+  if (proc.changed) {
+    if (!Parser::procStat(buf, n, proc.stat)) {
+      LOGE("failed to parse procStat :%.*s", (int)n, buf);
+      return false;
+    }
+    proc.raw.assign(buf, n);
+    // exe and cmdline only change on exec, which also changes the name
+    if (proc.extra.pid != pid || proc.extra.name != proc.stat.name) {
+      proc.extra = Parser::procExtraInfo(pid, proc.stat.name);
+    }
+  }
+  return true;
+}
+
+void ProcLogCollector::updateProcs() {
+  ++cycle_;
+  for (int pid : Parser::pids()) {
+    procs_[pid].cycle = cycle_;
+  }
+  for (auto it = procs_.begin(); it != procs_.end(); ) {
+    if (it->second.cycle == cycle_ && updateProc(it->first, it->second)) {
+      ++it;
+    } else {
+      if (it->second.fd != -1) close(it->second.fd);
+      it = procs_.erase(it);
+    }
+  }
+}
+
+void ProcLogCollector::buildCPUTimes(cereal::ProcLog::Builder &builder) {
+  preadFile(stat_fd_, buf_);
+  std::istringstream stream(buf_);
   std::vector<CPUTime> stats = Parser::cpuTimes(stream);
 
   auto log_cpu_times = builder.initCpuTimes(stats.size());
@@ -176,8 +318,9 @@ void buildCPUTimes(cereal::ProcLog::Builder &builder) {
   }
 }
 
-void buildMemInfo(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/meminfo");
+void ProcLogCollector::buildMemInfo(cereal::ProcLog::Builder &builder) {
+  preadFile(meminfo_fd_, buf_);
+  std::istringstream stream(buf_);
   auto mem_info = Parser::memInfo(stream);
 
   auto mem = builder.initMem();
@@ -191,21 +334,15 @@ void buildMemInfo(cereal::ProcLog::Builder &builder) {
   mem.setShared(mem_info["Shmem:"]);
 }
 
-void buildProcs(cereal::ProcLog::Builder &builder) {
-  auto pids = Parser::pids();
-  std::vector<ProcStat> proc_stats;
-  proc_stats.reserve(pids.size());
-  for (int pid : pids) {
-    std::string path = "/proc/" + std::to_string(pid) + "/stat";
-    if (auto stat = Parser::procStat(util::read_file(path))) {
-      proc_stats.push_back(*stat);
-    }
-  }
+void ProcLogCollector::buildProcs(cereal::ProcLog::Builder &builder, bool partial) {
+  size_t count = partial ? std::count_if(procs_.begin(), procs_.end(), [](auto &p) { return p.second.changed; }) : procs_.size();
+  auto procs = builder.initProcs(count);
+  size_t i = 0;
+  for (const auto &[pid, proc] : procs_) {
+    if (partial && !proc.changed) continue;
 
-  auto procs = builder.initProcs(proc_stats.size());
-  for (size_t i = 0; i < proc_stats.size(); i++) {
-    auto l = procs[i];
-    const ProcStat &r = proc_stats[i];
+    auto l = procs[i++];
+    const ProcStat &r = proc.stat;
     l.setPid(r.pid);
     l.setState(r.state);
     l.setPpid(r.ppid);
@@ -222,18 +359,30 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
     l.setProcessor(r.processor);
     l.setName(r.name);
 
-    const ProcCache &extra_info = Parser::getProcExtraInfo(r.pid, r.name);
-    l.setExe(extra_info.exe);
-    auto lcmdline = l.initCmdline(extra_info.cmdline.size());
+    l.setExe(proc.extra.exe);
+    auto lcmdline = l.initCmdline(proc.extra.cmdline.size());
     for (size_t j = 0; j < lcmdline.size(); j++) {
-      lcmdline.set(j, extra_info.cmdline[j]);
+      lcmdline.set(j, proc.extra.cmdline[j]);
     }
   }
 }
 
-void buildProcLogMessage(MessageBuilder &msg) {
+void ProcLogCollector::build(MessageBuilder &msg) {
+  const uint64_t start_ts = nanos_since_boot();
   auto procLog = msg.initEvent().initProcLog();
-  buildProcs(procLog);
+  updateProcs();
+  const bool partial = delta_ && (cycle_ - 1) % FULL_SNAPSHOT_INTERVAL != 0;
+  buildProcs(procLog, partial);
   buildCPUTimes(procLog);
   buildMemInfo(procLog);
+  if (sched_) {
+    sched_->build(procLog);
+  }
+  procLog.setPartial(partial);
+  procLog.setCollectTime((nanos_since_boot() - start_ts) / 1e9);
+}
+
+void buildProcLogMessage(MessageBuilder &msg) {
+  static ProcLogCollector collector;
+  collector.build(msg);
 }
@@ -1,3 +1,7 @@
+#pragma once
+
+#include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -21,20 +25,71 @@ struct ProcStat {
   int pid, ppid, processor;
   char state;
   long cutime, cstime, priority, nice, num_threads, rss;
-  unsigned long utime, stime, vms;
+  unsigned long utime, stime, vms, rt_priority, policy;
   unsigned long long starttime;
   std::string name;
 };
 
+struct SchedStat {
+  uint64_t run_time, run_delay, timeslices;
+};
+
 namespace Parser {
 
 std::vector<int> pids();
 std::optional<ProcStat> procStat(std::string stat);
+bool procStat(const char *buf, size_t len, ProcStat &stat);
 std::vector<std::string> cmdline(std::istream &stream);
 std::vector<CPUTime> cpuTimes(std::istream &stream);
 std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream);
-const ProcCache &getProcExtraInfo(int pid, const std::string &name);
+ProcCache procExtraInfo(int pid, const std::string &name);
+std::vector<int> tids(int pid);
+std::optional<SchedStat> schedStat(const char *str);
+std::unordered_map<std::string, uint64_t> schedInfo(std::istream &stream);
 
 };  // namespace Parser
 
+// reads the whole file from the start, keeping the file open.
+bool preadFile(int fd, std::string &buf);
+
+class SchedSampler;
+
+// Builds procLog messages.
+// /proc/<pid>/stat is kept open for every process and re-read with pread, and is only parsed
+// again when its content changed. Exited processes are evicted on the next cycle.
+// In delta mode, procs only contains the processes that changed since the previous message,
+// with a full snapshot every FULL_SNAPSHOT_INTERVAL messages.
+// In sched mode, scheduling stats of the realtime threads are added, see SchedSampler.
+class ProcLogCollector {
+public:
+  ProcLogCollector(bool delta = false, bool sched = false);
+  ~ProcLogCollector();
+  void build(MessageBuilder &msg);
+
+  static constexpr int FULL_SNAPSHOT_INTERVAL = 30;
+
+private:
+  struct Proc {
+    int fd = -1;
+    uint64_t cycle = 0;  // last cycle the pid was listed in /proc
+    bool changed = false;
+    std::string raw;  // last content of /proc/<pid>/stat
+    ProcStat stat;
+    ProcCache extra;
+  };
+  bool updateProc(int pid, Proc &proc);
+  void updateProcs();
+  void buildProcs(cereal::ProcLog::Builder &builder, bool partial);
+  void buildCPUTimes(cereal::ProcLog::Builder &builder);
+  void buildMemInfo(cereal::ProcLog::Builder &builder);
+
+  const bool delta_;
+  std::unique_ptr<SchedSampler> sched_;
+  uint64_t cycle_ = 0;
+  std::map<int, Proc> procs_;
+  int stat_fd_ = -1;
+  int meminfo_fd_ = -1;
+  std::string buf_;
+};
+
 void buildProcLogMessage(MessageBuilder &msg);
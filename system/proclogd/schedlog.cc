@@ -0,0 +1,158 @@
+#include "system/proclogd/schedlog.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "common/util.h"
+
+SchedSampler::File::File(const std::string &path) : fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+
+SchedSampler::File::~File() {
+  if (fd != -1) close(fd);
+}
+
+SchedSampler::SchedSampler(int rate) : rate_(rate) {
+  scanThreads();
+  thread_ = std::thread(&SchedSampler::samplerThread, this);
+}
+
+SchedSampler::~SchedSampler() {
+  exit_ = true;
+  thread_.join();
+}
+
+// only the sampler thread changes threads_, so it reads them here without the lock
+void SchedSampler::scanThreads() {
+  struct Found {
+    int pid, tid;
+    ProcStat stat;
+    std::shared_ptr<const File> schedstat, sched;  // for a new thread
+  };
+  std::vector<Found> found;
+  for (int pid : Parser::pids()) {
+    for (int tid : Parser::tids(pid)) {
+      const std::string dir = "/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid);
+      std::string stat = util::read_file(dir + "/stat");
+      ProcStat s;
+      if (stat.empty() || !Parser::procStat(stat.data(), stat.size(), s) || (s.policy != SCHED_FIFO && s.policy != SCHED_RR)) {
+        continue;
+      }
+
+      Found &f = found.emplace_back(Found{pid, tid, s});
+      auto it = threads_.find(tid);
+      if (it == threads_.end() || it->second.pid != pid || it->second.starttime != s.starttime) {
+        f.schedstat = std::make_shared<const File>(dir + "/schedstat");
+        f.sched = std::make_shared<const File>(dir + "/sched");
+        if (f.schedstat->fd == -1 || f.sched->fd == -1) {
+          found.pop_back();
+        }
+      }
+    }
+  }
+
+  std::lock_guard lk(lock_);
+  ++cycle_;
+  for (auto &f : found) {
+    Thread &t = threads_[f.tid];
+    if (f.schedstat) {
+      // a new thread, or the tid was reused
+      t = {.pid = f.pid, .starttime = f.stat.starttime, .schedstat = f.schedstat, .sched = f.sched};
+      sample(t);
+    }
+    t.name = f.stat.name;
+    t.policy = f.stat.policy;
+    t.rt_priority = f.stat.rt_priority;
+    t.cycle = cycle_;
+  }
+  for (auto it = threads_.begin(); it != threads_.end();) {
+    if (it->second.cycle != cycle_) {
+      it = threads_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SchedSampler::sample(Thread &t) {
+  char buf[128];
+  ssize_t n = pread(t.schedstat->fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) return;
+
+  buf[n] = '\0';
+  if (auto s = Parser::schedStat(buf)) {
+    // the run delay of this sample, averaged over the timeslices since the last one
+    if (t.last.timeslices > 0 && s->timeslices > t.last.timeslices) {
+      const uint64_t delay = (s->run_delay - t.last.run_delay) / (s->timeslices - t.last.timeslices);
+      auto bucket = std::upper_bound(RUN_DELAY_BUCKETS_US.begin(), RUN_DELAY_BUCKETS_US.end(), delay / 1000);
+      t.histogram[bucket - RUN_DELAY_BUCKETS_US.begin()]++;
+      t.max_run_delay = std::max(t.max_run_delay, delay);
+    }
+    t.last = *s;
+  }
+}
+
+void SchedSampler::samplerThread() {
+  util::set_thread_name("proclogd_sched");
+  const int scan_samples = std::max(1, rate_ * SCAN_INTERVAL_MS / 1000);
+  for (int n = 1; !exit_; ++n) {
+    if (n % scan_samples == 0) {
+      scanThreads();
+    }
+    {
+      std::lock_guard lk(lock_);
+      for (auto &[_, t] : threads_) {
+        sample(t);
+      }
+    }
+    util::sleep_for(1000 / rate_);
+  }
+}
+
+void SchedSampler::build(cereal::ProcLog::Builder &builder) {
+  auto buckets = builder.initRunDelayBuckets(RUN_DELAY_BUCKETS_US.size());
+  for (int i = 0; i < RUN_DELAY_BUCKETS_US.size(); ++i) {
+    buckets.set(i, RUN_DELAY_BUCKETS_US[i] / 1e6);
+  }
+
+  std::vector<std::pair<int, Thread>> snapshot;
+  {
+    std::lock_guard lk(lock_);
+    snapshot.assign(threads_.begin(), threads_.end());
+    for (auto &[_, t] : threads_) {
+      // the histogram covers the time since the previous message
+      t.histogram = {};
+      t.max_run_delay = 0;
+    }
+  }
+
+  auto threads = builder.initThreads(snapshot.size());
+  std::string buf;
+  for (int i = 0; i < snapshot.size(); ++i) {
+    auto &[tid, t] = snapshot[i];
+    std::istringstream stream(preadFile(t.sched->fd, buf) ? buf : "");
+    auto info = Parser::schedInfo(stream);
+
+    auto l = threads[i];
+    l.setPid(t.pid);
+    l.setTid(tid);
+    l.setName(t.name);
+    l.setPolicy(t.policy);
+    l.setRtPriority(t.rt_priority);
+    l.setRunTime(t.last.run_time / 1e9);
+    l.setRunDelay(t.last.run_delay / 1e9);
+    l.setTimeslices(t.last.timeslices);
+    l.setVoluntaryCtxtSwitches(info["nr_voluntary_switches"]);
+    l.setInvoluntaryCtxtSwitches(info["nr_involuntary_switches"]);
+    l.setMigrations(info["se.nr_migrations"]);
+    l.setMaxRunDelay(t.max_run_delay / 1e9);
+    auto histogram = l.initRunDelayHistogram(t.histogram.size());
+    for (int j = 0; j < t.histogram.size(); ++j) {
+      histogram.set(j, t.histogram[j]);
+    }
+  }
+}
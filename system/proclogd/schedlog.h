@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "system/proclogd/proclog.h"
+
+// Collects scheduling stats of the realtime threads (SCHED_FIFO or SCHED_RR), like the ones set up
+// with util::set_realtime_priority. schedstat is sampled at a high rate in a background thread to
+// build a histogram of the run delay per timeslice, the counters in sched are read once per message.
+// The background thread also looks for new realtime threads every SCAN_INTERVAL_MS.
+class SchedSampler {
+public:
+  SchedSampler(int rate = 100);
+  ~SchedSampler();
+  void build(cereal::ProcLog::Builder &builder);
+
+  // upper bounds of the run delay histogram buckets, the last bucket has no bound.
+  static constexpr std::array<uint32_t, 6> RUN_DELAY_BUCKETS_US = {10, 50, 100, 500, 1000, 5000};
+
+private:
+  static constexpr int SCAN_INTERVAL_MS = 5000;
+
+  // kept open as long as the thread is sampled, or a build still reads it
+  struct File {
+    File(const std::string &path);
+    ~File();
+    const int fd;
+  };
+  struct Thread {
+    int pid;
+    unsigned long long starttime;  // tells a reused tid apart
+    std::string name;
+    unsigned long policy, rt_priority;
+    std::shared_ptr<const File> schedstat, sched;
+    uint64_t cycle = 0;
+    SchedStat last = {};
+    std::array<uint32_t, RUN_DELAY_BUCKETS_US.size() + 1> histogram = {};
+    uint64_t max_run_delay = 0;  // ns
+  };
+  void scanThreads();
+  void samplerThread();
+  void sample(Thread &t);
+
+  const int rate_;
+  uint64_t cycle_ = 0;
+  std::mutex lock_;
+  std::map<int, Thread> threads_;  // by tid
+  std::atomic<bool> exit_ = false;
+  std::thread thread_;
+};
@@ -1,7 +1,16 @@
 #define CATCH_CONFIG_MAIN
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <csignal>
+#include <thread>
+
 #include "catch2/catch.hpp"
 #include "common/util.h"
 #include "system/proclogd/proclog.h"
+#include "system/proclogd/schedlog.h"
 
 const std::string allowed_states = "RSDTZtWXxKWPI";
 
@@ -140,3 +149,105 @@ TEST_CASE("buildProcLoggerMessage") {
     }
   }
 }
+
+TEST_CASE("ProcLogCollector") {
+  auto read_procs = [](ProcLogCollector &collector, bool &partial) {
+    MessageBuilder msg;
+    collector.build(msg);
+    kj::Array<capnp::word> buf = capnp::messageToFlatArray(msg);
+    capnp::FlatArrayMessageReader reader(buf);
+    auto log = reader.getRoot<cereal::Event>().getProcLog();
+    REQUIRE(log.getCollectTime() > 0);
+    partial = log.getPartial();
+    std::map<int, std::string> procs;
+    for (auto p : log.getProcs()) {
+      procs[p.getPid()] = p.getName();
+    }
+    return procs;
+  };
+
+  ProcLogCollector collector(true);
+  bool partial = true;
+  auto procs = read_procs(collector, partial);
+  REQUIRE(partial == false);
+  REQUIRE(procs.size() > 1);
+  REQUIRE(procs.count(::getpid()) == 1);
+
+  // a new process shows up in the next partial message, and is gone once it exited.
+  pid_t child = fork();
+  if (child == 0) {
+    pause();
+    _exit(0);
+  }
+  auto delta = read_procs(collector, partial);
+  REQUIRE(partial == true);
+  REQUIRE(delta.count(child) == 1);
+  REQUIRE(delta.size() <= procs.size() + 1);
+
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+  for (int i = 1; i < ProcLogCollector::FULL_SNAPSHOT_INTERVAL; ++i) {
+    delta = read_procs(collector, partial);
+    REQUIRE(delta.count(child) == 0);
+  }
+  REQUIRE(partial == false);
+  REQUIRE(delta.count(::getpid()) == 1);
+}
+
+TEST_CASE("Parser::schedStat") {
+  auto stat = Parser::schedStat("2005932 103563 17\n");
+  REQUIRE(stat);
+  REQUIRE(stat->run_time == 2005932);
+  REQUIRE(stat->run_delay == 103563);
+  REQUIRE(stat->timeslices == 17);
+  REQUIRE(!Parser::schedStat(""));
+}
+
+TEST_CASE("Parser::schedInfo") {
+  std::istringstream stream(
+      "test (4043, #threads: 1)\n"
+      "-------------------------------------------------------------------\n"
+      "se.exec_start                                :       1186043.051567\n"
+      "se.nr_migrations                             :                    3\n"
+      "nr_voluntary_switches                        :                   20\n"
+      "nr_involuntary_switches                      :                    1\n");
+  auto info = Parser::schedInfo(stream);
+  REQUIRE(info["se.nr_migrations"] == 3);
+  REQUIRE(info["nr_voluntary_switches"] == 20);
+  REQUIRE(info["nr_involuntary_switches"] == 1);
+}
+
+TEST_CASE("SchedSampler") {
+  std::atomic<int> tid = 0;
+  std::atomic<bool> done = false;
+  std::thread rt_thread([&]() {
+    util::set_thread_name("test_rt");
+    tid = util::set_realtime_priority(1) == 0 ? syscall(SYS_gettid) : -1;
+    while (!done) util::sleep_for(1);
+  });
+  while (tid == 0) util::sleep_for(1);
+  if (tid == -1) {
+    WARN("no permission to set realtime priority");
+  } else {
+    ProcLogCollector collector(false, true);
+    util::sleep_for(100);
+    MessageBuilder msg;
+    collector.build(msg);
+    kj::Array<capnp::word> buf = capnp::messageToFlatArray(msg);
+    capnp::FlatArrayMessageReader reader(buf);
+    auto log = reader.getRoot<cereal::Event>().getProcLog();
+    REQUIRE(log.getRunDelayBuckets().size() == SchedSampler::RUN_DELAY_BUCKETS_US.size());
+
+    auto threads = log.getThreads();
+    auto it = std::find_if(threads.begin(), threads.end(), [&](auto t) { return t.getTid() == tid; });
+    REQUIRE(it != threads.end());
+    REQUIRE(std::string((*it).getName()) == "test_rt");
+    REQUIRE((*it).getPid() == ::getpid());
+    REQUIRE((*it).getPolicy() == SCHED_FIFO);
+    REQUIRE((*it).getRtPriority() == 1);
+    REQUIRE((*it).getTimeslices() > 0);
+    REQUIRE((*it).getRunDelayHistogram().size() == SchedSampler::RUN_DELAY_BUCKETS_US.size() + 1);
+  }
+  done = true;
+  rt_thread.join();
+}
@@ -0,0 +1,206 @@
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "common/swaglog.h"
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus, int gpio_nr, int watermark) :
+  I2CSensor(bus, gpio_nr), accel(bus), gyro(bus), watermark(watermark),
+  buffer(LSM6DS3_FIFO_SIZE_WORDS * 2) {
+  assert(watermark > 0 && watermark * LSM6DS3_FIFO_SAMPLE_WORDS < LSM6DS3_FIFO_SIZE_WORDS);
+}
+
+int LSM6DS3_Fifo::init() {
+  uint8_t value = 0;
+  const int threshold = watermark * LSM6DS3_FIFO_SAMPLE_WORDS;
+
+  // chip ID, self tests, output data rates
+  int ret = accel.init();
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = gyro.init();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = init_gpio();
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // bypass mode empties the FIFO
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // threshold in 16 bit words
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL1, threshold & 0xFF);
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL2, (threshold >> 8) & 0x0F);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL3, LSM6DS3_FIFO_NO_DECIMATION);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // interrupt on the threshold instead of each sample. the line stays high while the FIFO is
+  // above it, so every read drains it for the next rising edge
+  ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value &= ~(LSM6DS3_ACCEL_INT1_DRDY_XL | LSM6DS3_GYRO_INT1_DRDY_G);
+  value |= LSM6DS3_FIFO_INT1_FTH;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+  last_interrupt_ts = nanos_since_boot();
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::shutdown() {
+  int ret = 0;
+
+  // disable FIFO threshold interrupt on INT1
+  uint8_t value = 0;
+  ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value &= ~LSM6DS3_FIFO_INT1_FTH;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+  if (ret < 0) {
+    LOGE("Could not disable lsm6ds3 FIFO interrupt!");
+    goto fail;
+  }
+
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    LOGE("Could not disable lsm6ds3 FIFO!");
+    goto fail;
+  }
+
+  ret = accel.shutdown();
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = gyro.shutdown();
+
+fail:
+  return ret;
+}
+
+bool LSM6DS3_Fifo::get_event(MessageBuilder &msg, uint64_t ts) {
+  // samples come in batches, see get_events
+  return false;
+}
+
+int LSM6DS3_Fifo::get_events(uint64_t ts, const std::string &msg_name, const std::function<void(const char *, MessageBuilder &)> &send) {
+  last_interrupt_ts = ts;
+  // INT1 is a level and the gpio gives edges: a FIFO left above the watermark after a failed read
+  // never interrupts again. retry once, then empty it.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (int samples = read_fifo(ts, send); samples >= 0) {
+      return samples;
+    }
+  }
+  reset_fifo();
+  return 0;
+}
+
+void LSM6DS3_Fifo::interrupt_timeout(uint64_t ts) {
+  // the watermark is reached every batch, two without an interrupt means the edge was missed
+  if (ts - last_interrupt_ts > 2 * watermark * LSM6DS3_FIFO_PERIOD_NS) {
+    LOGE("no lsm6ds3 FIFO interrupt, resetting the FIFO");
+    reset_fifo();
+  }
+}
+
+int LSM6DS3_Fifo::reset_fifo() {
+  // bypass mode empties the FIFO, INT1 goes low and rises again at the next watermark
+  last_ts = 0;
+  last_interrupt_ts = nanos_since_boot();
+  int ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret >= 0) {
+    ret = set_register(LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+  }
+  if (ret < 0) {
+    LOGE("Resetting lsm6ds3 FIFO failed: %d", ret);
+  }
+  return ret;
+}
+
+int LSM6DS3_Fifo::read_fifo(uint64_t ts, const std::function<void(const char *, MessageBuilder &)> &send) {
+  // FIFO_STATUS1-4: unread words, flags and the word that is read next
+  uint8_t status[4];
+  int ret = read_register(LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status));
+  if (ret < 0) {
+    LOGE("Reading lsm6ds3 FIFO status failed: %d", ret);
+    return -1;
+  }
+
+  int words = status[0] | ((status[1] & 0x0F) << 8);
+  const int pattern = status[2] | ((status[3] & 0x03) << 8);
+  if (status[1] & LSM6DS3_FIFO_OVER_RUN) {
+    LOGE("lsm6ds3 FIFO overrun, samples were lost");
+    last_ts = 0;
+  }
+
+  // start at a gyro x word, the pattern is off after an overrun
+  const int skip = std::min(words, (LSM6DS3_FIFO_SAMPLE_WORDS - pattern % LSM6DS3_FIFO_SAMPLE_WORDS) % LSM6DS3_FIFO_SAMPLE_WORDS);
+  const int samples = (words - skip) / LSM6DS3_FIFO_SAMPLE_WORDS;
+  const int len = (skip + samples * LSM6DS3_FIFO_SAMPLE_WORDS) * 2;
+  if (samples == 0) {
+    return 0;
+  }
+
+  ret = read_block(LSM6DS3_FIFO_I2C_REG_DATA_OUT, buffer.data(), len);
+  if (ret != len) {
+    LOGE("Reading lsm6ds3 FIFO failed: %d", ret);
+    return -1;
+  }
+
+  // ts is when the watermark sample arrived. the period is measured between those,
+  // unless this is the first read or samples were lost
+  const int ts_sample = std::min(watermark, samples) - 1;
+  double period = LSM6DS3_FIFO_PERIOD_NS;
+  if (last_ts != 0 && ts > last_ts) {
+    const double measured = double(ts - last_ts) / (last_ts_samples + ts_sample);
+    if (measured > 0.8 * LSM6DS3_FIFO_PERIOD_NS && measured < 1.25 * LSM6DS3_FIFO_PERIOD_NS) {
+      period = measured;
+    }
+  }
+  last_ts = ts;
+  last_ts_samples = samples - ts_sample;
+
+  const uint8_t *data = buffer.data() + skip * 2;
+  for (int i = 0; i < samples; ++i, data += LSM6DS3_FIFO_SAMPLE_WORDS * 2) {
+    const uint64_t sample_ts = ts + int64_t((i - ts_sample) * period);
+    {
+      MessageBuilder msg;
+      gyro.build_event(msg, data, sample_ts);
+      send("gyroscope", msg);
+    }
+    {
+      MessageBuilder msg;
+      accel.build_event(msg, data + 6, sample_ts);
+      send("accelerometer", msg);
+    }
+  }
+  return samples;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "system/sensord/sensors/i2c_sensor.h"
+#include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_gyro.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR          0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_CTRL1     0x06
+#define LSM6DS3_FIFO_I2C_REG_CTRL2     0x07
+#define LSM6DS3_FIFO_I2C_REG_CTRL3     0x08
+#define LSM6DS3_FIFO_I2C_REG_CTRL5     0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL 0x0D
+#define LSM6DS3_FIFO_I2C_REG_STATUS1   0x3A
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT  0x3E
+
+// Constants
+#define LSM6DS3_FIFO_NO_DECIMATION     0b001001  // gyro and accel, each sample of both
+#define LSM6DS3_FIFO_ODR_104HZ         (0b0100 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS       0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS   0b110
+#define LSM6DS3_FIFO_INT1_FTH          (1 << 3)
+#define LSM6DS3_FIFO_OVER_RUN          (1 << 6)
+#define LSM6DS3_FIFO_SIZE_WORDS        4096
+#define LSM6DS3_FIFO_SAMPLE_WORDS      6  // gyro x, y, z then accel x, y, z
+#define LSM6DS3_FIFO_PERIOD_NS         (1e9 / 104)
+
+// Reads the accel and gyro from the FIFO of the chip, interrupting once per batch of samples.
+// The FIFO is drained in one burst read, and the samples are timestamped by interpolating
+// between the interrupts.
+class LSM6DS3_Fifo : public I2CSensor {
+  uint8_t get_device_address() {return LSM6DS3_FIFO_I2C_ADDR;}
+
+  LSM6DS3_Accel accel;
+  LSM6DS3_Gyro gyro;
+  int watermark;  // samples per interrupt
+
+  std::vector<uint8_t> buffer;
+  uint64_t last_ts = 0;  // when the watermark sample of the last read arrived
+  int last_ts_samples = 0;  // samples read after it, and itself
+  uint64_t last_interrupt_ts = 0;
+
+  // the number of samples sent, -1 if reading the chip failed
+  int read_fifo(uint64_t ts, const std::function<void(const char *, MessageBuilder &)> &send);
+  int reset_fifo();
+
+public:
+  LSM6DS3_Fifo(I2CBus *bus, int gpio_nr = 0, int watermark = 8);
+  int init();
+  bool get_event(MessageBuilder &msg, uint64_t ts = 0);
+  int get_events(uint64_t ts, const std::string &msg_name, const std::function<void(const char *, MessageBuilder &)> &send);
+  void interrupt_timeout(uint64_t ts);
+  int shutdown();
+};
@@ -41,5 +41,7 @@ public:
   LSM6DS3_Gyro(I2CBus *bus, int gpio_nr = 0, bool shared_gpio = false);
   int init();
   bool get_event(MessageBuilder &msg, uint64_t ts = 0);
+  // the event of one sample, as the 6 bytes of the output registers
+  void build_event(MessageBuilder &msg, const uint8_t *buffer, uint64_t ts);
   int shutdown();
 };
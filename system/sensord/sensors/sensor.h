@@ -1,5 +1,8 @@
 #pragma once
 
+#include <functional>
+#include <string>
+
 #include "cereal/messaging/messaging.h"
 
 class Sensor {
@@ -13,6 +16,21 @@ public:
   virtual bool has_interrupt_enabled() = 0;
   virtual int shutdown() = 0;
 
+  // hands every sample read since the last call to send, with the service to publish it on.
+  // sensors read from a hardware FIFO have several, the others the one of get_event
+  virtual int get_events(uint64_t ts, const std::string &msg_name, const std::function<void(const char *, MessageBuilder &)> &send) {
+    MessageBuilder msg;
+    if (!get_event(msg, ts)) {
+      return 0;
+    }
+    send(msg_name.c_str(), msg);
+    return 1;
+  }
+
+  // called when the interrupt line was quiet for a while. sensors with a level triggered line
+  // recover here from an interrupt that was missed
+  virtual void interrupt_timeout(uint64_t ts) {}
+
   virtual bool is_data_valid(uint64_t current_ts) {
     if (start_ts == 0) {
       start_ts = current_ts;
@@ -1,5 +1,6 @@
 #include <sys/resource.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <vector>
@@ -20,6 +21,7 @@
 #include "system/sensord/sensors/bmx055_temp.h"
 #include "system/sensord/sensors/constants.h"
 #include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
 #include "system/sensord/sensors/lsm6ds3_gyro.h"
 #include "system/sensord/sensors/lsm6ds3_temp.h"
 #include "system/sensord/sensors/mmc5603nj_magn.h"
@@ -52,6 +54,11 @@ void interrupt_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
       return;
     } else if (err == 0) {
       LOGE("poll timed out");
+      for (auto &[sensor, msg_name] : sensors) {
+        if (sensor->has_interrupt_enabled()) {
+          sensor->interrupt_timeout(nanos_since_boot());
+        }
+      }
       continue;
     }
 
@@ -77,16 +84,12 @@ void interrupt_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
         continue;
       }
 
-      MessageBuilder msg;
-      if (!sensor->get_event(msg, ts)) {
-        continue;
-      }
-
-      if (!sensor->is_data_valid(ts)) {
-        continue;
-      }
-
-      pm.send(msg_name.c_str(), msg);
+      Sensor *s = sensor;
+      s->get_events(ts, msg_name, [&](const char *name, MessageBuilder &msg) {
+        if (s->is_data_valid(ts)) {
+          pm.send(name, msg);
+        }
+      });
     }
   }
 }
@@ -104,19 +107,24 @@ void polling_loop(Sensor *sensor, std::string msg_name) {
 }
 
 int sensor_loop(I2CBus *i2c_bus_imu) {
+  // LSM_FIFO=N reads the LSM6DS3 accel and gyro from its FIFO, with an interrupt every N samples
+  const int lsm_fifo = std::clamp(util::getenv("LSM_FIFO", 0), 0, 64);
+
   // Sensor init
   std::vector<std::tuple<Sensor *, std::string>> sensors_init = {
     {new BMX055_Accel(i2c_bus_imu), "accelerometer2"},
     {new BMX055_Gyro(i2c_bus_imu), "gyroscope2"},
     {new BMX055_Magn(i2c_bus_imu), "magnetometer"},
     {new BMX055_Temp(i2c_bus_imu), "temperatureSensor2"},
-
-    {new LSM6DS3_Accel(i2c_bus_imu, GPIO_LSM_INT), "accelerometer"},
-    {new LSM6DS3_Gyro(i2c_bus_imu, GPIO_LSM_INT, true), "gyroscope"},
-    {new LSM6DS3_Temp(i2c_bus_imu), "temperatureSensor"},
-
-    {new MMC5603NJ_Magn(i2c_bus_imu), "magnetometer"},
   };
+  if (lsm_fifo > 0) {
+    sensors_init.push_back({new LSM6DS3_Fifo(i2c_bus_imu, GPIO_LSM_INT, lsm_fifo), "accelerometer"});
+  } else {
+    sensors_init.push_back({new LSM6DS3_Accel(i2c_bus_imu, GPIO_LSM_INT), "accelerometer"});
+    sensors_init.push_back({new LSM6DS3_Gyro(i2c_bus_imu, GPIO_LSM_INT, true), "gyroscope"});
+  }
+  sensors_init.push_back({new LSM6DS3_Temp(i2c_bus_imu), "temperatureSensor"});
+  sensors_init.push_back({new MMC5603NJ_Magn(i2c_bus_imu), "magnetometer"});
 
   // Initialize sensors
   std::vector<std::thread> threads;
@@ -0,0 +1,196 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cmath>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/i2c.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+// LSM6DS3_Fifo against a mock of the chip: its registers, and a FIFO that is read like the real one
+
+class MockI2CBus : public I2CBus {
+public:
+  std::map<uint, uint8_t> registers = {
+    {LSM6DS3_ACCEL_I2C_REG_ID, LSM6DS3TRC_ACCEL_CHIP_ID},
+    {LSM6DS3_ACCEL_I2C_REG_STAT_REG, LSM6DS3_ACCEL_DRDY_XLDA | LSM6DS3_GYRO_DRDY_GDA},
+  };
+  std::deque<int16_t> fifo;
+  int pattern = 0;  // the word of the sample that is read next
+  bool over_run = false;
+  int block_reads = 0;
+
+  void push_sample(const int16_t gyro[3], const int16_t accel[3]) {
+    fifo.insert(fifo.end(), gyro, gyro + 3);
+    fifo.insert(fifo.end(), accel, accel + 3);
+  }
+
+  int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) override {
+    for (int i = 0; i < len; ++i) {
+      switch (register_address + i) {
+        case LSM6DS3_FIFO_I2C_REG_STATUS1: buffer[i] = fifo.size() & 0xFF; break;
+        case LSM6DS3_FIFO_I2C_REG_STATUS1 + 1: buffer[i] = ((fifo.size() >> 8) & 0x0F) | (over_run ? LSM6DS3_FIFO_OVER_RUN : 0); break;
+        case LSM6DS3_FIFO_I2C_REG_STATUS1 + 2: buffer[i] = pattern & 0xFF; break;
+        case LSM6DS3_FIFO_I2C_REG_STATUS1 + 3: buffer[i] = pattern >> 8; break;
+        default: buffer[i] = registers[register_address + i];
+      }
+    }
+    return len;
+  }
+
+  int set_register(uint8_t device_address, uint register_address, uint8_t data) override {
+    registers[register_address] = data;
+    return 0;
+  }
+
+  int read_block(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) override {
+    REQUIRE(register_address == LSM6DS3_FIFO_I2C_REG_DATA_OUT);
+    REQUIRE(len % 2 == 0);
+    REQUIRE(len / 2 <= fifo.size());
+    ++block_reads;
+    for (int i = 0; i < len / 2; ++i) {
+      buffer[i * 2] = fifo.front() & 0xFF;
+      buffer[i * 2 + 1] = fifo.front() >> 8;
+      fifo.pop_front();
+      pattern = (pattern + 1) % LSM6DS3_FIFO_SAMPLE_WORDS;
+    }
+    over_run = false;
+    return len;
+  }
+};
+
+struct Event {
+  std::string name;
+  uint64_t ts;
+  std::vector<float> v;
+};
+
+static std::vector<Event> read_events(LSM6DS3_Fifo &fifo, uint64_t ts) {
+  std::vector<Event> events;
+  fifo.get_events(ts, "accelerometer", [&](const char *name, MessageBuilder &msg) {
+    auto event = msg.getRoot<cereal::Event>().asReader();
+    auto data = event.isGyroscope() ? event.getGyroscope() : event.getAccelerometer();
+    auto v = event.isGyroscope() ? data.getGyroUncalibrated().getV() : data.getAcceleration().getV();
+    events.push_back({name, data.getTimestamp(), {v.begin(), v.end()}});
+  });
+  return events;
+}
+
+TEST_CASE("LSM6DS3_Fifo init") {
+  MockI2CBus bus;
+  bus.registers[LSM6DS3_FIFO_I2C_REG_INT1_CTRL] = 0b1100000;
+  LSM6DS3_Fifo fifo(&bus, 0, 50);
+  REQUIRE(fifo.init() >= 0);
+
+  // 300 words threshold, gyro and accel at 104 Hz, continuous mode
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL1] == (300 & 0xFF));
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL2] == (300 >> 8));
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL3] == LSM6DS3_FIFO_NO_DECIMATION);
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL5] == (LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS));
+  REQUIRE(bus.registers[LSM6DS3_ACCEL_I2C_REG_CTRL1_XL] == LSM6DS3_ACCEL_ODR_104HZ);
+  REQUIRE(bus.registers[LSM6DS3_GYRO_I2C_REG_CTRL2_G] == LSM6DS3_GYRO_ODR_104HZ);
+
+  // one interrupt per threshold, none per sample, the others untouched
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_INT1_CTRL] == (0b1100000 | LSM6DS3_FIFO_INT1_FTH));
+
+  REQUIRE(fifo.shutdown() >= 0);
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_INT1_CTRL] == 0b1100000);
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL5] == LSM6DS3_FIFO_MODE_BYPASS);
+}
+
+TEST_CASE("LSM6DS3_Fifo drains the FIFO in one read") {
+  MockI2CBus bus;
+  LSM6DS3_Fifo fifo(&bus, 0, 4);
+  for (int16_t i = 0; i < 10; ++i) {
+    const int16_t gyro[3] = {int16_t(100 * i), int16_t(-100 * i), 1000};
+    const int16_t accel[3] = {int16_t(i), 2000, int16_t(-16384)};
+    bus.push_sample(gyro, accel);
+  }
+
+  const auto events = read_events(fifo, 1e9);
+  REQUIRE(bus.block_reads == 1);
+  REQUIRE(bus.fifo.empty());
+  REQUIRE(events.size() == 20);
+
+  // gyro then accel of each sample, in the order they were measured, x and y swapped like get_event
+  const float gyro_scale = 8.75 / 1000.0 * M_PI / 180.0;
+  const float accel_scale = 9.81 * 2.0f / (1 << 15);
+  for (int i = 0; i < 10; ++i) {
+    const Event &gyro = events[i * 2], &accel = events[i * 2 + 1];
+    REQUIRE(gyro.name == "gyroscope");
+    REQUIRE(accel.name == "accelerometer");
+    REQUIRE(gyro.ts == accel.ts);
+    REQUIRE(gyro.v[0] == Approx(-100 * i * gyro_scale));
+    REQUIRE(gyro.v[1] == Approx(-100 * i * gyro_scale));
+    REQUIRE(gyro.v[2] == Approx(1000 * gyro_scale));
+    REQUIRE(accel.v[0] == Approx(2000 * accel_scale));
+    REQUIRE(accel.v[1] == Approx(-i * accel_scale));
+    REQUIRE(accel.v[2] == Approx(-9.81));
+  }
+
+  // an empty FIFO is not read
+  REQUIRE(read_events(fifo, 2e9).empty());
+  REQUIRE(bus.block_reads == 1);
+}
+
+TEST_CASE("LSM6DS3_Fifo realigns after an overrun") {
+  MockI2CBus bus;
+  LSM6DS3_Fifo fifo(&bus, 0, 4);
+
+  // the accel words of a sample whose gyro words were lost, and a partial sample at the end
+  bus.over_run = true;
+  bus.pattern = 3;
+  bus.fifo = {7, 7, 7};
+  for (int16_t i = 1; i <= 5; ++i) {
+    const int16_t gyro[3] = {i, i, i};
+    const int16_t accel[3] = {0, i, 0};
+    bus.push_sample(gyro, accel);
+  }
+  bus.fifo.push_back(9);
+
+  const auto events = read_events(fifo, 1e9);
+  REQUIRE(events.size() == 10);
+  REQUIRE(bus.fifo.size() == 1);
+  REQUIRE(bus.pattern == 0);
+  for (int i = 0; i < 5; ++i) {
+    REQUIRE(events[i * 2].v[2] == Approx(8.75 / 1000.0 * M_PI / 180.0 * (i + 1)));
+    REQUIRE(events[i * 2 + 1].v[0] == Approx(9.81 * 2.0f / (1 << 15) * (i + 1)));
+  }
+}
+
+TEST_CASE("LSM6DS3_Fifo interpolates timestamps") {
+  MockI2CBus bus;
+  const int watermark = 8;
+  LSM6DS3_Fifo fifo(&bus, 0, watermark);
+
+  // the chip runs a bit slow, the interrupts come with some latency jitter and a few samples
+  // arrive between the interrupt and the read
+  const double period = 1e9 / 104 * 1.01;
+  const uint64_t start = 5e9;
+  int next_sample = 0;
+  uint64_t last_ts = 0;
+  for (int batch = 0; batch < 50; ++batch) {
+    const int watermark_sample = next_sample + watermark - 1;
+    const uint64_t irq_ts = start + watermark_sample * period + (batch % 3) * 20e3;
+    const int extra = batch % 4 == 0 ? 1 : 0;
+    for (int i = 0; i < watermark + extra; ++i) {
+      const int16_t zero[3] = {};
+      bus.push_sample(zero, zero);
+    }
+
+    const auto events = read_events(fifo, irq_ts);
+    REQUIRE(events.size() == 2 * (watermark + extra));
+    for (int i = 0; i < watermark + extra; ++i) {
+      const uint64_t ts = events[i * 2].ts;
+      REQUIRE(ts > last_ts);
+      last_ts = ts;
+      // the first read only knows the nominal period
+      const double error = std::abs(double(ts) - (start + (next_sample + i) * period));
+      REQUIRE(error < (batch == 0 ? 0.01 * period * watermark + 1e3 : 60e3));
+    }
+    next_sample += watermark + extra;
+  }
+}
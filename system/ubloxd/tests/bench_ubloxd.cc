@@ -0,0 +1,201 @@
+// Measures the ubloxd parser: framing throughput of add_data on a clean and a corrupted stream, and the
+// time and heap allocations of gen_msg for each message type.
+//
+// usage: bench_ubloxd [RLOG] [-n PASSES] [-c CORRUPT]
+//   RLOG:    a decompressed rlog with ubloxRaw, by default a generated stream of NAV-PVT, RXM-RAWX,
+//            RXM-SFRBX and MON-HW messages
+//   CORRUPT: the fraction of bytes overwritten with random ones in the corrupted stream
+//   default: 20 passes, 1% of the bytes corrupted
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/alloc_counter.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "system/ubloxd/ublox_msg.h"
+
+struct Stats {
+  std::vector<double> us;
+  uint64_t allocations = 0;
+};
+
+static std::string ubx_frame(uint8_t msg_class, uint8_t msg_id, const std::string &payload) {
+  std::string msg = {(char)ublox::PREAMBLE1, (char)ublox::PREAMBLE2, (char)msg_class, (char)msg_id,
+                     (char)(payload.size() & 0xff), (char)(payload.size() >> 8)};
+  return ublox::ubx_add_checksum(msg + payload);
+}
+
+// one second of what the receiver sends at 10 Hz, give or take
+static std::string generate_stream(int seconds, std::mt19937 &gen) {
+  std::string stream;
+  for (int s = 0; s < seconds; ++s) {
+    for (int i = 0; i < 10; ++i) {
+      ublox::ubx_nav_pvt_t pvt = {};
+      pvt.year = 2023;
+      pvt.month = 6;
+      pvt.day = 1;
+      pvt.sec = s % 60;
+      pvt.nano = i * 100000000;
+      pvt.flags = 1;
+      pvt.lat = 377749000 + gen() % 1000;
+      pvt.lon = -1224194000 + gen() % 1000;
+      stream += ubx_frame(0x01, 0x07, std::string((const char *)&pvt, sizeof(pvt)));
+
+      ublox::ubx_rxm_rawx_t rawx = {};
+      rawx.rcvTow = s + i * 0.1;
+      rawx.numMeas = 24;
+      std::string payload((const char *)&rawx, sizeof(rawx));
+      for (int m = 0; m < rawx.numMeas; ++m) {
+        ublox::ubx_rxm_rawx_meas_t meas = {};
+        meas.prMes = 2e7 + gen() % 1000000;
+        meas.gnssId = m % 2 ? 6 : 0;
+        meas.svId = m + 1;
+        meas.cno = 30 + gen() % 15;
+        meas.trkStat = 0b0111;
+        payload += std::string((const char *)&meas, sizeof(meas));
+      }
+      stream += ubx_frame(0x02, 0x15, payload);
+    }
+    for (int sv = 0; sv < 8; ++sv) {
+      ublox::ubx_rxm_sfrbx_t sfrbx = {};
+      sfrbx.gnssId = sv % 2 ? 6 : 0;
+      sfrbx.svId = sv + 1;
+      sfrbx.freqId = sv;
+      sfrbx.numWords = sfrbx.gnssId == 0 ? 10 : 4;
+      std::string payload((const char *)&sfrbx, sizeof(sfrbx));
+      for (int w = 0; w < sfrbx.numWords; ++w) {
+        uint32_t word = gen();
+        payload += std::string((const char *)&word, sizeof(word));
+      }
+      stream += ubx_frame(0x02, 0x13, payload);
+    }
+    stream += ubx_frame(0x0a, 0x09, std::string(60, '\x01'));
+  }
+  return stream;
+}
+
+// the ubloxRaw bytes of a log, in order
+static std::string read_ublox_raw(const std::string &log) {
+  std::string stream;
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)log.data(), log.size() / sizeof(capnp::word));
+  try {
+    while (words.size() > 0) {
+      capnp::FlatArrayMessageReader reader(words);
+      auto event = reader.getRoot<cereal::Event>();
+      if (event.which() == cereal::Event::UBLOX_RAW) {
+        auto raw = event.getUbloxRaw();
+        stream.append((const char *)raw.begin(), raw.size());
+      }
+      words = kj::arrayPtr(reader.getEnd(), words.end());
+    }
+  } catch (const kj::Exception &e) {
+    printf("stopped reading at a corrupt event\n");
+  }
+  return stream;
+}
+
+// frames the stream in the 1 KB chunks the serial port gives, returns the number of messages and the time
+static std::pair<int, double> frame(const std::string &stream, std::vector<std::string> *frames) {
+  UbloxMsgParser parser;
+  int messages = 0;
+  const uint64_t t = nanos_since_boot();
+  for (size_t chunk = 0; chunk < stream.size(); chunk += 1024) {
+    const uint8_t *data = (const uint8_t *)stream.data() + chunk;
+    const size_t len = std::min<size_t>(1024, stream.size() - chunk);
+    size_t bytes_consumed = 0;
+    while (bytes_consumed < len) {
+      size_t bytes_consumed_this_time = 0;
+      if (parser.add_data(0, data + bytes_consumed, len - bytes_consumed, bytes_consumed_this_time)) {
+        ++messages;
+        if (frames) frames->push_back(parser.data());
+        parser.reset();
+      }
+      bytes_consumed += bytes_consumed_this_time;
+    }
+  }
+  return {messages, (nanos_since_boot() - t) / 1e6};
+}
+
+int main(int argc, char *argv[]) {
+  int passes = 20;
+  double corrupt = 0.01;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) passes = std::atoi(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-c") == 0) corrupt = std::atof(argv[++i]);
+    else args.push_back(argv[i]);
+  }
+  if (args.size() > 1 || passes < 1 || corrupt < 0 || corrupt > 1) {
+    printf("usage: %s [RLOG] [-n PASSES] [-c CORRUPT]\n", argv[0]);
+    return 1;
+  }
+
+  std::mt19937 gen(0);
+  const std::string stream = args.empty() ? generate_stream(60, gen) : read_ublox_raw(util::read_file(args[0]));
+  if (stream.empty()) {
+    printf("no ubloxRaw in %s\n", args[0].c_str());
+    return 1;
+  }
+  std::string corrupted = stream;
+  for (size_t i = 0; i < corrupted.size() * corrupt; ++i) {
+    corrupted[gen() % corrupted.size()] = gen();
+  }
+
+  printf("%.1f KB stream, %d passes\n", stream.size() / 1e3, passes);
+  const std::pair<const char *, const std::string *> streams[] = {{"clean", &stream}, {"corrupted", &corrupted}};
+  for (auto &[name, s] : streams) {
+    std::vector<double> ms;
+    int messages = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+      auto [n, t] = frame(*s, nullptr);
+      messages = n;
+      ms.push_back(t);
+    }
+    std::sort(ms.begin(), ms.end());
+    printf("  framing %-10s %6d messages, %8.3f ms p50, %8.1f MB/s\n", name, messages, ms[ms.size() / 2],
+           s->size() / 1e3 / ms[ms.size() / 2]);
+  }
+
+  std::vector<std::string> frames;
+  frame(stream, &frames);
+  std::map<std::string, Stats> stats;
+  for (int pass = 0; pass < passes; ++pass) {
+    // a new parser each pass, it keeps the ephemeris subframes it collected
+    UbloxMsgParser parser;
+    for (auto &f : frames) {
+      size_t consumed;
+      parser.reset();
+      parser.add_data(0, (const uint8_t *)f.data(), f.size(), consumed);
+
+      char name[16];
+      snprintf(name, sizeof(name), "0x%02x%02x", (uint8_t)f[2], (uint8_t)f[3]);
+      Stats &st = stats[name];
+      const uint64_t allocs = thread_allocations();
+      const uint64_t t = nanos_since_boot();
+      try {
+        parser.gen_msg();
+      } catch (const std::exception &) {
+        // a short payload, counted all the same
+      }
+      st.us.push_back((nanos_since_boot() - t) / 1e3);
+      st.allocations += thread_allocations() - allocs;
+    }
+  }
+
+  printf("  %-20s %8s %10s %10s %10s %12s\n", "gen_msg", "count", "mean us", "p50 us", "p99 us", "allocs/msg");
+  for (auto &[name, s] : stats) {
+    std::sort(s.us.begin(), s.us.end());
+    const double sum = std::accumulate(s.us.begin(), s.us.end(), 0.0);
+    printf("  %-20s %8zu %10.2f %10.2f %10.2f %12.1f\n", name.c_str(), s.us.size() / passes, sum / s.us.size(),
+           s.us[s.us.size() / 2], s.us[std::min(s.us.size() - 1, s.us.size() * 99 / 100)], (double)s.allocations / s.us.size());
+  }
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "system/ubloxd/ublox_msg.h"
+
+// framing and decoding of UbloxMsgParser on generated streams
+
+static std::string ubx_frame(uint8_t msg_class, uint8_t msg_id, const std::string &payload) {
+  std::string msg = {(char)ublox::PREAMBLE1, (char)ublox::PREAMBLE2, (char)msg_class, (char)msg_id,
+                     (char)(payload.size() & 0xff), (char)(payload.size() >> 8)};
+  return ublox::ubx_add_checksum(msg + payload);
+}
+
+template <class T>
+static std::string as_payload(const T &msg) {
+  return std::string((const char *)&msg, sizeof(msg));
+}
+
+// feeds the stream in chunks like ubloxd does, and returns the framed messages
+static std::vector<std::string> frame_stream(UbloxMsgParser &parser, const std::string &stream, size_t chunk_size) {
+  std::vector<std::string> frames;
+  for (size_t chunk = 0; chunk < stream.size(); chunk += chunk_size) {
+    const uint8_t *data = (const uint8_t *)stream.data() + chunk;
+    const size_t len = std::min(chunk_size, stream.size() - chunk);
+    size_t bytes_consumed = 0;
+    while (bytes_consumed < len) {
+      size_t bytes_consumed_this_time = 0;
+      if (parser.add_data(0, data + bytes_consumed, len - bytes_consumed, bytes_consumed_this_time)) {
+        frames.push_back(parser.data());
+        parser.reset();
+      }
+      REQUIRE(bytes_consumed_this_time <= len - bytes_consumed);
+      bytes_consumed += bytes_consumed_this_time;
+    }
+  }
+  return frames;
+}
+
+static std::vector<std::string> test_frames() {
+  std::mt19937 gen(0);
+  std::vector<std::string> frames;
+  for (int i = 0; i < 50; ++i) {
+    std::string payload(gen() % 300, '\0');
+    for (char &c : payload) c = gen();
+    frames.push_back(ubx_frame(0x0a, 0x09, payload));
+  }
+  return frames;
+}
+
+TEST_CASE("UbloxMsgParser frames messages split across chunks") {
+  const auto frames = test_frames();
+  std::string stream;
+  for (auto &f : frames) stream += f;
+
+  for (size_t chunk_size : {1, 2, 7, 64, 1000, 100000}) {
+    UbloxMsgParser parser;
+    INFO("chunk size " << chunk_size);
+    REQUIRE(frame_stream(parser, stream, chunk_size) == frames);
+  }
+}
+
+TEST_CASE("UbloxMsgParser resyncs after garbage") {
+  const auto frames = test_frames();
+  std::mt19937 gen(1);
+
+  // garbage with lone preamble bytes in between every message
+  std::string stream;
+  for (auto &f : frames) {
+    for (int i = gen() % 100; i > 0; --i) {
+      stream.push_back(gen() % 4 == 0 ? ublox::PREAMBLE1 : (gen() % 0x60));
+    }
+    stream += f;
+  }
+  for (size_t chunk_size : {1, 13, 4096}) {
+    UbloxMsgParser parser;
+    INFO("chunk size " << chunk_size);
+    REQUIRE(frame_stream(parser, stream, chunk_size) == frames);
+  }
+}
+
+TEST_CASE("UbloxMsgParser rejects bad checksums") {
+  const auto frames = test_frames();
+  std::string stream;
+  for (int i = 0; i < frames.size(); ++i) {
+    std::string f = frames[i];
+    if (i % 3 == 1) f[f.size() - 1 - i % 2] ^= 0x10;
+    stream += f;
+  }
+
+  UbloxMsgParser parser;
+  const auto out = frame_stream(parser, stream, 512);
+  std::vector<std::string> expected;
+  for (int i = 0; i < frames.size(); ++i) {
+    if (i % 3 != 1) expected.push_back(frames[i]);
+  }
+  REQUIRE(out == expected);
+}
+
+TEST_CASE("UbloxMsgParser fuzz") {
+  const auto frames = test_frames();
+  std::string clean;
+  for (auto &f : frames) clean += f;
+
+  std::mt19937 gen(2);
+  for (int run = 0; run < 200; ++run) {
+    // random byte flips, insertions and deletions
+    std::string stream = clean;
+    for (int i = gen() % 20; i > 0; --i) {
+      const size_t pos = gen() % stream.size();
+      switch (gen() % 3) {
+      case 0: stream[pos] = gen(); break;
+      case 1: stream.insert(pos, 1 + gen() % 8, gen() % 2 ? ublox::PREAMBLE1 : ublox::PREAMBLE2); break;
+      case 2: stream.erase(pos, 1 + gen() % 8); break;
+      }
+    }
+
+    // whatever comes out is a well formed message from the stream, in order
+    UbloxMsgParser parser;
+    const auto out = frame_stream(parser, stream, 1 + gen() % 2000);
+    auto it = frames.begin();
+    for (auto &msg : out) {
+      REQUIRE(msg.size() >= ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE);
+      REQUIRE(msg == ublox::ubx_add_checksum(msg.substr(0, msg.size() - ublox::UBLOX_CHECKSUM_SIZE)));
+      it = std::find(it, frames.end(), msg);
+      REQUIRE(it != frames.end());
+      ++it;
+    }
+  }
+}
+
+TEST_CASE("UbloxMsgParser decodes NAV-PVT in place") {
+  ublox::ubx_nav_pvt_t pvt = {};
+  pvt.year = 2023;
+  pvt.month = 6;
+  pvt.day = 1;
+  pvt.hour = 12;
+  pvt.min = 30;
+  pvt.sec = 15;
+  pvt.nano = 250000000;
+  pvt.flags = 1;
+  pvt.lat = 377749000;
+  pvt.lon = -1224194000;
+  pvt.height = 15500;
+  pvt.gSpeed = 12340;
+  pvt.headMot = 9000000;
+  pvt.velN = 1000;
+  pvt.velE = -2000;
+  pvt.velD = 30;
+  pvt.hAcc = 1500;
+  pvt.vAcc = 2500;
+
+  UbloxMsgParser parser;
+  const std::string frame = ubx_frame(0x01, 0x07, as_payload(pvt));
+  size_t consumed;
+  REQUIRE(parser.add_data(0, (const uint8_t *)frame.data(), frame.size(), consumed));
+
+  auto [name, words] = parser.gen_msg();
+  REQUIRE(name == "gpsLocationExternal");
+  capnp::FlatArrayMessageReader reader(words);
+  auto loc = reader.getRoot<cereal::Event>().getGpsLocationExternal();
+  REQUIRE(loc.getHasFix());
+  REQUIRE(loc.getLatitude() == Approx(37.7749));
+  REQUIRE(loc.getLongitude() == Approx(-122.4194));
+  REQUIRE(loc.getAltitude() == Approx(15.5));
+  REQUIRE(loc.getSpeed() == Approx(12.34));
+  REQUIRE(loc.getBearingDeg() == Approx(90.0));
+  REQUIRE(loc.getVNED().size() == 3);
+  REQUIRE(loc.getVNED()[1] == Approx(-2.0));
+  REQUIRE(loc.getHorizontalAccuracy() == Approx(1.5));
+  REQUIRE(loc.getVerticalAccuracy() == Approx(2.5));
+  REQUIRE(loc.getUnixTimestampMillis() == 1685622615250);
+}
+
+TEST_CASE("UbloxMsgParser decodes RXM-RAWX in place") {
+  ublox::ubx_rxm_rawx_t rawx = {};
+  rawx.rcvTow = 123456.5;
+  rawx.week = 2265;
+  rawx.leapS = 18;
+  rawx.numMeas = 2;
+  rawx.recStat = 1;
+  ublox::ubx_rxm_rawx_meas_t meas[2] = {};
+  for (int i = 0; i < 2; ++i) {
+    meas[i].prMes = 2.1e7 + i;
+    meas[i].cpMes = 1.1e8 - i;
+    meas[i].doMes = -1234.5f;
+    meas[i].gnssId = i * 6;
+    meas[i].svId = 10 + i;
+    meas[i].freqId = 7;
+    meas[i].locktime = 500;
+    meas[i].cno = 40;
+    meas[i].trkStat = 0b0011;
+  }
+
+  UbloxMsgParser parser;
+  const std::string frame = ubx_frame(0x02, 0x15, as_payload(rawx) + as_payload(meas));
+  size_t consumed;
+  REQUIRE(parser.add_data(0, (const uint8_t *)frame.data(), frame.size(), consumed));
+  REQUIRE(consumed == frame.size());
+
+  auto [name, words] = parser.gen_msg();
+  REQUIRE(name == "ubloxGnss");
+  capnp::FlatArrayMessageReader reader(words);
+  auto report = reader.getRoot<cereal::Event>().getUbloxGnss().getMeasurementReport();
+  REQUIRE(report.getRcvTow() == 123456.5);
+  REQUIRE(report.getGpsWeek() == 2265);
+  REQUIRE(report.getLeapSeconds() == 18);
+  REQUIRE(report.getNumMeas() == 2);
+  REQUIRE(report.getReceiverStatus().getLeapSecValid());
+  REQUIRE(report.getMeasurements().size() == 2);
+  for (int i = 0; i < 2; ++i) {
+    auto m = report.getMeasurements()[i];
+    REQUIRE(m.getSvId() == 10 + i);
+    REQUIRE(m.getGnssId() == i * 6);
+    REQUIRE(m.getPseudorange() == 2.1e7 + i);
+    REQUIRE(m.getCarrierCycles() == 1.1e8 - i);
+    REQUIRE(m.getDoppler() == -1234.5f);
+    REQUIRE(m.getCno() == 40);
+    REQUIRE(m.getTrackingStatus().getPseudorangeValid());
+    REQUIRE(m.getTrackingStatus().getCarrierPhaseValid());
+    REQUIRE_FALSE(m.getTrackingStatus().getHalfCycleValid());
+  }
+
+  // numMeas says more than the payload holds
+  rawx.numMeas = 3;
+  const std::string short_frame = ubx_frame(0x02, 0x15, as_payload(rawx) + as_payload(meas));
+  parser.reset();
+  REQUIRE(parser.add_data(0, (const uint8_t *)short_frame.data(), short_frame.size(), consumed));
+  REQUIRE_THROWS_AS(parser.gen_msg(), std::runtime_error);
+}
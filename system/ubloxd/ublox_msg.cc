@@ -9,6 +9,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <stdexcept>
 #include <unordered_map>
 #include <utility>
 
@@ -33,17 +34,14 @@ inline int UbloxMsgParser::needed_bytes() {
 }
 
 inline bool UbloxMsgParser::valid_cheksum() {
-  uint8_t ck_a = 0, ck_b = 0;
-  for (int i = 2; i < bytes_in_parse_buf - ublox::UBLOX_CHECKSUM_SIZE; i++) {
-    ck_a = (ck_a + msg_parse_buf[i]) & 0xFF;
-    ck_b = (ck_b + ck_a) & 0xFF;
-  }
+  uint8_t ck_a, ck_b;
+  ublox::ubx_checksum(msg_parse_buf + 2, bytes_in_parse_buf - 2 - ublox::UBLOX_CHECKSUM_SIZE, ck_a, ck_b);
   if (ck_a != msg_parse_buf[bytes_in_parse_buf - 2]) {
-    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg_parse_buf[6]);
+    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg_parse_buf[bytes_in_parse_buf - 2]);
     return false;
   }
   if (ck_b != msg_parse_buf[bytes_in_parse_buf - 1]) {
-    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg_parse_buf[7]);
+    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg_parse_buf[bytes_in_parse_buf - 1]);
     return false;
   }
   return true;
@@ -69,33 +67,67 @@ inline bool UbloxMsgParser::valid_so_far() {
 
 bool UbloxMsgParser::add_data(float log_time, const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed) {
   last_log_time = log_time;
+  bytes_consumed = 0;
+  if (bytes_in_parse_buf == 0) {
+    // Skip to the next preamble, the bytes before it are never copied.
+    auto preamble = (const uint8_t *)memchr(incoming_data, ublox::PREAMBLE1, incoming_data_len);
+    bytes_consumed = preamble ? preamble - incoming_data : incoming_data_len;
+  }
+
   int needed = needed_bytes();
   if (needed > 0) {
-    bytes_consumed = std::min((uint32_t)needed, incoming_data_len);
+    size_t len = std::min((size_t)needed, incoming_data_len - bytes_consumed);
     // Add data to buffer
-    memcpy(msg_parse_buf + bytes_in_parse_buf, incoming_data, bytes_consumed);
-    bytes_in_parse_buf += bytes_consumed;
+    memcpy(msg_parse_buf + bytes_in_parse_buf, incoming_data + bytes_consumed, len);
+    bytes_in_parse_buf += len;
+    bytes_consumed += len;
   } else {
     bytes_consumed = incoming_data_len;
   }
 
   // Validate msg format, detect invalid header and invalid checksum.
   while (!valid_so_far() && bytes_in_parse_buf != 0) {
-    // Corrupted msg, drop a byte.
-    bytes_in_parse_buf -= 1;
+    // Corrupted msg, drop everything before the next preamble in one go.
+    auto preamble = (const uint8_t *)memchr(msg_parse_buf + 1, ublox::PREAMBLE1, bytes_in_parse_buf - 1);
+    size_t drop = preamble ? preamble - msg_parse_buf : bytes_in_parse_buf;
+    bytes_in_parse_buf -= drop;
     if (bytes_in_parse_buf > 0)
-      memmove(&msg_parse_buf[0], &msg_parse_buf[1], bytes_in_parse_buf);
+      memmove(&msg_parse_buf[0], &msg_parse_buf[drop], bytes_in_parse_buf);
   }
 
   // There is redundant data at the end of buffer, reset the buffer.
   if (needed_bytes() == -1) {
     bytes_in_parse_buf = 0;
   }
-  return valid();
+  // valid_so_far() checked the checksum of a complete message
+  return bytes_in_parse_buf > 0 && needed_bytes() == 0;
 }
 
+// the payload as T, when it is long enough for it
+template <class T>
+static const T *payload_view(const uint8_t *payload, size_t payload_len) {
+  const T *msg = (const T *)payload;
+  if (payload_len < sizeof(T) || payload_len < msg->size()) {
+    throw std::runtime_error("payload too short for its message type");
+  }
+  return msg;
+}
 
 std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
+  const uint16_t msg_type = (msg_parse_buf[2] << 8) | msg_parse_buf[3];
+  const uint8_t *payload = msg_parse_buf + ublox::UBLOX_HEADER_SIZE;
+  const size_t payload_len = UBLOX_MSG_SIZE(msg_parse_buf);
+
+  // the frequent messages are read in place
+  switch (msg_type) {
+  case 0x0107:
+    return {"gpsLocationExternal", gen_nav_pvt(payload_view<ublox::ubx_nav_pvt_t>(payload, payload_len))};
+  case 0x0213: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
+    return {"ubloxGnss", gen_rxm_sfrbx(payload_view<ublox::ubx_rxm_sfrbx_t>(payload, payload_len))};
+  case 0x0215: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
+    return {"ubloxGnss", gen_rxm_rawx(payload_view<ublox::ubx_rxm_rawx_t>(payload, payload_len))};
+  }
+
   std::string dat = data();
   kaitai::kstream stream(dat);
 
@@ -103,12 +135,6 @@ std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
   auto body = ubx_message.body();
 
   switch (ubx_message.msg_type()) {
-  case 0x0107:
-    return {"gpsLocationExternal", gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body))};
-  case 0x0213: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
-    return {"ubloxGnss", gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body))};
-  case 0x0215: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
-    return {"ubloxGnss", gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body))};
   case 0x0a09:
     return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body))};
   case 0x0a0b:
@@ -122,46 +148,45 @@ std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg) {
   MessageBuilder msg_builder;
   auto gpsLoc = msg_builder.initEvent().initGpsLocationExternal();
   gpsLoc.setSource(cereal::GpsLocationData::SensorSource::UBLOX);
-  gpsLoc.setFlags(msg->flags());
-  gpsLoc.setHasFix((msg->flags() % 2) == 1);
-  gpsLoc.setLatitude(msg->lat() * 1e-07);
-  gpsLoc.setLongitude(msg->lon() * 1e-07);
-  gpsLoc.setAltitude(msg->height() * 1e-03);
-  gpsLoc.setSpeed(msg->g_speed() * 1e-03);
-  gpsLoc.setBearingDeg(msg->head_mot() * 1e-5);
-  gpsLoc.setHorizontalAccuracy(msg->h_acc() * 1e-03);
+  gpsLoc.setFlags(msg->flags);
+  gpsLoc.setHasFix((msg->flags % 2) == 1);
+  gpsLoc.setLatitude(msg->lat * 1e-07);
+  gpsLoc.setLongitude(msg->lon * 1e-07);
+  gpsLoc.setAltitude(msg->height * 1e-03);
+  gpsLoc.setSpeed(msg->gSpeed * 1e-03);
+  gpsLoc.setBearingDeg(msg->headMot * 1e-5);
+  gpsLoc.setHorizontalAccuracy(msg->hAcc * 1e-03);
   std::tm timeinfo = std::tm();
-  timeinfo.tm_year = msg->year() - 1900;
-  timeinfo.tm_mon = msg->month() - 1;
-  timeinfo.tm_mday = msg->day();
-  timeinfo.tm_hour = msg->hour();
-  timeinfo.tm_min = msg->min();
-  timeinfo.tm_sec = msg->sec();
+  timeinfo.tm_year = msg->year - 1900;
+  timeinfo.tm_mon = msg->month - 1;
+  timeinfo.tm_mday = msg->day;
+  timeinfo.tm_hour = msg->hour;
+  timeinfo.tm_min = msg->min;
+  timeinfo.tm_sec = msg->sec;
 
   std::time_t utc_tt = timegm(&timeinfo);
-  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg->nano() * 1e-06);
-  float f[] = { msg->vel_n() * 1e-03f, msg->vel_e() * 1e-03f, msg->vel_d() * 1e-03f };
+  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg->nano * 1e-06);
+  float f[] = { msg->velN * 1e-03f, msg->velE * 1e-03f, msg->velD * 1e-03f };
   gpsLoc.setVNED(f);
-  gpsLoc.setVerticalAccuracy(msg->v_acc() * 1e-03);
-  gpsLoc.setSpeedAccuracy(msg->s_acc() * 1e-03);
-  gpsLoc.setBearingAccuracyDeg(msg->head_acc() * 1e-05);
+  gpsLoc.setVerticalAccuracy(msg->vAcc * 1e-03);
+  gpsLoc.setSpeedAccuracy(msg->sAcc * 1e-03);
+  gpsLoc.setBearingAccuracyDeg(msg->headAcc * 1e-05);
   return capnp::messageToFlatArray(msg_builder);
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg) {
   // GPS subframes are packed into 10x 4 bytes, each containing 3 actual bytes
   // We will first need to separate the data from the padding and parity
-  auto body = *msg->body();
-  assert(body.size() == 10);
+  assert(msg->numWords == 10);
 
   std::string subframe_data;
   subframe_data.reserve(30);
-  for (uint32_t word : body) {
-    word = word >> 6; // TODO: Verify parity
+  for (int i = 0; i < msg->numWords; i++) {
+    uint32_t word = msg->dwrd(i) >> 6; // TODO: Verify parity
     subframe_data.push_back(word >> 16);
     subframe_data.push_back(word >> 8);
     subframe_data.push_back(word >> 0);
@@ -177,14 +202,14 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
       // dont parse almanac subframes
       return kj::Array<capnp::word>();
     }
-    gps_subframes[msg->sv_id()][subframe_id] = subframe_data;
+    gps_subframes[msg->svId][subframe_id] = subframe_data;
   }
 
   // publish if subframes 1-3 have been collected
-  if (gps_subframes[msg->sv_id()].size() == 3) {
+  if (gps_subframes[msg->svId].size() == 3) {
     MessageBuilder msg_builder;
     auto eph = msg_builder.initEvent().initUbloxGnss().initEphemeris();
-    eph.setSvId(msg->sv_id());
+    eph.setSvId(msg->svId);
 
     int iode_s2 = 0;
     int iode_s3 = 0;
@@ -193,7 +218,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 1
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][1]);
+      kaitai::kstream stream(gps_subframes[msg->svId][1]);
       gps_t subframe(&stream);
       gps_t::subframe_1_t* subframe_1 = static_cast<gps_t::subframe_1_t*>(subframe.body());
 
@@ -217,7 +242,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 2
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][2]);
+      kaitai::kstream stream(gps_subframes[msg->svId][2]);
       gps_t subframe(&stream);
       gps_t::subframe_2_t* subframe_2 = static_cast<gps_t::subframe_2_t*>(subframe.body());
 
@@ -240,7 +265,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
 
     // Subframe 3
     {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][3]);
+      kaitai::kstream stream(gps_subframes[msg->svId][3]);
       gps_t subframe(&stream);
       gps_t::subframe_3_t* subframe_3 = static_cast<gps_t::subframe_3_t*>(subframe.body());
 
@@ -259,7 +284,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
     eph.setToeWeek(week);
     eph.setTocWeek(week);
 
-    gps_subframes[msg->sv_id()].clear();
+    gps_subframes[msg->svId].clear();
     if (iodc_lsb != iode_s2 || iodc_lsb != iode_s3) {
       // data set cutover, reject ephemeris
       return kj::Array<capnp::word>();
@@ -269,15 +294,15 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
   return kj::Array<capnp::word>();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg) {
   // This parser assumes that no 2 satellites of the same frequency
   // can be in view at the same time
-  auto body = *msg->body();
-  assert(body.size() == 4);
+  assert(msg->numWords == 4);
   {
     std::string string_data;
     string_data.reserve(16);
-    for (uint32_t word : body) {
+    for (int w = 0; w < msg->numWords; w++) {
+      uint32_t word = msg->dwrd(w);
       for (int i = 3; i >= 0; i--)
         string_data.push_back(word >> 8*i);
     }
@@ -294,51 +319,51 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     bool superframe_unknown = false;
     bool needs_clear = false;
     for (int i = 1; i <= 5; i++) {
-      if (glonass_strings[msg->freq_id()].find(i) == glonass_strings[msg->freq_id()].end())
+      if (glonass_strings[msg->freqId].find(i) == glonass_strings[msg->freqId].end())
         continue;
-      if (glonass_string_superframes[msg->freq_id()][i] == 0 || gl_string.superframe_number() == 0) {
+      if (glonass_string_superframes[msg->freqId][i] == 0 || gl_string.superframe_number() == 0) {
         superframe_unknown = true;
-      } else if (glonass_string_superframes[msg->freq_id()][i] != gl_string.superframe_number()) {
+      } else if (glonass_string_superframes[msg->freqId][i] != gl_string.superframe_number()) {
         needs_clear = true;
       }
       // Check if string times add up to being from the same frame
       // If superframe is known this is redundant
       // Strings are sent 2s apart and frames are 30s apart
       if (superframe_unknown &&
-          std::abs((glonass_string_times[msg->freq_id()][i] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
+          std::abs((glonass_string_times[msg->freqId][i] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
         needs_clear = true;
     }
     if (needs_clear) {
-      glonass_strings[msg->freq_id()].clear();
-      glonass_string_superframes[msg->freq_id()].clear();
-      glonass_string_times[msg->freq_id()].clear();
+      glonass_strings[msg->freqId].clear();
+      glonass_string_superframes[msg->freqId].clear();
+      glonass_string_times[msg->freqId].clear();
     }
-    glonass_strings[msg->freq_id()][string_number] = string_data;
-    glonass_string_superframes[msg->freq_id()][string_number] = gl_string.superframe_number();
-    glonass_string_times[msg->freq_id()][string_number] = last_log_time;
+    glonass_strings[msg->freqId][string_number] = string_data;
+    glonass_string_superframes[msg->freqId][string_number] = gl_string.superframe_number();
+    glonass_string_times[msg->freqId][string_number] = last_log_time;
   }
-  if (msg->sv_id() == 255) {
+  if (msg->svId == 255) {
     // data can be decoded before identifying the SV number, in this case 255
     // is returned, which means "unknown"  (ublox p32)
     return kj::Array<capnp::word>();
   }
 
   // publish if strings 1-5 have been collected
-  if (glonass_strings[msg->freq_id()].size() != 5) {
+  if (glonass_strings[msg->freqId].size() != 5) {
     return kj::Array<capnp::word>();
   }
 
   MessageBuilder msg_builder;
   auto eph = msg_builder.initEvent().initUbloxGnss().initGlonassEphemeris();
-  eph.setSvId(msg->sv_id());
-  eph.setFreqNum(msg->freq_id() - 7);
+  eph.setSvId(msg->svId);
+  eph.setFreqNum(msg->freqId - 7);
 
   uint16_t current_day = 0;
   uint16_t tk = 0;
 
   // string number 1
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][1]);
+    kaitai::kstream stream(glonass_strings[msg->freqId][1]);
     glonass_t gl_stream(&stream);
     glonass_t::string_1_t* data = static_cast<glonass_t::string_1_t*>(gl_stream.data());
 
@@ -352,7 +377,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 2
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][2]);
+    kaitai::kstream stream(glonass_strings[msg->freqId][2]);
     glonass_t gl_stream(&stream);
     glonass_t::string_2_t* data = static_cast<glonass_t::string_2_t*>(gl_stream.data());
 
@@ -366,7 +391,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 3
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][3]);
+    kaitai::kstream stream(glonass_strings[msg->freqId][3]);
     glonass_t gl_stream(&stream);
     glonass_t::string_3_t* data = static_cast<glonass_t::string_3_t*>(gl_stream.data());
 
@@ -380,7 +405,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
 
   // string number 4
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][4]);
+    kaitai::kstream stream(glonass_strings[msg->freqId][4]);
     glonass_t gl_stream(&stream);
     glonass_t::string_4_t* data = static_cast<glonass_t::string_4_t*>(gl_stream.data());
 
@@ -391,15 +416,15 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     eph.setAge(data->e_n());
     eph.setP4(data->p4());
     eph.setSvURA(glonass_URA_lookup.at(data->f_t()));
-    if (msg->sv_id() != data->n()) {
-      LOGE("SV_ID != SLOT_NUMBER: %d %" PRIu64, msg->sv_id(), data->n());
+    if (msg->svId != data->n()) {
+      LOGE("SV_ID != SLOT_NUMBER: %d %" PRIu64, msg->svId, data->n());
     }
     eph.setSvType(data->m());
   }
 
   // string number 5
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][5]);
+    kaitai::kstream stream(glonass_strings[msg->freqId][5]);
     glonass_t gl_stream(&stream);
     glonass_t::string_5_t* data = static_cast<glonass_t::string_5_t*>(gl_stream.data());
 
@@ -410,13 +435,13 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     eph.setTkSeconds(tk_seconds);
   }
 
-  glonass_strings[msg->freq_id()].clear();
+  glonass_strings[msg->freqId].clear();
   return capnp::messageToFlatArray(msg_builder);
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
-  switch (msg->gnss_id()) {
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg) {
+  switch (msg->gnssId) {
     case ubx_t::gnss_type_t::GNSS_TYPE_GPS:
       return parse_gps_ephemeris(msg);
     case ubx_t::gnss_type_t::GNSS_TYPE_GLONASS:
@@ -426,41 +451,41 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
   }
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg) {
   MessageBuilder msg_builder;
   auto mr = msg_builder.initEvent().initUbloxGnss().initMeasurementReport();
-  mr.setRcvTow(msg->rcv_tow());
-  mr.setGpsWeek(msg->week());
-  mr.setLeapSeconds(msg->leap_s());
-  mr.setGpsWeek(msg->week());
-
-  auto mb = mr.initMeasurements(msg->num_meas());
-  auto measurements = *msg->meas();
-  for (int8_t i = 0; i < msg->num_meas(); i++) {
-    mb[i].setSvId(measurements[i]->sv_id());
-    mb[i].setPseudorange(measurements[i]->pr_mes());
-    mb[i].setCarrierCycles(measurements[i]->cp_mes());
-    mb[i].setDoppler(measurements[i]->do_mes());
-    mb[i].setGnssId(measurements[i]->gnss_id());
-    mb[i].setGlonassFrequencyIndex(measurements[i]->freq_id());
-    mb[i].setLocktime(measurements[i]->lock_time());
-    mb[i].setCno(measurements[i]->cno());
-    mb[i].setPseudorangeStdev(0.01 * (pow(2, (measurements[i]->pr_stdev() & 15)))); // weird scaling, might be wrong
-    mb[i].setCarrierPhaseStdev(0.004 * (measurements[i]->cp_stdev() & 15));
-    mb[i].setDopplerStdev(0.002 * (pow(2, (measurements[i]->do_stdev() & 15)))); // weird scaling, might be wrong
+  mr.setRcvTow(msg->rcvTow);
+  mr.setGpsWeek(msg->week);
+  mr.setLeapSeconds(msg->leapS);
+  mr.setGpsWeek(msg->week);
+
+  auto mb = mr.initMeasurements(msg->numMeas);
+  for (int i = 0; i < msg->numMeas; i++) {
+    const ublox::ubx_rxm_rawx_meas_t &meas = msg->meas(i);
+    mb[i].setSvId(meas.svId);
+    mb[i].setPseudorange(meas.prMes);
+    mb[i].setCarrierCycles(meas.cpMes);
+    mb[i].setDoppler(meas.doMes);
+    mb[i].setGnssId(meas.gnssId);
+    mb[i].setGlonassFrequencyIndex(meas.freqId);
+    mb[i].setLocktime(meas.locktime);
+    mb[i].setCno(meas.cno);
+    mb[i].setPseudorangeStdev(0.01 * (pow(2, (meas.prStdev & 15)))); // weird scaling, might be wrong
+    mb[i].setCarrierPhaseStdev(0.004 * (meas.cpStdev & 15));
+    mb[i].setDopplerStdev(0.002 * (pow(2, (meas.doStdev & 15)))); // weird scaling, might be wrong
 
     auto ts = mb[i].initTrackingStatus();
-    auto trk_stat = measurements[i]->trk_stat();
+    auto trk_stat = meas.trkStat;
     ts.setPseudorangeValid(bit_to_bool(trk_stat, 0));
     ts.setCarrierPhaseValid(bit_to_bool(trk_stat, 1));
     ts.setHalfCycleValid(bit_to_bool(trk_stat, 2));
     ts.setHalfCycleSubtracted(bit_to_bool(trk_stat, 3));
   }
 
-  mr.setNumMeas(msg->num_meas());
+  mr.setNumMeas(msg->numMeas);
   auto rs = mr.initReceiverStatus();
-  rs.setLeapSecValid(bit_to_bool(msg->rec_stat(), 0));
-  rs.setClkReset(bit_to_bool(msg->rec_stat(), 2));
+  rs.setLeapSecValid(bit_to_bool(msg->recStat, 0));
+  rs.setClkReset(bit_to_bool(msg->recStat, 2));
   return capnp::messageToFlatArray(msg_builder);
 }
 
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -48,14 +49,113 @@ namespace ublox {
     uint32_t tAccNs;
   } __attribute__((packed));
 
+  // the payloads read in place, without kaitai. the layouts follow ubx.ksy
+  struct ubx_nav_pvt_t {
+    uint32_t iTOW;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;
+    uint32_t tAcc;
+    int32_t nano;
+    uint8_t fixType;
+    uint8_t flags;
+    uint8_t flags2;
+    uint8_t numSV;
+    int32_t lon;
+    int32_t lat;
+    int32_t height;
+    int32_t hMSL;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;
+    int32_t headMot;
+    int32_t sAcc;
+    uint32_t headAcc;
+    uint16_t pDOP;
+    uint8_t flags3;
+    uint8_t reserved1[5];
+    int32_t headVeh;
+    int16_t magDec;
+    uint16_t magAcc;
+
+    size_t size() const { return sizeof(*this); }
+  } __attribute__((packed));
+  static_assert(sizeof(ubx_nav_pvt_t) == 92);
+
+  struct ubx_rxm_rawx_meas_t {
+    double prMes;
+    double cpMes;
+    float doMes;
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t reserved2;
+    uint8_t freqId;
+    uint16_t locktime;
+    uint8_t cno;
+    uint8_t prStdev;
+    uint8_t cpStdev;
+    uint8_t doStdev;
+    uint8_t trkStat;
+    uint8_t reserved3;
+  } __attribute__((packed));
+  static_assert(sizeof(ubx_rxm_rawx_meas_t) == 32);
+
+  struct ubx_rxm_rawx_t {
+    double rcvTow;
+    uint16_t week;
+    int8_t leapS;
+    uint8_t numMeas;
+    uint8_t recStat;
+    uint8_t reserved1[3];
+
+    // numMeas measurements follow
+    const ubx_rxm_rawx_meas_t &meas(int i) const { return ((const ubx_rxm_rawx_meas_t *)(this + 1))[i]; }
+    size_t size() const { return sizeof(*this) + numMeas * sizeof(ubx_rxm_rawx_meas_t); }
+  } __attribute__((packed));
+  static_assert(sizeof(ubx_rxm_rawx_t) == 16);
+
+  struct ubx_rxm_sfrbx_t {
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t reserved1;
+    uint8_t freqId;
+    uint8_t numWords;
+    uint8_t chn;
+    uint8_t version;
+    uint8_t reserved2;
+
+    // numWords words follow, unaligned
+    uint32_t dwrd(int i) const {
+      uint32_t word;
+      memcpy(&word, (const uint8_t *)(this + 1) + i * sizeof(word), sizeof(word));
+      return word;
+    }
+    size_t size() const { return sizeof(*this) + numWords * sizeof(uint32_t); }
+  } __attribute__((packed));
+  static_assert(sizeof(ubx_rxm_sfrbx_t) == 8);
+
+  // the 8-bit Fletcher checksum of the bytes after the preamble
+  inline void ubx_checksum(const uint8_t *data, size_t len, uint8_t &ck_a, uint8_t &ck_b) {
+    ck_a = 0;
+    ck_b = 0;
+    for (size_t i = 0; i < len; i++) {
+      ck_a += data[i];
+      ck_b += ck_a;
+    }
+  }
+
   inline std::string ubx_add_checksum(const std::string &msg) {
     assert(msg.size() > 2);
 
-    uint8_t ck_a = 0, ck_b = 0;
-    for (int i = 2; i < msg.size(); i++) {
-      ck_a = (ck_a + msg[i]) & 0xFF;
-      ck_b = (ck_b + ck_a) & 0xFF;
-    }
+    uint8_t ck_a, ck_b;
+    ubx_checksum((const uint8_t *)msg.data() + 2, msg.size() - 2, ck_a, ck_b);
 
     std::string r = msg;
     r.push_back(ck_a);
@@ -98,9 +198,9 @@ class UbloxMsgParser {
     inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
 
     std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
+    kj::Array<capnp::word> gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg);
+    kj::Array<capnp::word> gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg);
+    kj::Array<capnp::word> gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg);
     kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
     kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
     kj::Array<capnp::word> gen_nav_sat(ubx_t::nav_sat_t *msg);
@@ -110,14 +210,14 @@ class UbloxMsgParser {
     inline bool valid();
     inline bool valid_so_far();
 
-    kj::Array<capnp::word> parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg);
+    kj::Array<capnp::word> parse_gps_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg);
+    kj::Array<capnp::word> parse_glonass_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg);
 
     std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
 
     float last_log_time = 0.0;
     size_t bytes_in_parse_buf = 0;
-    uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE];
+    uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE + ublox::UBLOX_CHECKSUM_SIZE];
 
     // user range accuracy in meters
     const std::unordered_map<uint8_t, float> glonass_URA_lookup =
@@ -282,10 +282,10 @@ void ChartView::updateSeriesPoints() {
   }
 }
 
-void ChartView::appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
+void ChartView::appendCanEvents(const cabana::Signal *sig, const CanEventList &events,
                                 std::vector<QPointF> &vals, std::vector<QPointF> &step_vals) {
-  vals.reserve(vals.size() + events.capacity());
-  step_vals.reserve(step_vals.size() + events.capacity() * 2);
+  vals.reserve(vals.size() + events.size());
+  step_vals.reserve(step_vals.size() + events.size() * 2);
 
   double value = 0;
   for (const CanEvent *e : events) {
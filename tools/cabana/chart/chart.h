@@ -65,7 +65,7 @@ private slots:
   void signalRemoved(const cabana::Signal *sig) { removeIf([=](auto &s) { return s.sig == sig; }); }
 
 private:
-  void appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
+  void appendCanEvents(const cabana::Signal *sig, const CanEventList &events,
                        std::vector<QPointF> &vals, std::vector<QPointF> &step_vals);
   void createToolButtons();
   void addSeries(QXYSeries *series);
@@ -1,8 +1,16 @@
 #include "tools/cabana/dbc/dbcfile.h"
 
+#include <cctype>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
 #include <QFile>
 #include <QFileInfo>
-#include <QRegularExpression>
+#include <QtConcurrent>
 
 DBCFile::DBCFile(const QString &dbc_file_name) {
   QFile file(dbc_file_name);
@@ -16,7 +24,7 @@ DBCFile::DBCFile(const QString &dbc_file_name) {
 }
 
 DBCFile::DBCFile(const QString &name, const QString &content) : name_(name), filename("") {
-  parse(content);
+  parse(content.toUtf8());
 }
 
 bool DBCFile::save() {
@@ -61,172 +69,352 @@ cabana::Signal *DBCFile::signal(uint32_t address, const QString &name) {
   return m ? (cabana::Signal *)m->sig(name) : nullptr;
 }
 
-void DBCFile::parse(const QString &content) {
-  msgs.clear();
+namespace {
 
-  int line_num = 0;
-  QString line;
-  cabana::Msg *current_msg = nullptr;
-  int multiplexor_cnt = 0;
-  bool seen_first = false;
-  QTextStream stream((QString *)&content);
+struct DBCParseError {
+  int line = 0;
+  int column = 0;
+  QString message;
+  QString text;  // the line
+};
 
-  while (!stream.atEnd()) {
-    ++line_num;
-    QString raw_line = stream.readLine();
-    line = raw_line.trimmed();
+// what parsing a DBC file gives, shared by the DBCFiles opened with the same content
+struct ParsedDBC {
+  QString header;
+  std::map<uint32_t, cabana::Msg> msgs;
+  std::optional<DBCParseError> error;
+};
 
-    bool seen = true;
+// a single pass over the UTF-8 bytes of a DBC file, only names and text are copied into QStrings
+class DBCParser {
+public:
+  DBCParser(const QByteArray &content) : p(content.constData()), end(p + content.size()), line_start(p) {}
+
+  void parse(ParsedDBC *dbc) {
     try {
-      if (line.startsWith("BO_ ")) {
+      parseStatements(dbc);
+    } catch (DBCParseError &e) {
+      dbc->msgs.clear();
+      dbc->error = e;
+    }
+  }
+
+private:
+  void parseStatements(ParsedDBC *dbc) {
+    cabana::Msg *current_msg = nullptr;
+    int multiplexor_cnt = 0;
+    bool seen_first = false;
+
+    while (p < end) {
+      const char *raw_line = p;
+      skipSpaces();
+
+      bool seen = true;
+      if (consume("BO_ ")) {
         multiplexor_cnt = 0;
-        current_msg = parseBO(line);
-      } else if (line.startsWith("SG_ ")) {
-        parseSG(line, current_msg, multiplexor_cnt);
-      } else if (line.startsWith("VAL_ ")) {
-        parseVAL(line);
-      } else if (line.startsWith("CM_ BO_")) {
-        parseCM_BO(line, content, raw_line, stream);
-      } else if (line.startsWith("CM_ SG_ ")) {
-        parseCM_SG(line, content, raw_line, stream);
+        current_msg = parseBO(dbc);
+      } else if (consume("SG_ ")) {
+        parseSG(current_msg, multiplexor_cnt);
+      } else if (consume("VAL_ ")) {
+        parseVAL(dbc);
+      } else if (consume("CM_ BO_")) {
+        parseCM_BO(dbc);
+      } else if (consume("CM_ SG_ ")) {
+        parseCM_SG(dbc);
       } else {
         seen = false;
       }
-    } catch (std::exception &e) {
-      throw std::runtime_error(QString("[%1:%2]%3: %4").arg(filename).arg(line_num).arg(e.what()).arg(line).toStdString());
+
+      if (seen) {
+        seen_first = true;
+      } else if (!seen_first) {
+        dbc->header += QString::fromUtf8(raw_line, lineEnd() - raw_line) + "\n";
+      }
+      nextLine();
     }
 
-    if (seen) {
-      seen_first = true;
-    } else if (!seen_first) {
-      header += raw_line + "\n";
+    for (auto &[_, m] : dbc->msgs) {
+      m.update();
     }
   }
 
-  for (auto &[_, m] : msgs) {
-    m.update();
+  cabana::Msg *parseBO(ParsedDBC *dbc) {
+    const char *err = "Invalid BO_ line format";
+    uint32_t address = integer(err);
+    std::string_view name = word(err);
+    expect(':', err);
+    uint32_t size = integer(err);
+    std::string_view transmitter = word(err);
+    if (dbc->msgs.count(address) > 0)
+      fail(QString("Duplicate message address: %1").arg(address));
+
+    cabana::Msg *msg = &dbc->msgs[address];
+    msg->address = address;
+    msg->name = toQString(name);
+    msg->size = size;
+    msg->transmitter = toQString(transmitter);
+    return msg;
+  }
+
+  void parseSG(cabana::Msg *current_msg, int &multiplexor_cnt) {
+    const char *err = "Invalid SG_ line format";
+    if (!current_msg)
+      fail("No Message");
+
+    cabana::Signal s{};
+    s.name = toQString(word(err));
+    if (current_msg->sig(s.name) != nullptr)
+      fail("Duplicate signal name");
+
+    skipSpaces();
+    if (p < end && *p != ':') {
+      std::string_view indicator = word(err);
+      if (indicator == "M") {
+        // Only one signal within a single message can be the multiplexer switch.
+        if (++multiplexor_cnt >= 2)
+          fail("Multiple multiplexor");
+        s.type = cabana::Signal::Type::Multiplexor;
+      } else {
+        s.type = cabana::Signal::Type::Multiplexed;
+        s.multiplex_value = toQString(indicator.substr(1)).toInt();
+      }
+    }
+    expect(':', err);
+    s.start_bit = integer(err);
+    expect('|', err);
+    s.size = integer(err);
+    expect('@', err);
+    s.is_little_endian = integer(err) == 1;
+    skipSpaces();
+    if (p == end || (*p != '+' && *p != '-'))
+      fail(err);
+    s.is_signed = *p++ == '-';
+    expect('(', err);
+    s.factor = number(err);
+    expect(',', err);
+    s.offset = number(err);
+    expect(')', err);
+    expect('[', err);
+    s.min = number(err);
+    expect('|', err);
+    s.max = number(err);
+    expect(']', err);
+    s.unit = toQString(quoted(err));
+    s.receiver_name = toQString(restOfLine()).trimmed();
+    current_msg->sigs.push_back(new cabana::Signal(s));
   }
-}
 
-cabana::Msg *DBCFile::parseBO(const QString &line) {
-  static QRegularExpression bo_regexp(R"(^BO_ (?<address>\w+) (?<name>\w+) *: (?<size>\w+) (?<transmitter>\w+))");
+  void parseCM_BO(ParsedDBC *dbc) {
+    const char *err = "Invalid message comment format";
+    uint32_t address = integer(err);
+    std::string_view comment = quoted(err);
+    expect(';', err);
 
-  QRegularExpressionMatch match = bo_regexp.match(line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid BO_ line format");
+    if (auto it = dbc->msgs.find(address); it != dbc->msgs.end())
+      it->second.comment = toQString(comment).trimmed().replace("\\\"", "\"");
+  }
 
-  uint32_t address = match.captured("address").toUInt();
-  if (msgs.count(address) > 0)
-    throw std::runtime_error(QString("Duplicate message address: %1").arg(address).toStdString());
+  void parseCM_SG(ParsedDBC *dbc) {
+    const char *err = "Invalid CM_ SG_ line format";
+    uint32_t address = integer(err);
+    std::string_view name = word(err);
+    std::string_view comment = quoted(err);
+    expect(';', err);
 
-  // Create a new message object
-  cabana::Msg *msg = &msgs[address];
-  msg->address = address;
-  msg->name = match.captured("name");
-  msg->size = match.captured("size").toULong();
-  msg->transmitter = match.captured("transmitter").trimmed();
-  return msg;
-}
+    if (auto s = signal(dbc, address, name))
+      s->comment = toQString(comment).trimmed().replace("\\\"", "\"");
+  }
 
-void DBCFile::parseCM_BO(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream) {
-  static QRegularExpression msg_comment_regexp(R"(^CM_ BO_ *(?<address>\w+) *\"(?<comment>(?:[^"\\]|\\.)*)\"\s*;)");
+  void parseVAL(ParsedDBC *dbc) {
+    const char *err = "invalid VAL_ line format";
+    uint32_t address = integer(err);
+    std::string_view name = word(err);
 
-  QString parse_line = line;
-  if (!parse_line.endsWith("\";")) {
-    int pos = stream.pos() - raw_line.length() - 1;
-    parse_line = content.mid(pos, content.indexOf("\";", pos));
+    ValueDescription val_desc;
+    for (skipSpaces(); p < end && *p != ';' && *p != '\n' && *p != '\r'; skipSpaces()) {
+      double val = number(err);
+      QString desc = toQString(quoted(err)).trimmed();
+      val_desc.push_back({val, desc});
+    }
+    if (val_desc.empty())
+      fail(err);
+
+    if (auto s = signal(dbc, address, name))
+      s->val_desc = std::move(val_desc);
   }
-  auto match = msg_comment_regexp.match(parse_line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid message comment format");
 
-  if (auto m = (cabana::Msg *)msg(match.captured("address").toUInt()))
-    m->comment = match.captured("comment").trimmed().replace("\\\"", "\"");
-}
+  static cabana::Signal *signal(ParsedDBC *dbc, uint32_t address, std::string_view name) {
+    auto it = dbc->msgs.find(address);
+    return it != dbc->msgs.end() ? it->second.sig(toQString(name)) : nullptr;
+  }
 
-void DBCFile::parseSG(const QString &line, cabana::Msg *current_msg, int &multiplexor_cnt) {
-  static QRegularExpression sg_regexp(R"(^SG_ (\w+) : (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
-  static QRegularExpression sgm_regexp(R"(^SG_ (\w+) (\w+) *: (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
+  static QString toQString(std::string_view s) { return QString::fromUtf8(s.data(), s.size()); }
 
-  if (!current_msg)
-    throw std::runtime_error("No Message");
+  // the tokens skip the spaces before them, but never the end of the line
 
-  int offset = 0;
-  auto match = sg_regexp.match(line);
-  if (!match.hasMatch()) {
-    match = sgm_regexp.match(line);
-    offset = 1;
+  void skipSpaces() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\f')) ++p;
   }
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid SG_ line format");
-
-  QString name = match.captured(1);
-  if (current_msg->sig(name) != nullptr)
-    throw std::runtime_error("Duplicate signal name");
-
-  cabana::Signal s{};
-  if (offset == 1) {
-    auto indicator = match.captured(2);
-    if (indicator == "M") {
-      ++multiplexor_cnt;
-      // Only one signal within a single message can be the multiplexer switch.
-      if (multiplexor_cnt >= 2)
-        throw std::runtime_error("Multiple multiplexor");
-
-      s.type = cabana::Signal::Type::Multiplexor;
-    } else {
-      s.type = cabana::Signal::Type::Multiplexed;
-      s.multiplex_value = indicator.mid(1).toInt();
+
+  bool consume(const char *keyword) {
+    const size_t len = strlen(keyword);
+    if (size_t(end - p) < len || memcmp(p, keyword, len) != 0) return false;
+    p += len;
+    return true;
+  }
+
+  void expect(char c, const char *err) {
+    skipSpaces();
+    if (p == end || *p != c) fail(err);
+    ++p;
+  }
+
+  // \w+
+  std::string_view word(const char *err) {
+    skipSpaces();
+    const char *begin = p;
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_')) ++p;
+    if (p == begin) fail(err);
+    return {begin, size_t(p - begin)};
+  }
+
+  uint32_t integer(const char *err) {
+    skipSpaces();
+    const char *begin = p;
+    uint64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9' && value <= UINT32_MAX) value = value * 10 + (*p++ - '0');
+    if (p == begin || value > UINT32_MAX) fail(err);
+    return value;
+  }
+
+  double number(const char *err) {
+    skipSpaces();
+    const char *begin = p;
+    while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == '+' || *p == '-' || *p == 'e' || *p == 'E')) ++p;
+    // QByteArray parses in the C locale, strtod follows the one Qt sets
+    bool ok = false;
+    double value = QByteArray::fromRawData(begin, p - begin).toDouble(&ok);
+    if (!ok) fail(err);
+    return value;
+  }
+
+  // the text between double quotes, as it is in the file. \" doesn't end it and it can span lines
+  std::string_view quoted(const char *err) {
+    expect('"', err);
+    const char *begin = p;
+    const char *begin_line_start = line_start;
+    const int begin_line_num = line_num;
+    for (; p < end && *p != '"'; ++p) {
+      if (*p == '\\' && p + 1 < end && p[1] != '\n') {
+        ++p;
+      } else if (*p == '\n') {
+        ++line_num;
+        line_start = p + 1;
+      }
+    }
+    if (p == end) {
+      // point at the opening quote
+      p = begin - 1;
+      line_start = begin_line_start;
+      line_num = begin_line_num;
+      fail("Unterminated string");
     }
+    return {begin, size_t(p++ - begin)};
   }
-  s.name = name;
-  s.start_bit = match.captured(offset + 2).toInt();
-  s.size = match.captured(offset + 3).toInt();
-  s.is_little_endian = match.captured(offset + 4).toInt() == 1;
-  s.is_signed = match.captured(offset + 5) == "-";
-  s.factor = match.captured(offset + 6).toDouble();
-  s.offset = match.captured(offset + 7).toDouble();
-  s.min = match.captured(8 + offset).toDouble();
-  s.max = match.captured(9 + offset).toDouble();
-  s.unit = match.captured(10 + offset);
-  s.receiver_name = match.captured(11 + offset).trimmed();
-  current_msg->sigs.push_back(new cabana::Signal(s));
-}
 
-void DBCFile::parseCM_SG(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream) {
-  static QRegularExpression sg_comment_regexp(R"(^CM_ SG_ *(\w+) *(\w+) *\"((?:[^"\\]|\\.)*)\"\s*;)");
+  std::string_view restOfLine() {
+    const char *begin = p;
+    p = lineEnd();
+    return {begin, size_t(p - begin)};
+  }
 
-  QString parse_line = line;
-  if (!parse_line.endsWith("\";")) {
-    int pos = stream.pos() - raw_line.length() - 1;
-    parse_line = content.mid(pos, content.indexOf("\";", pos));
+  // the end of the current line, without \r\n or \n
+  const char *lineEnd() const {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if (!eol) eol = end;
+    return eol > p && eol[-1] == '\r' ? eol - 1 : eol;
   }
-  auto match = sg_comment_regexp.match(parse_line);
-  if (!match.hasMatch())
-    throw std::runtime_error("Invalid CM_ SG_ line format");
 
-  if (auto s = signal(match.captured(1).toUInt(), match.captured(2))) {
-    s->comment = match.captured(3).trimmed().replace("\\\"", "\"");
+  void nextLine() {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    p = eol ? eol + 1 : end;
+    line_start = p;
+    ++line_num;
   }
+
+  [[noreturn]] void fail(const QString &message) {
+    const char *eol = (const char *)memchr(line_start, '\n', end - line_start);
+    throw DBCParseError{line_num, int(p - line_start) + 1, message,
+                        QString::fromUtf8(line_start, (eol ? eol : end) - line_start).trimmed()};
+  }
+
+  const char *p;
+  const char *const end;
+  const char *line_start;
+  int line_num = 1;
+};
+
+// the most recently parsed files, a hit compares the whole content, not only its hash
+const size_t MAX_PARSED_CACHE = 16;
+
+struct ParsedCacheEntry {
+  size_t hash;
+  QByteArray content;  // implicitly shared with the caller, not copied
+  std::shared_ptr<const ParsedDBC> dbc;
+};
+
+std::mutex cache_lock;
+std::list<ParsedCacheEntry> parsed_cache;  // most recently used first
+
+std::shared_ptr<const ParsedDBC> findCached(size_t hash, const QByteArray &content) {
+  for (auto it = parsed_cache.begin(); it != parsed_cache.end(); ++it) {
+    if (it->hash == hash && it->content == content) {
+      parsed_cache.splice(parsed_cache.begin(), parsed_cache, it);
+      return it->dbc;
+    }
+  }
+  return nullptr;
 }
 
-void DBCFile::parseVAL(const QString &line) {
-  static QRegularExpression val_regexp(R"(VAL_ (\w+) (\w+) (\s*[-+]?[0-9]+\s+\".+?\"[^;]*))");
+std::shared_ptr<const ParsedDBC> parseCached(const QByteArray &content) {
+  const size_t hash = std::hash<std::string_view>{}({content.constData(), (size_t)content.size()});
+  {
+    std::lock_guard lk(cache_lock);
+    if (auto dbc = findCached(hash, content)) return dbc;
+  }
+
+  auto dbc = std::make_shared<ParsedDBC>();
+  DBCParser(content).parse(dbc.get());
+  std::lock_guard lk(cache_lock);
+  // another thread may have parsed the same content meanwhile
+  if (auto cached = findCached(hash, content)) return cached;
+  parsed_cache.push_front({hash, content, dbc});
+  if (parsed_cache.size() > MAX_PARSED_CACHE) {
+    parsed_cache.pop_back();
+  }
+  return dbc;
+}
 
-  auto match = val_regexp.match(line);
-  if (!match.hasMatch())
-    throw std::runtime_error("invalid VAL_ line format");
+}  // namespace
 
-  if (auto s = signal(match.captured(1).toUInt(), match.captured(2))) {
-    QStringList desc_list = match.captured(3).trimmed().split('"');
-    for (int i = 0; i < desc_list.size(); i += 2) {
-      auto val = desc_list[i].trimmed();
-      if (!val.isEmpty() && (i + 1) < desc_list.size()) {
-        auto desc = desc_list[i + 1].trimmed();
-        s->val_desc.push_back({val.toDouble(), desc});
-      }
+void DBCFile::preload(const QStringList &filenames) {
+  QtConcurrent::blockingMap(filenames.cbegin(), filenames.cend(), [](const QString &fn) {
+    QFile file(fn);
+    if (file.open(QIODevice::ReadOnly)) {
+      parseCached(file.readAll());
     }
+  });
+}
+
+void DBCFile::parse(const QByteArray &content) {
+  auto dbc = parseCached(content);
+  if (dbc->error) {
+    const DBCParseError &e = *dbc->error;
+    throw std::runtime_error(QString("[%1:%2:%3]%4: %5").arg(filename).arg(e.line).arg(e.column).arg(e.message).arg(e.text).toStdString());
   }
+  // copies, the cached result is shared with the other DBCFiles of the same content
+  header = dbc->header;
+  msgs = dbc->msgs;
 }
 
 QString DBCFile::generateDBC() {
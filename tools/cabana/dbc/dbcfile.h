@@ -1,7 +1,8 @@
 #pragma once
 
 #include <map>
-#include <QTextStream>
+#include <QByteArray>
+#include <QStringList>
 
 #include "tools/cabana/dbc/dbc.h"
 
@@ -11,6 +12,10 @@ public:
   DBCFile(const QString &name, const QString &content);
   ~DBCFile() {}
 
+  // parses the files on all cores, later DBCFiles with the same content copy the result.
+  // the results of the 16 most recently used files are kept
+  static void preload(const QStringList &filenames);
+
   bool save();
   bool saveAs(const QString &new_filename);
   bool writeContents(const QString &fn);
@@ -31,12 +36,7 @@ public:
   QString filename;
 
 private:
-  void parse(const QString &content);
-  cabana::Msg *parseBO(const QString &line);
-  void parseSG(const QString &line, cabana::Msg *current_msg, int &multiplexor_cnt);
-  void parseCM_BO(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream);
-  void parseCM_SG(const QString &line, const QString &content, const QString &raw_line, const QTextStream &stream);
-  void parseVAL(const QString &line);
+  void parse(const QByteArray &content);
 
   QString header;
   std::map<uint32_t, cabana::Msg> msgs;
@@ -19,6 +19,7 @@
 #include <QUndoView>
 #include <QVBoxLayout>
 #include <QWidgetAction>
+#include <QtConcurrent>
 
 #include "tools/cabana/commands.h"
 #include "tools/cabana/streamselector.h"
@@ -103,6 +104,8 @@ void MainWindow::createActions() {
   for (const auto &dbc_name : QDir(OPENDBC_FILE_PATH).entryList({"*.dbc"}, QDir::Files, QDir::Name)) {
     load_opendbc_menu->addAction(dbc_name, [this, name = dbc_name]() { loadDBCFromOpendbc(name); });
   }
+  // parse the recently used files in the background, opening one of them later only copies the result
+  QtConcurrent::run([recent_files = settings.recent_files]() { DBCFile::preload(recent_files); });
 
   file_menu->addAction(tr("Load DBC From Clipboard"), [=]() { loadFromClipboard(); });
 
@@ -65,6 +65,11 @@ MessagesWidget::MessagesWidget(QWidget *parent) : menu(new QMenu(this)), QWidget
     view->updateBytesSectionSize();
     updateTitle();
   });
+  QObject::connect(model, &MessageListModel::rowsInserted, [this]() {
+    view->updateBytesSectionSize();
+    updateTitle();
+  });
+  QObject::connect(model, &MessageListModel::rowsRemoved, this, &MessagesWidget::updateTitle);
   QObject::connect(view->selectionModel(), &QItemSelectionModel::currentChanged, [=](const QModelIndex &current, const QModelIndex &previous) {
     if (current.isValid() && current.row() < model->items_.size()) {
       const auto &id = model->items_[current.row()].id;
@@ -244,23 +249,23 @@ void MessageListModel::dbcModified() {
   filterAndSort();
 }
 
-void MessageListModel::sortItems(std::vector<MessageListModel::Item> &items) {
+bool MessageListModel::lessThan(const Item &l, const Item &r) const {
   auto compare = [this](const auto &l, const auto &r) {
     switch (sort_column) {
       case Column::NAME: return std::tie(l.name, l.id) < std::tie(r.name, r.id);
       case Column::SOURCE: return std::tie(l.id.source, l.id.address) < std::tie(r.id.source, r.id.address);
       case Column::ADDRESS: return std::tie(l.id.address, l.id.source) < std::tie(r.id.address, r.id.source);
       case Column::NODE: return std::tie(l.node, l.id) < std::tie(r.node, r.id);
-      case Column::FREQ: return std::tie(can->lastMessage(l.id).freq, l.id) < std::tie(can->lastMessage(r.id).freq, r.id);
-      case Column::COUNT: return std::tie(can->lastMessage(l.id).count, l.id) < std::tie(can->lastMessage(r.id).count, r.id);
+      case Column::FREQ: return std::tie(l.freq, l.id) < std::tie(r.freq, r.id);
+      case Column::COUNT: return std::tie(l.count, l.id) < std::tie(r.count, r.id);
       default: return false; // Default case to suppress compiler warning
     }
   };
+  return sort_order == Qt::AscendingOrder ? compare(l, r) : compare(r, l);
+}
 
-  if (sort_order == Qt::DescendingOrder)
-    std::stable_sort(items.rbegin(), items.rend(), compare);
-  else
-    std::stable_sort(items.begin(), items.end(), compare);
+void MessageListModel::sortItems(std::vector<MessageListModel::Item> &items) {
+  std::stable_sort(items.begin(), items.end(), [this](const auto &l, const auto &r) { return lessThan(l, r); });
 }
 
 static bool parseRange(const QString &filter, uint32_t value, int base = 10) {
@@ -320,6 +325,10 @@ bool MessageListModel::match(const MessageListModel::Item &item) {
   return match;
 }
 
+bool MessageListModel::hasDynamicFilter() const {
+  return filters_.count(Column::FREQ) || filters_.count(Column::COUNT) || filters_.count(Column::DATA);
+}
+
 bool MessageListModel::filterAndSort() {
   // merge CAN and DBC messages
   std::vector<MessageId> all_messages;
@@ -338,37 +347,159 @@ bool MessageListModel::filterAndSort() {
     bool active = isMessageActive(id);
     if (active || show_inactive_messages) {
       auto msg = dbc()->msg(id);
+      const auto &data = can->lastMessage(id);
       Item item = {.id = id,
                   .active = active,
                   .name = msg ? msg->name : UNTITLED,
-                  .node = msg ? msg->transmitter : QString()};
+                  .node = msg ? msg->transmitter : QString(),
+                  .freq = data.freq,
+                  .count = data.count};
       if (match(item))
         items.emplace_back(item);
     }
   }
   sortItems(items);
 
-  if (items_ != items) {
-    beginResetModel();
-    items_ = std::move(items);
-    endResetModel();
-    return true;
+  bool changed = items_ != items;
+  if (changed) beginResetModel();
+  items_ = std::move(items);
+  row_index_.clear();
+  updateRowIndex(0, (int)items_.size() - 1);
+  if (changed) endResetModel();
+  return changed;
+}
+
+void MessageListModel::updateRowIndex(int first, int last) {
+  for (int i = first; i <= last; ++i) {
+    row_index_[items_[i].id] = i;
+  }
+}
+
+int MessageListModel::sortedPosition(int row) const {
+  auto less = [this](const auto &l, const auto &r) { return lessThan(l, r); };
+  const auto &item = items_[row];
+  if (row > 0 && less(item, items_[row - 1])) {
+    return std::upper_bound(items_.begin(), items_.begin() + row, item, less) - items_.begin();
+  }
+  if (row + 1 < items_.size() && less(items_[row + 1], item)) {
+    return std::lower_bound(items_.begin() + row + 1, items_.end(), item, less) - items_.begin() - 1;
+  }
+  return row;
+}
+
+void MessageListModel::insertItem(Item &&item) {
+  auto less = [this](const auto &l, const auto &r) { return lessThan(l, r); };
+  int row = std::upper_bound(items_.begin(), items_.end(), item, less) - items_.begin();
+  beginInsertRows({}, row, row);
+  items_.insert(items_.begin() + row, std::move(item));
+  updateRowIndex(row, (int)items_.size() - 1);
+  endInsertRows();
+}
+
+void MessageListModel::removeItem(int row) {
+  beginRemoveRows({}, row, row);
+  row_index_.erase(items_[row].id);
+  items_.erase(items_.begin() + row);
+  updateRowIndex(row, (int)items_.size() - 1);
+  endRemoveRows();
+}
+
+void MessageListModel::moveItem(int from, int to) {
+  beginMoveRows({}, from, from, {}, to > from ? to + 1 : to);
+  if (from < to) {
+    std::rotate(items_.begin() + from, items_.begin() + from + 1, items_.begin() + to + 1);
+  } else {
+    std::rotate(items_.begin() + to, items_.begin() + from, items_.begin() + from + 1);
+  }
+  updateRowIndex(std::min(from, to), std::max(from, to));
+  endMoveRows();
+}
+
+// Keeps items_ sorted and filtered by re-positioning only the rows of the updated messages.
+void MessageListModel::updateItems(const std::set<MessageId> &ids, std::set<MessageId> &dirty) {
+  const bool dynamic_filter = hasDynamicFilter();
+  for (const auto &id : ids) {
+    const auto &data = can->lastMessage(id);
+    auto it = row_index_.find(id);
+    if (it == row_index_.end()) {
+      // the DBC message is received now, its placeholder goes away even if the message is filtered out
+      const MessageId dbc_id = {.source = INVALID_SOURCE, .address = id.address};
+      if (auto dbc_it = row_index_.find(dbc_id); dbc_it != row_index_.end()) {
+        removeItem(dbc_it->second);
+        dirty.erase(dbc_id);
+      }
+      auto msg = dbc()->msg(id);
+      Item item = {.id = id,
+                   .active = isMessageActive(id),
+                   .name = msg ? msg->name : UNTITLED,
+                   .node = msg ? msg->transmitter : QString(),
+                   .freq = data.freq,
+                   .count = data.count};
+      if ((item.active || show_inactive_messages) && match(item)) {
+        insertItem(std::move(item));
+        dirty.insert(id);
+      }
+      continue;
+    }
+
+    const int row = it->second;
+    auto &item = items_[row];
+    item.active = isMessageActive(id);
+    item.freq = data.freq;
+    item.count = data.count;
+    if ((!item.active && !show_inactive_messages) || (dynamic_filter && !match(item))) {
+      removeItem(row);
+      dirty.erase(id);
+    } else {
+      if (int to = sortedPosition(row); to != row) {
+        moveItem(row, to);
+      }
+      dirty.insert(id);
+    }
   }
-  return false;
 }
 
 void MessageListModel::msgsReceived(const std::set<MessageId> *new_msgs, bool has_new_ids) {
-  if (has_new_ids || ((filters_.count(Column::FREQ) || filters_.count(Column::COUNT) || filters_.count(Column::DATA)) &&
-                      ++sort_threshold_ == settings.fps)) {
-    sort_threshold_ = 0;
-    if (filterAndSort()) return;
+  if (!new_msgs) {
+    // all messages are changed after seeking.
+    if (!filterAndSort()) {
+      for (auto &item : items_) {
+        item.active = isMessageActive(item.id);
+      }
+      emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1));
+    }
+    return;
   }
 
+  // update the active state of messages not received in this round.
+  std::set<MessageId> dirty, inactive;
   for (auto &item : items_) {
-    item.active = isMessageActive(item.id);
+    if (!new_msgs->count(item.id)) {
+      if (bool active = isMessageActive(item.id); active != item.active) {
+        item.active = active;
+        (active || show_inactive_messages ? dirty : inactive).insert(item.id);
+      }
+    }
+  }
+  for (const auto &id : inactive) {
+    removeItem(row_index_.at(id));
+  }
+
+  updateItems(*new_msgs, dirty);
+
+  // Update viewport for changed rows, merged into continuous ranges
+  std::vector<int> rows;
+  rows.reserve(dirty.size());
+  for (const auto &id : dirty) {
+    rows.push_back(row_index_.at(id));
+  }
+  std::sort(rows.begin(), rows.end());
+  for (size_t i = 0; i < rows.size();) {
+    size_t j = i + 1;
+    while (j < rows.size() && rows[j] == rows[j - 1] + 1) ++j;
+    emit dataChanged(index(rows[i], 0), index(rows[j - 1], columnCount() - 1));
+    i = j;
   }
-  // Update viewport
-  emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1));
 }
 
 void MessageListModel::sort(int column, Qt::SortOrder order) {
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <optional>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include <QAbstractTableModel>
@@ -46,6 +47,9 @@ public:
     QString name;
     QString node;
     bool active;
+    // sort keys of the last update. items_ is always sorted by these.
+    double freq = 0;
+    uint32_t count = 0;
     bool operator==(const Item &other) const {
       return id == other.id && name == other.name && node == other.node;
     }
@@ -55,13 +59,21 @@ public:
 
 private:
   void sortItems(std::vector<MessageListModel::Item> &items);
+  bool lessThan(const Item &l, const Item &r) const;
   bool match(const MessageListModel::Item &id);
+  bool hasDynamicFilter() const;
+  void updateItems(const std::set<MessageId> &ids, std::set<MessageId> &dirty);
+  void insertItem(Item &&item);
+  void removeItem(int row);
+  void moveItem(int from, int to);
+  int sortedPosition(int row) const;
+  void updateRowIndex(int first, int last);
 
   QMap<int, QString> filters_;
   std::set<MessageId> dbc_messages_;
+  std::unordered_map<MessageId, int> row_index_;
   int sort_column = 0;
   Qt::SortOrder sort_order = Qt::AscendingOrder;
-  int sort_threshold_ = 0;
 };
 
 class MessageView : public QTreeView {
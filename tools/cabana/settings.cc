@@ -41,11 +41,14 @@ void settings_op(SettingOperation op) {
   op(s, "log_path", settings.log_path);
   op(s, "drag_direction", (int &)settings.drag_direction);
   op(s, "suppress_defined_signals", settings.suppress_defined_signals);
+  op(s, "spill_events", settings.spill_events);
+  op(s, "spill_path", settings.spill_path);
 }
 
 Settings::Settings() {
   last_dir = last_route_dir = QDir::homePath();
   log_path = QStandardPaths::writableLocation(QStandardPaths::HomeLocation) + "/cabana_live_stream/";
+  spill_path = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
   settings_op([](QSettings &s, const QString &key, auto &value) {
     if (auto v = s.value(key); v.canConvert<std::decay_t<decltype(value)>>())
       value = v.value<std::decay_t<decltype(value)>>();
@@ -108,6 +111,17 @@ SettingsDlg::SettingsDlg(QWidget *parent) : QDialog(parent) {
   path_layout->addWidget(browse_btn);
   main_layout->addWidget(log_livestream);
 
+  spill_events = new QGroupBox(tr("Spill CAN events to disk"), this);
+  spill_events->setToolTip(tr("Keep events of long routes in a memory-mapped file. Applies to the next opened stream"));
+  spill_events->setCheckable(true);
+  spill_events->setChecked(settings.spill_events);
+  QHBoxLayout *spill_layout = new QHBoxLayout(spill_events);
+  spill_layout->addWidget(spill_path = new QLineEdit(settings.spill_path, this));
+  spill_path->setReadOnly(true);
+  auto spill_browse_btn = new QPushButton(tr("Br&owse..."));
+  spill_layout->addWidget(spill_browse_btn);
+  main_layout->addWidget(spill_events);
+
   auto buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
   main_layout->addWidget(buttonBox);
   setFixedSize(400, sizeHint().height());
@@ -121,6 +135,13 @@ SettingsDlg::SettingsDlg(QWidget *parent) : QDialog(parent) {
       log_path->setText(fn);
     }
   });
+  QObject::connect(spill_browse_btn, &QPushButton::clicked, [this]() {
+    QString fn = QFileDialog::getExistingDirectory(this, tr("Spill File Location"), spill_path->text(),
+                                                   QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks);
+    if (!fn.isEmpty()) {
+      spill_path->setText(fn);
+    }
+  });
   QObject::connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
   QObject::connect(buttonBox, &QDialogButtonBox::accepted, this, &SettingsDlg::save);
 }
@@ -136,6 +157,8 @@ void SettingsDlg::save() {
   settings.chart_height = chart_height->value();
   settings.log_livestream = log_livestream->isChecked();
   settings.log_path = log_path->text();
+  settings.spill_events = spill_events->isChecked();
+  settings.spill_path = spill_path->text();
   settings.drag_direction = (Settings::DragDirection)drag_direction->currentIndex();
   emit settings.changed();
   QDialog::accept();
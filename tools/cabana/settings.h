@@ -36,7 +36,9 @@ public:
   bool multiple_lines_hex = false;
   bool log_livestream = true;
   bool suppress_defined_signals = false;
+  bool spill_events = false;
   QString log_path;
+  QString spill_path;
   QString last_dir;
   QString last_route_dir;
   QByteArray geometry;
@@ -61,6 +63,8 @@ public:
   QComboBox *theme;
   QGroupBox *log_livestream;
   QLineEdit *log_path;
+  QGroupBox *spill_events;
+  QLineEdit *spill_path;
   QComboBox *drag_direction;
 };
 
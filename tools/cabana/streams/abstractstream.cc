@@ -6,13 +6,13 @@
 #include "common/timing.h"
 #include "tools/cabana/settings.h"
 
-static const int EVENT_NEXT_BUFFER_SIZE = 6 * 1024 * 1024;  // 6MB
-
 AbstractStream *can = nullptr;
 
-AbstractStream::AbstractStream(QObject *parent) : QObject(parent) {
+AbstractStream::AbstractStream(QObject *parent)
+    : QObject(parent),
+      event_store_(std::make_unique<CanEventStore>(settings.spill_events ? settings.spill_path.toStdString() : "")),
+      all_events_(event_store_.get()) {
   assert(parent != nullptr);
-  event_buffer_ = std::make_unique<MonotonicBuffer>(EVENT_NEXT_BUFFER_SIZE);
 
   QObject::connect(this, &AbstractStream::privateUpdateLastMsgsSignal, this, &AbstractStream::updateLastMessages, Qt::QueuedConnection);
   QObject::connect(this, &AbstractStream::seekedTo, this, &AbstractStream::updateLastMsgsTo);
@@ -108,14 +108,30 @@ void AbstractStream::setTimeRange(const std::optional<std::pair<double, double>>
   emit timeRangeChanged(time_range_);
 }
 
-void AbstractStream::updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size) {
+void AbstractStream::updateEvents(CanEventList::const_iterator first, CanEventList::const_iterator last) {
+  const double speed = getSpeed();
+  std::lock_guard lk(mutex_);
+  for (auto it = first; it != last; ++it) {
+    const CanEvent *e = *it;
+    MessageId id = {.source = e->src, .address = e->address};
+    messages_[id].compute(id, e->dat, e->size, toSeconds(e->mono_time), speed, masks_[id]);
+    new_msgs_.insert(id);
+  }
+}
+
+void AbstractStream::updateEvents(double sec, const capnp::List<cereal::CanData>::Reader &can_data) {
+  const double speed = getSpeed();
   std::lock_guard lk(mutex_);
-  messages_[id].compute(id, data, size, sec, getSpeed(), masks_[id]);
-  new_msgs_.insert(id);
+  for (const auto &c : can_data) {
+    MessageId id = {.source = c.getSrc(), .address = c.getAddress()};
+    const auto dat = c.getDat();
+    messages_[id].compute(id, (const uint8_t *)dat.begin(), dat.size(), sec, speed, masks_[id]);
+    new_msgs_.insert(id);
+  }
 }
 
-const std::vector<const CanEvent *> &AbstractStream::events(const MessageId &id) const {
-  static std::vector<const CanEvent *> empty_events;
+const CanEventList &AbstractStream::events(const MessageId &id) const {
+  static CanEventList empty_events;
   auto it = events_.find(id);
   return it != events_.end() ? it->second : empty_events;
 }
@@ -163,37 +179,32 @@ void AbstractStream::updateLastMsgsTo(double sec) {
   emit msgsReceived(nullptr, id_changed);
 }
 
-const CanEvent *AbstractStream::newEvent(uint64_t mono_time, const cereal::CanData::Reader &c) {
+CanEventList::Offset AbstractStream::newEvent(uint64_t mono_time, const cereal::CanData::Reader &c) {
   auto dat = c.getDat();
-  CanEvent *e = (CanEvent *)event_buffer_->allocate(sizeof(CanEvent) + sizeof(uint8_t) * dat.size());
-  e->src = c.getSrc();
-  e->address = c.getAddress();
-  e->mono_time = mono_time;
-  e->size = dat.size();
-  memcpy(e->dat, (uint8_t *)dat.begin(), e->size);
-  return e;
+  return event_store_->append(mono_time, c.getSrc(), c.getAddress(), (const uint8_t *)dat.begin(), dat.size());
 }
 
-void AbstractStream::mergeEvents(const std::vector<const CanEvent *> &events) {
-  static MessageEventsMap msg_events;
-  std::for_each(msg_events.begin(), msg_events.end(), [](auto &e) { e.second.clear(); });
+void AbstractStream::mergeEvents(const CanEventList &events) {
+  std::for_each(merged_events_.begin(), merged_events_.end(), [](auto &e) { e.second.clear(); });
 
   // Group events by message ID
-  for (auto e : events) {
-    msg_events[{.source = e->src, .address = e->address}].push_back(e);
+  for (auto it = events.begin(); it != events.end(); ++it) {
+    const CanEvent *e = *it;
+    MessageId id = {.source = e->src, .address = e->address};
+    merged_events_.try_emplace(id, event_store_.get()).first->second.push_back(it.offset());
   }
 
   if (!events.empty()) {
-    for (const auto &[id, new_e] : msg_events) {
+    for (const auto &[id, new_e] : merged_events_) {
       if (!new_e.empty()) {
-        auto &e = events_[id];
+        auto &e = events_.try_emplace(id, event_store_.get()).first->second;
         auto pos = std::upper_bound(e.cbegin(), e.cend(), new_e.front()->mono_time, CompareCanEvent());
         e.insert(pos, new_e.cbegin(), new_e.cend());
       }
     }
     auto pos = std::upper_bound(all_events_.cbegin(), all_events_.cend(), events.front()->mono_time, CompareCanEvent());
     all_events_.insert(pos, events.cbegin(), events.cend());
-    emit eventsMerged(msg_events);
+    emit eventsMerged(merged_events_);
   }
 }
 
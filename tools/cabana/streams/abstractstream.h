@@ -15,6 +15,7 @@
 
 #include "cereal/messaging/messaging.h"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/streams/eventstore.h"
 #include "tools/cabana/utils/util.h"
 #include "tools/replay/util.h"
 
@@ -39,20 +40,7 @@ struct CanData {
   double last_freq_update_ts = 0;
 };
 
-struct CanEvent {
-  uint8_t src;
-  uint32_t address;
-  uint64_t mono_time;
-  uint8_t size;
-  uint8_t dat[];
-};
-
-struct CompareCanEvent {
-  constexpr bool operator()(const CanEvent *const e, uint64_t ts) const { return e->mono_time < ts; }
-  constexpr bool operator()(uint64_t ts, const CanEvent *const e) const { return ts < e->mono_time; }
-};
-
-typedef std::unordered_map<MessageId, std::vector<const CanEvent *>> MessageEventsMap;
+typedef std::unordered_map<MessageId, CanEventList> MessageEventsMap;
 
 class AbstractStream : public QObject {
   Q_OBJECT
@@ -82,9 +70,9 @@ public:
 
   inline const std::unordered_map<MessageId, CanData> &lastMessages() const { return last_msgs; }
   inline const MessageEventsMap &eventsMap() const { return events_; }
-  inline const std::vector<const CanEvent *> &allEvents() const { return all_events_; }
+  inline const CanEventList &allEvents() const { return all_events_; }
   const CanData &lastMessage(const MessageId &id) const;
-  const std::vector<const CanEvent *> &events(const MessageId &id) const;
+  const CanEventList &events(const MessageId &id) const;
 
   size_t suppressHighlighted();
   void clearSuppressed();
@@ -105,11 +93,15 @@ public:
   SourceSet sources;
 
 protected:
-  void mergeEvents(const std::vector<const CanEvent *> &events);
-  const CanEvent *newEvent(uint64_t mono_time, const cereal::CanData::Reader &c);
-  void updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size);
-
-  std::vector<const CanEvent *> all_events_;
+  void mergeEvents(const CanEventList &events);
+  CanEventList::Offset newEvent(uint64_t mono_time, const cereal::CanData::Reader &c);
+  inline CanEventList newEventList() const { return CanEventList(event_store_.get()); }
+  // update messages_ with a batch of events, taking mutex_ once for the whole batch.
+  void updateEvents(CanEventList::const_iterator first, CanEventList::const_iterator last);
+  void updateEvents(double sec, const capnp::List<cereal::CanData>::Reader &can_data);
+
+  std::unique_ptr<CanEventStore> event_store_;
+  CanEventList all_events_;
   double current_sec_ = 0;
   std::optional<std::pair<double, double>> time_range_;
 
@@ -120,7 +112,7 @@ private:
 
   MessageEventsMap events_;
   std::unordered_map<MessageId, CanData> last_msgs;
-  std::unique_ptr<MonotonicBuffer> event_buffer_;
+  MessageEventsMap merged_events_;
 
   // Members accessed in multiple threads. (mutex protected)
   std::mutex mutex_;
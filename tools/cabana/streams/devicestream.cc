@@ -26,6 +26,7 @@ void DeviceStream::streamThread() {
   while (!QThread::currentThread()->isInterruptionRequested()) {
     std::unique_ptr<Message> msg(sock->receive(true));
     if (!msg) {
+      flushPendingEvents();
       QThread::msleep(50);
       continue;
     }
@@ -0,0 +1,120 @@
+#include "tools/cabana/streams/eventstore.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "tools/replay/util.h"
+
+CanEventStore::CanEventStore(const std::string &spill_dir) {
+  if (!spill_dir.empty()) {
+    std::string path = spill_dir + "/cabana_events.XXXXXX";
+    fd_ = mkstemp(path.data());
+    if (fd_ != -1) {
+      // the file is only referenced by fd_ and is removed by the kernel once it is closed.
+      unlink(path.c_str());
+    } else {
+      rWarning("failed to create event spill file in %s, keeping events in memory", spill_dir.c_str());
+    }
+  }
+}
+
+CanEventStore::~CanEventStore() {
+  for (size_t i = 0; i < num_blocks_; ++i) {
+    munmap(blocks_[i], BLOCK_SIZE);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool CanEventStore::newBlock() {
+  if (full_) return false;
+
+  void *p = MAP_FAILED;
+  if (num_blocks_ == MAX_BLOCKS) {
+    rWarning("cabana event store is full (%zu GB), new CAN events are dropped", MAX_BLOCKS * BLOCK_SIZE >> 30);
+    full_ = true;
+    return false;
+  }
+  if (fd_ != -1) {
+    off_t offset = num_blocks_ * BLOCK_SIZE;
+    if (ftruncate(fd_, offset + BLOCK_SIZE) == 0) {
+      p = mmap(nullptr, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+    }
+  } else {
+    p = mmap(nullptr, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    rWarning("failed to allocate cabana event store block, new CAN events are dropped");
+    full_ = true;
+    return false;
+  }
+  blocks_[num_blocks_++] = (uint8_t *)p;
+  used_ = 0;
+  return true;
+}
+
+CanEventStore::Offset CanEventStore::append(uint64_t mono_time, uint8_t src, uint32_t address, const uint8_t *dat, uint8_t size) {
+  const size_t bytes = (offsetof(CanEvent, dat) + size + (1 << ALIGN_SHIFT) - 1) & ~size_t((1 << ALIGN_SHIFT) - 1);
+  if ((num_blocks_ == 0 || used_ + bytes > BLOCK_SIZE) && !newBlock()) {
+    return INVALID_OFFSET;
+  }
+
+  CanEvent *e = (CanEvent *)(blocks_[num_blocks_ - 1] + used_);
+  e->mono_time = mono_time;
+  e->address = address;
+  e->src = src;
+  e->size = size;
+  memcpy(e->dat, dat, size);
+
+  Offset offset = ((num_blocks_ - 1) << BLOCK_SHIFT) | Offset(used_ >> ALIGN_SHIFT);
+  used_ += bytes;
+  return offset;
+}
+
+CanEventList::const_iterator CanEventList::insert(const_iterator pos, const_iterator first, const_iterator last) {
+  if (first == last) return pos;
+
+  const size_t index = pos.index_;
+  size_t run = pos.run_;
+  if (index == size_) {
+    // appending extends the last run
+    if (runs_.empty()) {
+      runs_.emplace_back();
+      starts_.push_back(0);
+    }
+    run = runs_.size() - 1;
+  } else {
+    if (pos.pos_ > 0) {
+      // split the run at pos, moving the shorter part into a run of its own
+      auto &r = runs_[run];
+      const auto split = r.begin() + pos.pos_;
+      if (pos.pos_ < r.size() / 2) {
+        std::deque<Offset> head(r.begin(), split);
+        r.erase(r.begin(), split);
+        runs_.insert(runs_.begin() + run, std::move(head));
+      } else {
+        std::deque<Offset> tail(split, r.end());
+        r.erase(split, r.end());
+        runs_.insert(runs_.begin() + run + 1, std::move(tail));
+      }
+      ++run;
+    }
+    runs_.emplace(runs_.begin() + run);
+  }
+
+  auto &r = runs_[run];
+  for (auto it = first; it != last; ++it) {
+    r.push_back(it.offset());
+  }
+  size_ += last - first;
+
+  starts_.resize(runs_.size());
+  for (size_t i = run; i < runs_.size(); ++i) {
+    starts_[i] = i == 0 ? 0 : starts_[i - 1] + runs_[i - 1].size();
+  }
+  return {this, index};
+}
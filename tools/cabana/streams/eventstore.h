@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct CanEvent {
+  uint64_t mono_time;
+  uint32_t address;
+  uint8_t src;
+  uint8_t size;
+  uint8_t dat[];
+};
+
+struct CompareCanEvent {
+  constexpr bool operator()(const CanEvent *const e, uint64_t ts) const { return e->mono_time < ts; }
+  constexpr bool operator()(uint64_t ts, const CanEvent *const e) const { return ts < e->mono_time; }
+};
+
+// Append-only storage for CanEvents.
+// Events are packed into large mmap'ed blocks and addressed by 32-bit offsets (in units of 8 bytes),
+// which allows up to 32GB of events while keeping every reference to an event at 4 bytes.
+// If a spill directory is given, the blocks are backed by an unlinked file in that directory,
+// so the kernel can write them back to disk under memory pressure instead of swapping.
+class CanEventStore {
+public:
+  typedef uint32_t Offset;
+
+  CanEventStore(const std::string &spill_dir = {});
+  ~CanEventStore();
+  CanEventStore(const CanEventStore &) = delete;
+  CanEventStore &operator=(const CanEventStore &) = delete;
+
+  // returns INVALID_OFFSET and drops the event when the store is full or out of memory
+  Offset append(uint64_t mono_time, uint8_t src, uint32_t address, const uint8_t *dat, uint8_t size);
+  inline const CanEvent *at(Offset offset) const {
+    return (const CanEvent *)(blocks_[offset >> BLOCK_SHIFT] + ((size_t)(offset & BLOCK_MASK) << ALIGN_SHIFT));
+  }
+  inline size_t bytesUsed() const { return num_blocks_ == 0 ? 0 : (num_blocks_ - 1) * BLOCK_SIZE + used_; }
+  inline bool isSpilling() const { return fd_ != -1; }
+
+  static constexpr int ALIGN_SHIFT = 3;
+  static constexpr int BLOCK_SHIFT = 23;
+  static constexpr Offset BLOCK_MASK = (Offset(1) << BLOCK_SHIFT) - 1;
+  static constexpr size_t BLOCK_SIZE = size_t(1) << (BLOCK_SHIFT + ALIGN_SHIFT);  // 64MB
+  static constexpr size_t MAX_BLOCKS = size_t(1) << (32 - BLOCK_SHIFT);
+  // the last slot of the last block, too small for an event
+  static constexpr Offset INVALID_OFFSET = ~Offset(0);
+
+private:
+  bool newBlock();
+
+  // fixed size, so readers never observe a reallocation while the stream thread appends.
+  std::array<uint8_t *, MAX_BLOCKS> blocks_ = {};
+  size_t num_blocks_ = 0;
+  size_t used_ = 0;  // bytes used in the last block
+  int fd_ = -1;
+  bool full_ = false;  // no more blocks, warned once
+};
+
+// A time ordered list of events in a CanEventStore.
+// The offsets are kept in sorted runs of chunked containers. Appending extends the last run and never moves
+// existing entries. Inserting in the middle, like a segment merged before the ones already there, adds a run
+// and splits at most the one it lands in, instead of shifting everything after it.
+class CanEventList {
+public:
+  typedef CanEventStore::Offset Offset;
+
+  class const_iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = const CanEvent *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const CanEvent *const *;
+    using reference = const CanEvent *;
+
+    const_iterator() = default;
+    const_iterator(const CanEventList *list, size_t index) : list_(list), index_(index) { locate(); }
+    inline reference operator*() const { return list_->store_->at(offset()); }
+    inline reference operator[](difference_type n) const { return *(*this + n); }
+    inline Offset offset() const { return list_->runs_[run_][pos_]; }
+    inline const_iterator &operator++() {
+      ++index_;
+      if (++pos_ == list_->runs_[run_].size()) {
+        ++run_;
+        pos_ = 0;
+      }
+      return *this;
+    }
+    inline const_iterator &operator--() {
+      --index_;
+      if (pos_ == 0) {
+        pos_ = list_->runs_[--run_].size();
+      }
+      --pos_;
+      return *this;
+    }
+    inline const_iterator operator++(int) { auto it = *this; ++*this; return it; }
+    inline const_iterator operator--(int) { auto it = *this; --*this; return it; }
+    inline const_iterator &operator+=(difference_type n) { index_ += n; locate(); return *this; }
+    inline const_iterator &operator-=(difference_type n) { index_ -= n; locate(); return *this; }
+    inline const_iterator operator+(difference_type n) const { return {list_, index_ + n}; }
+    inline const_iterator operator-(difference_type n) const { return {list_, index_ - n}; }
+    friend inline const_iterator operator+(difference_type n, const const_iterator &it) { return it + n; }
+    inline difference_type operator-(const const_iterator &other) const { return difference_type(index_ - other.index_); }
+    inline bool operator==(const const_iterator &other) const { return index_ == other.index_; }
+    inline bool operator!=(const const_iterator &other) const { return index_ != other.index_; }
+    inline bool operator<(const const_iterator &other) const { return index_ < other.index_; }
+    inline bool operator>(const const_iterator &other) const { return index_ > other.index_; }
+    inline bool operator<=(const const_iterator &other) const { return index_ <= other.index_; }
+    inline bool operator>=(const const_iterator &other) const { return index_ >= other.index_; }
+
+  private:
+    friend class CanEventList;
+    // finds the run of index_, the end is the position after the last run
+    inline void locate() {
+      if (!list_ || index_ >= list_->size_) {
+        run_ = list_ ? list_->runs_.size() : 0;
+        pos_ = 0;
+      } else {
+        run_ = std::upper_bound(list_->starts_.begin(), list_->starts_.end(), index_) - list_->starts_.begin() - 1;
+        pos_ = index_ - list_->starts_[run_];
+      }
+    }
+
+    const CanEventList *list_ = nullptr;
+    size_t index_ = 0;
+    size_t run_ = 0, pos_ = 0;
+  };
+  typedef const_iterator iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  CanEventList(const CanEventStore *store = nullptr) : store_(store) {}
+  inline void push_back(Offset offset) {
+    if (runs_.empty()) {
+      runs_.emplace_back();
+      starts_.push_back(0);
+    }
+    runs_.back().push_back(offset);
+    ++size_;
+  }
+  const_iterator insert(const_iterator pos, const_iterator first, const_iterator last);
+  inline void clear() {
+    runs_.clear();
+    starts_.clear();
+    size_ = 0;
+  }
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline const CanEvent *front() const { return store_->at(runs_.front().front()); }
+  inline const CanEvent *back() const { return store_->at(runs_.back().back()); }
+  inline const CanEvent *operator[](size_t i) const { return *const_iterator(this, i); }
+  inline const_iterator begin() const { return {this, 0}; }
+  inline const_iterator end() const { return {this, size_}; }
+  inline const_iterator cbegin() const { return begin(); }
+  inline const_iterator cend() const { return end(); }
+  inline const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  inline const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+private:
+  const CanEventStore *store_;
+  std::vector<std::deque<Offset>> runs_;  // never empty ones
+  std::vector<size_t> starts_;  // the index of the first event of each run
+  size_t size_ = 0;
+};
@@ -31,7 +31,12 @@ struct LiveStream::Logger {
   uint64_t start_ts;
 };
 
-LiveStream::LiveStream(QObject *parent) : AbstractStream(parent) {
+static const size_t RECEIVED_EVENTS_CAPACITY = 1 << 20;
+
+LiveStream::LiveStream(QObject *parent)
+    : AbstractStream(parent),
+      received_events_(RECEIVED_EVENTS_CAPACITY),
+      new_events_(newEventList()) {
   if (settings.log_livestream) {
     logger = std::make_unique<Logger>();
   }
@@ -77,23 +82,34 @@ void LiveStream::handleEvent(kj::ArrayPtr<capnp::word> data) {
   capnp::FlatArrayMessageReader reader(data);
   auto event = reader.getRoot<cereal::Event>();
   if (event.which() == cereal::Event::Which::CAN) {
+    // never block the stream thread. keep the events that don't fit until the UI thread catches up.
+    flushPendingEvents();
     const uint64_t mono_time = event.getLogMonoTime();
-    std::lock_guard lk(lock);
     for (const auto &c : event.getCan()) {
-      received_events_.push_back(newEvent(mono_time, c));
+      auto offset = newEvent(mono_time, c);
+      if (offset == CanEventStore::INVALID_OFFSET) continue;
+      if (!pending_events_.empty() || !received_events_.try_push(offset)) {
+        pending_events_.push_back(offset);
+      }
     }
   }
 }
 
+// called in streamThread, also when no new events arrive so the last ones are not held back.
+void LiveStream::flushPendingEvents() {
+  while (!pending_events_.empty() && received_events_.try_push(pending_events_.front())) {
+    pending_events_.pop_front();
+  }
+}
+
 void LiveStream::timerEvent(QTimerEvent *event) {
   if (event->timerId() == timer_id) {
-    {
-      // merge events received from live stream thread.
-      std::lock_guard lk(lock);
-      mergeEvents(received_events_);
-      uint64_t last_received_ts = !received_events_.empty() ? received_events_.back()->mono_time : 0;
-      lastest_event_ts = std::max(lastest_event_ts, last_received_ts);
-      received_events_.clear();
+    // merge events received from live stream thread.
+    new_events_.clear();
+    received_events_.consume_all([this](auto offset) { new_events_.push_back(offset); });
+    if (!new_events_.empty()) {
+      mergeEvents(new_events_);
+      lastest_event_ts = std::max(lastest_event_ts, new_events_.back()->mono_time);
     }
     if (!all_events_.empty()) {
       begin_event_ts = all_events_.front()->mono_time;
@@ -125,11 +141,9 @@ void LiveStream::updateEvents() {
   auto first = std::upper_bound(all_events_.cbegin(), all_events_.cend(), current_event_ts, CompareCanEvent());
   auto last = std::upper_bound(first, all_events_.cend(), last_ts, CompareCanEvent());
 
-  for (auto it = first; it != last; ++it) {
-    const CanEvent *e = *it;
-    MessageId id = {.source = e->src, .address = e->address};
-    updateEvent(id, (e->mono_time - begin_event_ts) / 1e9, e->dat, e->size);
-    current_event_ts = e->mono_time;
+  if (first != last) {
+    AbstractStream::updateEvents(first, last);
+    current_event_ts = (*std::prev(last))->mono_time;
   }
   emit privateUpdateLastMsgsSignal();
 }
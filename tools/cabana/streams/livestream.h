@@ -1,11 +1,13 @@
 #pragma once
 
 #include <algorithm>
+#include <deque>
 #include <memory>
 #include <vector>
 
 #include <QBasicTimer>
 
+#include "common/queue.h"
 #include "tools/cabana/streams/abstractstream.h"
 
 class LiveStream : public AbstractStream {
@@ -28,15 +30,18 @@ public:
 protected:
   virtual void streamThread() = 0;
   void handleEvent(kj::ArrayPtr<capnp::word> event);
+  void flushPendingEvents();
 
 private:
   void startUpdateTimer();
   void timerEvent(QTimerEvent *event) override;
   void updateEvents();
 
-  std::mutex lock;
   QThread *stream_thread;
-  std::vector<const CanEvent *> received_events_;
+  // events handed off from the stream thread to the UI thread without locking.
+  SPSCQueue<CanEventList::Offset> received_events_;
+  std::deque<CanEventList::Offset> pending_events_;  // events that did not fit in received_events_. (stream thread only)
+  CanEventList new_events_;  // (UI thread only)
 
   int timer_id;
   QBasicTimer update_timer;
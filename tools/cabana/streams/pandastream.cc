@@ -46,6 +46,7 @@ void PandaStream::streamThread() {
 
   while (!QThread::currentThread()->isInterruptionRequested()) {
     QThread::msleep(1);
+    flushPendingEvents();
 
     if (!panda->connected()) {
       qDebug() << "Connection to panda lost. Attempting reconnect.";
@@ -32,14 +32,15 @@ void ReplayStream::mergeSegments() {
     if (seg && seg->isLoaded() && !processed_segments.count(n)) {
       processed_segments.insert(n);
 
-      std::vector<const CanEvent *> new_events;
-      new_events.reserve(seg->log->events.size());
+      CanEventList new_events = newEventList();
       for (const Event &e : seg->log->events) {
         if (e.which == cereal::Event::Which::CAN) {
           capnp::FlatArrayMessageReader reader(e.data);
           auto event = reader.getRoot<cereal::Event>();
           for (const auto &c : event.getCan()) {
-            new_events.push_back(newEvent(e.mono_time, c));
+            if (auto offset = newEvent(e.mono_time, c); offset != CanEventStore::INVALID_OFFSET) {
+              new_events.push_back(offset);
+            }
           }
         }
       }
@@ -89,11 +90,7 @@ bool ReplayStream::eventFilter(const Event *event) {
     double current_sec = toSeconds(event->mono_time);
     capnp::FlatArrayMessageReader reader(event->data);
     auto e = reader.getRoot<cereal::Event>();
-    for (const auto &c : e.getCan()) {
-      MessageId id = {.source = c.getSrc(), .address = c.getAddress()};
-      const auto dat = c.getDat();
-      updateEvent(id, current_sec, (const uint8_t*)dat.begin(), dat.size());
-    }
+    updateEvents(current_sec, e.getCan());
   }
 
   double ts = millis_since_boot();
@@ -44,6 +44,7 @@ bool SocketCanStream::connect() {
 void SocketCanStream::streamThread() {
   while (!QThread::currentThread()->isInterruptionRequested()) {
     QThread::msleep(1);
+    flushPendingEvents();
 
     auto frames = device->readAllFrames();
     if (frames.size() == 0) continue;
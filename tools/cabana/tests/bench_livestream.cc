@@ -0,0 +1,146 @@
+// Drives a LiveStream at multi-bus CAN rates and reports how well the UI thread keeps up.
+//
+// usage: bench_livestream [--device] [--buses N] [--rate FRAMES_PER_SEC_PER_BUS] [--seconds N]
+//   default: an in-process stream thread that batches frames like PandaStream
+//   --device: publish on the "can" socket and receive through DeviceStream
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QThread>
+#include <QTimer>
+
+#include "common/timing.h"
+#include "tools/cabana/settings.h"
+#include "tools/cabana/streams/devicestream.h"
+
+struct BenchConfig {
+  int buses = 3;
+  int rate = 4000;  // ~full load of a 500kbps bus with 8 byte frames
+  int seconds = 10;
+};
+
+// builds a can event with the frames due since the last call, like PandaStream does for each usb read.
+static std::atomic<uint64_t> frames_sent = 0;
+static kj::Array<capnp::word> buildCanEvent(const BenchConfig &cfg, uint64_t start_ts, uint64_t &sent) {
+  const uint64_t due = (nanos_since_boot() - start_ts) * cfg.rate * cfg.buses / 1e9;
+  const int count = std::min<uint64_t>(due - sent, 1000);
+
+  MessageBuilder msg;
+  auto can_data = msg.initEvent().initCan(count);
+  for (int i = 0; i < count; ++i, ++sent) {
+    uint8_t dat[8] = {};
+    std::memcpy(dat, &sent, sizeof(sent));
+    can_data[i].setSrc(sent % cfg.buses);
+    can_data[i].setAddress(0x100 + (sent / cfg.buses) % 200);
+    can_data[i].setDat(kj::arrayPtr(dat, sizeof(dat)));
+  }
+  frames_sent += count;
+  return capnp::messageToFlatArray(msg);
+}
+
+static void produce(const BenchConfig &cfg, std::function<void(kj::Array<capnp::word> &&)> send) {
+  const uint64_t start_ts = nanos_since_boot();
+  uint64_t sent = 0;
+  while (!QThread::currentThread()->isInterruptionRequested() && nanos_since_boot() - start_ts < cfg.seconds * 1e9) {
+    QThread::usleep(1000);
+    send(buildCanEvent(cfg, start_ts, sent));
+  }
+}
+
+class SyntheticStream : public LiveStream {
+public:
+  SyntheticStream(QObject *parent, const BenchConfig &cfg) : LiveStream(parent), cfg(cfg) {}
+  QString routeName() const override { return "Synthetic"; }
+
+protected:
+  void streamThread() override {
+    produce(cfg, [this](kj::Array<capnp::word> &&data) { handleEvent(data); });
+  }
+  const BenchConfig cfg;
+};
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min<size_t>(v.size() - 1, v.size() * p)];
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  parser.addOption({"device", "receive through DeviceStream"});
+  parser.addOption({"buses", "number of buses", "buses", "3"});
+  parser.addOption({"rate", "frames per second per bus", "rate", "4000"});
+  parser.addOption({"seconds", "duration", "seconds", "10"});
+  parser.process(app);
+
+  BenchConfig cfg = {.buses = parser.value("buses").toInt(),
+                     .rate = parser.value("rate").toInt(),
+                     .seconds = parser.value("seconds").toInt()};
+  settings.log_livestream = false;
+  settings.fps = 20;
+
+  std::thread publisher;
+  LiveStream *stream = nullptr;
+  if (parser.isSet("device")) {
+    stream = new DeviceStream(&app);
+    publisher = std::thread([&cfg]() {
+      PubMaster pm({"can"});
+      produce(cfg, [&pm](kj::Array<capnp::word> &&data) {
+        auto bytes = data.asBytes();
+        pm.send("can", bytes.begin(), bytes.size());
+      });
+    });
+  } else {
+    stream = new SyntheticStream(&app, cfg);
+  }
+  can = stream;
+
+  // latency from producing a frame to it being merged in the UI thread
+  std::vector<double> handoff_ms;
+  QObject::connect(stream, &AbstractStream::eventsMerged, [&](const MessageEventsMap &events_map) {
+    const uint64_t now = nanos_since_boot();
+    for (const auto &[_, events] : events_map) {
+      if (!events.empty()) handoff_ms.push_back((now - events.front()->mono_time) / 1e6);
+    }
+  });
+
+  // how long the UI thread is blocked, sampled with a 1ms timer
+  std::vector<double> ui_gap_ms;
+  double last_tick = millis_since_boot();
+  QTimer ui_timer;
+  QObject::connect(&ui_timer, &QTimer::timeout, [&]() {
+    double now = millis_since_boot();
+    ui_gap_ms.push_back(now - last_tick);
+    last_tick = now;
+  });
+  ui_timer.start(1);
+
+  const double start_ts = millis_since_boot();
+  stream->start();
+  QTimer::singleShot((cfg.seconds + 1) * 1000, &app, &QCoreApplication::quit);
+  app.exec();
+  const double elapsed = (millis_since_boot() - start_ts) / 1000.0;
+
+  if (publisher.joinable()) publisher.join();
+  const size_t merged = stream->allEvents().size();
+  stream->stop();
+
+  printf("buses: %d, rate: %d frames/s/bus, mode: %s\n", cfg.buses, cfg.rate, parser.isSet("device") ? "device" : "synthetic");
+  printf("frames sent: %lu, merged: %zu (%.1f%%), %.0f frames/s\n", frames_sent.load(), merged,
+         frames_sent ? merged * 100.0 / frames_sent : 0.0, merged / elapsed);
+  printf("handoff latency ms: p50 %.2f, p99 %.2f, max %.2f\n", percentile(handoff_ms, 0.5),
+         percentile(handoff_ms, 0.99), percentile(handoff_ms, 1.0));
+  printf("ui thread gap ms: p50 %.2f, p99 %.2f, max %.2f\n", percentile(ui_gap_ms, 0.5),
+         percentile(ui_gap_ms, 0.99), percentile(ui_gap_ms, 1.0));
+  return 0;
+}
@@ -1,9 +1,13 @@
 
 #undef INFO
 #include <QDir>
+#include <QTemporaryDir>
+#include <numeric>
 
 #include "catch2/catch.hpp"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/messageswidget.h"
+#include "tools/cabana/streams/eventstore.h"
 
 const std::string TEST_RLOG_URL = "https://commadataci.blob.core.windows.net/openpilotci/0c94aa1e1296d7c6/2021-05-05--19-48-37/0/rlog.bz2";
 
@@ -142,6 +146,64 @@ CM_ SG_ 162 signal_1 "signal comment with \"escaped quotes\"";
   REQUIRE(msg->sigs[0]->comment == "signal comment with \"escaped quotes\"");
 }
 
+TEST_CASE("DBCFile parse errors") {
+  auto parse_error = [](const QString &content) -> std::string {
+    try {
+      DBCFile dbc("", content);
+    } catch (std::exception &e) {
+      return e.what();
+    }
+    return "";
+  };
+  // [file:line:column]
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\nBO_ 160 message_2: 8 EON\n") ==
+          "[:2:25]Duplicate message address: 160: BO_ 160 message_2: 8 EON");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\n SG_ signal_1 : 0|12@1+ (1,x) [0|4095] \"unit\" XXX\n") ==
+          "[:2:28]Invalid SG_ line format: SG_ signal_1 : 0|12@1+ (1,x) [0|4095] \"unit\" XXX");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\nCM_ BO_ 160 \"multiple\nline\ncomment;\n") ==
+          "[:2:13]Unterminated string: CM_ BO_ 160 \"multiple");
+  REQUIRE(parse_error("BO_ 160 message_1: 8 EON\r\nCM_ BO_ 160 \"multiple\r\nline\";\r\nVAL_ 160 signal_1;\r\n") ==
+          "[:4:18]invalid VAL_ line format: VAL_ 160 signal_1;");
+}
+
+TEST_CASE("DBCFile::preload") {
+  QString content = R"(BO_ 160 message_1: 8 EON
+ SG_ signal_1 : 0|12@1+ (1,0) [0|4095] "unit" XXX
+)";
+  QTemporaryDir dir;
+  QStringList files;
+  for (int i = 0; i < 8; ++i) {
+    QFile file(dir.filePath(QString("%1.dbc").arg(i)));
+    REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(QString(content).replace("message_1", QString("message_%1").arg(i)).toUtf8());
+    files.push_back(file.fileName());
+  }
+  DBCFile::preload(files);
+
+  // files with the same content share the parsed result, but not the messages
+  DBCFile dbc(files[3]), other(files[3]);
+  REQUIRE(dbc.msg(160)->name == "message_3");
+  REQUIRE(dbc.msg(160)->transmitter == "EON");
+  REQUIRE(dbc.msg(160)->sigs.size() == 1);
+  dbc.updateMsg({.address = 160}, "renamed", 8, "EON", "");
+  dbc.msg(160)->sigs[0]->name = "renamed";
+  REQUIRE(other.msg(160)->name == "message_3");
+  REQUIRE(other.msg(160)->sigs[0]->name == "signal_1");
+  REQUIRE(DBCFile(files[3]).msg(160)->name == "message_3");
+
+  // more files than the cache keeps, and files of the same size, each get their own result
+  for (int i = 8; i < 24; ++i) {
+    QFile file(dir.filePath(QString("%1.dbc").arg(i)));
+    REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(QString(content).replace("message_1", QString("message_%1").arg(i)).toUtf8());
+    files.push_back(file.fileName());
+  }
+  DBCFile::preload(files);
+  for (int i = 0; i < files.size(); ++i) {
+    REQUIRE(DBCFile(files[i]).msg(160)->name == QString("message_%1").arg(i));
+  }
+}
+
 TEST_CASE("parse_opendbc") {
   QDir dir(OPENDBC_FILE_PATH);
   QStringList errors;
@@ -155,3 +217,167 @@ TEST_CASE("parse_opendbc") {
   INFO(errors.join("\n").toStdString());
   REQUIRE(errors.empty());
 }
+
+TEST_CASE("CanEventStore") {
+  auto spill_dir = GENERATE(std::string(), QDir::tempPath().toStdString());
+  CanEventStore store(spill_dir);
+  REQUIRE(store.isSpilling() == !spill_dir.empty());
+
+  uint8_t dat[64];
+  std::iota(std::begin(dat), std::end(dat), 0);
+  CanEventList all(&store), odd(&store);
+  const int event_count = CanEventStore::BLOCK_SIZE / 32;  // spans multiple blocks
+  for (int i = 0; i < event_count; ++i) {
+    auto offset = store.append(i * 10, i % 3, i, dat, i % 65);
+    all.push_back(offset);
+    if (i % 2) odd.push_back(offset);
+  }
+  REQUIRE(store.bytesUsed() > CanEventStore::BLOCK_SIZE);
+
+  for (int i = 0; i < event_count; i += 997) {
+    const CanEvent *e = all[i];
+    REQUIRE(e->mono_time == i * 10);
+    REQUIRE(e->src == i % 3);
+    REQUIRE(e->address == i);
+    REQUIRE(e->size == i % 65);
+    REQUIRE(std::equal(e->dat, e->dat + e->size, dat));
+  }
+
+  auto it = std::upper_bound(odd.begin(), odd.end(), 500, CompareCanEvent());
+  REQUIRE((*it)->mono_time == 510);
+  auto rit = std::upper_bound(all.rbegin(), all.rend(), 500, [](uint64_t ts, auto e) { return ts > e->mono_time; });
+  REQUIRE((*rit)->mono_time == 490);
+
+  // insert in the middle
+  CanEventList list(&store);
+  list.insert(list.end(), all.begin(), all.begin() + 10);
+  list.insert(list.end(), all.begin() + 20, all.begin() + 30);
+  list.insert(list.begin() + 10, all.begin() + 10, all.begin() + 20);
+  REQUIRE(list.size() == 30);
+  REQUIRE(std::is_sorted(list.begin(), list.end(), [](auto l, auto r) { return l->mono_time < r->mono_time; }));
+
+  // segments merged out of order, some of them landing inside runs
+  CanEventList merged(&store);
+  for (int seg : {5, 9, 0, 7, 3, 8, 1, 2, 6, 4}) {
+    auto first = all.begin() + seg * 100, last = first + 100;
+    auto pos = std::upper_bound(merged.begin(), merged.end(), (*first)->mono_time, CompareCanEvent());
+    REQUIRE(merged.insert(pos, first, last) - merged.begin() == pos - merged.begin());
+  }
+  REQUIRE(merged.size() == 1000);
+  REQUIRE(std::equal(merged.begin(), merged.end(), all.begin()));
+  REQUIRE(std::equal(merged.rbegin(), merged.rend(), std::make_reverse_iterator(all.begin() + 1000)));
+  for (int i = 0; i < 1000; i += 37) {
+    REQUIRE(merged[i] == all[i]);
+    REQUIRE(*(merged.end() - (1000 - i)) == all[i]);
+  }
+}
+
+// a stream fed by the test, each feed() is one update of the UI
+class TestStream : public AbstractStream {
+public:
+  TestStream(QObject *parent) : AbstractStream(parent) {}
+  QString routeName() const override { return "Test"; }
+  void start() override {}
+
+  void feed(double sec, const std::vector<MessageId> &ids) {
+    MessageBuilder msg;
+    auto can_data = msg.initEvent().initCan(ids.size());
+    for (int i = 0; i < ids.size(); ++i) {
+      uint8_t dat[8] = {(uint8_t)(sec * 10)};
+      can_data[i].setSrc(ids[i].source);
+      can_data[i].setAddress(ids[i].address);
+      can_data[i].setDat(kj::arrayPtr(dat, sizeof(dat)));
+    }
+    updateEvents(sec, can_data.asReader());
+    emit privateUpdateLastMsgsSignal();
+    QCoreApplication::processEvents();
+  }
+};
+
+static std::vector<std::pair<MessageId, bool>> itemStates(const MessageListModel &model) {
+  std::vector<std::pair<MessageId, bool>> states;
+  for (const auto &item : model.items_) states.push_back({item.id, item.active});
+  return states;
+}
+
+TEST_CASE("MessageListModel incremental updates") {
+  const int column = GENERATE(MessageListModel::NAME, MessageListModel::ADDRESS, MessageListModel::COUNT);
+  const bool show_inactive = GENERATE(true, false);
+
+  QObject parent;
+  TestStream stream(&parent);
+  can = &stream;
+  REQUIRE(dbc()->open(SOURCE_ALL, "", R"(BO_ 256 message_1: 8 EON
+ SG_ signal_1 : 0|8@1+ (1,0) [0|255] "" XXX
+
+BO_ 263 message_2: 8 EON
+ SG_ signal_2 : 0|8@1+ (1,0) [0|255] "" XXX
+
+BO_ 512 message_3: 8 EON
+ SG_ signal_3 : 0|8@1+ (1,0) [0|255] "" XXX
+)"));
+
+  // the model under test only gets the updates, the reference is rebuilt from scratch every time
+  MessageListModel model(nullptr), reference(nullptr);
+  auto both = [&](auto f) { f(model); f(reference); };
+  both([&](MessageListModel &m) {
+    m.sort(column, Qt::DescendingOrder);
+    m.showInactivemessages(show_inactive);
+    m.dbcModified();
+  });
+  QObject::connect(&stream, &AbstractStream::msgsReceived, &model, &MessageListModel::msgsReceived);
+
+  // the rows as a view sees them, following the row signals of the model
+  std::vector<MessageId> rows;
+  auto model_rows = [&](int first, int last) {
+    std::vector<MessageId> ids;
+    for (int i = first; i <= last; ++i) ids.push_back(model.items_[i].id);
+    return ids;
+  };
+  QObject::connect(&model, &MessageListModel::modelReset, [&]() { rows = model_rows(0, model.rowCount() - 1); });
+  QObject::connect(&model, &MessageListModel::rowsInserted, [&](const QModelIndex &, int first, int last) {
+    auto ids = model_rows(first, last);
+    rows.insert(rows.begin() + first, ids.begin(), ids.end());
+  });
+  QObject::connect(&model, &MessageListModel::rowsRemoved, [&](const QModelIndex &, int first, int last) {
+    rows.erase(rows.begin() + first, rows.begin() + last + 1);
+  });
+  QObject::connect(&model, &MessageListModel::rowsMoved, [&](const QModelIndex &, int start, int end, const QModelIndex &, int row) {
+    std::vector<MessageId> ids(rows.begin() + start, rows.begin() + end + 1);
+    rows.erase(rows.begin() + start, rows.begin() + end + 1);
+    const int to = row > start ? row - (end - start + 1) : row;
+    rows.insert(rows.begin() + to, ids.begin(), ids.end());
+  });
+  rows = model_rows(0, model.rowCount() - 1);
+
+  auto check = [&]() {
+    reference.filterAndSort();
+    REQUIRE(itemStates(model) == itemStates(reference));
+    REQUIRE(rows == model_rows(0, model.rowCount() - 1));
+  };
+  check();
+
+  // the placeholder of a DBC message goes away when the message is received, even if it is filtered out
+  both([](MessageListModel &m) { m.setFilterStrings({{MessageListModel::SOURCE, "100-"}}); });
+  stream.feed(0.1, {{.source = 0, .address = 256}, {.source = 1, .address = 256}});
+  check();
+  REQUIRE(std::none_of(model.items_.begin(), model.items_.end(), [](auto &item) { return item.id.address == 256; }));
+  both([](MessageListModel &m) { m.setFilterStrings({}); });
+  check();
+
+  // messages at different rates, some of them pausing long enough to become inactive
+  for (int i = 1; i <= 100; ++i) {
+    if (i == 60) both([](MessageListModel &m) { m.setFilterStrings({{MessageListModel::COUNT, "10-"}}); });
+    std::vector<MessageId> ids;
+    for (uint32_t address = 0x100; address < 0x110; ++address) {
+      const bool paused = address % 3 == 0 && i > 20 && i < 50;
+      if (i % (address - 0x100 + 1) == 0 && !paused) ids.push_back({.source = (uint8_t)(address % 2), .address = address});
+    }
+    stream.feed(0.1 + i * 0.1, ids);
+    check();
+  }
+  REQUIRE(!model.items_.empty());
+
+  dbc()->closeAll();
+  can = nullptr;
+}
@@ -0,0 +1,57 @@
+#include "tools/replay/eventcursor.h"
+
+#include <algorithm>
+
+void EventCursor::setRuns(const std::vector<EventRun> &runs) {
+  std::vector<Run> new_runs;
+  new_runs.reserve(runs.size());
+  last_mono_time_ = 0;
+  for (const auto &r : runs) {
+    if (r.events->empty()) continue;
+
+    auto old = std::find_if(runs_.begin(), runs_.end(), [&](auto &o) { return o.seg_num == r.seg_num && o.events == r.events; });
+    if (old != runs_.end()) {
+      new_runs.push_back(*old);
+    } else {
+      auto pos = last_ ? std::upper_bound(r.events->cbegin(), r.events->cend(), *last_) : r.events->cbegin();
+      new_runs.push_back({r.seg_num, r.events, r.events->cbegin(), pos, r.events->cend()});
+    }
+    last_mono_time_ = std::max(last_mono_time_, r.events->back().mono_time);
+  }
+  std::sort(new_runs.begin(), new_runs.end(), [](auto &l, auto &r) { return *l.begin < *r.begin; });
+  runs_ = std::move(new_runs);
+  first_ = 0;
+  update();
+}
+
+void EventCursor::seek(const Event &key) {
+  for (auto &r : runs_) {
+    r.pos = std::upper_bound(r.begin, r.end, key);
+  }
+  last_ = key;
+  first_ = 0;
+  update();
+}
+
+void EventCursor::next() {
+  if (cur_ == -1) return;
+
+  last_ = *runs_[cur_].pos++;
+  update();
+}
+
+void EventCursor::update() {
+  while (first_ < runs_.size() && runs_[first_].pos == runs_[first_].end) {
+    ++first_;
+  }
+
+  cur_ = -1;
+  for (int i = first_; i < runs_.size(); ++i) {
+    const auto &r = runs_[i];
+    // the remaining runs start after the current event
+    if (cur_ != -1 && *runs_[cur_].pos < *r.begin) break;
+    if (r.pos != r.end && (cur_ == -1 || *r.pos < *runs_[cur_].pos)) {
+      cur_ = i;
+    }
+  }
+}
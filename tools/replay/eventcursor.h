@@ -0,0 +1,41 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "tools/replay/logreader.h"
+
+// A time ordered run of events, usually the events of one loaded segment.
+struct EventRun {
+  int seg_num;
+  const std::vector<Event> *events;
+};
+
+// Iterates the events of several sorted runs in time order without merging them into one vector.
+// Runs are ordered by their first event and only overlap around segment boundaries, so advancing
+// usually looks at one or two runs. The position is kept per run, so it survives setRuns() when
+// segments are merged or evicted, and only the newly added runs have to be searched.
+class EventCursor {
+public:
+  // keeps the position in runs of segments that are still present.
+  void setRuns(const std::vector<EventRun> &runs);
+  // positions the cursor at the first event after key.
+  void seek(const Event &key);
+  void next();
+  inline const Event *get() const { return cur_ == -1 ? nullptr : &*runs_[cur_].pos; }
+  inline uint64_t lastMonoTime() const { return last_mono_time_; }
+
+private:
+  struct Run {
+    int seg_num;
+    const std::vector<Event> *events;
+    std::vector<Event>::const_iterator begin, pos, end;
+  };
+  void update();
+
+  std::vector<Run> runs_;
+  int first_ = 0;  // runs before first_ are exhausted
+  int cur_ = -1;
+  std::optional<Event> last_;  // the last event the cursor moved past, or the seek key
+  uint64_t last_mono_time_ = 0;
+};
@@ -1,46 +1,224 @@
 #include "tools/replay/filereader.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 #include "common/util.h"
 #include "system/hardware/hw.h"
 #include "tools/replay/util.h"
 
-std::string cacheFilePath(const std::string &url) {
+namespace {
+
+const std::string &cacheDir() {
   static std::string cache_path = [] {
     const std::string comma_cache = Path::download_cache_root();
     util::create_directories(comma_cache, 0755);
     return comma_cache.back() == '/' ? comma_cache : comma_cache + "/";
   }();
+  return cache_path;
+}
+
+// the directory cacheWrite keeps under budget. size is the total of its files, scanned on the first
+// write and then tracked, so the directory is only scanned again when it is over budget.
+struct CacheBudget {
+  std::mutex lock;
+  std::string dir;
+  uint64_t max_bytes = 0;
+  uint64_t size = 0;
+  bool scanned = false;
+};
 
-  return cache_path + sha256(getUrlWithoutQuery(url));
+CacheBudget &cacheBudget() {
+  static CacheBudget budget;
+  return budget;
+}
+
+void setDefaultCacheBudget(CacheBudget &budget) {
+  budget.dir = cacheDir();
+  budget.max_bytes = (uint64_t)std::max(util::getenv("REPLAY_CACHE_SIZE_MB", 10 * 1024), 0) << 20;
+  budget.scanned = false;
+}
+
+}  // namespace
+
+std::string cacheFilePath(const std::string &url) {
+  return cacheDir() + sha256(getUrlWithoutQuery(url));
 }
 
-std::string FileReader::read(const std::string &file, std::atomic<bool> *abort) {
-  const bool is_remote = file.find("https://") == 0;
+void setCacheBudget(const std::string &dir, uint64_t max_bytes) {
+  CacheBudget &budget = cacheBudget();
+  std::lock_guard lk(budget.lock);
+  if (dir.empty()) {
+    setDefaultCacheBudget(budget);
+  } else {
+    budget.dir = dir.back() == '/' ? dir : dir + "/";
+    budget.max_bytes = max_bytes;
+    budget.scanned = false;
+  }
+}
+
+bool cacheWrite(const std::string &file, const std::string &data) {
+  // write to a temporary file first, so concurrent readers never see a partial file.
+  const std::string tmp_file = file + ".tmp" + std::to_string(util::random_int(0, 1000000));
+  {
+    std::ofstream fs(tmp_file, std::ios::binary | std::ios::out);
+    fs.write(data.data(), data.size());
+    if (!fs) {
+      fs.close();
+      std::remove(tmp_file.c_str());
+      return false;
+    }
+  }
+  struct stat st;
+  const uint64_t replaced = stat(file.c_str(), &st) == 0 ? st.st_size : 0;
+  if (std::rename(tmp_file.c_str(), file.c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+    return false;
+  }
+
+  CacheBudget &budget = cacheBudget();
+  std::lock_guard lk(budget.lock);
+  if (budget.dir.empty()) setDefaultCacheBudget(budget);
+  if (file.compare(0, budget.dir.size(), budget.dir) == 0) {
+    // other processes and downloads also add files, the scan when over budget catches up with them
+    budget.size = std::max(budget.size + data.size(), replaced) - replaced;
+    if (!budget.scanned || budget.size > budget.max_bytes) {
+      budget.size = cacheEvict(budget.dir, budget.max_bytes);
+      budget.scanned = true;
+    }
+  }
+  return true;
+}
+
+std::string cacheRead(const std::string &file) {
+  std::string result = util::read_file(file);
+  if (!result.empty()) {
+    // the modification time orders the files for eviction
+    utimensat(AT_FDCWD, file.c_str(), nullptr, 0);
+  }
+  return result;
+}
+
+uint64_t cacheEvict(const std::string &dir, uint64_t max_bytes) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return 0;
+
+  // (mtime, size, path) of each file
+  std::vector<std::tuple<timespec, uint64_t, std::string>> files;
+  uint64_t total = 0;
+  while (struct dirent *de = readdir(d)) {
+    std::string path = dir + (dir.back() == '/' ? "" : "/") + de->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      total += st.st_size;
+      files.emplace_back(st.st_mtim, st.st_size, std::move(path));
+    }
+  }
+  closedir(d);
+  if (total <= max_bytes) return total;
+
+  std::sort(files.begin(), files.end(), [](auto &a, auto &b) {
+    const timespec &ta = std::get<0>(a), &tb = std::get<0>(b);
+    return ta.tv_sec < tb.tv_sec || (ta.tv_sec == tb.tv_sec && ta.tv_nsec < tb.tv_nsec);
+  });
+  for (auto it = files.begin(); it != files.end() && total > max_bytes; ++it) {
+    auto &[mtime, size, path] = *it;
+    // another replay may have removed it already
+    if (std::remove(path.c_str()) == 0 || errno == ENOENT) {
+      total -= size;
+    }
+  }
+  return total;
+}
+
+std::string FileReader::read(const std::string &file, std::atomic<bool> *abort, bool decompress,
+                             const DownloadDataHandler &on_data) {
+  const bool is_remote = util::starts_with(file, "https://") || util::starts_with(file, "http://");
   const std::string local_file = is_remote ? cacheFilePath(file) : file;
+  const std::string decompressed_file = local_file + ".decompressed";
+  const bool use_cache = is_remote && cache_to_local_;
+  decompress = decompress && file.find(".bz2") != std::string::npos;
+  bool decompressed = false;
   std::string result;
 
-  if ((!is_remote || cache_to_local_) && util::file_exists(local_file)) {
+  if (use_cache && decompress && util::file_exists(decompressed_file)) {
+    result = cacheRead(decompressed_file);
+    if (!result.empty()) return result;
+  }
+
+  if (use_cache && util::file_exists(local_file)) {
+    result = cacheRead(local_file);
+  } else if (!is_remote && util::file_exists(local_file)) {
     result = util::read_file(local_file);
+  } else if (is_remote && !decompress) {
+    result = download(file, abort, on_data);
+    if (use_cache && !result.empty()) {
+      cacheWrite(local_file, result);
+    }
+    return result;
   } else if (is_remote) {
-    result = download(file, abort);
-    if (cache_to_local_ && !result.empty()) {
-      std::ofstream fs(local_file, std::ios::binary | std::ios::out);
-      fs.write(result.data(), result.size());
+    // decompress the downloaded prefix while the rest is still arriving
+    auto bz2 = std::make_unique<BZ2Decompressor>();
+    std::string out;
+    size_t fed = 0;
+    bool ok = true;
+    auto feed = [&](const char *data, size_t size) {
+      ok = ok && bz2->decompress(data + fed, size - fed, out, abort);
+      fed = size;
+    };
+    result = download(file, abort, [&](const char *data, size_t size) {
+      if (size == 0) {
+        // a retry starts over, so does the decompression and whoever reads it
+        bz2 = std::make_unique<BZ2Decompressor>();
+        out.clear();
+        fed = 0;
+        ok = true;
+        if (on_data) on_data(nullptr, 0);
+        return;
+      }
+      if (size <= fed) return;
+      feed(data, size);
+      if (ok && on_data && !out.empty()) on_data(out.data(), out.size());
+    });
+    if (result.empty()) return {};
+
+    feed(result.data(), result.size());
+    if (!ok || (abort && *abort)) return {};
+    if (!bz2->finished()) {
+      rWarning("decompressBZ2 error : content is corrupt");
     }
+    result = std::move(out);
+    decompressed = true;
+  }
+
+  if (decompress && !decompressed && !result.empty()) {
+    result = decompressBZ2(result, abort);
+  }
+  if (use_cache && decompress && !result.empty() && cacheWrite(decompressed_file, result)) {
+    std::remove(local_file.c_str());
   }
   return result;
 }
 
-std::string FileReader::download(const std::string &url, std::atomic<bool> *abort) {
+std::string FileReader::download(const std::string &url, std::atomic<bool> *abort, const DownloadDataHandler &on_data) {
   for (int i = 0; i <= max_retries_ && !(abort && *abort); ++i) {
     if (i > 0) {
       rWarning("download failed, retrying %d", i);
       util::sleep_for(3000);
+      if (on_data) on_data(nullptr, 0);
     }
 
-    std::string result = httpGet(url, chunk_size_, abort);
+    std::string result = httpGet(url, chunk_size_, abort, on_data);
     if (!result.empty()) {
       return result;
     }
@@ -3,18 +3,36 @@
 #include <atomic>
 #include <string>
 
+#include "tools/replay/util.h"
+
 class FileReader {
 public:
   FileReader(bool cache_to_local, size_t chunk_size = 0, int retries = 3)
       : cache_to_local_(cache_to_local), chunk_size_(chunk_size), max_retries_(retries) {}
   virtual ~FileReader() {}
-  std::string read(const std::string &file, std::atomic<bool> *abort = nullptr);
+  // with decompress, a .bz2 file is returned decompressed. the local cache then keeps the
+  // decompressed copy instead of the downloaded one, so reopening it skips bz2 as well.
+  // on_data sees the result grow while it downloads, a prefix of what read returns. it is called with
+  // size 0 when a failed download is retried, what it saw so far is not part of the result.
+  std::string read(const std::string &file, std::atomic<bool> *abort = nullptr, bool decompress = false,
+                   const DownloadDataHandler &on_data = nullptr);
 
 private:
-  std::string download(const std::string &url, std::atomic<bool> *abort);
+  std::string download(const std::string &url, std::atomic<bool> *abort, const DownloadDataHandler &on_data);
   size_t chunk_size_;
   int max_retries_;
   bool cache_to_local_;
 };
 
 std::string cacheFilePath(const std::string &url);
+
+// the local cache is kept under REPLAY_CACHE_SIZE_MB (default 10 GB), the least recently used files are removed first.
+// setCacheBudget puts another directory under another budget, an empty dir restores the default.
+void setCacheBudget(const std::string &dir, uint64_t max_bytes);
+// cacheWrite writes to a temporary file and renames it, so a killed replay never leaves a partial file behind.
+// files in the budgeted directory count against the budget, and the least recently used ones are evicted when it is exceeded.
+bool cacheWrite(const std::string &file, const std::string &data);
+// reads a cached file and marks it as recently used
+std::string cacheRead(const std::string &file);
+// removes the least recently used files in dir until it is at most max_bytes, returns the size left
+uint64_t cacheEvict(const std::string &dir, uint64_t max_bytes);
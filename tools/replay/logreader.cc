@@ -5,27 +5,71 @@
 #include "tools/replay/filereader.h"
 #include "tools/replay/util.h"
 
-bool LogReader::load(const std::string &url, std::atomic<bool> *abort, bool local_cache, int chunk_size, int retries) {
-  std::string data = FileReader(local_cache, chunk_size, retries).read(url, abort);
-  if (!data.empty() && url.find(".bz2") != std::string::npos)
-    data = decompressBZ2(data, abort);
+bool LogReader::load(const std::string &url, std::atomic<bool> *abort, bool local_cache, int chunk_size, int retries,
+                     const LogEventsHandler &on_events) {
+  // parse the events while the rest of the log is still downloading
+  auto on_data = [&](const char *data, size_t size) {
+    if (size == 0) {
+      // the download is retried from the start
+      bool had_events = !events.empty();
+      events.clear();
+      base_ = nullptr;
+      parsed_ = 0;
+      corrupt_ = false;
+      if (on_events && had_events) on_events(events, 0);
+      return;
+    }
+    const size_t first = events.size();
+    parse(data, size, false, abort);
+    if (on_events && events.size() > first) on_events(events, first);
+  };
+  std::string data = FileReader(local_cache, chunk_size, retries).read(url, abort, true, on_data);
+  if (data.empty()) {
+    // the events parsed so far point into a download that is gone
+    events.clear();
+    return false;
+  }
 
-  bool success = !data.empty() && load(data.data(), data.size(), abort);
+  const size_t first = events.size();
+  parse(data.data(), data.size(), true, abort);
+  if (on_events && events.size() > first) on_events(events, first);
+  bool success = finish(abort);
   if (filters_.empty())
     raw_ = std::move(data);
   return success;
 }
 
 bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
+  parse(data, size, true, abort);
+  return finish(abort);
+}
+
+void LogReader::parse(const char *data, size_t size, bool complete, std::atomic<bool> *abort) {
+  if (base_ && base_ != data && filters_.empty()) {
+    // the data grew and moved, so did the events in it. filtered events are copies
+    for (auto &e : events) {
+      const uintptr_t offset = (uintptr_t)e.data.begin() - (uintptr_t)base_;
+      if (offset < parsed_) {
+        e.data = kj::arrayPtr((const capnp::word *)(data + offset), e.data.size());
+      }
+    }
+  }
+  base_ = data;
+  if (corrupt_) return;
+
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)(data + parsed_), (size - parsed_) / sizeof(capnp::word));
   try {
     events.reserve(65000);
-    kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
     while (words.size() > 0 && !(abort && *abort)) {
+      if (!complete && capnp::expectedSizeInWordsFromPrefix(words) > words.size()) {
+        break;  // the rest of the event is still downloading
+      }
       capnp::FlatArrayMessageReader reader(words);
       auto event = reader.getRoot<cereal::Event>();
       auto which = event.which();
       auto event_data = kj::arrayPtr(words.begin(), reader.getEnd());
       words = kj::arrayPtr(reader.getEnd(), words.end());
+      parsed_ = (const char *)words.begin() - data;
 
       if (!filters_.empty()) {
         if (which >= filters_.size() || !filters_[which])
@@ -50,8 +94,11 @@ bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
     }
   } catch (const kj::Exception &e) {
     rWarning("Failed to parse log : %s.\nRetrieved %zu events from corrupt log", e.getDescription().cStr(), events.size());
+    corrupt_ = true;
   }
+}
 
+bool LogReader::finish(std::atomic<bool> *abort) {
   if (!events.empty() && !(abort && *abort)) {
     events.shrink_to_fit();
     std::sort(events.begin(), events.end());
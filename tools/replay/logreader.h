@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -25,15 +26,29 @@ public:
   int32_t eidx_segnum;
 };
 
+// called while a log downloads with the events parsed so far, unsorted. the ones from first on are new since the
+// last call. without filters their data points into the download and is only valid during the call.
+// no events means a retry starts over and the events passed before are gone.
+typedef std::function<void(const std::vector<Event> &events, size_t first)> LogEventsHandler;
+
 class LogReader {
 public:
   LogReader(const std::vector<bool> &filters = {}) { filters_ = filters; }
+  // returns once the whole log is in and the events are sorted, on_events sees them as they are parsed
   bool load(const std::string &url, std::atomic<bool> *abort = nullptr,
-            bool local_cache = false, int chunk_size = -1, int retries = 0);
+            bool local_cache = false, int chunk_size = -1, int retries = 0,
+            const LogEventsHandler &on_events = nullptr);
   bool load(const char *data, size_t size, std::atomic<bool> *abort = nullptr);
   std::vector<Event> events;
 
 private:
+  // parses the events in data after the ones parsed so far. until the data is complete, a partial event waits for more
+  void parse(const char *data, size_t size, bool complete, std::atomic<bool> *abort);
+  bool finish(std::atomic<bool> *abort);
+
+  const char *base_ = nullptr;
+  size_t parsed_ = 0;
+  bool corrupt_ = false;
   std::string raw_;
   std::vector<bool> filters_;
   MonotonicBuffer buffer_{1024 * 1024};
@@ -4,9 +4,11 @@
 #include <QtConcurrent>
 #include <capnp/dynamic.h>
 #include <csignal>
+#include <thread>
 #include "cereal/services.h"
 #include "common/params.h"
 #include "common/timing.h"
+#include "tools/replay/filereader.h"
 #include "tools/replay/util.h"
 
 static void interrupt_sleep_handler(int signal) {}
@@ -120,6 +122,7 @@ void Replay::seekTo(double seconds, bool relative) {
     rInfo("Seeking to %d s, segment %d", (int)target_time, target_segment);
     current_segment_ = target_segment;
     cur_mono_time_ = route_start_ts_ + target_time * 1e9;
+    event_cursor_.seek(Event(cereal::Event::Which::INIT_DATA, cur_mono_time_, {}));
     seeking_to_ = target_time;
     return false;
   });
@@ -150,93 +153,110 @@ void Replay::seekToFlag(FindFlag flag) {
 }
 
 void Replay::buildTimeline() {
-  uint64_t engaged_begin = 0;
-  bool engaged = false;
-
-  auto alert_status = cereal::ControlsState::AlertStatus::NORMAL;
-  auto alert_size = cereal::ControlsState::AlertSize::NONE;
-  uint64_t alert_begin = 0;
-  std::string alert_type;
-
-  const TimelineType timeline_types[] = {
-    [(int)cereal::ControlsState::AlertStatus::NORMAL] = TimelineType::AlertInfo,
-    [(int)cereal::ControlsState::AlertStatus::USER_PROMPT] = TimelineType::AlertWarning,
-    [(int)cereal::ControlsState::AlertStatus::CRITICAL] = TimelineType::AlertCritical,
-  };
+  {
+    std::lock_guard lk(timeline_lock);
+    timeline_ = Timeline(route_start_ts_);
+  }
 
-  const auto &route_segments = route_->segments();
-  for (auto it = route_segments.cbegin(); it != route_segments.cend() && !exit_; ++it) {
-    std::shared_ptr<LogReader> log(new LogReader());
-    if (!log->load(it->second.qlog.toStdString(), &exit_, !hasFlag(REPLAY_FLAG_NO_FILE_CACHE), 0, 3) || log->events.empty()) continue;
-
-    std::vector<std::tuple<double, double, TimelineType>> timeline;
-    for (const Event &e : log->events) {
-      if (e.which == cereal::Event::Which::CONTROLS_STATE) {
-        capnp::FlatArrayMessageReader reader(e.data);
-        auto event = reader.getRoot<cereal::Event>();
-        auto cs = event.getControlsState();
-
-        if (engaged != cs.getEnabled()) {
-          if (engaged) {
-            timeline.push_back({toSeconds(engaged_begin), toSeconds(e.mono_time), TimelineType::Engaged});
-          }
-          engaged_begin = e.mono_time;
-          engaged = cs.getEnabled();
-        }
-
-        if (alert_type != cs.getAlertType().cStr() || alert_status != cs.getAlertStatus()) {
-          if (!alert_type.empty() && alert_size != cereal::ControlsState::AlertSize::NONE) {
-            timeline.push_back({toSeconds(alert_begin), toSeconds(e.mono_time), timeline_types[(int)alert_status]});
-          }
-          alert_begin = e.mono_time;
-          alert_type = cs.getAlertType().cStr();
-          alert_size = cs.getAlertSize();
-          alert_status = cs.getAlertStatus();
-        }
-      } else if (e.which == cereal::Event::Which::USER_FLAG) {
-        timeline.push_back({toSeconds(e.mono_time), toSeconds(e.mono_time), TimelineType::UserFlag});
-      }
-    }
+  std::vector<std::pair<int, std::string>> qlogs;
+  for (const auto &[n, f] : route_->segments()) {
+    qlogs.push_back({n, f.qlog.toStdString()});
+  }
+  if (qlogs.empty()) return;
 
-    if (it->first == route_segments.rbegin()->first) {
-      if (engaged) {
-        timeline.push_back({toSeconds(engaged_begin), toSeconds(log->events.back().mono_time), TimelineType::Engaged});
-      }
-      if (!alert_type.empty() && alert_size != cereal::ControlsState::AlertSize::NONE) {
-        timeline.push_back({toSeconds(alert_begin), toSeconds(log->events.back().mono_time), timeline_types[(int)alert_status]});
+  struct Result {
+    bool done = false;
+    bool ok = false;
+    TimelineSegment seg;
+    std::shared_ptr<LogReader> log;
+  };
+  std::vector<Result> results(qlogs.size());
+  std::mutex lock;
+  std::condition_variable cv;
+  size_t merged = 0;
+
+  // qlogs are downloaded and parsed in parallel, then merged in route order below.
+  // workers stay at most a few segments ahead of the merge, which bounds the memory used by loaded qlogs.
+  const int num_workers = std::clamp<int>(std::thread::hardware_concurrency(), 1, 4);
+  const size_t max_ahead = num_workers * 2;
+  std::atomic<size_t> next = 0;
+  auto worker = [&]() {
+    for (size_t i = next++; i < results.size() && !exit_; i = next++) {
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [&]() { return i < merged + max_ahead || exit_; });
       }
+      Result r;
+      r.done = true;
+      r.ok = loadTimelineSegment(qlogs[i].second, r.seg, r.log);
+      std::lock_guard lk(lock);
+      results[i] = std::move(r);
+      cv.notify_all();
+    }
+    std::lock_guard lk(lock);
+    cv.notify_all();
+  };
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.emplace_back(worker);
+  }
 
-      max_seconds_ = std::ceil(toSeconds(log->events.back().mono_time));
-      emit minMaxTimeChanged(route_segments.cbegin()->first * 60.0, max_seconds_);
+  for (size_t i = 0; i < results.size(); ++i) {
+    Result r;
+    {
+      std::unique_lock lk(lock);
+      cv.wait(lk, [&]() { return results[i].done || exit_; });
+      if (!results[i].done) break;
+      r = std::move(results[i]);
+      merged = i + 1;
+      cv.notify_all();
     }
+    if (!r.ok) continue;
+
+    const bool last_segment = i == results.size() - 1;
     {
       std::lock_guard lk(timeline_lock);
-      timeline_.insert(timeline_.end(), timeline.begin(), timeline.end());
-      std::sort(timeline_.begin(), timeline_.end(), [](auto &l, auto &r) { return std::get<2>(l) < std::get<2>(r); });
+      timeline_.merge(r.seg, last_segment);
+    }
+    if (last_segment) {
+      max_seconds_ = std::ceil(toSeconds(r.seg.last_mono_time));
+      emit minMaxTimeChanged(qlogs.front().first * 60.0, max_seconds_);
+    }
+    if (r.log) {
+      emit qLogLoaded(r.log);
     }
-    emit qLogLoaded(log);
+  }
+
+  for (auto &t : workers) {
+    t.join();
   }
 }
 
+bool Replay::loadTimelineSegment(const std::string &qlog, TimelineSegment &seg, std::shared_ptr<LogReader> &log) {
+  const bool cache_to_local = !hasFlag(REPLAY_FLAG_NO_FILE_CACHE);
+  const std::string cache_file = cacheFilePath(qlog) + ".timeline";
+  // the cached timeline is only enough if no one needs the whole qlog (cabana uses it for thumbnails)
+  const bool need_log = isSignalConnected(QMetaMethod::fromSignal(&Replay::qLogLoaded));
+  if (cache_to_local && !need_log && seg.load(cache_file)) {
+    return true;
+  }
+
+  log.reset(new LogReader());
+  if (!log->load(qlog, &exit_, cache_to_local, 0, 3) || log->events.empty()) {
+    log.reset();
+    return false;
+  }
+  seg = TimelineSegment(*log);
+  if (cache_to_local && !seg.save(cache_file)) {
+    rWarning("failed to cache timeline to %s", cache_file.c_str());
+  }
+  return true;
+}
+
 std::optional<uint64_t> Replay::find(FindFlag flag) {
   int cur_ts = currentSeconds();
-  for (auto [start_ts, end_ts, type] : getTimeline()) {
-    if (type == TimelineType::Engaged) {
-      if (flag == FindFlag::nextEngagement && start_ts > cur_ts) {
-        return start_ts;
-      } else if (flag == FindFlag::nextDisEngagement && end_ts > cur_ts) {
-        return end_ts;
-      }
-    } else if (start_ts > cur_ts) {
-      if ((flag == FindFlag::nextUserFlag && type == TimelineType::UserFlag) ||
-          (flag == FindFlag::nextInfo && type == TimelineType::AlertInfo) ||
-          (flag == FindFlag::nextWarning && type == TimelineType::AlertWarning) ||
-          (flag == FindFlag::nextCritical && type == TimelineType::AlertCritical)) {
-        return start_ts;
-      }
-    }
-  }
-  return std::nullopt;
+  std::lock_guard lk(timeline_lock);
+  return timeline_.find(cur_ts, flag);
 }
 
 void Replay::pause(bool pause) {
@@ -314,11 +334,9 @@ void Replay::loadSegmentInRange(SegmentMap::iterator begin, SegmentMap::iterator
 
 void Replay::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end) {
   std::set<int> segments_to_merge;
-  size_t new_events_size = 0;
   for (auto it = begin; it != end; ++it) {
     if (it->second && it->second->isLoaded()) {
       segments_to_merge.insert(it->first);
-      new_events_size += it->second->log->events.size();
     }
   }
 
@@ -327,16 +345,10 @@ void Replay::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::
   rDebug("merge segments %s", std::accumulate(segments_to_merge.begin(), segments_to_merge.end(), std::string{},
     [](auto & a, int b) { return a + (a.empty() ? "" : ", ") + std::to_string(b); }).c_str());
 
-  std::vector<Event> new_events;
-  new_events.reserve(new_events_size);
-
-  // Merge events from segments_to_merge into new_events
+  // the segments' events are streamed in place, no need to copy them into one vector.
+  std::vector<EventRun> runs;
   for (int n : segments_to_merge) {
-    size_t size = new_events.size();
-    const auto &events = segments_.at(n)->log->events;
-    std::copy_if(events.begin(), events.end(), std::back_inserter(new_events),
-                  [this](const Event &e) { return e.which < sockets_.size() && sockets_[e.which] != nullptr; });
-    std::inplace_merge(new_events.begin(), new_events.begin() + size, new_events.end());
+    runs.push_back({n, &segments_.at(n)->log->events});
   }
 
   if (stream_thread_) {
@@ -344,7 +356,7 @@ void Replay::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::
   }
 
   updateEvents([&]() {
-    events_.swap(new_events);
+    event_cursor_.setRuns(runs);
     merged_segments_ = segments_to_merge;
     // Wake up the stream thread if the current segment is loaded or invalid.
     return !seeking_to_ && (isSegmentMerged(current_segment_) || (segments_.count(current_segment_) == 0));
@@ -356,6 +368,7 @@ void Replay::startStream(const Segment *cur_segment) {
   const auto &events = cur_segment->log->events;
   route_start_ts_ = events.front().mono_time;
   cur_mono_time_ += route_start_ts_ - 1;
+  event_cursor_.seek(Event(cereal::Event::Which::INIT_DATA, cur_mono_time_, {}));
 
   // get datetime from INIT_DATA, fallback to datetime in the route name
   route_date_time_ = route()->datetime();
@@ -446,31 +459,26 @@ void Replay::publishFrame(const Event *e) {
 
 void Replay::streamThread() {
   stream_thread_id = pthread_self();
-  cereal::Event::Which cur_which = cereal::Event::Which::INIT_DATA;
   std::unique_lock lk(stream_lock_);
 
   while (true) {
     stream_cv_.wait(lk, [=]() { return exit_ || ( events_ready_ && !paused_); });
     if (exit_) break;
 
-    Event event(cur_which, cur_mono_time_, {});
-    auto first = std::upper_bound(events_.cbegin(), events_.cend(), event);
-    if (first == events_.cend()) {
+    if (!event_cursor_.get()) {
       rInfo("waiting for events...");
       events_ready_ = false;
       continue;
     }
 
-    auto it = publishEvents(first, events_.cend());
+    publishEvents();
 
     // Ensure frames are sent before unlocking to prevent race conditions
     if (camera_server_) {
       camera_server_->waitForSent();
     }
 
-    if (it != events_.cend()) {
-      cur_which = it->which;
-    } else if (!hasFlag(REPLAY_FLAG_NO_LOOP)) {
+    if (!event_cursor_.get() && !hasFlag(REPLAY_FLAG_NO_LOOP)) {
       // Check for loop end and restart if necessary
       int last_segment = segments_.rbegin()->first;
       if (current_segment_ >= last_segment && isSegmentMerged(last_segment)) {
@@ -481,14 +489,13 @@ void Replay::streamThread() {
   }
 }
 
-std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::const_iterator first,
-                                                         std::vector<Event>::const_iterator last) {
+void Replay::publishEvents() {
   uint64_t evt_start_ts = cur_mono_time_;
   uint64_t loop_start_ts = nanos_since_boot();
   double prev_replay_speed = speed_;
 
-  for (; !paused_ && first != last; ++first) {
-    const Event &evt = *first;
+  for (const Event *e = nullptr; !paused_ && (e = event_cursor_.get()); event_cursor_.next()) {
+    const Event &evt = *e;
     int segment = toSeconds(evt.mono_time) / 60;
 
     if (current_segment_ != segment) {
@@ -497,7 +504,7 @@ std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::con
     }
 
      // Skip events if socket is not present
-    if (!sockets_[evt.which]) continue;
+    if (evt.which >= sockets_.size() || !sockets_[evt.which]) continue;
 
     cur_mono_time_ = evt.mono_time;
     const uint64_t current_nanos = nanos_since_boot();
@@ -525,6 +532,4 @@ std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::con
       publishFrame(&evt);
     }
   }
-
-  return first;
 }
@@ -13,7 +13,9 @@
 #include <QThread>
 
 #include "tools/replay/camera.h"
+#include "tools/replay/eventcursor.h"
 #include "tools/replay/route.h"
+#include "tools/replay/timeline.h"
 
 const QString DEMO_ROUTE = "a2a0ccea32023010|2023-07-27--13-01-19";
 
@@ -32,16 +34,6 @@ enum REPLAY_FLAGS {
   REPLAY_FLAG_ALL_SERVICES = 0x0800,
 };
 
-enum class FindFlag {
-  nextEngagement,
-  nextDisEngagement,
-  nextUserFlag,
-  nextInfo,
-  nextWarning,
-  nextCritical
-};
-
-enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserFlag };
 typedef bool (*replayEventFilter)(const Event *, void *);
 Q_DECLARE_METATYPE(std::shared_ptr<LogReader>);
 
@@ -82,12 +74,12 @@ public:
   inline double maxSeconds() const { return max_seconds_; }
   inline void setSpeed(float speed) { speed_ = speed; }
   inline float getSpeed() const { return speed_; }
-  inline const std::vector<Event> *events() const { return &events_; }
+  inline uint64_t lastEventMonoTime() const { return event_cursor_.lastMonoTime(); }
   inline const std::map<int, std::unique_ptr<Segment>> &segments() const { return segments_; }
   inline const std::string &carFingerprint() const { return car_fingerprint_; }
   inline const std::vector<std::tuple<double, double, TimelineType>> getTimeline() {
     std::lock_guard lk(timeline_lock);
-    return timeline_;
+    return timeline_.entries();
   }
 
 signals:
@@ -111,11 +103,11 @@ protected:
   void loadSegmentInRange(SegmentMap::iterator begin, SegmentMap::iterator cur, SegmentMap::iterator end);
   void mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end);
   void updateEvents(const std::function<bool()>& update_events_function);
-  std::vector<Event>::const_iterator publishEvents(std::vector<Event>::const_iterator first,
-                                                   std::vector<Event>::const_iterator last);
+  void publishEvents();
   void publishMessage(const Event *e);
   void publishFrame(const Event *e);
   void buildTimeline();
+  bool loadTimelineSegment(const std::string &qlog, TimelineSegment &seg, std::shared_ptr<LogReader> &log);
   void checkSeekProgress();
   inline bool isSegmentMerged(int n) const { return merged_segments_.count(n) > 0; }
 
@@ -135,7 +127,7 @@ protected:
   uint64_t route_start_ts_ = 0;
   std::atomic<uint64_t> cur_mono_time_ = 0;
   std::atomic<double> max_seconds_ = 0;
-  std::vector<Event> events_;
+  EventCursor event_cursor_;
   std::set<int> merged_segments_;
 
   // messaging
@@ -149,7 +141,7 @@ protected:
 
   std::mutex timeline_lock;
   QFuture<void> timeline_future;
-  std::vector<std::tuple<double, double, TimelineType>> timeline_;
+  Timeline timeline_;
   std::string car_fingerprint_;
   std::atomic<float> speed_ = 1.0;
   replayEventFilter event_filter = nullptr;
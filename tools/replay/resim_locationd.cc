@@ -0,0 +1,242 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cereal/services.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/locationd/locationd.h"
+#include "tools/replay/logreader.h"
+#include "tools/replay/route.h"
+
+// Runs locationd over logged routes, as fast as the CPU allows, and writes the liveLocationKalman it would have sent.
+// Each route gets its own Localizer and the routes are spread over a pool of threads.
+
+// what locationd_thread gets from its SubMaster, replayed in log order. like there, the GPS doesn't need
+// to be alive and a service is valid until a message says otherwise.
+class ResimInputs {
+public:
+  ResimInputs(const char *gps_service) {
+    auto event_struct = capnp::Schema::from<cereal::Event>().asStruct();
+    for (const char *name : {gps_service, "cameraOdometry", "liveCalibration", "carState", "accelerometer", "gyroscope"}) {
+      services.push_back({.name = name,
+                          .which = event_struct.getFieldByName(name).getProto().getDiscriminantValue(),
+                          .freq = ::services.at(name).frequency,
+                          .ignore_alive = name == gps_service});
+    }
+  }
+
+  // whether the event is from a subscribed service
+  bool update(const cereal::Event::Reader &event) {
+    for (Service &s : services) {
+      if (event.which() == s.which) {
+        s.last_time = event.getLogMonoTime();
+        s.valid = event.getValid();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // a service is alive when it was received within ten of its periods of log time, as SubMaster does it
+  bool all_alive_and_valid(uint64_t now, std::initializer_list<const char *> names = {}) const {
+    return std::all_of(services.begin(), services.end(), [&](const Service &s) {
+      bool selected = names.size() == 0 || std::any_of(names.begin(), names.end(), [&](const char *name) { return s.name == name; });
+      bool alive = s.freq <= 1e-5 || (s.last_time != 0 && (now - s.last_time) * 1e-9 < 10.0 / s.freq);
+      return !selected || (s.valid && (alive || s.ignore_alive));
+    });
+  }
+
+  bool all_valid() const {
+    return std::all_of(services.begin(), services.end(), [](const Service &s) { return s.valid; });
+  }
+
+private:
+  struct Service {
+    std::string name;
+    uint16_t which;
+    int freq;
+    bool ignore_alive;
+    uint64_t last_time = 0;
+    bool valid = true;
+  };
+  std::vector<Service> services;
+};
+
+struct RouteResult {
+  int segments = 0;
+  size_t messages = 0;
+  size_t outputs = 0;
+  double log_seconds = 0;
+  double load_ms = 0;  // waiting for logs, the next one downloads while the current one runs
+  double run_ms = 0;
+  bool success = true;
+};
+
+std::unique_ptr<LogReader> load_segment(const std::string &rlog, std::atomic<bool> *abort) {
+  std::vector<bool> filters(capnp::Schema::from<cereal::Event>().asStruct().getUnionFields().size());
+  for (auto which : {cereal::Event::GPS_LOCATION, cereal::Event::GPS_LOCATION_EXTERNAL, cereal::Event::CAMERA_ODOMETRY,
+                     cereal::Event::LIVE_CALIBRATION, cereal::Event::CAR_STATE, cereal::Event::ACCELEROMETER, cereal::Event::GYROSCOPE}) {
+    filters[which] = true;
+  }
+  auto log = std::make_unique<LogReader>(filters);
+  if (!log->load(rlog, abort, true, 0, 3)) {
+    return nullptr;
+  }
+  return log;
+}
+
+// runs one Localizer over the segments of a route in order, and writes OUTPUT_DIR/DONGLE_ID_TIMESTAMP--N/rlog for each of them
+RouteResult resim_route(const Route &route, const std::string &output_dir, LocalizerImuMode imu_mode, std::atomic<bool> *abort) {
+  RouteResult result;
+  // routes from different devices can share a timestamp, so the dongle id goes into the name when there is one
+  const auto &id = route.identifier();
+  const std::string route_name = (id.dongle_id.isEmpty() ? id.timestamp : id.dongle_id + "_" + id.timestamp).toStdString();
+  std::vector<std::pair<int, std::string>> rlogs;
+  for (auto &[n, files] : route.segments()) {
+    if (!files.rlog.isEmpty()) rlogs.push_back({n, files.rlog.toStdString()});
+  }
+
+  std::unique_ptr<Localizer> localizer;
+  std::unique_ptr<ResimInputs> inputs;
+  bool filter_initialized = false;
+  uint64_t first_time = 0, last_time = 0;
+
+  std::future<std::unique_ptr<LogReader>> next;
+  if (!rlogs.empty()) next = std::async(std::launch::async, load_segment, rlogs[0].second, abort);
+  for (int i = 0; i < rlogs.size() && !*abort; ++i) {
+    double t = millis_since_boot();
+    std::unique_ptr<LogReader> log = next.get();
+    if (i + 1 < rlogs.size()) next = std::async(std::launch::async, load_segment, rlogs[i + 1].second, abort);
+    result.load_ms += millis_since_boot() - t;
+    if (!log) {
+      fprintf(stderr, "%s: failed to load segment %d\n", route.name().toStdString().c_str(), rlogs[i].first);
+      result.success = false;
+      continue;
+    }
+
+    t = millis_since_boot();
+    if (!localizer) {
+      // locationd reads UbloxAvailable, the log tells which one there was
+      bool ublox = std::any_of(log->events.begin(), log->events.end(), [](auto &e) { return e.which == cereal::Event::GPS_LOCATION_EXTERNAL; });
+      localizer = std::make_unique<Localizer>(ublox ? LocalizerGnssSource::UBLOX : LocalizerGnssSource::QCOM, imu_mode);
+      inputs = std::make_unique<ResimInputs>(ublox ? "gpsLocationExternal" : "gpsLocation");
+    }
+
+    std::string out;
+    for (const Event &e : log->events) {
+      capnp::FlatArrayMessageReader reader(e.data);
+      const cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+      if (!inputs->update(event)) continue;
+
+      ++result.messages;
+      if (first_time == 0) first_time = e.mono_time;
+      last_time = e.mono_time;
+
+      if (filter_initialized) {
+        localizer->observation_timings_invalid_reset();
+        if (event.getValid()) {
+          localizer->handle_msg(event);
+        }
+      } else {
+        filter_initialized = inputs->all_alive_and_valid(e.mono_time);
+      }
+
+      if (e.which == cereal::Event::CAMERA_ODOMETRY) {
+        MessageBuilder msg_builder;
+        bool sensors_ok = inputs->all_alive_and_valid(e.mono_time, {"accelerometer", "gyroscope"});
+        auto bytes = localizer->get_output_bytes(msg_builder, e.mono_time, inputs->all_valid(), sensors_ok, filter_initialized, e.mono_time);
+        out.append((const char *)bytes.begin(), bytes.size());
+        ++result.outputs;
+      }
+    }
+    result.run_ms += millis_since_boot() - t;
+
+    const std::string segment_dir = util::string_format("%s/%s--%d", output_dir.c_str(), route_name.c_str(), rlogs[i].first);
+    if (!util::create_directories(segment_dir, 0775) || util::write_file((segment_dir + "/rlog").c_str(), out.data(), out.size(), O_WRONLY | O_CREAT | O_TRUNC) != 0) {
+      fprintf(stderr, "failed to write %s/rlog\n", segment_dir.c_str());
+      result.success = false;
+    }
+    ++result.segments;
+  }
+  if (next.valid()) next.wait();
+  result.log_seconds = (last_time - first_time) / 1e9;
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Run locationd over routes as fast as possible and log its liveLocationKalman.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("routes", "the routes to run, each with its own localizer", "ROUTE...");
+  parser.addOption({{"j", "jobs"}, "run <n> routes at a time. default is the number of cores", "n"});
+  parser.addOption({{"o", "output"}, "write <dir>/DONGLE_ID_TIMESTAMP--N/rlog for each segment. default is resim_locationd", "dir"});
+  parser.addOption({{"m", "imu-mode"}, "how IMU samples are observed: each, batch or preintegrate", "mode"});
+  parser.addOption({"data_dir", "local directory with routes", "data_dir"});
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.empty()) {
+    parser.showHelp();
+  }
+  const int jobs = parser.isSet("jobs") ? parser.value("jobs").toInt() : std::thread::hardware_concurrency();
+  const std::string output_dir = parser.isSet("output") ? parser.value("output").toStdString() : "resim_locationd";
+  const LocalizerImuMode imu_mode = parse_imu_mode(parser.value("imu-mode").toStdString());
+
+  // the routes are listed on the main thread, which has the event loop for the API requests
+  std::vector<std::unique_ptr<Route>> routes;
+  for (const QString &name : args) {
+    auto route = std::make_unique<Route>(name, parser.value("data_dir"));
+    if (!route->load()) {
+      fprintf(stderr, "failed to load route %s\n", name.toStdString().c_str());
+      continue;
+    }
+    routes.push_back(std::move(route));
+  }
+
+  std::atomic<bool> abort = false;
+  std::atomic<int> next_route = 0;
+  std::vector<RouteResult> results(routes.size());
+  std::mutex print_lock;
+  const double start = millis_since_boot();
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < std::clamp<int>(jobs, 1, std::max<int>(routes.size(), 1)); ++i) {
+    workers.emplace_back([&]() {
+      for (int n = next_route++; n < routes.size(); n = next_route++) {
+        const RouteResult &r = results[n] = resim_route(*routes[n], output_dir, imu_mode, &abort);
+        std::lock_guard lk(print_lock);
+        printf("%s: %d segments, %zu messages, %zu outputs, %.1f s of log in %.1f ms (%.0fx realtime), %.1f ms waiting for logs%s\n",
+               routes[n]->name().toStdString().c_str(), r.segments, r.messages, r.outputs, r.log_seconds, r.run_ms,
+               r.log_seconds * 1e3 / std::max(r.run_ms, 1e-3), r.load_ms, r.success ? "" : ", FAILED");
+        fflush(stdout);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  const double elapsed_ms = millis_since_boot() - start;
+  double log_seconds = 0;
+  size_t outputs = 0;
+  int failed = args.size() - routes.size();
+  for (auto &r : results) {
+    log_seconds += r.log_seconds;
+    outputs += r.outputs;
+    failed += !r.success;
+  }
+  printf("%zu routes with %d jobs: %zu outputs, %.1f s of log in %.1f s (%.0fx realtime), %d failed\n", routes.size(), jobs,
+         outputs, log_seconds, elapsed_ms / 1e3, log_seconds * 1e3 / std::max(elapsed_ms, 1e-3), failed);
+  return failed ? 1 : 0;
+}
@@ -1,5 +1,14 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <thread>
+#include <vector>
 
 #include <QEventLoop>
 
@@ -23,6 +32,77 @@ bool download_to_file(const std::string &url, const std::string &local_file, int
   return false;
 }
 
+// a local stand-in for the log server. it answers HEAD and ranged GET requests for one file,
+// and sends it in small pieces so the client sees it arrive over time. the first fail_requests
+// GET requests are answered with a 503.
+class TestHttpServer {
+public:
+  TestHttpServer(const std::string &content, int fail_requests = 0) : content_(content), fail_requests_(fail_requests) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    REQUIRE(bind(fd_, (sockaddr *)&addr, len) == 0);
+    REQUIRE(listen(fd_, 16) == 0);
+    REQUIRE(getsockname(fd_, (sockaddr *)&addr, &len) == 0);
+    port_ = ntohs(addr.sin_port);
+
+    accept_thread_ = std::thread([this]() {
+      int c;
+      while ((c = accept(fd_, nullptr, nullptr)) >= 0) {
+        connections_.emplace_back(&TestHttpServer::serve, this, c);
+      }
+    });
+  }
+
+  ~TestHttpServer() {
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+    accept_thread_.join();
+    for (auto &t : connections_) t.join();
+  }
+
+  std::string url(const std::string &name) const { return "http://127.0.0.1:" + std::to_string(port_) + "/" + name; }
+
+private:
+  void serve(int c) {
+    std::string request;
+    char buf[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t n = recv(c, buf, sizeof(buf), 0);
+      if (n <= 0) break;
+      request.append(buf, n);
+    }
+
+    size_t begin = 0, end = content_.size() - 1;
+    const char *range = strstr(request.c_str(), "Range: bytes=");
+    if (range) sscanf(range, "Range: bytes=%zu-%zu", &begin, &end);
+    if (!util::starts_with(request, "HEAD") && fail_requests_-- > 0) {
+      const std::string error = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 4\r\nConnection: close\r\n\r\nbusy";
+      send(c, error.data(), error.size(), MSG_NOSIGNAL);
+      close(c);
+      return;
+    }
+    std::string header = util::string_format("HTTP/1.1 %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                             range ? "206 Partial Content" : "200 OK", end - begin + 1);
+    send(c, header.data(), header.size(), MSG_NOSIGNAL);
+    if (!util::starts_with(request, "HEAD")) {
+      for (size_t pos = begin; pos <= end; pos += 64 * 1024) {
+        if (send(c, content_.data() + pos, std::min<size_t>(64 * 1024, end + 1 - pos), MSG_NOSIGNAL) < 0) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+    }
+    close(c);
+  }
+
+  const std::string content_;
+  std::atomic<int> fail_requests_;
+  int fd_, port_;
+  std::thread accept_thread_;
+  std::vector<std::thread> connections_;
+};
+
 TEST_CASE("httpMultiPartDownload") {
   char filename[] = "/tmp/XXXXXX";
   close(mkstemp(filename));
@@ -47,7 +127,7 @@ TEST_CASE("httpMultiPartDownload") {
 TEST_CASE("FileReader") {
   auto enable_local_cache = GENERATE(true, false);
   std::string cache_file = cacheFilePath(TEST_RLOG_URL);
-  system(("rm " + cache_file + " -f").c_str());
+  system(("rm " + cache_file + " " + cache_file + ".decompressed -f").c_str());
 
   FileReader reader(enable_local_cache);
   std::string content = reader.read(TEST_RLOG_URL);
@@ -57,6 +137,47 @@ TEST_CASE("FileReader") {
   } else {
     REQUIRE(util::file_exists(cache_file) == false);
   }
+
+  // the decompressed copy replaces the downloaded one
+  REQUIRE(reader.read(TEST_RLOG_URL, nullptr, true) == decompressBZ2(content));
+  REQUIRE(util::file_exists(cache_file + ".decompressed") == enable_local_cache);
+  REQUIRE(util::file_exists(cache_file) == false);
+}
+
+TEST_CASE("cache eviction") {
+  char dir[] = "/tmp/cache_XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  const std::string data(400 * 1024, 'x');
+  auto file = [&](const std::string &name) { return std::string(dir) + "/" + name; };
+  // the writes only ever evict from the test directory, never from COMMA_CACHE
+  setCacheBudget(dir, 3 * data.size());
+
+  for (auto name : {"a", "b", "c"}) {
+    REQUIRE(cacheWrite(file(name), data));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // no temporary files are left behind
+  REQUIRE(util::read_files_in_dir(dir).size() == 3);
+
+  // a is the most recently used after reading it, b goes first
+  REQUIRE(cacheRead(file("a")) == data);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(cacheWrite(file("d"), data));
+  REQUIRE(util::file_exists(file("a")));
+  REQUIRE(!util::file_exists(file("b")));
+  REQUIRE(util::file_exists(file("c")));
+  REQUIRE(util::file_exists(file("d")));
+
+  // rewriting a file only counts the difference
+  REQUIRE(cacheWrite(file("a"), data));
+  REQUIRE(util::read_files_in_dir(dir).size() == 3);
+
+  // c is the least recently used
+  REQUIRE(cacheEvict(dir, 2 * data.size()) == 2 * data.size());
+  REQUIRE(!util::file_exists(file("c")));
+
+  setCacheBudget("", 0);
+  system(("rm " + std::string(dir) + " -rf").c_str());
 }
 
 TEST_CASE("LogReader") {
@@ -71,6 +192,96 @@ TEST_CASE("LogReader") {
   }
 }
 
+TEST_CASE("streaming download") {
+  const std::string content = FileReader(true).read(TEST_RLOG_URL);
+  REQUIRE(sha256(content) == TEST_RLOG_CHECKSUM);
+
+  SECTION("httpGet sees the ranges arrive in order") {
+    // over 10 MB, so it is downloaded in parts
+    const std::string big_content = content + content;
+    TestHttpServer server(big_content);
+    std::vector<size_t> sizes;
+    std::string result = httpGet(server.url("big"), 5 * 1024 * 1024, nullptr, [&](const char *data, size_t size) {
+      REQUIRE(memcmp(data, big_content.data(), size) == 0);
+      sizes.push_back(size);
+    });
+    REQUIRE(result == big_content);
+    REQUIRE(sizes.size() > 1);
+    REQUIRE(std::is_sorted(sizes.begin(), sizes.end()));
+    REQUIRE(sizes.back() == big_content.size());
+  }
+
+  SECTION("LogReader parses while it downloads") {
+    TestHttpServer server(content);
+    const std::string url = server.url("rlog.bz2");
+    const std::string decompressed = decompressBZ2(content);
+
+    std::vector<size_t> sizes;
+    std::string result = FileReader(false).read(url, nullptr, true, [&](const char *data, size_t size) {
+      REQUIRE(memcmp(data, decompressed.data(), size) == 0);
+      sizes.push_back(size);
+    });
+    REQUIRE(result == decompressed);
+    REQUIRE(sizes.size() > 1);
+
+    LogReader expected, log;
+    REQUIRE(expected.load(decompressed.data(), decompressed.size()));
+    // the parsed events are handed out while the log downloads, each of them once
+    std::vector<size_t> event_counts;
+    std::vector<Event> streamed;
+    REQUIRE(log.load(url, nullptr, true, -1, 0, [&](const std::vector<Event> &events, size_t first) {
+      REQUIRE(first == streamed.size());
+      streamed.insert(streamed.end(), events.begin() + first, events.end());
+      event_counts.push_back(events.size());
+    }));
+    REQUIRE(event_counts.size() > 1);
+    REQUIRE(event_counts.front() < expected.events.size());
+    std::sort(streamed.begin(), streamed.end());
+    REQUIRE(streamed.size() == expected.events.size());
+    REQUIRE(log.events.size() == expected.events.size());
+    for (size_t i = 0; i < log.events.size(); ++i) {
+      const Event &a = log.events[i], &b = expected.events[i];
+      REQUIRE((a.which == b.which && a.mono_time == b.mono_time && a.data.asBytes() == b.data.asBytes()));
+      REQUIRE((streamed[i].which == b.which && streamed[i].mono_time == b.mono_time));
+    }
+    REQUIRE(util::file_exists(cacheFilePath(url) + ".decompressed"));
+    std::remove((cacheFilePath(url) + ".decompressed").c_str());
+  }
+
+  SECTION("a failed download starts over") {
+    // one of the ranges fails while the others are streamed, the retry starts from scratch
+    TestHttpServer server(content, 1);
+    const std::string url = server.url("rlog.bz2");
+    const std::string decompressed = decompressBZ2(content);
+
+    int restarts = 0;
+    size_t last_size = 0;
+    std::string result = FileReader(false, 1024 * 1024, 3).read(url, nullptr, true, [&](const char *data, size_t size) {
+      if (size == 0) {
+        ++restarts;
+      } else {
+        REQUIRE(memcmp(data, decompressed.data(), size) == 0);
+      }
+      last_size = size;
+    });
+    REQUIRE(restarts == 1);
+    REQUIRE(result == decompressed);
+    REQUIRE(last_size == decompressed.size());
+
+    TestHttpServer log_server(content, 1);
+    LogReader expected, log;
+    REQUIRE(expected.load(decompressed.data(), decompressed.size()));
+    REQUIRE(log.load(log_server.url("rlog.bz2"), nullptr, true));
+    REQUIRE(log.events.size() == expected.events.size());
+    for (size_t i = 0; i < log.events.size(); ++i) {
+      const Event &a = log.events[i], &b = expected.events[i];
+      REQUIRE((a.which == b.which && a.mono_time == b.mono_time && a.data.asBytes() == b.data.asBytes()));
+    }
+    std::remove((cacheFilePath(url) + ".decompressed").c_str());
+    std::remove((cacheFilePath(log_server.url("rlog.bz2")) + ".decompressed").c_str());
+  }
+}
+
 void read_segment(int n, const SegmentFile &segment_file, uint32_t flags) {
   QEventLoop loop;
   Segment segment(n, segment_file, flags);
@@ -157,6 +368,103 @@ TEST_CASE("Remote route") {
   }
 }
 
+TEST_CASE("Timeline") {
+  using AlertStatus = cereal::ControlsState::AlertStatus;
+  using AlertSize = cereal::ControlsState::AlertSize;
+  const uint64_t sec = 1e9;
+
+  // engaged from 10s to 70s across the segment boundary, a warning from 20s to 30s and an open alert at the end
+  TimelineSegment seg0, seg1;
+  seg0.states = {{0, false, AlertStatus::NORMAL, AlertSize::NONE, ""},
+                 {10 * sec, true, AlertStatus::NORMAL, AlertSize::NONE, ""},
+                 {20 * sec, true, AlertStatus::USER_PROMPT, AlertSize::MID, "steerSaturated"},
+                 {30 * sec, true, AlertStatus::NORMAL, AlertSize::NONE, ""}};
+  seg0.user_flags = {15 * sec};
+  seg0.last_mono_time = 59 * sec;
+  seg1.states = {{60 * sec, true, AlertStatus::NORMAL, AlertSize::NONE, ""},
+                 {70 * sec, false, AlertStatus::CRITICAL, AlertSize::FULL, "fcw"}};
+  seg1.user_flags = {80 * sec, 90 * sec};
+  seg1.last_mono_time = 119 * sec;
+
+  SECTION("save and load") {
+    std::string file = "/tmp/test_timeline_" + std::to_string(util::random_int(0, 1000000));
+    REQUIRE(seg0.save(file));
+    TimelineSegment loaded;
+    REQUIRE(loaded.load(file));
+    REQUIRE(loaded.states.size() == seg0.states.size());
+    REQUIRE(loaded.states[2].alert_type == "steerSaturated");
+    REQUIRE(loaded.states[2].alert_status == AlertStatus::USER_PROMPT);
+    REQUIRE(loaded.user_flags == seg0.user_flags);
+    REQUIRE(loaded.last_mono_time == seg0.last_mono_time);
+    std::remove(file.c_str());
+    REQUIRE_FALSE(loaded.load(file));
+  }
+
+  SECTION("merge and find") {
+    Timeline timeline(0);
+    timeline.merge(seg0, false);
+    timeline.merge(seg1, true);
+
+    auto entries = timeline.entries();
+    REQUIRE(std::is_sorted(entries.begin(), entries.end(), [](auto &l, auto &r) { return std::get<2>(l) < std::get<2>(r); }));
+    REQUIRE(std::count_if(entries.begin(), entries.end(), [](auto &e) { return std::get<2>(e) == TimelineType::UserFlag; }) == 3);
+
+    REQUIRE(timeline.find(0, FindFlag::nextEngagement) == 10);
+    REQUIRE(timeline.find(10, FindFlag::nextEngagement) == std::nullopt);
+    REQUIRE(timeline.find(10, FindFlag::nextDisEngagement) == 70);
+    REQUIRE(timeline.find(0, FindFlag::nextWarning) == 20);
+    REQUIRE(timeline.find(20, FindFlag::nextWarning) == std::nullopt);
+    REQUIRE(timeline.find(60, FindFlag::nextCritical) == 70);
+    REQUIRE(timeline.find(15, FindFlag::nextUserFlag) == 80);
+    REQUIRE(timeline.find(80, FindFlag::nextUserFlag) == 90);
+  }
+}
+
+TEST_CASE("EventCursor") {
+  // three segments of events that overlap a little at the segment boundaries
+  std::vector<std::vector<Event>> segments(3);
+  for (int n = 0; n < segments.size(); ++n) {
+    for (int i = 0; i < 1000; ++i) {
+      segments[n].emplace_back((cereal::Event::Which)n, n * 1000 + i + i / 30, kj::ArrayPtr<const capnp::word>{});
+    }
+  }
+  auto merge = [&](std::vector<int> seg_nums) {
+    std::vector<EventRun> runs;
+    std::vector<Event> events;
+    for (int n : seg_nums) {
+      runs.push_back({n, &segments[n]});
+      events.insert(events.end(), segments[n].begin(), segments[n].end());
+    }
+    std::sort(events.begin(), events.end());
+    return std::make_pair(runs, events);
+  };
+  auto require_same = [](EventCursor &cursor, std::vector<Event>::const_iterator it, std::vector<Event>::const_iterator end) {
+    for (; cursor.get(); cursor.next(), ++it) {
+      REQUIRE(it != end);
+      REQUIRE(!(*cursor.get() < *it));
+      REQUIRE(!(*it < *cursor.get()));
+    }
+    REQUIRE(it == end);
+  };
+
+  EventCursor cursor;
+  auto [runs, events] = merge({0, 1});
+  cursor.setRuns(runs);
+  REQUIRE(cursor.lastMonoTime() == events.back().mono_time);
+  for (int i = 0; i < 1500; ++i) cursor.next();
+
+  // evict segment 0 and add segment 2, the cursor stays at the same event.
+  Event cur = *cursor.get();
+  std::tie(runs, events) = merge({1, 2});
+  cursor.setRuns(runs);
+  REQUIRE(cursor.get()->mono_time == cur.mono_time);
+  require_same(cursor, std::lower_bound(events.cbegin(), events.cend(), cur), events.cend());
+
+  Event key(cereal::Event::Which::INIT_DATA, 1500, {});
+  cursor.seek(key);
+  require_same(cursor, std::upper_bound(events.cbegin(), events.cend(), key), events.cend());
+}
+
 TEST_CASE("seek_to") {
   QEventLoop loop;
   int seek_to = util::random_int(0, 2 * 59);
@@ -0,0 +1,197 @@
+#include "tools/replay/timeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/util.h"
+#include "tools/replay/filereader.h"
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x31544c52;  // "RLT1"
+
+class BufferReader {
+public:
+  BufferReader(const std::string &buf) : buf_(buf) {}
+  template <typename T>
+  bool read(T &v) {
+    if (pos_ + sizeof(T) > buf_.size()) return false;
+    memcpy(&v, buf_.data() + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+  bool read(std::string &s, size_t len) {
+    if (pos_ + len > buf_.size()) return false;
+    s.assign(buf_.data() + pos_, len);
+    pos_ += len;
+    return true;
+  }
+  bool atEnd() const { return pos_ == buf_.size(); }
+
+private:
+  const std::string &buf_;
+  size_t pos_ = 0;
+};
+
+template <typename T>
+void append(std::string &buf, const T &v) {
+  buf.append((const char *)&v, sizeof(T));
+}
+
+}  // namespace
+
+// TimelineSegment
+
+TimelineSegment::TimelineSegment(const LogReader &log) {
+  for (const Event &e : log.events) {
+    if (e.which == cereal::Event::Which::CONTROLS_STATE) {
+      capnp::FlatArrayMessageReader reader(e.data);
+      auto cs = reader.getRoot<cereal::Event>().getControlsState();
+      // only keep the states where enabled or the alert changes, plus the first one of the segment,
+      // which is compared against the state carried over from the previous segment.
+      const char *alert_type = cs.getAlertType().cStr();
+      if (states.empty() || states.back().enabled != cs.getEnabled() ||
+          states.back().alert_status != cs.getAlertStatus() || states.back().alert_type != alert_type) {
+        states.push_back({e.mono_time, cs.getEnabled(), cs.getAlertStatus(), cs.getAlertSize(), alert_type});
+      }
+    } else if (e.which == cereal::Event::Which::USER_FLAG) {
+      user_flags.push_back(e.mono_time);
+    }
+  }
+  if (!log.events.empty()) {
+    last_mono_time = log.events.back().mono_time;
+  }
+}
+
+bool TimelineSegment::load(const std::string &file) {
+  std::string buf = cacheRead(file);
+  BufferReader reader(buf);
+  uint32_t magic = 0, num_states = 0, num_flags = 0;
+  if (!reader.read(magic) || magic != CACHE_MAGIC || !reader.read(last_mono_time) || !reader.read(num_states)) {
+    return false;
+  }
+
+  states.resize(num_states);
+  for (auto &s : states) {
+    uint8_t enabled;
+    uint16_t status, size, type_len;
+    if (!reader.read(s.mono_time) || !reader.read(enabled) || !reader.read(status) || !reader.read(size) ||
+        !reader.read(type_len) || !reader.read(s.alert_type, type_len)) {
+      return false;
+    }
+    s.enabled = enabled;
+    s.alert_status = (cereal::ControlsState::AlertStatus)status;
+    s.alert_size = (cereal::ControlsState::AlertSize)size;
+  }
+
+  if (!reader.read(num_flags)) return false;
+  user_flags.resize(num_flags);
+  for (auto &flag : user_flags) {
+    if (!reader.read(flag)) return false;
+  }
+  return reader.atEnd();
+}
+
+bool TimelineSegment::save(const std::string &file) const {
+  std::string buf;
+  append(buf, CACHE_MAGIC);
+  append(buf, last_mono_time);
+  append(buf, (uint32_t)states.size());
+  for (const auto &s : states) {
+    append(buf, s.mono_time);
+    append(buf, (uint8_t)s.enabled);
+    append(buf, (uint16_t)s.alert_status);
+    append(buf, (uint16_t)s.alert_size);
+    append(buf, (uint16_t)s.alert_type.size());
+    buf += s.alert_type;
+  }
+  append(buf, (uint32_t)user_flags.size());
+  for (auto flag : user_flags) {
+    append(buf, flag);
+  }
+
+  return cacheWrite(file, buf);
+}
+
+// Timeline
+
+void Timeline::add(uint64_t begin, uint64_t end, TimelineType type) {
+  entries_[(int)type].push_back({toSeconds(begin), toSeconds(end), type});
+}
+
+void Timeline::merge(const TimelineSegment &seg, bool last_segment) {
+  const TimelineType timeline_types[] = {
+    [(int)cereal::ControlsState::AlertStatus::NORMAL] = TimelineType::AlertInfo,
+    [(int)cereal::ControlsState::AlertStatus::USER_PROMPT] = TimelineType::AlertWarning,
+    [(int)cereal::ControlsState::AlertStatus::CRITICAL] = TimelineType::AlertCritical,
+  };
+
+  for (const auto &s : seg.states) {
+    if (engaged_ != s.enabled) {
+      if (engaged_) {
+        add(engaged_begin_, s.mono_time, TimelineType::Engaged);
+      }
+      engaged_begin_ = s.mono_time;
+      engaged_ = s.enabled;
+    }
+
+    if (alert_type_ != s.alert_type || alert_status_ != s.alert_status) {
+      if (!alert_type_.empty() && alert_size_ != cereal::ControlsState::AlertSize::NONE) {
+        add(alert_begin_, s.mono_time, timeline_types[(int)alert_status_]);
+      }
+      alert_begin_ = s.mono_time;
+      alert_type_ = s.alert_type;
+      alert_size_ = s.alert_size;
+      alert_status_ = s.alert_status;
+    }
+  }
+  for (auto mono_time : seg.user_flags) {
+    add(mono_time, mono_time, TimelineType::UserFlag);
+  }
+
+  if (last_segment) {
+    if (engaged_) {
+      add(engaged_begin_, seg.last_mono_time, TimelineType::Engaged);
+    }
+    if (!alert_type_.empty() && alert_size_ != cereal::ControlsState::AlertSize::NONE) {
+      add(alert_begin_, seg.last_mono_time, timeline_types[(int)alert_status_]);
+    }
+  }
+}
+
+std::optional<double> Timeline::find(double cur_ts, FindFlag flag) const {
+  TimelineType type = TimelineType::None;
+  switch (flag) {
+    case FindFlag::nextEngagement:
+    case FindFlag::nextDisEngagement: type = TimelineType::Engaged; break;
+    case FindFlag::nextUserFlag: type = TimelineType::UserFlag; break;
+    case FindFlag::nextInfo: type = TimelineType::AlertInfo; break;
+    case FindFlag::nextWarning: type = TimelineType::AlertWarning; break;
+    case FindFlag::nextCritical: type = TimelineType::AlertCritical; break;
+  }
+
+  // entries of one type don't overlap, so both begin and end times are sorted.
+  const auto &entries = entries_[(int)type];
+  if (flag == FindFlag::nextDisEngagement) {
+    auto it = std::upper_bound(entries.begin(), entries.end(), cur_ts,
+                               [](double ts, const Entry &e) { return ts < std::get<1>(e); });
+    if (it != entries.end()) return std::get<1>(*it);
+  } else {
+    auto it = std::upper_bound(entries.begin(), entries.end(), cur_ts,
+                               [](double ts, const Entry &e) { return ts < std::get<0>(e); });
+    if (it != entries.end()) return std::get<0>(*it);
+  }
+  return std::nullopt;
+}
+
+std::vector<Timeline::Entry> Timeline::entries() const {
+  size_t size = 0;
+  for (const auto &entries : entries_) size += entries.size();
+
+  std::vector<Entry> result;
+  result.reserve(size);
+  for (const auto &entries : entries_) {
+    result.insert(result.end(), entries.begin(), entries.end());
+  }
+  return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "tools/replay/logreader.h"
+
+enum class FindFlag {
+  nextEngagement,
+  nextDisEngagement,
+  nextUserFlag,
+  nextInfo,
+  nextWarning,
+  nextCritical
+};
+
+enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserFlag };
+
+// The controlsState changes and user flags of one segment. This is everything needed to build
+// the timeline, so it can be extracted from each qlog in parallel and cached on disk.
+struct TimelineSegment {
+  TimelineSegment() = default;
+  TimelineSegment(const LogReader &log);
+  bool load(const std::string &file);
+  bool save(const std::string &file) const;
+
+  struct State {
+    uint64_t mono_time;
+    bool enabled;
+    cereal::ControlsState::AlertStatus alert_status;
+    cereal::ControlsState::AlertSize alert_size;
+    std::string alert_type;
+  };
+  std::vector<State> states;
+  std::vector<uint64_t> user_flags;
+  uint64_t last_mono_time = 0;
+};
+
+// Timeline entries indexed by type.
+// Entries of the same type never overlap and are appended in time order, so each type
+// is a sorted array and find() is a binary search.
+class Timeline {
+public:
+  typedef std::tuple<double, double, TimelineType> Entry;
+
+  Timeline(uint64_t route_start_ts = 0) : route_start_ts_(route_start_ts) {}
+  // segments must be merged in route order. the open entries are closed at the end of the last segment.
+  void merge(const TimelineSegment &seg, bool last_segment);
+  std::optional<double> find(double cur_ts, FindFlag flag) const;
+  std::vector<Entry> entries() const;
+
+private:
+  inline double toSeconds(uint64_t mono_time) const { return (mono_time - route_start_ts_) / 1e9; }
+  void add(uint64_t begin, uint64_t end, TimelineType type);
+
+  uint64_t route_start_ts_;
+  std::array<std::vector<Entry>, (int)TimelineType::UserFlag + 1> entries_;
+
+  // state carried across segments
+  bool engaged_ = false;
+  uint64_t engaged_begin_ = 0;
+  cereal::ControlsState::AlertStatus alert_status_ = cereal::ControlsState::AlertStatus::NORMAL;
+  cereal::ControlsState::AlertSize alert_size_ = cereal::ControlsState::AlertSize::NONE;
+  uint64_t alert_begin_ = 0;
+  std::string alert_type_;
+};
@@ -15,6 +15,7 @@
 #include <mutex>
 #include <numeric>
 #include <utility>
+#include <vector>
 
 #include "common/timing.h"
 #include "common/util.h"
@@ -65,11 +66,17 @@ struct MultiPartWriter {
   size_t *total_written;
   size_t offset;
   size_t end;
+  CURL *curl = nullptr;
 
   size_t write(char *data, size_t size, size_t count) {
     size_t bytes = size * count;
     if ((offset + bytes) > end) return 0;
 
+    // the body of an error response never reaches buf, where the streaming reader would see it
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (status != 206) return 0;
+
     if constexpr (std::is_same<T, std::string>::value) {
       memcpy(buf->data() + offset, data, bytes);
     } else if constexpr (std::is_same<T, std::ofstream>::value) {
@@ -179,7 +186,8 @@ std::string getUrlWithoutQuery(const std::string &url) {
 }
 
 template <class T>
-bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t content_length, std::atomic<bool> *abort) {
+bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t content_length, std::atomic<bool> *abort,
+                  const DownloadDataHandler &on_data = nullptr) {
   download_stats.add(url, content_length);
 
   int parts = 1;
@@ -191,6 +199,7 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
   CURLM *cm = curl_multi_init();
   size_t written = 0;
   std::map<CURL *, MultiPartWriter<T>> writers;
+  std::vector<const MultiPartWriter<T> *> ordered_writers;
   const int part_size = content_length / parts;
   for (int i = 0; i < parts; ++i) {
     CURL *eh = curl_easy_init();
@@ -199,7 +208,9 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
         .total_written = &written,
         .offset = (size_t)(i * part_size),
         .end = i == parts - 1 ? content_length : (i + 1) * part_size,
+        .curl = eh,
     };
+    ordered_writers.push_back(&writers[eh]);
     curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, write_cb<T>);
     curl_easy_setopt(eh, CURLOPT_WRITEDATA, (void *)(&writers[eh]));
     curl_easy_setopt(eh, CURLOPT_URL, url.c_str());
@@ -212,12 +223,28 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
   }
 
   int still_running = 1;
-  size_t prev_written = 0;
+  size_t prev_written = 0, prev_ready = 0;
   while (still_running > 0 && !(abort && *abort)) {
     CURLMcode mc = curl_multi_perform(cm, &still_running);
     if (mc != CURLM_OK) {
       break;
     }
+
+    if constexpr (std::is_same<T, std::string>::value) {
+      if (on_data) {
+        // the parts are contiguous, the prefix ends in the first one that is still downloading
+        size_t ready = 0;
+        for (auto w : ordered_writers) {
+          ready = w->offset;
+          if (w->offset < w->end) break;
+        }
+        if (ready > prev_ready) {
+          on_data(buf.data(), ready);
+          prev_ready = ready;
+        }
+      }
+    }
+
     if (still_running > 0) {
       curl_multi_wait(cm, nullptr, 0, 1000, nullptr);
     }
@@ -260,12 +287,12 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
   return success;
 }
 
-std::string httpGet(const std::string &url, size_t chunk_size, std::atomic<bool> *abort) {
+std::string httpGet(const std::string &url, size_t chunk_size, std::atomic<bool> *abort, const DownloadDataHandler &on_data) {
   size_t size = getRemoteFileSize(url, abort);
   if (size == 0) return {};
 
   std::string result(size, '\0');
-  return httpDownload(url, result, chunk_size, size, abort) ? result : "";
+  return httpDownload(url, result, chunk_size, size, abort, on_data) ? result : "";
 }
 
 bool httpDownload(const std::string &url, const std::string &file, size_t chunk_size, std::atomic<bool> *abort) {
@@ -277,6 +304,42 @@ bool httpDownload(const std::string &url, const std::string &file, size_t chunk_
   return httpDownload(url, of, chunk_size, size, abort);
 }
 
+BZ2Decompressor::BZ2Decompressor() {
+  int bzerror = BZ2_bzDecompressInit(&strm_, 0, 0);
+  assert(bzerror == BZ_OK);
+}
+
+BZ2Decompressor::~BZ2Decompressor() {
+  BZ2_bzDecompressEnd(&strm_);
+}
+
+bool BZ2Decompressor::decompress(const char *in, size_t size, std::string &out, std::atomic<bool> *abort) {
+  strm_.next_in = (char *)in;
+  strm_.avail_in = size;
+  while (!finished_ && !(abort && *abort)) {
+    // decompress into the spare capacity of out
+    const size_t pos = out.size();
+    if (out.capacity() - pos < 1024 * 1024) {
+      out.reserve(std::max(out.capacity() * 2, pos + 4 * 1024 * 1024));
+    }
+    out.resize(out.capacity());
+    strm_.next_out = &out[pos];
+    strm_.avail_out = out.size() - pos;
+
+    int bzerror = BZ2_bzDecompress(&strm_);
+    out.resize(out.size() - strm_.avail_out);
+    if (bzerror == BZ_STREAM_END) {
+      finished_ = true;
+    } else if (bzerror != BZ_OK) {
+      rWarning("decompressBZ2 error : content is corrupt");
+      return false;
+    } else if (strm_.avail_in == 0 && strm_.avail_out > 0) {
+      break;  // needs more input
+    }
+  }
+  return true;
+}
+
 std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort) {
   return decompressBZ2((std::byte *)in.data(), in.size(), abort);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <bzlib.h>
+
 #include <atomic>
 #include <deque>
 #include <functional>
@@ -40,9 +42,28 @@ std::string sha256(const std::string &str);
 void precise_nano_sleep(int64_t nanoseconds, std::atomic<bool> &should_exit);
 std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort = nullptr);
 std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
+
+// decompresses a bz2 stream piece by piece as it arrives
+class BZ2Decompressor {
+public:
+  BZ2Decompressor();
+  ~BZ2Decompressor();
+  // appends what the next piece of input decompresses to, false if the content is corrupt
+  bool decompress(const char *in, size_t size, std::string &out, std::atomic<bool> *abort = nullptr);
+  bool finished() const { return finished_; }
+
+private:
+  bz_stream strm_ = {};
+  bool finished_ = false;
+};
+
 std::string getUrlWithoutQuery(const std::string &url);
 size_t getRemoteFileSize(const std::string &url, std::atomic<bool> *abort = nullptr);
-std::string httpGet(const std::string &url, size_t chunk_size = 0, std::atomic<bool> *abort = nullptr);
+// called with the downloaded prefix of the file whenever it grows, data may move between calls.
+// only bytes of responses that passed the status check are in it. size 0 means a retry starts over.
+typedef std::function<void(const char *data, size_t size)> DownloadDataHandler;
+std::string httpGet(const std::string &url, size_t chunk_size = 0, std::atomic<bool> *abort = nullptr,
+                    const DownloadDataHandler &on_data = nullptr);
 
 typedef std::function<void(uint64_t cur, uint64_t total, bool success)> DownloadProgressHandler;
 void installDownloadProgressHandler(DownloadProgressHandler);